@@ -0,0 +1,372 @@
+/**
+ * @file bench_main.cpp
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief Host benchmarks of the per-frame and per-request streaming paths
+ *
+ * Runs the firmware sources unchanged against the shims in bench/shims:
+ * JPEG parsing, RTP/JPEG fragmentation (UDP and TCP interleaved sizes),
+ * RTSP request parsing, SDP generation and timecode stamping. Each line
+ * reports the time, heap allocations and wire bytes per operation, so a
+ * change to one of these paths can be measured before it is flashed.
+ *
+ * Usage: bench [corpus_dir] [min_ms]
+ *   corpus_dir  Directory of .jpg frames from the camera (default bench/corpus),
+ *               e.g. saved with "curl -o 001.jpg http://<ip>/snapshot".
+ *               Without frames a SyntheticJpeg set (QVGA to HD) is used.
+ *   min_ms      Minimum run time of each benchmark (default 500)
+ */
+// bench_main.cpp
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include <dirent.h>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <string>
+#include <vector>
+#include "../lib/CameraManager/CameraManager.h"
+#include "../lib/CameraManager/SyntheticJpeg.h"
+#include "../lib/Nano-RTSP/RtcpCodec.h"
+#include "../lib/Nano-RTSP/RtpJpegPacketizer.h"
+#include "../lib/Nano-RTSP/RTSPRequestParser.h"
+#include "../lib/Nano-RTSP/SdpBuilder.h"
+#include "../lib/Utils/TimecodeManager.h"
+
+// ============================================================================
+// ALLOCATION COUNTING
+// ============================================================================
+
+static std::atomic<uint64_t> allocCount(0);
+
+void *operator new(size_t size)
+{
+    allocCount.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = malloc(size ? size : 1))
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+// ============================================================================
+// CORPUS
+// ============================================================================
+
+struct CorpusFrame
+{
+    std::string name;
+    std::vector<uint8_t> data;
+    camera_fb_t fb;
+    SharedFrame shared;
+};
+
+static bool endsWith(const std::string &text, const char *suffix)
+{
+    size_t n = strlen(suffix);
+    return text.size() >= n && strcasecmp(text.c_str() + text.size() - n, suffix) == 0;
+}
+
+static void loadCorpus(const char *dir, std::vector<CorpusFrame *> &frames)
+{
+    if (DIR *d = opendir(dir))
+    {
+        while (struct dirent *entry = readdir(d))
+        {
+            std::string name = entry->d_name;
+            if (!endsWith(name, ".jpg") && !endsWith(name, ".jpeg"))
+            {
+                continue;
+            }
+            FILE *f = fopen((std::string(dir) + "/" + name).c_str(), "rb");
+            if (!f)
+            {
+                continue;
+            }
+            CorpusFrame *frame = new CorpusFrame();
+            frame->name = name;
+            uint8_t chunk[4096];
+            size_t n;
+            while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+            {
+                frame->data.insert(frame->data.end(), chunk, chunk + n);
+            }
+            fclose(f);
+            frames.push_back(frame);
+        }
+        closedir(d);
+    }
+
+    if (frames.empty())
+    {
+        // Typical OV2640 sizes at CAMERA_JPEG_QUALITY 10-15
+        static const struct
+        {
+            uint16_t width, height;
+            size_t size;
+        } profiles[] = {{320, 240, 9600}, {640, 480, 28800}, {800, 600, 42800}, {1280, 720, 78800}};
+        for (const auto &p : profiles)
+        {
+            CorpusFrame *frame = new CorpusFrame();
+            frame->name = "synthetic-" + std::to_string(p.width) + "x" + std::to_string(p.height);
+            frame->data.resize(p.size + 16);
+            frame->data.resize(SyntheticJpeg::encode(frame->data.data(), frame->data.size(), p.width, p.height,
+                                                     p.size, p.width));
+            frames.push_back(frame);
+        }
+    }
+
+    for (CorpusFrame *frame : frames)
+    {
+        frame->fb = {};
+        frame->fb.buf = frame->data.data();
+        frame->fb.len = frame->data.size();
+        frame->fb.format = PIXFORMAT_JPEG;
+        frame->shared.fb = &frame->fb;
+        frame->shared.frameId = 1;
+        frame->shared.stream = CAPTURE_STREAM_MAIN;
+        frame->shared.refCount.store(1);
+        frame->shared.cached = false;
+        CameraManager::parseJpeg(&frame->fb, frame->shared.jpeg);
+        frame->fb.width = frame->shared.jpeg.width;
+        frame->fb.height = frame->shared.jpeg.height;
+    }
+}
+
+// ============================================================================
+// HARNESS
+// ============================================================================
+
+/**
+ * @brief Totals of one benchmark, all divided by ops for the report
+ */
+struct BenchResult
+{
+    uint64_t ops = 0;
+    uint64_t nanos = 0;
+    uint64_t allocs = 0;
+    uint64_t bytes = 0;   // Wire (or output) bytes produced
+    uint64_t packets = 0; // RTP packets or RTSP requests produced
+};
+
+static uint32_t minRunMs = 500;
+
+/**
+ * @brief Repeat one pass of body() until minRunMs elapsed
+ */
+template <typename Body>
+static BenchResult runBench(Body body)
+{
+    BenchResult r;
+    body(r); // Warm caches and first-use paths outside the measurement
+    r = BenchResult();
+
+    const uint64_t allocsBefore = allocCount.load();
+    const auto start = std::chrono::steady_clock::now();
+    auto now = start;
+    while (std::chrono::duration_cast<std::chrono::milliseconds>(now - start).count() < minRunMs)
+    {
+        body(r);
+        now = std::chrono::steady_clock::now();
+    }
+    r.nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(now - start).count();
+    r.allocs = allocCount.load() - allocsBefore;
+    return r;
+}
+
+static void report(const char *name, const BenchResult &r)
+{
+    double ops = r.ops ? (double)r.ops : 1.0;
+    printf("%-28s %12.0f %10.2f %12.0f %10.1f %12llu\n", name, r.nanos / ops, r.allocs / ops, r.bytes / ops,
+           r.packets / ops, (unsigned long long)r.ops);
+}
+
+// ============================================================================
+// BENCHMARKS
+// ============================================================================
+
+static BenchResult benchParseJpeg(const std::vector<CorpusFrame *> &frames)
+{
+    return runBench([&](BenchResult &r)
+                    {
+        JpegFrameInfo info;
+        for (CorpusFrame *frame : frames)
+        {
+            CameraManager::parseJpeg(&frame->fb, info);
+            r.bytes += info.scanOffset;
+            r.ops++;
+        } });
+}
+
+/**
+ * @brief Fragment every frame and gather each packet the way sendmsg() would
+ */
+static BenchResult benchPacketize(const std::vector<CorpusFrame *> &frames, size_t maxPayload, bool interleaved)
+{
+    static uint8_t wire[RTSP_TCP_MAX_PACKET_SIZE + RTP_PACKET_HEADER_SIZE + RTP_JPEG_QTABLE_MAX_SIZE];
+    RtpJpegPacketizer packetizer;
+    RtpJpegPacket packet;
+    uint16_t sequence = 0;
+
+    return runBench([&](BenchResult &r)
+                    {
+        for (CorpusFrame *frame : frames)
+        {
+            packetizer.beginFrame(&frame->shared, maxPayload, 0);
+            while (packetizer.hasMore())
+            {
+                packetizer.next(packet, sequence++);
+                struct iovec iov[3];
+                int count = RtpJpegPacketizer::toIovec(packet, interleaved, 0, iov);
+                size_t length = 0;
+                for (int i = 0; i < count; i++)
+                {
+                    memcpy(wire + length, iov[i].iov_base, iov[i].iov_len);
+                    length += iov[i].iov_len;
+                }
+                r.bytes += length;
+                r.packets++;
+            }
+            packetizer.reset();
+            r.ops++;
+        } });
+}
+
+static const char RTSP_SCRIPT[] =
+    "OPTIONS rtsp://192.168.1.50:554/mjpeg/1 RTSP/1.0\r\n"
+    "CSeq: 1\r\n"
+    "User-Agent: LibVLC/3.0.20 (LIVE555 Streaming Media v2016.11.28)\r\n"
+    "\r\n"
+    "DESCRIBE rtsp://192.168.1.50:554/mjpeg/1 RTSP/1.0\r\n"
+    "CSeq: 2\r\n"
+    "User-Agent: LibVLC/3.0.20 (LIVE555 Streaming Media v2016.11.28)\r\n"
+    "Accept: application/sdp\r\n"
+    "\r\n"
+    "SETUP rtsp://192.168.1.50:554/mjpeg/1/track1 RTSP/1.0\r\n"
+    "CSeq: 3\r\n"
+    "User-Agent: LibVLC/3.0.20 (LIVE555 Streaming Media v2016.11.28)\r\n"
+    "Transport: RTP/AVP/TCP;unicast;interleaved=0-1\r\n"
+    "\r\n"
+    "PLAY rtsp://192.168.1.50:554/mjpeg/1 RTSP/1.0\r\n"
+    "CSeq: 4\r\n"
+    "User-Agent: LibVLC/3.0.20 (LIVE555 Streaming Media v2016.11.28)\r\n"
+    "Session: 12345678\r\n"
+    "Range: npt=0.000-\r\n"
+    "\r\n";
+
+/**
+ * @brief Parse a VLC session start, with an interleaved RTCP RR after PLAY
+ */
+static BenchResult benchRequestParser()
+{
+    std::vector<uint8_t> script(RTSP_SCRIPT, RTSP_SCRIPT + sizeof(RTSP_SCRIPT) - 1);
+    // '$' + RTCP channel + 32-byte receiver report
+    const uint8_t rr[] = {'$', 1, 0, 32, 0x81, RTCP_PT_RR, 0, 7};
+    script.insert(script.end(), rr, rr + sizeof(rr));
+    script.insert(script.end(), 32 - 4, 0);
+
+    RTSPRequestParser parser;
+    WiFiClient client;
+    uint64_t interleaved = 0;
+    parser.setInterleavedHandler([&](uint8_t, const uint8_t *, size_t length)
+                                 { interleaved += length; });
+
+    return runBench([&](BenchResult &r)
+                    {
+        // Segment sizes a phone hotspot typically delivers
+        client.load(script.data(), script.size(), 536);
+        RTSPRequest request;
+        while (parser.feed(client) > 0 || parser.next(request))
+        {
+            while (parser.next(request))
+            {
+                r.bytes += request.method.length + request.uri.length + request.transport.length;
+                r.packets++;
+                parser.consume();
+            }
+        }
+        r.ops++; });
+}
+
+static BenchResult benchSdp(TimecodeManager &clock)
+{
+    static char sdpData[RTSP_SDP_BUFFER_SIZE];
+    static char clockData[256];
+
+    return runBench([&](BenchResult &r)
+                    {
+        RTSPTextBuffer sdp(sdpData, sizeof(sdpData));
+        RTSPTextBuffer clockLines(clockData, sizeof(clockData));
+        SdpBuilder::build(sdp, clock, CAPTURE_STREAM_MAIN, 800, 600, "192.168.1.50", millis());
+        SdpBuilder::appendClockLines(clockLines, clock);
+        r.bytes += sdp.length + clockLines.length;
+        r.ops++; });
+}
+
+static BenchResult benchTimecode(TimecodeManager &clock)
+{
+    return runBench([&](BenchResult &r)
+                    {
+        for (int i = 0; i < 64; i++)
+        {
+            RTSPTimecode_t timecode = clock.generateTimecode(esp_timer_get_time());
+            r.bytes += timecode.pts & 1; // Keep the call observable
+            r.ops++;
+        } });
+}
+
+int main(int argc, char **argv)
+{
+    const char *corpusDir = argc > 1 ? argv[1] : "bench/corpus";
+    if (argc > 2)
+    {
+        minRunMs = (uint32_t)atoi(argv[2]);
+    }
+
+    std::vector<CorpusFrame *> frames;
+    loadCorpus(corpusDir, frames);
+
+    size_t totalBytes = 0;
+    int rfc2435 = 0;
+    for (CorpusFrame *frame : frames)
+    {
+        totalBytes += frame->data.size();
+        rfc2435 += frame->shared.jpeg.rfc2435 ? 1 : 0;
+    }
+    printf("Corpus: %zu frames from %s, %zu bytes average, %d RFC 2435 compatible\n", frames.size(),
+           corpusDir, frames.empty() ? 0 : totalBytes / frames.size(), rfc2435);
+    for (CorpusFrame *frame : frames)
+    {
+        printf("  %-32s %7zu bytes  %4ux%-4u %s\n", frame->name.c_str(), frame->data.size(),
+               frame->shared.jpeg.width, frame->shared.jpeg.height,
+               frame->shared.jpeg.rfc2435 ? "scan payload" : frame->shared.jpeg.valid ? "whole file" : "INVALID");
+    }
+    printf("\n");
+
+    TimecodeManager clock;
+    clock.begin();
+
+    const size_t udpPayload = RTSP_MAX_FRAGMENT_SIZE - RTP_HEADER_SIZE - RTP_JPEG_HEADER_SIZE;
+    const size_t tcpPayload = RTSP_TCP_MAX_PACKET_SIZE - RTP_HEADER_SIZE - RTP_JPEG_HEADER_SIZE;
+
+    printf("%-28s %12s %10s %12s %10s %12s\n", "benchmark", "ns/op", "allocs/op", "bytes/op", "pkts/op", "ops");
+    report("jpeg_parse (frame)", benchParseJpeg(frames));
+    report("rtp_packetize_udp (frame)", benchPacketize(frames, udpPayload, false));
+    report("rtp_packetize_tcp (frame)", benchPacketize(frames, tcpPayload, true));
+    report("rtsp_parse (session start)", benchRequestParser());
+    report("sdp_build (describe)", benchSdp(clock));
+    report("timecode_generate (frame)", benchTimecode(clock));
+
+    for (CorpusFrame *frame : frames)
+    {
+        delete frame;
+    }
+    return 0;
+}
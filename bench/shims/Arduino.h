@@ -0,0 +1,71 @@
+/**
+ * @file Arduino.h
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief Host shim of the Arduino core subset used by the benchmarked modules
+ */
+// Arduino.h (bench shim)
+#ifndef BENCH_SHIM_ARDUINO_H
+#define BENCH_SHIM_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <algorithm>
+#include <string>
+#include "esp_timer.h" // Pulled in by the Arduino-ESP32 core as well
+
+using std::max;
+using std::min;
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void yield();
+void configTime(long gmtOffset, int daylightOffset, const char *server);
+
+#define LOW 0
+#define HIGH 1
+#define OUTPUT 0x03
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+
+/**
+ * @brief Minimal String: only what the module headers and logs touch
+ */
+class String
+{
+public:
+    String(const char *text = "") : value(text ? text : "") {}
+    String(const std::string &text) : value(text) {}
+    const char *c_str() const { return value.c_str(); }
+    size_t length() const { return value.size(); }
+    String operator+(const String &other) const { return String(value + other.value); }
+    String &operator+=(const String &other)
+    {
+        value += other.value;
+        return *this;
+    }
+
+private:
+    std::string value;
+};
+
+/**
+ * @brief ESP object: cycle counter backed by the host steady clock
+ */
+class EspClass
+{
+public:
+    uint32_t getCycleCount();
+    uint32_t getCpuFreqMHz() { return 240; }
+    uint32_t getFreeHeap() { return 0; }
+};
+extern EspClass ESP;
+
+#endif // BENCH_SHIM_ARDUINO_H
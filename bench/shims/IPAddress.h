@@ -0,0 +1,33 @@
+/**
+ * @file IPAddress.h
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief Host shim of the Arduino IPAddress
+ */
+// IPAddress.h (bench shim)
+#ifndef BENCH_SHIM_IPADDRESS_H
+#define BENCH_SHIM_IPADDRESS_H
+
+#include <stdint.h>
+#include <string.h>
+
+class IPAddress
+{
+public:
+    IPAddress() : bytes{0, 0, 0, 0} {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : bytes{a, b, c, d} {}
+    explicit IPAddress(uint32_t value) { memcpy(bytes, &value, sizeof(bytes)); }
+    operator uint32_t() const
+    {
+        uint32_t value;
+        memcpy(&value, bytes, sizeof(value));
+        return value;
+    }
+    uint8_t operator[](int index) const { return bytes[index]; }
+
+private:
+    uint8_t bytes[4];
+};
+
+#endif // BENCH_SHIM_IPADDRESS_H
@@ -0,0 +1,24 @@
+/**
+ * @file WiFi.h
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief Host shim of the WiFi object: never connected, loopback address
+ */
+// WiFi.h (bench shim)
+#ifndef BENCH_SHIM_WIFI_H
+#define BENCH_SHIM_WIFI_H
+
+#include <Arduino.h>
+#include "IPAddress.h"
+#include "WiFiClient.h"
+
+class WiFiClass
+{
+public:
+    bool isConnected() { return false; }
+    IPAddress localIP() { return IPAddress(127, 0, 0, 1); }
+};
+extern WiFiClass WiFi;
+
+#endif // BENCH_SHIM_WIFI_H
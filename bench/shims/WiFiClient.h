@@ -0,0 +1,53 @@
+/**
+ * @file WiFiClient.h
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief Host shim of WiFiClient: reads from a memory buffer, discards writes
+ */
+// WiFiClient.h (bench shim)
+#ifndef BENCH_SHIM_WIFICLIENT_H
+#define BENCH_SHIM_WIFICLIENT_H
+
+#include <Arduino.h>
+#include "IPAddress.h"
+
+/**
+ * @brief Socket stand-in for the RTSP request parser
+ *
+ * load() sets the bytes the "peer" sent; available()/read() hand them
+ * out in chunks of at most readChunk to mimic lwIP segments.
+ */
+class WiFiClient
+{
+public:
+    void load(const uint8_t *data, size_t length, size_t chunk = 1460)
+    {
+        rx = data;
+        rxLength = length;
+        rxOffset = 0;
+        readChunk = chunk;
+    }
+
+    int available() { return (int)std::min(rxLength - rxOffset, readChunk); }
+
+    int read(uint8_t *buffer, size_t size)
+    {
+        size_t n = std::min(size, rxLength - rxOffset);
+        memcpy(buffer, rx + rxOffset, n);
+        rxOffset += n;
+        return (int)n;
+    }
+
+    size_t write(const uint8_t *, size_t size) { return size; }
+    bool connected() { return true; }
+    IPAddress remoteIP() const { return IPAddress(127, 0, 0, 1); }
+
+private:
+    const uint8_t *rx = nullptr;
+    size_t rxLength = 0;
+    size_t rxOffset = 0;
+    size_t readChunk = 1460;
+};
+
+#endif // BENCH_SHIM_WIFICLIENT_H
@@ -0,0 +1,20 @@
+/**
+ * @file esp_err.h
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief Host shim of the ESP-IDF error codes
+ */
+// esp_err.h (bench shim)
+#ifndef BENCH_SHIM_ESP_ERR_H
+#define BENCH_SHIM_ESP_ERR_H
+
+typedef int esp_err_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_NOT_SUPPORTED 0x106
+
+const char *esp_err_to_name(esp_err_t code);
+
+#endif // BENCH_SHIM_ESP_ERR_H
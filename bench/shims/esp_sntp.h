@@ -0,0 +1,27 @@
+/**
+ * @file esp_sntp.h
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief Host shim of the SNTP configuration calls: never syncs
+ */
+// esp_sntp.h (bench shim)
+#ifndef BENCH_SHIM_ESP_SNTP_H
+#define BENCH_SHIM_ESP_SNTP_H
+
+#include <stdint.h>
+#include <sys/time.h>
+
+typedef enum
+{
+    SNTP_SYNC_MODE_IMMED,
+    SNTP_SYNC_MODE_SMOOTH
+} sntp_sync_mode_t;
+
+typedef void (*sntp_sync_time_cb_t)(struct timeval *tv);
+
+void sntp_set_sync_mode(sntp_sync_mode_t mode);
+void sntp_set_sync_interval(uint32_t intervalMs);
+void sntp_set_time_sync_notification_cb(sntp_sync_time_cb_t callback);
+
+#endif // BENCH_SHIM_ESP_SNTP_H
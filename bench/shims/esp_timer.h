@@ -0,0 +1,16 @@
+/**
+ * @file esp_timer.h
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief Host shim of esp_timer_get_time()
+ */
+// esp_timer.h (bench shim)
+#ifndef BENCH_SHIM_ESP_TIMER_H
+#define BENCH_SHIM_ESP_TIMER_H
+
+#include <stdint.h>
+
+int64_t esp_timer_get_time();
+
+#endif // BENCH_SHIM_ESP_TIMER_H
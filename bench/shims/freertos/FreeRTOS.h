@@ -0,0 +1,22 @@
+/**
+ * @file FreeRTOS.h
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief Host shim of the FreeRTOS types seen in module headers
+ */
+// freertos/FreeRTOS.h (bench shim)
+#ifndef BENCH_SHIM_FREERTOS_H
+#define BENCH_SHIM_FREERTOS_H
+
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+
+#define pdPASS 1
+#define pdFAIL 0
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+#endif // BENCH_SHIM_FREERTOS_H
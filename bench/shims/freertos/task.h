@@ -0,0 +1,23 @@
+/**
+ * @file task.h
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief Host shim of the FreeRTOS task handle type and task creation
+ */
+// freertos/task.h (bench shim)
+#ifndef BENCH_SHIM_FREERTOS_TASK_H
+#define BENCH_SHIM_FREERTOS_TASK_H
+
+#include "FreeRTOS.h"
+
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+// No scheduler on the host: creation always fails, nothing runs in the background
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char *name, uint32_t stackBytes, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *handle, BaseType_t core);
+void vTaskDelay(TickType_t ticks);
+void vTaskDelete(TaskHandle_t task);
+
+#endif // BENCH_SHIM_FREERTOS_TASK_H
@@ -0,0 +1,19 @@
+/**
+ * @file sockets.h
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief Host shim of lwIP sockets: the POSIX ones
+ */
+// lwip/sockets.h (bench shim)
+#ifndef BENCH_SHIM_LWIP_SOCKETS_H
+#define BENCH_SHIM_LWIP_SOCKETS_H
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#endif // BENCH_SHIM_LWIP_SOCKETS_H
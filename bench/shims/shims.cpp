@@ -0,0 +1,101 @@
+/**
+ * @file shims.cpp
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief Host implementations behind the bench shims
+ *
+ * Time comes from the steady clock, the camera driver is absent and the
+ * logger discards everything: the benchmarked code runs unchanged but
+ * never prints or touches hardware.
+ */
+// shims.cpp (bench shim)
+#include <Arduino.h>
+#include <WiFi.h>
+#include <esp_camera.h>
+#include <esp_timer.h>
+#include <esp_sntp.h>
+#include <freertos/task.h>
+#include <chrono>
+#include <thread>
+#include "../../lib/Utils/Logger.h"
+#include "../../lib/CameraManager/TestFrameSource.h"
+
+static const std::chrono::steady_clock::time_point bootTime = std::chrono::steady_clock::now();
+
+static uint64_t elapsedMicros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - bootTime).count();
+}
+
+unsigned long millis() { return (unsigned long)(elapsedMicros() / 1000); }
+unsigned long micros() { return (unsigned long)elapsedMicros(); }
+int64_t esp_timer_get_time() { return (int64_t)elapsedMicros(); }
+void delay(uint32_t ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
+void yield() {}
+void configTime(long, int, const char *) {}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t, const char *, uint32_t, void *, UBaseType_t, TaskHandle_t *, BaseType_t)
+{
+    return pdFAIL;
+}
+void vTaskDelay(TickType_t ticks) { delay(ticks); }
+void vTaskDelete(TaskHandle_t) {}
+
+void sntp_set_sync_mode(sntp_sync_mode_t) {}
+void sntp_set_sync_interval(uint32_t) {}
+void sntp_set_time_sync_notification_cb(sntp_sync_time_cb_t) {}
+void pinMode(uint8_t, uint8_t) {}
+void digitalWrite(uint8_t, uint8_t) {}
+
+EspClass ESP;
+WiFiClass WiFi;
+
+uint32_t EspClass::getCycleCount()
+{
+    // Nanoseconds scaled to the 240 MHz getCpuFreqMHz() reports
+    uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - bootTime).count();
+    return (uint32_t)(ns * 240 / 1000);
+}
+
+const char *esp_err_to_name(esp_err_t code) { return code == ESP_OK ? "ESP_OK" : "ESP_FAIL"; }
+
+const resolution_info_t resolution[] = {
+    {96, 96}, {160, 120}, {176, 144}, {240, 176}, {240, 240}, {320, 240}, {400, 296},
+    {480, 320}, {640, 480}, {800, 600}, {1024, 768}, {1280, 720}, {1280, 1024}, {1600, 1200}};
+
+esp_err_t esp_camera_init(const camera_config_t *) { return ESP_ERR_NOT_SUPPORTED; }
+esp_err_t esp_camera_deinit() { return ESP_OK; }
+camera_fb_t *esp_camera_fb_get() { return nullptr; }
+void esp_camera_fb_return(camera_fb_t *) {}
+sensor_t *esp_camera_sensor_get() { return nullptr; }
+
+// Logging would dominate the timings: every entry point is a no-op
+LogLevel Logger::currentLevel = LOG_ERROR;
+
+bool Logger::begin() { return true; }
+void Logger::setLogLevel(LogLevel level) { currentLevel = level; }
+LogLevel Logger::getLogLevel() { return currentLevel; }
+uint32_t Logger::getDroppedCount() { return 0; }
+void Logger::error(const char *) {}
+void Logger::error(const String &) {}
+void Logger::warn(const char *) {}
+void Logger::warn(const String &) {}
+void Logger::info(const char *) {}
+void Logger::info(const String &) {}
+void Logger::debug(const char *) {}
+void Logger::debug(const String &) {}
+void Logger::verbose(const char *) {}
+void Logger::verbose(const String &) {}
+void Logger::errorf(const char *, ...) {}
+void Logger::warnf(const char *, ...) {}
+void Logger::infof(const char *, ...) {}
+void Logger::debugf(const char *, ...) {}
+void Logger::verbosef(const char *, ...) {}
+
+// The test frame source needs flash and PSRAM: CameraManager links an empty one
+bool TestFrameSource::begin(CameraFrameSource) { return false; }
+camera_fb_t *TestFrameSource::grab() { return nullptr; }
+bool TestFrameSource::owns(const camera_fb_t *) { return false; }
+void TestFrameSource::release(camera_fb_t *) {}
+uint8_t TestFrameSource::frameCount = 0;
@@ -0,0 +1,222 @@
+/**
+ * @file AdaptiveBitrate.cpp
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief Implementation of the adaptive bitrate controller
+ */
+
+#include "AdaptiveBitrate.h"
+#include "../Utils/Logger.h"
+
+std::atomic<uint8_t> AdaptiveBitrate::targetLevel(0);
+std::atomic<uint8_t> AdaptiveBitrate::floorLevel(0);
+uint8_t AdaptiveBitrate::appliedLevel = 0;
+uint8_t AdaptiveBitrate::downWindows = 0;
+uint8_t AdaptiveBitrate::upWindows = 0;
+size_t AdaptiveBitrate::roundFrameLen = 0;
+bool AdaptiveBitrate::roundHasViewer = false;
+bool AdaptiveBitrate::roundDropped = false;
+uint32_t AdaptiveBitrate::roundWorstLoad = 0;
+uint16_t AdaptiveBitrate::roundWorstBacklog = 0;
+uint8_t AdaptiveBitrate::roundWorstLossPercent = 0;
+uint16_t AdaptiveBitrate::roundWorstJitterMs = 0;
+
+// 4:3 frame sizes, largest first: stepping down keeps the aspect ratio
+static const framesize_t FRAME_SIZE_LADDER[] = {
+    FRAMESIZE_UXGA, FRAMESIZE_XGA, FRAMESIZE_SVGA, FRAMESIZE_VGA, FRAMESIZE_QVGA, FRAMESIZE_QQVGA};
+static const uint8_t FRAME_SIZE_LADDER_COUNT = sizeof(FRAME_SIZE_LADDER) / sizeof(FRAME_SIZE_LADDER[0]);
+
+uint8_t AdaptiveBitrate::qualitySteps()
+{
+    if (RTSP_ABR_MAX_JPEG_QUALITY <= CAMERA_JPEG_QUALITY)
+    {
+        return 0;
+    }
+    return (RTSP_ABR_MAX_JPEG_QUALITY - CAMERA_JPEG_QUALITY + RTSP_ABR_QUALITY_STEP - 1) / RTSP_ABR_QUALITY_STEP;
+}
+
+uint8_t AdaptiveBitrate::frameSizeSteps()
+{
+    // Ladder entries strictly below the configured size, down to the minimum
+    uint8_t steps = 0;
+    for (uint8_t i = 0; i < FRAME_SIZE_LADDER_COUNT; i++)
+    {
+        if (FRAME_SIZE_LADDER[i] < CAMERA_FRAME_SIZE && FRAME_SIZE_LADDER[i] >= RTSP_ABR_MIN_FRAME_SIZE)
+        {
+            steps++;
+        }
+    }
+    return steps;
+}
+
+uint8_t AdaptiveBitrate::getMaxLevel()
+{
+    return qualitySteps() + frameSizeSteps();
+}
+
+int AdaptiveBitrate::qualityForLevel(uint8_t level)
+{
+    const int worstQuality = max(RTSP_ABR_MAX_JPEG_QUALITY, CAMERA_JPEG_QUALITY);
+    int quality = CAMERA_JPEG_QUALITY + level * RTSP_ABR_QUALITY_STEP;
+    return quality > worstQuality ? worstQuality : quality;
+}
+
+framesize_t AdaptiveBitrate::frameSizeForLevel(uint8_t level)
+{
+    uint8_t qSteps = qualitySteps();
+    if (level <= qSteps)
+    {
+        return CAMERA_FRAME_SIZE;
+    }
+
+    uint8_t sizeStep = level - qSteps;
+    for (uint8_t i = 0; i < FRAME_SIZE_LADDER_COUNT; i++)
+    {
+        if (FRAME_SIZE_LADDER[i] < CAMERA_FRAME_SIZE && FRAME_SIZE_LADDER[i] >= RTSP_ABR_MIN_FRAME_SIZE)
+        {
+            if (--sizeStep == 0)
+            {
+                return FRAME_SIZE_LADDER[i];
+            }
+        }
+    }
+    return RTSP_ABR_MIN_FRAME_SIZE;
+}
+
+void AdaptiveBitrate::beginRound(size_t frameLen)
+{
+    roundFrameLen = frameLen;
+    roundHasViewer = false;
+    roundDropped = false;
+    roundWorstLoad = 0;
+    roundWorstBacklog = 0;
+    roundWorstLossPercent = 0;
+    roundWorstJitterMs = 0;
+}
+
+void AdaptiveBitrate::submit(const AbrLinkSample &sample)
+{
+    if (sample.frames == 0 && sample.dropped == 0 && sample.backlogPackets == 0)
+    {
+        return; // Viewer idle this window
+    }
+    roundHasViewer = true;
+
+    uint32_t attempted = sample.frames + sample.dropped;
+    if (sample.dropped * 100 >= attempted * RTSP_ABR_DROP_PERCENT)
+    {
+        roundDropped = true;
+    }
+
+    // Link load: share of the measured throughput the current frame size
+    // needs at RTSP_FPS. Throughput is bytes over the time spent sending them.
+    uint32_t load = 100;
+    if (sample.bytes > 0 && sample.frames > 0)
+    {
+        uint32_t throughput = (uint64_t)sample.bytes * 1000 / max(sample.sendTimeMs, (uint32_t)1); // bytes/s
+        size_t frameLen = roundFrameLen ? roundFrameLen : sample.bytes / sample.frames;
+        load = (uint64_t)frameLen * RTSP_FPS * 100 / max(throughput, (uint32_t)1);
+    }
+    roundWorstLoad = max(roundWorstLoad, load);
+    roundWorstBacklog = max(roundWorstBacklog, sample.backlogPackets);
+
+    if (sample.hasReceiverReport)
+    {
+        roundWorstLossPercent = max(roundWorstLossPercent, sample.lossPercent);
+        roundWorstJitterMs = max(roundWorstJitterMs, sample.jitterMs);
+    }
+}
+
+void AdaptiveBitrate::endRound()
+{
+#if RTSP_ABR_ENABLED
+    if (!roundHasViewer)
+    {
+        return;
+    }
+
+    uint8_t level = targetLevel.load();
+    const bool lossy = roundWorstLossPercent >= RTSP_ABR_LOSS_HIGH_PERCENT ||
+                       roundWorstJitterMs >= RTSP_ABR_JITTER_HIGH_MS;
+    const bool congested = roundDropped || lossy || roundWorstLoad >= RTSP_ABR_LOAD_HIGH_PERCENT;
+    const bool clear = !roundDropped && roundWorstBacklog == 0 && roundWorstLoad <= RTSP_ABR_LOAD_LOW_PERCENT &&
+                       roundWorstLossPercent <= RTSP_ABR_LOSS_LOW_PERCENT && roundWorstJitterMs <= RTSP_ABR_JITTER_LOW_MS;
+
+    if (congested)
+    {
+        upWindows = 0;
+        if (++downWindows >= RTSP_ABR_DOWN_WINDOWS && level < getMaxLevel())
+        {
+            level++;
+            downWindows = 0;
+            LOG_INFOF("ABR: link congested (load %lu%%, loss %d%%, jitter %d ms, frame %d bytes) - level %d, quality %d",
+                      roundWorstLoad, roundWorstLossPercent, roundWorstJitterMs, roundFrameLen, level, qualityForLevel(level));
+        }
+    }
+    else if (clear)
+    {
+        downWindows = 0;
+        if (++upWindows >= RTSP_ABR_UP_WINDOWS && level > 0)
+        {
+            level--;
+            upWindows = 0;
+            LOG_INFOF("ABR: link clear (load %lu%%) - level %d, quality %d",
+                      roundWorstLoad, level, qualityForLevel(level));
+        }
+    }
+    else
+    {
+        // In the hysteresis band: hold the current setting
+        downWindows = 0;
+        upWindows = 0;
+    }
+
+    targetLevel.store(level);
+#endif
+}
+
+void AdaptiveBitrate::applyPending()
+{
+    uint8_t level = max(targetLevel.load(), floorLevel.load());
+    if (level == appliedLevel)
+    {
+        return;
+    }
+
+    sensor_t *sensor = esp_camera_sensor_get();
+    if (!sensor)
+    {
+        return;
+    }
+
+    framesize_t frameSize = frameSizeForLevel(level);
+    if (frameSize != frameSizeForLevel(appliedLevel))
+    {
+        sensor->set_framesize(sensor, frameSize);
+    }
+    sensor->set_quality(sensor, qualityForLevel(level));
+
+    LOG_DEBUGF("ABR applied: level %d, framesize %d, quality %d", level, frameSize, qualityForLevel(level));
+    appliedLevel = level;
+}
+
+void AdaptiveBitrate::setFloorLevel(uint8_t level)
+{
+    floorLevel.store(min(level, getMaxLevel()));
+}
+
+uint8_t AdaptiveBitrate::getLevel()
+{
+    return appliedLevel;
+}
+
+int AdaptiveBitrate::getJpegQuality()
+{
+    return qualityForLevel(appliedLevel);
+}
+
+framesize_t AdaptiveBitrate::getFrameSize()
+{
+    return frameSizeForLevel(appliedLevel);
+}
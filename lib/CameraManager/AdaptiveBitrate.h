@@ -0,0 +1,111 @@
+/**
+ * @file AdaptiveBitrate.h
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief Adaptive bitrate controller driving sensor JPEG quality and frame size
+ */
+
+#ifndef ADAPTIVE_BITRATE_H
+#define ADAPTIVE_BITRATE_H
+
+#include <esp_camera.h>
+#include <atomic>
+#include "../../src/config.h"
+
+/**
+ * @brief Link statistics of one viewer over an evaluation window
+ */
+struct AbrLinkSample
+{
+    uint32_t frames = 0;         // Frames fully sent
+    uint32_t dropped = 0;        // Frames skipped or aborted
+    uint32_t sendTimeMs = 0;     // Time spent sending those frames
+    uint32_t bytes = 0;          // Bytes written
+    uint16_t backlogPackets = 0; // Packets still queued at the end of the window
+    uint8_t lossPercent = 0;     // Worst loss the viewer reported (RTCP RR / NACK)
+    uint16_t jitterMs = 0;       // Interarrival jitter the viewer reported
+    bool hasReceiverReport = false;
+};
+
+/**
+ * @brief Adaptive bitrate controller
+ *
+ * Works on a ladder of levels: level 0 is the configured
+ * CAMERA_FRAME_SIZE / CAMERA_JPEG_QUALITY, each level above first raises
+ * the JPEG quality number by RTSP_ABR_QUALITY_STEP up to
+ * RTSP_ABR_MAX_JPEG_QUALITY, then steps the frame size down a 4:3 ladder
+ * to RTSP_ABR_MIN_FRAME_SIZE.
+ *
+ * Each window every active viewer submits an AbrLinkSample; the arbiter
+ * keeps the worst one (highest link load, drops, backlog, and the loss
+ * and jitter the viewer reports over RTCP) and steps the level with
+ * hysteresis. Receiver-side loss shows up before local drops do, so the
+ * controller backs off before the viewer stutters. The new setting is applied by the capture task
+ * between two frames, so the sensor is never reconfigured mid-capture.
+ */
+class AdaptiveBitrate
+{
+public:
+    /**
+     * @brief Start a new arbitration round
+     *
+     * @param frameLen Size of the latest frame (bytes), used to turn each
+     *        viewer's measured throughput into a link load
+     */
+    static void beginRound(size_t frameLen);
+
+    /**
+     * @brief Submit one viewer's sample for the current round
+     */
+    static void submit(const AbrLinkSample &sample);
+
+    /**
+     * @brief Close the round and step the level if needed
+     */
+    static void endRound();
+
+    /**
+     * @brief Apply a pending level change to the sensor
+     *
+     * Called by the capture task before each frame.
+     */
+    static void applyPending();
+
+    /**
+     * @brief Keep the level at or above a floor, whatever the link does
+     *
+     * Used to lighten the stream while something else needs airtime and
+     * CPU (an OTA upload). 0 lifts the floor.
+     */
+    static void setFloorLevel(uint8_t level);
+
+    // Current state
+    static uint8_t getLevel();
+    static uint8_t getMaxLevel();
+    static int getJpegQuality();
+    static framesize_t getFrameSize();
+
+private:
+    static std::atomic<uint8_t> targetLevel;
+    static std::atomic<uint8_t> floorLevel;
+    static uint8_t appliedLevel;
+    static uint8_t downWindows;
+    static uint8_t upWindows;
+
+    // Current round
+    static size_t roundFrameLen;
+    static bool roundHasViewer;
+    static bool roundDropped;
+    static uint32_t roundWorstLoad;
+    static uint16_t roundWorstBacklog;
+    static uint8_t roundWorstLossPercent;
+    static uint16_t roundWorstJitterMs;
+
+    static int qualityForLevel(uint8_t level);
+    static framesize_t frameSizeForLevel(uint8_t level);
+    static uint8_t qualitySteps();
+    static uint8_t frameSizeSteps();
+};
+
+#endif // ADAPTIVE_BITRATE_H
@@ -7,11 +7,19 @@
  */
 
 #include "CameraManager.h"
+#include "TestFrameSource.h"
 #include "../../src/config.h"
 #include "../Utils/Logger.h"
+#include "../Utils/Metrics.h"
+#include <time.h>
+
+// Sensor power-down pin (AI-Thinker ESP32-CAM), also driven by setStandby()
+#define CAMERA_PIN_PWDN 32
 
 // Static variable to track initialization status
 bool CameraManager::initialized = false;
+bool CameraManager::standby = false;
+CameraFrameSource CameraManager::frameSource = CAMERA_SOURCE_LIVE;
 
 // Static variables for framerate control
 static unsigned long lastCaptureTime = 0;
@@ -39,7 +47,7 @@ bool CameraManager::begin()
     config.pin_href = 23;
     config.pin_sccb_sda = 26;
     config.pin_sccb_scl = 27;
-    config.pin_pwdn = 32;
+    config.pin_pwdn = CAMERA_PIN_PWDN;
     config.pin_reset = -1;
 
     // LED configuration (for flash)
@@ -62,11 +70,15 @@ bool CameraManager::begin()
     if (err != ESP_OK)
     {
         LOG_ERRORF("Camera initialization error: %s", esp_err_to_name(err));
-        return false;
+        if (CAMERA_FRAME_SOURCE == CAMERA_SOURCE_LIVE)
+        {
+            return false;
+        }
+        // A test source does not need the sensor: boards without one can still be load tested
     }
 
     // Advanced parameters configuration
-    sensor_t *s = esp_camera_sensor_get();
+    sensor_t *s = err == ESP_OK ? esp_camera_sensor_get() : nullptr;
     if (s)
     {
         configureAdvancedSettings(s);
@@ -77,6 +89,22 @@ bool CameraManager::begin()
         LOG_WARN("Unable to get sensor for advanced configuration");
     }
 
+    if (CAMERA_FRAME_SOURCE != CAMERA_SOURCE_LIVE)
+    {
+        if (TestFrameSource::begin((CameraFrameSource)CAMERA_FRAME_SOURCE))
+        {
+            frameSource = (CameraFrameSource)CAMERA_FRAME_SOURCE;
+        }
+        else if (err != ESP_OK)
+        {
+            return false;
+        }
+        else
+        {
+            LOG_WARN("Test frame source unavailable, using the live sensor");
+        }
+    }
+
     // Initialize timing control
     lastCaptureTime = 0;
     frameInterval = 1000 / RTSP_FPS;
@@ -86,7 +114,7 @@ bool CameraManager::begin()
     return true;
 }
 
-camera_fb_t *CameraManager::capture()
+camera_fb_t *CameraManager::capture(JpegFrameInfo *info)
 {
     if (!initialized)
     {
@@ -108,7 +136,7 @@ camera_fb_t *CameraManager::capture()
     lastCaptureTime = currentTime;
 
     // Capture with error handling
-    camera_fb_t *fb = esp_camera_fb_get();
+    camera_fb_t *fb = grabFrame();
     if (!fb)
     {
         LOG_ERROR("Image capture failed");
@@ -119,45 +147,30 @@ camera_fb_t *CameraManager::capture()
     if (fb->len == 0 || fb->width == 0 || fb->height == 0)
     {
         LOG_ERROR("Invalid frame captured - empty or corrupted");
-        esp_camera_fb_return(fb);
+        releaseFrame(fb);
         return nullptr;
     }
 
-    // Validate JPEG markers (SOI and EOI)
-    if (fb->len >= 2)
+    // Validate JPEG structure (SOI, segments, EOI) in a single header walk
+    JpegFrameInfo localInfo;
+    JpegFrameInfo &meta = info ? *info : localInfo;
+    if (!parseJpeg(fb, meta))
     {
-        // Check SOI marker (Start of Image): 0xFF 0xD8
-        if (fb->buf[0] != 0xFF || fb->buf[1] != 0xD8)
-        {
-            Logger::errorf("Invalid JPEG SOI marker - expected 0xFF 0xD8, got 0x%02X 0x%02X",
-                           fb->buf[0], fb->buf[1]);
-            esp_camera_fb_return(fb);
-            return nullptr;
-        }
-
-        // Check EOI marker (End of Image): 0xFF 0xD9
-        if (fb->len >= 4)
-        {
-            if (fb->buf[fb->len - 2] != 0xFF || fb->buf[fb->len - 1] != 0xD9)
-            {
-                Logger::errorf("Invalid JPEG EOI marker - expected 0xFF 0xD9, got 0x%02X 0x%02X",
-                               fb->buf[fb->len - 2], fb->buf[fb->len - 1]);
-                esp_camera_fb_return(fb);
-                return nullptr;
-            }
-        }
+        LOG_ERRORF("Invalid JPEG structure - SOI 0x%02X 0x%02X, EOI 0x%02X 0x%02X",
+                   fb->buf[0], fb->buf[1], fb->buf[fb->len - 2], fb->buf[fb->len - 1]);
+        releaseFrame(fb);
+        return nullptr;
     }
 
     LOG_DEBUGF("Frame captured successfully: %d bytes, %dx%d, timestamp: %lu, JPEG valid",
                fb->len, fb->width, fb->height, currentTime);
 
-    // Add HLS metadata for better compatibility
-    addHLSMetadataToJPEG(fb);
+    prepareTimestampApp1(meta);
 
     return fb;
 }
 
-camera_fb_t *CameraManager::captureForced()
+camera_fb_t *CameraManager::captureForced(JpegFrameInfo *info)
 {
     if (!initialized)
     {
@@ -169,7 +182,9 @@ camera_fb_t *CameraManager::captureForced()
     unsigned long currentTime = millis();
 
     // Capture with error handling - optimized for speed
-    camera_fb_t *fb = esp_camera_fb_get();
+    METRIC_TIMER_START(waitStart);
+    camera_fb_t *fb = grabFrame();
+    METRIC_TIMER_STOP(METRIC_CAPTURE_WAIT, waitStart);
     if (!fb)
     {
         LOG_ERROR("Forced image capture failed");
@@ -180,24 +195,27 @@ camera_fb_t *CameraManager::captureForced()
     if (fb->len == 0 || fb->width == 0 || fb->height == 0)
     {
         LOG_ERROR("Invalid frame captured in forced mode - empty or corrupted");
-        esp_camera_fb_return(fb);
+        releaseFrame(fb);
         return nullptr;
     }
 
-    // Minimal JPEG validation for speed
-    if (fb->len >= 4 && (fb->buf[0] != 0xFF || fb->buf[1] != 0xD8 ||
-                         fb->buf[fb->len - 2] != 0xFF || fb->buf[fb->len - 1] != 0xD9))
+    // Header walk only: stops at SOS, never reads the entropy-coded data
+    JpegFrameInfo localInfo;
+    JpegFrameInfo &meta = info ? *info : localInfo;
+    METRIC_TIMER_START(parseStart);
+    bool parsed = parseJpeg(fb, meta);
+    METRIC_TIMER_STOP(METRIC_JPEG_VALIDATE, parseStart);
+    if (!parsed)
     {
         LOG_ERROR("Invalid JPEG markers in forced mode");
-        esp_camera_fb_return(fb);
+        releaseFrame(fb);
         return nullptr;
     }
 
     LOG_DEBUGF("Forced frame captured: %d bytes, %dx%d, timestamp: %lu, JPEG valid",
                fb->len, fb->width, fb->height, currentTime);
 
-    // Add HLS metadata for better compatibility
-    addHLSMetadataToJPEG(fb);
+    prepareTimestampApp1(meta);
 
     return fb;
 }
@@ -212,11 +230,29 @@ camera_fb_t *CameraManager::captureForced()
  */
 void CameraManager::releaseFrame(camera_fb_t *fb)
 {
-    if (fb)
+    if (!fb)
+    {
+        return;
+    }
+    if (TestFrameSource::owns(fb))
+    {
+        TestFrameSource::release(fb);
+    }
+    else
     {
         esp_camera_fb_return(fb);
-        LOG_DEBUG("Frame buffer released");
     }
+    LOG_DEBUG("Frame buffer released");
+}
+
+CameraFrameSource CameraManager::getFrameSource()
+{
+    return frameSource;
+}
+
+camera_fb_t *CameraManager::grabFrame()
+{
+    return frameSource == CAMERA_SOURCE_LIVE ? esp_camera_fb_get() : TestFrameSource::grab();
 }
 
 bool CameraManager::isInitialized()
@@ -224,6 +260,25 @@ bool CameraManager::isInitialized()
     return initialized;
 }
 
+void CameraManager::setStandby(bool enable)
+{
+    if (!initialized || enable == standby)
+    {
+        return;
+    }
+
+    // PWDN high stops the sensor array and its PLL; registers are kept,
+    // so waking up needs no reconfiguration, only a fresh exposure
+    digitalWrite(CAMERA_PIN_PWDN, enable ? HIGH : LOW);
+    standby = enable;
+    LOG_DEBUGF("Camera sensor %s", enable ? "in standby" : "awake");
+}
+
+bool CameraManager::isStandby()
+{
+    return standby;
+}
+
 std::string CameraManager::getCameraInfo()
 {
     if (!initialized)
@@ -231,6 +286,13 @@ std::string CameraManager::getCameraInfo()
         return "Camera not initialized";
     }
 
+    if (frameSource != CAMERA_SOURCE_LIVE)
+    {
+        return std::string("Test frame source: ") + (frameSource == CAMERA_SOURCE_REPLAY ? "replay" : "synthetic") +
+               ", " + std::to_string(TestFrameSource::getFrameCount()) + " frames at " +
+               std::to_string(CAMERA_TEST_SOURCE_FPS) + " FPS\n";
+    }
+
     sensor_t *s = esp_camera_sensor_get();
     if (!s)
     {
@@ -292,41 +354,194 @@ void CameraManager::configureAdvancedSettings(sensor_t *sensor)
     LOG_DEBUG("Advanced camera configuration completed");
 }
 
-bool CameraManager::addHLSMetadataToJPEG(camera_fb_t *fb)
+bool CameraManager::parseJpeg(const camera_fb_t *fb, JpegFrameInfo &info)
 {
-    if (!fb || fb->len < 4)
+    info.valid = false;
+    info.rfc2435 = false;
+    info.hasApp1 = false;
+    info.type = 0;
+    info.width = 0;
+    info.height = 0;
+    info.restartInterval = 0;
+    info.qtableCount = 0;
+    info.qtablePrecision = 0;
+    info.qtables[0] = info.qtables[1] = nullptr;
+    info.scanOffset = 0;
+    info.scanLength = 0;
+    info.app1Length = 0;
+
+    // SOI at the head and EOI at the tail, the scan in between is never read
+    if (!fb || fb->len < 6 || fb->buf[0] != 0xFF || fb->buf[1] != 0xD8 ||
+        fb->buf[fb->len - 2] != 0xFF || fb->buf[fb->len - 1] != 0xD9)
     {
         return false;
     }
 
-    // Check if JPEG already has EXIF data (look for APP1 marker after SOI)
-    if (fb->len >= 6 && fb->buf[0] == 0xFF && fb->buf[1] == 0xD8)
+    const uint8_t *buf = fb->buf;
+    const size_t len = fb->len;
+    bool baseline = false;
+    bool samplingOk = false;
+    size_t pos = 2;
+
+    // Segments are 0xFF <marker> <16-bit length incl. itself> <data>
+    while (pos + 4 <= len)
     {
-        // Look for APP1 marker (0xFF 0xE1) which contains EXIF
-        for (int i = 2; i < fb->len - 2; i++)
+        if (buf[pos] != 0xFF)
+        {
+            LOG_DEBUGF("JPEG parse: no marker at offset %d", pos);
+            return false;
+        }
+        uint8_t marker = buf[pos + 1];
+        if (marker == 0xFF)
+        {
+            pos++; // Fill byte
+            continue;
+        }
+
+        size_t segmentLength = (buf[pos + 2] << 8) | buf[pos + 3];
+        size_t data = pos + 4;
+        size_t next = pos + 2 + segmentLength;
+        if (segmentLength < 2 || next > len)
+        {
+            LOG_DEBUG("JPEG parse: truncated segment");
+            return false;
+        }
+
+        switch (marker)
         {
-            if (fb->buf[i] == 0xFF && fb->buf[i + 1] == 0xE1)
+        case 0xE1: // APP1 - EXIF/XMP already present
+            info.hasApp1 = true;
+            break;
+
+        case 0xDB: // DQT - one or more tables
+        {
+            size_t p = data;
+            while (p < next)
             {
-                // EXIF already present, no need to add
-                return true;
+                uint8_t precision = buf[p] >> 4;
+                uint8_t id = buf[p] & 0x0F;
+                size_t tableSize = precision ? 128 : 64;
+                if (p + 1 + tableSize > next)
+                {
+                    return false;
+                }
+                if (id <= 1)
+                {
+                    info.qtables[id] = buf + p + 1;
+                    if (precision)
+                    {
+                        info.qtablePrecision |= (1 << id);
+                    }
+                    if (id + 1 > info.qtableCount)
+                    {
+                        info.qtableCount = id + 1;
+                    }
+                }
+                p += 1 + tableSize;
             }
+            break;
         }
+
+        case 0xC0: // SOF0 - baseline
+        case 0xC1: // SOF1..3 - valid JPEG, but not carried by RFC 2435
+        case 0xC2:
+        case 0xC3:
+        {
+            if (segmentLength < 8)
+            {
+                return false;
+            }
+            info.height = (buf[data + 1] << 8) | buf[data + 2];
+            info.width = (buf[data + 3] << 8) | buf[data + 4];
+            baseline = marker == 0xC0;
+
+            // RFC 2435 types 0/1: 3 components, Y decides the type, chroma 1x1
+            if (segmentLength >= 17 && buf[data + 5] == 3 &&
+                buf[data + 10] == 0x11 && buf[data + 13] == 0x11)
+            {
+                uint8_t ySampling = buf[data + 7];
+                if (ySampling == 0x21)
+                {
+                    info.type = 0; // 4:2:2
+                    samplingOk = true;
+                }
+                else if (ySampling == 0x22)
+                {
+                    info.type = 1; // 4:2:0
+                    samplingOk = true;
+                }
+            }
+            break;
+        }
+
+        case 0xDD: // DRI
+            info.restartInterval = (buf[data] << 8) | buf[data + 1];
+            break;
+
+        case 0xDA: // SOS - entropy-coded data follows, stop here
+        {
+            info.scanOffset = next;
+            size_t end = len - 2; // Receivers append their own EOI
+            if (end <= info.scanOffset)
+            {
+                return false;
+            }
+            info.scanLength = end - info.scanOffset;
+            info.valid = true;
+            info.rfc2435 = baseline && samplingOk && info.qtableCount > 0;
+            return true;
+        }
+
+        case 0xD9: // EOI before any scan
+            return false;
+
+        default: // APP0/APPn, COM, DHT (standard tables are implied by RFC 2435)
+            break;
+        }
+        pos = next;
     }
 
-    // For now, we'll add minimal metadata by ensuring proper JPEG structure
-    // In a full implementation, we would add EXIF APP1 segment with:
-    // - Keyframe information
-    // - GOP size
-    // - HLS compatibility flags
-    // - Timestamp information
+    return false;
+}
+
+void CameraManager::prepareTimestampApp1(JpegFrameInfo &info)
+{
+#if CAMERA_JPEG_APP1_TIMESTAMP
+    // Fixed EXIF template: only the 19 DateTime characters are rewritten
+    static uint8_t app1Template[JPEG_APP1_TIMESTAMP_SIZE] = {
+        0xFF, 0xE1, 0x00, JPEG_APP1_TIMESTAMP_SIZE - 2, // APP1 marker + length
+        'E', 'x', 'i', 'f', 0x00, 0x00,                 // EXIF identifier
+        'I', 'I', 0x2A, 0x00, 0x08, 0x00, 0x00, 0x00,   // TIFF header, little endian, IFD0 at 8
+        0x01, 0x00,                                     // IFD0: 1 entry
+        0x32, 0x01, 0x02, 0x00, 0x14, 0x00, 0x00, 0x00, // DateTime (0x0132), ASCII, 20 bytes
+        0x1A, 0x00, 0x00, 0x00,                         // Value at TIFF offset 26
+        0x00, 0x00, 0x00, 0x00,                         // No next IFD
+        '1', '9', '7', '0', ':', '0', '1', ':', '0', '1', ' ',
+        '0', '0', ':', '0', '0', ':', '0', '0', 0x00};
+    static time_t lastSecond = 0;
+    static const size_t DATETIME_OFFSET = JPEG_APP1_TIMESTAMP_SIZE - 20;
+
+    if (info.hasApp1 || !info.valid)
+    {
+        info.app1Length = 0;
+        return;
+    }
 
-    // Ensure proper JPEG structure for HLS compatibility
-    if (fb->len >= 2 && fb->buf[0] == 0xFF && fb->buf[1] == 0xD8)
+    time_t now = time(nullptr);
+    if (now != lastSecond)
     {
-        // Valid JPEG start marker
-        LOG_DEBUG("JPEG frame ready for HLS streaming");
-        return true;
+        lastSecond = now;
+        struct tm t;
+        gmtime_r(&now, &t);
+        char stamp[20];
+        snprintf(stamp, sizeof(stamp), "%04d:%02d:%02d %02d:%02d:%02d",
+                 t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec);
+        memcpy(app1Template + DATETIME_OFFSET, stamp, 19);
     }
 
-    return false;
+    memcpy(info.app1, app1Template, JPEG_APP1_TIMESTAMP_SIZE);
+    info.app1Length = JPEG_APP1_TIMESTAMP_SIZE;
+#else
+    info.app1Length = 0;
+#endif
 }
@@ -12,6 +12,43 @@
 #include <esp_camera.h>
 #include <string>
 
+// Precomputed EXIF APP1 segment: marker + length + "Exif\0\0" + TIFF IFD0 with DateTime
+#define JPEG_APP1_TIMESTAMP_SIZE 56
+
+/**
+ * @brief Per-frame JPEG metadata, found once per capture by a marker-segment walk
+ *
+ * Offsets point into the frame buffer the info was parsed from and are
+ * only valid while that buffer is held.
+ */
+struct JpegFrameInfo
+{
+    bool valid = false;                 // SOI, well-formed segments up to SOS, EOI
+    bool rfc2435 = false;               // Layout RFC 2435 can describe (baseline, YUV 4:2:2 / 4:2:0)
+    bool hasApp1 = false;               // Frame already carries an APP1 (EXIF/XMP) segment
+    uint8_t type = 0;                   // RFC 2435 type: 0 = 4:2:2, 1 = 4:2:0
+    uint16_t width = 0;                 // From SOF
+    uint16_t height = 0;                // From SOF
+    uint16_t restartInterval = 0;       // From DRI (0 = no restart markers)
+    uint8_t qtableCount = 0;            // Quantization tables found (DQT)
+    uint8_t qtablePrecision = 0;        // Bit n set = table n is 16-bit
+    const uint8_t *qtables[2] = {};     // Table data (64 or 128 bytes each)
+    size_t scanOffset = 0;              // First byte of entropy-coded data (after SOS)
+    size_t scanLength = 0;              // Entropy-coded bytes, EOI excluded
+    uint8_t app1[JPEG_APP1_TIMESTAMP_SIZE]; // Timestamp segment to insert after SOI
+    uint8_t app1Length = 0;             // 0 = nothing to insert
+};
+
+/**
+ * @brief Where captured frames come from (CAMERA_FRAME_SOURCE)
+ */
+enum CameraFrameSource
+{
+    CAMERA_SOURCE_LIVE = 0,  // OV2640 through esp_camera_fb_get()
+    CAMERA_SOURCE_REPLAY,    // Recorded JPEGs from flash or SD, see TestFrameSource
+    CAMERA_SOURCE_SYNTHETIC  // Generated frames with a configured size distribution
+};
+
 /**
  * @brief ESP32-CAM camera manager class
  *
@@ -42,33 +79,56 @@ public:
      * to maintain the configured framerate. Returns nullptr if it's too
      * early for the next frame (framerate control).
      *
+     * @param info Optional per-frame metadata filled from the same walk
      * @return Pointer to camera frame buffer, or nullptr if error or too early
      * @note Call releaseFrame() immediately after processing the frame
      */
-    static camera_fb_t *capture();
+    static camera_fb_t *capture(JpegFrameInfo *info = nullptr);
 
     /**
      * @brief Capture a single frame without timing restrictions (for TCP mode)
      *
      * Captures a JPEG frame from the camera without framerate control.
-     * Used when timing is not critical (e.g., TCP fallback mode).
+     * Called by the CapturePipeline task, which owns frame pacing.
      *
+     * @param info Optional per-frame metadata filled from the same walk
      * @return Pointer to camera frame buffer, or nullptr if error
      * @note Call releaseFrame() immediately after processing the frame
      */
-    static camera_fb_t *captureForced();
+    static camera_fb_t *captureForced(JpegFrameInfo *info = nullptr);
 
     /**
      * @brief Release camera frame buffer - CRITICAL for memory management
      *
      * This function MUST be called after using a camera_fb_t to prevent
      * memory leaks and system crashes. Call this immediately after
-     * processing the frame.
+     * processing the frame. Frames from a test source go back to it,
+     * whichever source is active now.
      *
      * @param fb Pointer to camera frame buffer to release
      */
     static void releaseFrame(camera_fb_t *fb);
 
+    /**
+     * @brief Get the source capture() and captureForced() read from
+     */
+    static CameraFrameSource getFrameSource();
+
+    /**
+     * @brief Walk the marker segments of a JPEG frame
+     *
+     * Follows segment lengths from SOI up to SOS without touching the
+     * entropy-coded data, recording APP1, DQT, SOF, DRI and the scan
+     * range, and checks the EOI at the tail. info.rfc2435 is set for
+     * baseline frames with the sampling layouts RFC 2435 can describe
+     * (YUV 4:2:2 / 4:2:0).
+     *
+     * @param fb Frame buffer to parse
+     * @param info Filled with the frame metadata
+     * @return true if the frame is a well-formed JPEG
+     */
+    static bool parseJpeg(const camera_fb_t *fb, JpegFrameInfo &info);
+
     /**
      * @brief Check if camera is initialized
      *
@@ -76,6 +136,22 @@ public:
      */
     static bool isInitialized();
 
+    /**
+     * @brief Put the sensor in (or out of) power-down standby
+     *
+     * Driven by the capture scheduler while nobody watches. The driver
+     * keeps its DMA buffers; frames captured before the standby must be
+     * discarded by timestamp after waking up.
+     *
+     * @param enable true to power the sensor down
+     */
+    static void setStandby(bool enable);
+
+    /**
+     * @brief Check if the sensor is in standby
+     */
+    static bool isStandby();
+
     /**
      * @brief Get camera information as string
      *
@@ -88,6 +164,13 @@ public:
 
 private:
     static bool initialized;
+    static bool standby;
+    static CameraFrameSource frameSource;
+
+    /**
+     * @brief Get the next frame from the active source (blocks like the driver)
+     */
+    static camera_fb_t *grabFrame();
 
     /**
      * @brief Configure advanced camera parameters
@@ -100,15 +183,14 @@ private:
     static void configureAdvancedSettings(sensor_t *sensor);
 
     /**
-     * @brief Add HLS metadata to JPEG frame for better compatibility
+     * @brief Fill info.app1 with a timestamp segment if the frame has none
      *
-     * Adds EXIF metadata to JPEG frames to improve HLS compatibility
-     * with FFmpeg and video players.
+     * The segment is a fixed template: only the DateTime digits change,
+     * and only when the second changes.
      *
-     * @param fb Pointer to camera frame buffer
-     * @return true if metadata added successfully, false otherwise
+     * @param info Metadata of the frame (hasApp1 already known)
      */
-    static bool addHLSMetadataToJPEG(camera_fb_t *fb);
+    static void prepareTimestampApp1(JpegFrameInfo &info);
 };
 
 #endif // CAMERA_MANAGER_H
@@ -0,0 +1,593 @@
+/**
+ * @file CapturePipeline.cpp
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief Implementation of the capture task and lock-free frame ring
+ */
+
+#include "CapturePipeline.h"
+#include "CameraManager.h"
+#include "AdaptiveBitrate.h"
+#include "MotionDetector.h"
+#include "../Utils/TimecodeManager.h"
+#include "../Utils/Logger.h"
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+#include <string.h>
+
+SharedFrame CapturePipeline::slots[CAPTURE_RING_SIZE];
+std::atomic<int> CapturePipeline::latestIndex[CAPTURE_STREAM_COUNT] = {{-1}, {-1}};
+std::atomic<uint32_t> CapturePipeline::demandMask(0);
+std::atomic<uint32_t> CapturePipeline::capturedFrames(0);
+std::atomic<uint32_t> CapturePipeline::droppedFrames(0);
+TaskHandle_t CapturePipeline::captureTask = nullptr;
+TaskHandle_t CapturePipeline::consumerTasks[CAPTURE_MAX_CONSUMER_TASKS] = {};
+uint8_t CapturePipeline::consumerTaskCount = 0;
+std::atomic<bool> CapturePipeline::frameRequested(false);
+std::atomic<uint8_t> CapturePipeline::rateLimit(0);
+SharedFrame CapturePipeline::cacheSlots[CAPTURE_CACHE_SLOTS];
+camera_fb_t CapturePipeline::cacheFb[CAPTURE_CACHE_SLOTS];
+uint8_t *CapturePipeline::cacheBuffers[CAPTURE_CACHE_SLOTS] = {};
+std::atomic<int> CapturePipeline::cacheIndex(-1);
+unsigned long CapturePipeline::lastCacheUpdate = 0;
+uint8_t CapturePipeline::sensorStream = CAPTURE_STREAM_MAIN;
+std::atomic<uint8_t> CapturePipeline::powerState(CAPTURE_STATE_WARM);
+uint32_t CapturePipeline::activeCpuMhz = 0;
+
+static const char *const powerStateNames[] = {"idle", "warm", "streaming"};
+
+// Driver timestamp of a frame (esp_timer clock)
+static inline int64_t frameMicros(const camera_fb_t *fb)
+{
+    return (int64_t)fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec;
+}
+
+// Single clock for all consumers: every viewer gets the same PTS per frame
+static TimecodeManager &pipelineClock = TimecodeManager::media();
+
+bool CapturePipeline::begin()
+{
+    if (captureTask)
+    {
+        return true;
+    }
+
+    for (int i = 0; i < CAPTURE_RING_SIZE; i++)
+    {
+        slots[i].fb = nullptr;
+        slots[i].captureTime = 0;
+        slots[i].captureMicros = 0;
+        slots[i].frameId = 0;
+        slots[i].refCount.store(0);
+        slots[i].cached = false;
+        slots[i].stream = CAPTURE_STREAM_MAIN;
+    }
+    allocateCache();
+    activeCpuMhz = getCpuFrequencyMhz();
+
+    pipelineClock.begin();
+
+    BaseType_t created = xTaskCreatePinnedToCore(captureTaskEntry, "capture",
+                                                 CAPTURE_TASK_STACK_SIZE, nullptr,
+                                                 CAPTURE_TASK_PRIORITY, &captureTask,
+                                                 CAPTURE_TASK_CORE);
+    if (created != pdPASS)
+    {
+        LOG_ERROR("Failed to create capture task");
+        captureTask = nullptr;
+        return false;
+    }
+
+    LOG_INFOF("Capture pipeline started on core %d - %d slots, %d FPS",
+              CAPTURE_TASK_CORE, CAPTURE_RING_SIZE, RTSP_FPS);
+    return true;
+}
+
+bool CapturePipeline::isRunning()
+{
+    return captureTask != nullptr;
+}
+
+void CapturePipeline::setDemand(uint32_t consumer, bool active)
+{
+    if (active)
+    {
+        // New demand wakes the capture task out of idle
+        uint32_t previous = demandMask.fetch_or(consumer);
+        if (!(previous & consumer) && captureTask)
+        {
+            xTaskNotifyGive(captureTask);
+        }
+    }
+    else
+    {
+        demandMask.fetch_and(~consumer);
+    }
+}
+
+CapturePowerState CapturePipeline::getPowerState()
+{
+    return (CapturePowerState)powerState.load(std::memory_order_relaxed);
+}
+
+bool CapturePipeline::registerConsumerTask(TaskHandle_t task)
+{
+    if (!task || consumerTaskCount >= CAPTURE_MAX_CONSUMER_TASKS)
+    {
+        return false;
+    }
+    consumerTasks[consumerTaskCount++] = task;
+    return true;
+}
+
+SharedFrame *CapturePipeline::acquireLatest(uint32_t afterFrameId, uint8_t stream)
+{
+    SharedFrame *frame = acquireFrom(slots, latestIndex[stream], CAPTURE_RING_SIZE);
+    if (frame && frame->frameId <= afterFrameId)
+    {
+        release(frame);
+        return nullptr;
+    }
+    return frame;
+}
+
+SharedFrame *CapturePipeline::acquireCached(uint32_t maxAgeMs)
+{
+    // The live frame when streaming, the PSRAM copy when idle
+    SharedFrame *frame = acquireFrom(slots, latestIndex[CAPTURE_STREAM_MAIN], CAPTURE_RING_SIZE);
+    SharedFrame *cached = acquireFrom(cacheSlots, cacheIndex, CAPTURE_CACHE_SLOTS);
+    if (cached && (!frame || cached->frameId > frame->frameId))
+    {
+        release(frame);
+        frame = cached;
+    }
+    else
+    {
+        release(cached);
+    }
+
+    if (frame && maxAgeMs && millis() - frame->captureTime > maxAgeMs)
+    {
+        release(frame);
+        frame = nullptr;
+    }
+    if (!frame)
+    {
+        requestFrame();
+    }
+    return frame;
+}
+
+void CapturePipeline::setRateLimit(uint8_t fps)
+{
+    rateLimit = fps >= RTSP_FPS ? 0 : fps;
+}
+
+void CapturePipeline::requestFrame()
+{
+    if (!frameRequested.exchange(true, std::memory_order_relaxed) && captureTask)
+    {
+        xTaskNotifyGive(captureTask);
+    }
+}
+
+SharedFrame *CapturePipeline::acquireFrom(SharedFrame *pool, std::atomic<int> &latest, int poolSize)
+{
+    for (int attempt = 0; attempt < poolSize; attempt++)
+    {
+        int index = latest.load(std::memory_order_acquire);
+        if (index < 0)
+        {
+            return nullptr;
+        }
+
+        // Take a reference only while the slot is alive (refCount > 0).
+        // A slot at zero may be refilled by the producer at any time.
+        SharedFrame *frame = &pool[index];
+        uint8_t refs = frame->refCount.load(std::memory_order_acquire);
+        bool acquired = false;
+        while (refs > 0)
+        {
+            if (frame->refCount.compare_exchange_weak(refs, refs + 1, std::memory_order_acq_rel))
+            {
+                acquired = true;
+                break;
+            }
+        }
+
+        if (acquired)
+        {
+            return frame;
+        }
+        // Slot recycled under us, re-read the latest index
+    }
+    return nullptr;
+}
+
+void CapturePipeline::retain(SharedFrame *frame)
+{
+    if (frame)
+    {
+        frame->refCount.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void CapturePipeline::release(SharedFrame *frame)
+{
+    if (!frame)
+    {
+        return;
+    }
+
+    // Read the buffer before dropping our reference: once the count hits
+    // zero the producer is free to refill the slot
+    camera_fb_t *fb = frame->fb;
+    bool cached = frame->cached;
+    if (frame->refCount.fetch_sub(1, std::memory_order_acq_rel) == 1 && !cached)
+    {
+        // CRITICAL: last holder gone, give the buffer back to the driver
+        CameraManager::releaseFrame(fb);
+    }
+}
+
+uint32_t CapturePipeline::getCapturedFrames()
+{
+    return capturedFrames.load();
+}
+
+uint32_t CapturePipeline::getDroppedFrames()
+{
+    return droppedFrames.load();
+}
+
+int CapturePipeline::findFreeSlot()
+{
+    // A published slot keeps its ring reference, so refCount alone tells
+    // whether it may be refilled
+    for (int i = 0; i < CAPTURE_RING_SIZE; i++)
+    {
+        if (slots[i].refCount.load(std::memory_order_acquire) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void CapturePipeline::publish(int index, uint8_t stream)
+{
+    // The ring's own reference moves from the previous latest to this one
+    int previous = latestIndex[stream].exchange(index, std::memory_order_acq_rel);
+    if (previous >= 0)
+    {
+        release(&slots[previous]);
+    }
+    notifyConsumers();
+}
+
+void CapturePipeline::notifyConsumers()
+{
+    for (uint8_t i = 0; i < consumerTaskCount; i++)
+    {
+        xTaskNotifyGive(consumerTasks[i]);
+    }
+}
+
+bool CapturePipeline::enterPowerState(CapturePowerState state)
+{
+    const CapturePowerState previous = getPowerState();
+    bool woke = false;
+    if (state == CAPTURE_STATE_IDLE)
+    {
+        // Nothing left in the ring holds a driver buffer (see retireLatest)
+        CameraManager::setStandby(true);
+        if (CAPTURE_IDLE_CPU_FREQ_MHZ && CAPTURE_IDLE_CPU_FREQ_MHZ < activeCpuMhz)
+        {
+            setCpuFrequencyMhz(CAPTURE_IDLE_CPU_FREQ_MHZ);
+        }
+    }
+    else if (previous == CAPTURE_STATE_IDLE)
+    {
+        if (getCpuFrequencyMhz() != activeCpuMhz)
+        {
+            setCpuFrequencyMhz(activeCpuMhz);
+        }
+        CameraManager::setStandby(false);
+        woke = true;
+    }
+
+    powerState.store(state, std::memory_order_relaxed);
+    LOG_INFOF("Capture %s -> %s", powerStateNames[previous], powerStateNames[state]);
+    notifyConsumers();
+    return woke;
+}
+
+void CapturePipeline::allocateCache()
+{
+    for (int i = 0; i < CAPTURE_CACHE_SLOTS; i++)
+    {
+        cacheSlots[i].fb = &cacheFb[i];
+        cacheSlots[i].frameId = 0;
+        cacheSlots[i].refCount.store(0);
+        cacheSlots[i].cached = true;
+#if CAPTURE_CACHE_ENABLED
+        if (!cacheBuffers[i])
+        {
+            cacheBuffers[i] = (uint8_t *)heap_caps_malloc(CAPTURE_CACHE_MAX_FRAME_SIZE, MALLOC_CAP_SPIRAM);
+        }
+        if (!cacheBuffers[i])
+        {
+            LOG_WARN("No PSRAM for the last-good frame cache, new viewers wait for a capture");
+            return;
+        }
+#endif
+    }
+}
+
+void CapturePipeline::updateCache(const SharedFrame &source)
+{
+    if (source.fb->len > CAPTURE_CACHE_MAX_FRAME_SIZE)
+    {
+        LOG_DEBUGF("Frame %lu too large for the cache (%d bytes)", source.frameId, source.fb->len);
+        return;
+    }
+
+    // Same rule as the ring: only refill a slot nobody holds
+    int latest = cacheIndex.load(std::memory_order_relaxed);
+    int index = -1;
+    for (int i = 0; i < CAPTURE_CACHE_SLOTS; i++)
+    {
+        if (i != latest && cacheBuffers[i] && cacheSlots[i].refCount.load(std::memory_order_acquire) == 0)
+        {
+            index = i;
+            break;
+        }
+    }
+    if (index < 0)
+    {
+        return;
+    }
+
+    SharedFrame &slot = cacheSlots[index];
+    memcpy(cacheBuffers[index], source.fb->buf, source.fb->len);
+    cacheFb[index] = *source.fb;
+    cacheFb[index].buf = cacheBuffers[index];
+    slot.timecode = source.timecode;
+    slot.captureTime = source.captureTime;
+    slot.captureMicros = source.captureMicros;
+    slot.frameId = source.frameId;
+    slot.jpeg = source.jpeg;
+    for (int t = 0; t < 2; t++)
+    {
+        // Quantization tables point into the frame: move them to the copy
+        if (slot.jpeg.qtables[t])
+        {
+            slot.jpeg.qtables[t] = cacheBuffers[index] + (source.jpeg.qtables[t] - source.fb->buf);
+        }
+    }
+    slot.refCount.store(1, std::memory_order_release); // Cache reference
+
+    int previous = cacheIndex.exchange(index, std::memory_order_acq_rel);
+    if (previous >= 0)
+    {
+        release(&cacheSlots[previous]);
+    }
+    lastCacheUpdate = millis();
+}
+
+void CapturePipeline::retireLatest(uint8_t stream)
+{
+    // Idle stream: hand the DMA buffer back, the main frame lives on in the cache
+    int previous = latestIndex[stream].exchange(-1, std::memory_order_acq_rel);
+    if (previous < 0)
+    {
+        return;
+    }
+
+    int cached = cacheIndex.load(std::memory_order_relaxed);
+    if (CAPTURE_CACHE_ENABLED && stream == CAPTURE_STREAM_MAIN &&
+        (cached < 0 || cacheSlots[cached].frameId != slots[previous].frameId))
+    {
+        updateCache(slots[previous]);
+    }
+    release(&slots[previous]);
+}
+
+bool CapturePipeline::applyStreamProfile(uint8_t stream)
+{
+    if (stream == CAPTURE_STREAM_MAIN)
+    {
+        // Sensor changes requested by the ABR controller land between frames
+        AdaptiveBitrate::applyPending();
+    }
+    if (stream == sensorStream)
+    {
+        return false;
+    }
+
+    sensor_t *sensor = esp_camera_sensor_get();
+    if (!sensor)
+    {
+        return false;
+    }
+    if (stream == CAPTURE_STREAM_SUB)
+    {
+        sensor->set_framesize(sensor, RTSP_SUBSTREAM_FRAME_SIZE);
+        sensor->set_quality(sensor, RTSP_SUBSTREAM_JPEG_QUALITY);
+    }
+    else
+    {
+        sensor->set_framesize(sensor, AdaptiveBitrate::getFrameSize());
+        sensor->set_quality(sensor, AdaptiveBitrate::getJpegQuality());
+    }
+    sensorStream = stream;
+    return true;
+}
+
+uint16_t CapturePipeline::expectedWidth(uint8_t stream)
+{
+    return resolution[stream == CAPTURE_STREAM_SUB ? RTSP_SUBSTREAM_FRAME_SIZE : AdaptiveBitrate::getFrameSize()].width;
+}
+
+void CapturePipeline::captureTaskEntry(void *arg)
+{
+    const TickType_t period = pdMS_TO_TICKS(1000 / RTSP_FPS);
+    TickType_t lastWake = xTaskGetTickCount();
+    uint32_t frameCounter[CAPTURE_STREAM_COUNT] = {};
+    uint32_t tick = 0;
+    uint32_t lastSubTick = 0;
+    unsigned long lastActivity = millis();
+    unsigned long lastWarmCapture = 0;
+    unsigned long lastLimited = 0;
+    int64_t wakeMicros = 0; // Driver frames older than this predate the last wake-up
+
+    for (;;)
+    {
+        vTaskDelayUntil(&lastWake, period);
+        tick++;
+
+        bool requested = frameRequested.exchange(false, std::memory_order_relaxed);
+        uint32_t demand = demandMask.load(std::memory_order_relaxed);
+        bool streamMain = demand & PIPELINE_MAIN_CONSUMERS;
+        bool wantSub = RTSP_SUBSTREAM_ENABLED && (demand & PIPELINE_CONSUMER_RTSP_SUB);
+
+        // Streaming while someone streams, warm while someone is about
+        // to, idle once nobody has shown up for CAPTURE_WARM_HOLD_MS
+        unsigned long now = millis();
+        bool active = streamMain || wantSub || (demand & PIPELINE_CONSUMER_WARM) || requested;
+        if (active)
+        {
+            lastActivity = now;
+        }
+        CapturePowerState state = CAPTURE_STATE_IDLE;
+        if (streamMain || wantSub)
+        {
+            state = CAPTURE_STATE_STREAMING;
+        }
+        else if (active || now - lastActivity < CAPTURE_WARM_HOLD_MS)
+        {
+            state = CAPTURE_STATE_WARM;
+        }
+
+        bool warmDue = state == CAPTURE_STATE_WARM && now - lastWarmCapture >= CAPTURE_WARM_INTERVAL_MS;
+        bool wantMain = streamMain || requested || warmDue;
+
+        // Retired even without the cache: a parked frame would keep its
+        // driver buffer through standby and come back stale on wake-up
+        if (!wantMain && latestIndex[CAPTURE_STREAM_MAIN].load(std::memory_order_relaxed) >= 0)
+        {
+            retireLatest(CAPTURE_STREAM_MAIN);
+        }
+        if (!wantSub && latestIndex[CAPTURE_STREAM_SUB].load(std::memory_order_relaxed) >= 0)
+        {
+            retireLatest(CAPTURE_STREAM_SUB);
+        }
+
+        if (state != getPowerState() && enterPowerState(state))
+        {
+            wakeMicros = esp_timer_get_time();
+        }
+        if (state == CAPTURE_STATE_IDLE)
+        {
+            // Parked until setDemand() or requestFrame(), then back on the tick grid
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            lastWake = xTaskGetTickCount();
+            continue;
+        }
+
+        // The substream borrows one tick every RTSP_FPS / RTSP_SUBSTREAM_FPS
+        bool subDue = wantSub && tick - lastSubTick >= RTSP_FPS / RTSP_SUBSTREAM_FPS;
+        if (!wantMain && !subDue)
+        {
+            continue;
+        }
+        const uint8_t stream = subDue ? CAPTURE_STREAM_SUB : CAPTURE_STREAM_MAIN;
+        if (subDue)
+        {
+            lastSubTick = tick;
+            if (requested)
+            {
+                frameRequested.store(true, std::memory_order_relaxed); // Next main tick
+            }
+        }
+
+        int index = findFreeSlot();
+        if (index < 0)
+        {
+            // Every slot is held by slow consumers: drop rather than block
+            droppedFrames.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        // Slot is at refCount 0 and not published: only this task touches it
+        SharedFrame &slot = slots[index];
+        bool switched = applyStreamProfile(stream) && CameraManager::getFrameSource() == CAMERA_SOURCE_LIVE;
+        camera_fb_t *fb = CameraManager::captureForced(&slot.jpeg);
+
+        // After a profile switch or a wake-up the driver may still hold
+        // frames exposed before it: skip them by SOF width and timestamp
+        // (test sources keep their own resolution whatever the profile)
+        for (int attempt = 0;
+             fb && ((switched && slot.jpeg.width != expectedWidth(stream)) || frameMicros(fb) < wakeMicros);
+             attempt++)
+        {
+            CameraManager::releaseFrame(fb);
+            fb = attempt < CAMERA_FB_COUNT ? CameraManager::captureForced(&slot.jpeg) : nullptr;
+        }
+        if (!fb)
+        {
+            droppedFrames.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        wakeMicros = 0;
+        if (stream == CAPTURE_STREAM_MAIN && state == CAPTURE_STATE_WARM)
+        {
+            lastWarmCapture = now;
+        }
+
+        // The PTS is the capture time itself, so every frame that never
+        // gets here (ring full, no buffer, gated, missed ticks) leaves its
+        // real gap: never a compressed timeline
+        const int64_t captureMicros = esp_timer_get_time();
+        RTSPTimecode_t timecode = pipelineClock.generateTimecode(captureMicros);
+        unsigned long captureTime = millis();
+        const uint8_t limit = rateLimit.load(std::memory_order_relaxed);
+        if (stream == CAPTURE_STREAM_MAIN && limit && !requested)
+        {
+            if (captureTime - lastLimited + 500 / RTSP_FPS < 1000 / limit)
+            {
+                CameraManager::releaseFrame(fb);
+                continue;
+            }
+            lastLimited = captureTime;
+        }
+        if (stream == CAPTURE_STREAM_MAIN &&
+            !MotionDetector::analyze(fb, slot.jpeg, captureTime, requested || state != CAPTURE_STATE_STREAMING))
+        {
+            CameraManager::releaseFrame(fb);
+            continue;
+        }
+
+        slot.fb = fb;
+        slot.timecode = timecode;
+        slot.captureTime = captureTime;
+        slot.captureMicros = (unsigned long)captureMicros; // Same instant as the PTS
+        slot.frameId = ++frameCounter[stream];
+        slot.stream = stream;
+        slot.refCount.store(1, std::memory_order_release); // Ring reference
+
+        publish(index, stream);
+        if (capturedFrames.fetch_add(1, std::memory_order_relaxed) == 0)
+        {
+            LOG_INFOF("First frame captured %lu ms after reset", slot.captureTime);
+        }
+
+        // Keep the last-good copy fresh without a memcpy on every frame
+        if (CAPTURE_CACHE_ENABLED && stream == CAPTURE_STREAM_MAIN && slot.jpeg.valid &&
+            (requested || state == CAPTURE_STATE_WARM || millis() - lastCacheUpdate >= CAPTURE_CACHE_REFRESH_MS))
+        {
+            updateCache(slot);
+        }
+    }
+}
@@ -0,0 +1,222 @@
+/**
+ * @file CapturePipeline.h
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief Dedicated capture task publishing frames into a lock-free ring
+ */
+
+#ifndef CAPTURE_PIPELINE_H
+#define CAPTURE_PIPELINE_H
+
+#include <esp_camera.h>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "CameraManager.h"
+#include "../../src/config.h"
+
+/**
+ * @brief Reference-counted view on a captured camera frame
+ *
+ * Every consumer receives the same SharedFrame for a given capture,
+ * so all viewers get identical pixels and the same PTS. The underlying
+ * camera buffer is returned to the driver only when the last holder
+ * releases it. Cached frames are PSRAM copies: releasing them never
+ * touches the driver.
+ */
+struct SharedFrame
+{
+    camera_fb_t *fb;                // Driver frame buffer
+    RTSPTimecode_t timecode;        // Timecode stamped once at capture
+    unsigned long captureTime;      // millis() at capture
+    unsigned long captureMicros;    // micros() at capture, the PTS instant (frame age metrics)
+    uint32_t frameId;               // Monotonic capture counter of its stream (0 = never filled)
+    uint8_t stream;                 // CAPTURE_STREAM_* profile it was captured with
+    JpegFrameInfo jpeg;             // JPEG layout, parsed once for every consumer
+    std::atomic<uint8_t> refCount;  // Active holders, including the ring itself
+    bool cached;                    // fb is a PSRAM copy owned by the last-good cache
+};
+
+// Consumer identifiers for capture demand
+#define PIPELINE_CONSUMER_RTSP (1 << 0)
+#define PIPELINE_CONSUMER_HTTP (1 << 1)
+#define PIPELINE_CONSUMER_RTSP_SUB (1 << 2)
+#define PIPELINE_CONSUMER_WARM (1 << 3) // Connected but not streaming: keep the sensor warm
+#define PIPELINE_CONSUMER_RECORDER (1 << 4)
+#define PIPELINE_MAIN_CONSUMERS (PIPELINE_CONSUMER_RTSP | PIPELINE_CONSUMER_HTTP | PIPELINE_CONSUMER_RECORDER)
+
+// Sensor profiles: main (CAMERA_FRAME_SIZE, ABR) and the low-resolution substream
+#define CAPTURE_STREAM_MAIN 0
+#define CAPTURE_STREAM_SUB 1
+#define CAPTURE_STREAM_COUNT 2
+
+/**
+ * @brief Power state of the capture scheduler
+ */
+enum CapturePowerState
+{
+    CAPTURE_STATE_IDLE = 0,  // Sensor in standby, CPU clock dropped, nothing captured
+    CAPTURE_STATE_WARM,      // Sensor awake, one frame per CAPTURE_WARM_INTERVAL_MS into the cache
+    CAPTURE_STATE_STREAMING  // Full rate for the consumers that declared demand
+};
+
+/**
+ * @brief Capture pipeline stage
+ *
+ * A single producer task, pinned to CAPTURE_TASK_CORE, owns
+ * esp_camera_fb_get() and publishes frames into a single-producer /
+ * multi-consumer ring of CAPTURE_RING_SIZE slots:
+ * - The ring keeps one reference on the latest frame only
+ * - Consumers grab the latest frame with acquireLatest() (never blocks)
+ * - If every slot is still held by slow consumers, the producer drops
+ *   the tick instead of waiting for them
+ * - Registered consumer tasks are notified on every new frame
+ *
+ * While the substream has demand, every tick that falls due at
+ * RTSP_SUBSTREAM_FPS switches the sensor to RTSP_SUBSTREAM_FRAME_SIZE for
+ * one capture (time multiplexing); each stream has its own latest frame.
+ *
+ * With CAPTURE_CACHE_ENABLED the last good frame is also copied, already
+ * parsed, into a small PSRAM cache. New viewers and snapshots are served
+ * from it at once, and the ring gives its camera buffer back to the
+ * driver as soon as nobody streams.
+ *
+ * Capture is demand driven (see CapturePowerState): streaming while a
+ * consumer declares demand, warm while a session is connected, a
+ * snapshot was asked for or a stream ended less than
+ * CAPTURE_WARM_HOLD_MS ago, idle otherwise. Registered tasks are also
+ * notified on every state change, so they can park while idle.
+ */
+class CapturePipeline
+{
+public:
+    /**
+     * @brief Start the capture task
+     *
+     * The camera must already be initialized with CameraManager::begin().
+     *
+     * @return true if the task was created
+     */
+    static bool begin();
+
+    /**
+     * @brief Check if the capture task is running
+     */
+    static bool isRunning();
+
+    /**
+     * @brief Declare whether a consumer currently needs frames
+     *
+     * The producer only touches the sensor while at least one consumer
+     * has declared demand.
+     *
+     * @param consumer PIPELINE_CONSUMER_* identifier
+     * @param active true while the consumer is streaming
+     */
+    static void setDemand(uint32_t consumer, bool active);
+
+    /**
+     * @brief Register a task to be notified (xTaskNotifyGive) on new frames
+     *
+     * @param task Handle of the consumer task
+     * @return false if all notification slots are used
+     */
+    static bool registerConsumerTask(TaskHandle_t task);
+
+    /**
+     * @brief Get the current power state of the capture scheduler
+     */
+    static CapturePowerState getPowerState();
+
+    /**
+     * @brief Grab the latest frame if it is newer than the given one
+     *
+     * Lock-free; the returned frame holds a reference owned by the caller
+     * that must be dropped with release().
+     *
+     * @param afterFrameId frameId of the last frame the caller processed
+     * @param stream CAPTURE_STREAM_* profile
+     * @return Retained frame, or nullptr if nothing newer is available
+     */
+    static SharedFrame *acquireLatest(uint32_t afterFrameId, uint8_t stream = CAPTURE_STREAM_MAIN);
+
+    /**
+     * @brief Grab the most recent good frame, live or cached
+     *
+     * Never touches the sensor. If nothing recent enough exists, one
+     * capture is requested on the next regular tick (see requestFrame()).
+     *
+     * @param maxAgeMs Oldest acceptable frame (0 = any age)
+     * @return Retained frame (drop with release()), or nullptr
+     */
+    static SharedFrame *acquireCached(uint32_t maxAgeMs);
+
+    /**
+     * @brief Ask for one capture on the next tick even without demand
+     *
+     * The frame lands in the ring and in the cache; the capture cadence
+     * is unchanged.
+     */
+    static void requestFrame();
+
+    /**
+     * @brief Publish at most this many main-stream frames per second
+     *
+     * Frames in between are captured and released. The PTS comes from
+     * the capture time, so the published ones carry the real gap.
+     *
+     * @param fps Cap (0 = RTSP_FPS, no cap)
+     */
+    static void setRateLimit(uint8_t fps);
+
+    /**
+     * @brief Add a reference to a frame already held by the caller
+     */
+    static void retain(SharedFrame *frame);
+
+    /**
+     * @brief Drop a reference; the camera buffer is returned on the last one
+     */
+    static void release(SharedFrame *frame);
+
+    // Statistics
+    static uint32_t getCapturedFrames();
+    static uint32_t getDroppedFrames();
+
+private:
+    static SharedFrame slots[CAPTURE_RING_SIZE];
+    static std::atomic<int> latestIndex[CAPTURE_STREAM_COUNT];
+    static std::atomic<uint32_t> demandMask;
+    static std::atomic<uint32_t> capturedFrames;
+    static std::atomic<uint32_t> droppedFrames;
+    static TaskHandle_t captureTask;
+    static TaskHandle_t consumerTasks[CAPTURE_MAX_CONSUMER_TASKS];
+    static uint8_t consumerTaskCount;
+    static std::atomic<bool> frameRequested;
+    static std::atomic<uint8_t> rateLimit;
+
+    // Last-good cache, written by the capture task only
+    static SharedFrame cacheSlots[CAPTURE_CACHE_SLOTS];
+    static camera_fb_t cacheFb[CAPTURE_CACHE_SLOTS];
+    static uint8_t *cacheBuffers[CAPTURE_CACHE_SLOTS];
+    static std::atomic<int> cacheIndex;
+    static unsigned long lastCacheUpdate;
+    static uint8_t sensorStream; // Profile the sensor is currently set to
+    static std::atomic<uint8_t> powerState;
+    static uint32_t activeCpuMhz; // CPU clock restored when leaving idle
+
+    static void captureTaskEntry(void *arg);
+    static int findFreeSlot();
+    static void publish(int index, uint8_t stream);
+    static void notifyConsumers();
+    static bool enterPowerState(CapturePowerState state);
+    static bool applyStreamProfile(uint8_t stream);
+    static uint16_t expectedWidth(uint8_t stream);
+    static SharedFrame *acquireFrom(SharedFrame *pool, std::atomic<int> &latest, int poolSize);
+    static void allocateCache();
+    static void updateCache(const SharedFrame &source);
+    static void retireLatest(uint8_t stream);
+};
+
+#endif // CAPTURE_PIPELINE_H
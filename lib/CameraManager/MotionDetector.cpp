@@ -0,0 +1,181 @@
+/**
+ * @file MotionDetector.cpp
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief Implementation of the scene change detector
+ */
+
+#include "MotionDetector.h"
+#include "../Utils/Logger.h"
+#include <string.h>
+
+static_assert(MOTION_GRID_CELLS >= 2 && MOTION_GRID_CELLS <= 255, "MOTION_GRID_CELLS must be 2..255");
+static_assert(MOTION_STATIC_FPS > 0 && MOTION_STATIC_FPS <= RTSP_FPS, "MOTION_STATIC_FPS must be 1..RTSP_FPS");
+
+std::atomic<bool> MotionDetector::staticScene(false);
+std::atomic<unsigned long> MotionDetector::lastMotion(0);
+std::atomic<uint32_t> MotionDetector::motionEvents(0);
+std::atomic<uint32_t> MotionDetector::gatedFrames(0);
+std::atomic<uint8_t> MotionDetector::changedCells(0);
+
+uint32_t MotionDetector::referenceCells[MOTION_GRID_CELLS];
+uint32_t MotionDetector::frameCells[MOTION_GRID_CELLS];
+uint8_t MotionDetector::referenceCellCount = 0;
+uint8_t MotionDetector::frameCellCount = 0;
+size_t MotionDetector::referenceLength = 0;
+uint16_t MotionDetector::referenceWidth = 0;
+uint16_t MotionDetector::referenceHeight = 0;
+uint32_t MotionDetector::referenceTables = 0;
+unsigned long MotionDetector::quietSince = 0;
+unsigned long MotionDetector::lastPublished = 0;
+
+bool MotionDetector::analyze(const camera_fb_t *fb, const JpegFrameInfo &jpeg, unsigned long now, bool force)
+{
+    if (!MOTION_DETECTION_ENABLED)
+    {
+        return true;
+    }
+
+    const bool motion = detect(fb, jpeg);
+    if (motion)
+    {
+        lastMotion = now ? now : 1; // 0 = never
+        quietSince = now;
+        if (staticScene.exchange(false))
+        {
+            motionEvents++;
+            LOG_DEBUGF("Motion: %u cells changed, back to %d fps", (unsigned)changedCells.load(), RTSP_FPS);
+        }
+    }
+    else if (!staticScene && now - quietSince >= MOTION_STATIC_HOLD_MS)
+    {
+        staticScene = true;
+        LOG_DEBUGF("Motion: scene static, publishing %d fps", MOTION_STATIC_FPS);
+    }
+
+    // Half a capture tick of tolerance keeps the floor on the tick grid
+    const bool due = now - lastPublished + 500 / RTSP_FPS >= 1000 / MOTION_STATIC_FPS;
+    const bool publish = force || !MOTION_GATING_ENABLED || !staticScene || due;
+    if (!publish)
+    {
+        gatedFrames++;
+        return false;
+    }
+
+    // Later frames are compared with what the consumers last received,
+    // so a slow change adds up until it counts
+    lastPublished = now;
+    memcpy(referenceCells, frameCells, sizeof(referenceCells));
+    referenceCellCount = frameCellCount;
+    referenceLength = fb->len;
+    referenceWidth = jpeg.width;
+    referenceHeight = jpeg.height;
+    referenceTables = tableChecksum(jpeg);
+    return true;
+}
+
+bool MotionDetector::detect(const camera_fb_t *fb, const JpegFrameInfo &jpeg)
+{
+    if (!jpeg.valid)
+    {
+        frameCellCount = 0;
+        changedCells = 0;
+        return false;
+    }
+
+    frameCellCount = measureCells(fb, jpeg, frameCells);
+
+    // New resolution or quality (ABR step): nothing to compare with yet
+    if (!referenceLength || jpeg.width != referenceWidth || jpeg.height != referenceHeight ||
+        frameCellCount != referenceCellCount || tableChecksum(jpeg) != referenceTables)
+    {
+        referenceLength = 0;
+        changedCells = 0;
+        return false;
+    }
+
+    if (frameCellCount < 2)
+    {
+        const size_t delta = fb->len > referenceLength ? fb->len - referenceLength : referenceLength - fb->len;
+        changedCells = 0;
+        return (uint64_t)delta * 100 > (uint64_t)referenceLength * MOTION_FRAME_DELTA_PERCENT;
+    }
+
+    // Flat areas compress to a few bytes: judge them against half the
+    // average cell so sensor noise there does not count as motion
+    uint32_t total = 0;
+    for (uint8_t i = 0; i < frameCellCount; i++)
+    {
+        total += referenceCells[i];
+    }
+    const uint32_t floor = max(total / frameCellCount / 2, (uint32_t)1);
+
+    uint8_t changed = 0;
+    for (uint8_t i = 0; i < frameCellCount; i++)
+    {
+        const uint32_t reference = referenceCells[i];
+        const uint32_t delta = frameCells[i] > reference ? frameCells[i] - reference : reference - frameCells[i];
+        if ((uint64_t)delta * 100 > (uint64_t)max(reference, floor) * MOTION_CELL_DELTA_PERCENT)
+        {
+            changed++;
+        }
+    }
+    changedCells = changed;
+    return changed >= MOTION_MIN_CHANGED_CELLS;
+}
+
+uint8_t MotionDetector::measureCells(const camera_fb_t *fb, const JpegFrameInfo &jpeg, uint32_t *cells)
+{
+    if (!jpeg.restartInterval || !jpeg.rfc2435 || !jpeg.scanLength)
+    {
+        return 0;
+    }
+
+    // MCUs are 16x8 (4:2:2) or 16x16 (4:2:0)
+    const uint16_t mcuHeight = jpeg.type == 1 ? 16 : 8;
+    const uint32_t mcus = (uint32_t)((jpeg.width + 15) / 16) * ((jpeg.height + mcuHeight - 1) / mcuHeight);
+    const uint32_t intervals = (mcus + jpeg.restartInterval - 1) / jpeg.restartInterval;
+    const uint32_t perCell = (intervals + MOTION_GRID_CELLS - 1) / MOTION_GRID_CELLS;
+    const uint8_t count = (intervals + perCell - 1) / perCell;
+    memset(cells, 0, count * sizeof(uint32_t));
+
+    // RSTn markers delimit the intervals; 0xFF00 is a stuffed data byte
+    const uint8_t *start = fb->buf + jpeg.scanOffset;
+    const uint8_t *end = start + jpeg.scanLength;
+    const uint8_t *p = start;
+    uint32_t interval = 0;
+    while (p + 1 < end)
+    {
+        const uint8_t *marker = (const uint8_t *)memchr(p, 0xFF, end - p - 1);
+        if (!marker)
+        {
+            break;
+        }
+        if ((marker[1] & 0xF8) == 0xD0)
+        {
+            cells[min(interval / perCell, (uint32_t)count - 1)] += marker - start;
+            interval++;
+            start = marker + 2;
+        }
+        p = marker + (marker[1] == 0xFF ? 1 : 2);
+    }
+    cells[min(interval / perCell, (uint32_t)count - 1)] += end - start;
+
+    // Markers missing or unexpected: fall back to the frame size
+    return interval + 1 == intervals ? count : 0;
+}
+
+uint32_t MotionDetector::tableChecksum(const JpegFrameInfo &jpeg)
+{
+    uint32_t sum = jpeg.qtableCount;
+    for (uint8_t i = 0; i < jpeg.qtableCount && i < 2; i++)
+    {
+        const uint8_t length = (jpeg.qtablePrecision & (1 << i)) ? 128 : 64;
+        for (uint8_t j = 0; j < length; j++)
+        {
+            sum = sum * 31 + jpeg.qtables[i][j];
+        }
+    }
+    return sum;
+}
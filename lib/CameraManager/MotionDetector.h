@@ -0,0 +1,77 @@
+/**
+ * @file MotionDetector.h
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief Scene change detector gating the published frame rate of static scenes
+ */
+
+#ifndef MOTION_DETECTOR_H
+#define MOTION_DETECTOR_H
+
+#include <esp_camera.h>
+#include <atomic>
+#include "CameraManager.h"
+#include "../../src/config.h"
+
+/**
+ * @brief Change detector and frame gate of the main stream
+ *
+ * The entropy-coded size of a JPEG region follows what is in it: each
+ * restart interval of a frame is a few MCU rows of the picture, and its
+ * byte count changes when something moves there. Intervals are summed
+ * into MOTION_GRID_CELLS cells and compared with the previous frame; a
+ * frame is "motion" when at least MOTION_MIN_CHANGED_CELLS cells moved by
+ * more than MOTION_CELL_DELTA_PERCENT. Without restart markers the whole
+ * frame size is compared instead. Finding the markers is a memchr() over
+ * the scan: no Huffman decoding.
+ *
+ * A new resolution or quantization table (ABR step) only resets the
+ * reference. analyze() runs in the capture task; the getters are safe
+ * from any task.
+ */
+class MotionDetector
+{
+public:
+    /**
+     * @brief Analyze a captured main-stream frame and decide if it is published
+     *
+     * @param fb Captured frame
+     * @param jpeg Its parsed layout
+     * @param now millis() at capture
+     * @param force Publish whatever the scene does (snapshot, warm capture)
+     * @return true if the frame goes to the consumers
+     */
+    static bool analyze(const camera_fb_t *fb, const JpegFrameInfo &jpeg, unsigned long now, bool force);
+
+    static bool isStatic() { return staticScene.load(); }
+    static unsigned long getLastMotion() { return lastMotion.load(); } // millis() of the last changed frame (0 = none)
+    static uint32_t getMotionEvents() { return motionEvents.load(); }  // Static to motion transitions
+    static uint32_t getGatedFrames() { return gatedFrames.load(); }    // Captured but not published
+    static uint8_t getChangedCells() { return changedCells.load(); }   // In the last analyzed frame
+
+private:
+    static std::atomic<bool> staticScene;
+    static std::atomic<unsigned long> lastMotion;
+    static std::atomic<uint32_t> motionEvents;
+    static std::atomic<uint32_t> gatedFrames;
+    static std::atomic<uint8_t> changedCells;
+
+    // Last published frame (the reference) and the one analyzed, capture task only
+    static uint32_t referenceCells[MOTION_GRID_CELLS];
+    static uint32_t frameCells[MOTION_GRID_CELLS];
+    static uint8_t referenceCellCount;
+    static uint8_t frameCellCount;
+    static size_t referenceLength; // 0 = no reference
+    static uint16_t referenceWidth;
+    static uint16_t referenceHeight;
+    static uint32_t referenceTables;
+    static unsigned long quietSince;
+    static unsigned long lastPublished;
+
+    static bool detect(const camera_fb_t *fb, const JpegFrameInfo &jpeg);
+    static uint8_t measureCells(const camera_fb_t *fb, const JpegFrameInfo &jpeg, uint32_t *cells);
+    static uint32_t tableChecksum(const JpegFrameInfo &jpeg);
+};
+
+#endif // MOTION_DETECTOR_H
@@ -0,0 +1,227 @@
+/**
+ * @file SyntheticJpeg.cpp
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief Implementation of the synthetic baseline JPEG encoder
+ */
+// SyntheticJpeg.cpp
+#include "SyntheticJpeg.h"
+#include <string.h>
+
+// Standard Huffman tables (ITU T.81 Annex K.3): code counts per length, then symbols
+static const uint8_t LUMA_DC_BITS[16] = {0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+static const uint8_t CHROMA_DC_BITS[16] = {0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0};
+static const uint8_t DC_VALUES[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+
+static const uint8_t LUMA_AC_BITS[16] = {0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7D};
+static const uint8_t LUMA_AC_VALUES[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xA1, 0x08, 0x23, 0x42, 0xB1, 0xC1, 0x15, 0x52, 0xD1, 0xF0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0A, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2A, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7,
+    0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3, 0xC4, 0xC5,
+    0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA, 0xE1, 0xE2,
+    0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8,
+    0xF9, 0xFA};
+
+static const uint8_t CHROMA_AC_BITS[16] = {0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77};
+static const uint8_t CHROMA_AC_VALUES[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+    0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xA1, 0xB1, 0xC1, 0x09, 0x23, 0x33, 0x52, 0xF0,
+    0x15, 0x62, 0x72, 0xD1, 0x0A, 0x16, 0x24, 0x34, 0xE1, 0x25, 0xF1, 0x17, 0x18, 0x19, 0x1A, 0x26,
+    0x27, 0x28, 0x29, 0x2A, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+    0x49, 0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A, 0xA2, 0xA3, 0xA4, 0xA5,
+    0xA6, 0xA7, 0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3,
+    0xC4, 0xC5, 0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA,
+    0xE2, 0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8,
+    0xF9, 0xFA};
+
+// Flat quantization: +/-1 coefficients come out as visible, even noise
+#define SYNTHETIC_LUMA_Q 12
+#define SYNTHETIC_CHROMA_Q 16
+
+// SOI + DQT (2 tables) + SOF0 + DHT (4 tables) + SOS
+#define SYNTHETIC_HEADER_SIZE (2 + (4 + 2 * 65) + 19 + (4 + 2 * 29 + 2 * 179) + 14)
+
+// Codes used from the tables above: DC category 0, AC run 0 / size 1, EOB
+#define LUMA_DC_ZERO_LEN 2 // 00
+#define LUMA_AC_ONE 0x0    // 00 + sign
+#define LUMA_EOB 0xA       // 1010
+#define LUMA_EOB_LEN 4
+#define CHROMA_DC_ZERO_LEN 2 // 00
+#define CHROMA_AC_ONE 0x1    // 01 + sign
+#define CHROMA_EOB 0x0       // 00
+#define CHROMA_EOB_LEN 2
+#define AC_ONE_LEN 3 // Code and sign bit, same length in both tables
+
+/**
+ * @brief MSB-first bit writer with JPEG 0xFF stuffing
+ */
+struct ScanWriter
+{
+    uint8_t *out;
+    size_t capacity;
+    size_t length;
+    uint32_t bits;
+    uint8_t count;
+    bool overflow;
+
+    void putByte(uint8_t b)
+    {
+        if (length + (b == 0xFF ? 2 : 1) > capacity)
+        {
+            overflow = true;
+            return;
+        }
+        out[length++] = b;
+        if (b == 0xFF)
+        {
+            out[length++] = 0x00;
+        }
+    }
+
+    void put(uint32_t code, uint8_t len)
+    {
+        bits = (bits << len) | code;
+        count += len;
+        while (count >= 8)
+        {
+            count -= 8;
+            putByte((bits >> count) & 0xFF);
+        }
+    }
+
+    void flush()
+    {
+        if (count)
+        {
+            put((1u << (8 - count)) - 1, 8 - count); // Pad with 1 bits
+        }
+    }
+};
+
+static size_t blockCount(uint16_t width, uint16_t height)
+{
+    // One 16x8 MCU = two luma blocks, one Cb and one Cr
+    return (size_t)((width + 15) / 16) * ((height + 7) / 8) * 4;
+}
+
+static size_t putSegmentHeader(uint8_t *p, uint8_t marker, size_t length)
+{
+    p[0] = 0xFF;
+    p[1] = marker;
+    p[2] = length >> 8;
+    p[3] = length & 0xFF;
+    return 4;
+}
+
+static size_t putHuffmanTable(uint8_t *p, uint8_t classId, const uint8_t *bits, const uint8_t *values, size_t count)
+{
+    p[0] = classId;
+    memcpy(p + 1, bits, 16);
+    memcpy(p + 17, values, count);
+    return 17 + count;
+}
+
+size_t SyntheticJpeg::minSize(uint16_t width, uint16_t height)
+{
+    const size_t bits = blockCount(width, height) / 4 *
+                        (2 * (LUMA_DC_ZERO_LEN + LUMA_EOB_LEN) + 2 * (CHROMA_DC_ZERO_LEN + CHROMA_EOB_LEN));
+    return SYNTHETIC_HEADER_SIZE + (bits + 7) / 8 + 2;
+}
+
+size_t SyntheticJpeg::maxSize(uint16_t width, uint16_t height)
+{
+    const size_t bits = blockCount(width, height) / 4 *
+                        (2 * LUMA_DC_ZERO_LEN + 2 * CHROMA_DC_ZERO_LEN + 4 * 63 * AC_ONE_LEN);
+    return SYNTHETIC_HEADER_SIZE + (bits + 7) / 8 + 2;
+}
+
+size_t SyntheticJpeg::encode(uint8_t *out, size_t capacity, uint16_t width, uint16_t height, size_t targetBytes,
+                             uint32_t seed)
+{
+    if (!out || capacity < SYNTHETIC_HEADER_SIZE + 2 || width == 0 || height == 0)
+    {
+        return 0;
+    }
+
+    uint8_t *p = out;
+    *p++ = 0xFF;
+    *p++ = 0xD8;
+
+    p += putSegmentHeader(p, 0xDB, 2 + 2 * 65);
+    for (uint8_t id = 0; id < 2; id++)
+    {
+        *p++ = id;
+        memset(p, id ? SYNTHETIC_CHROMA_Q : SYNTHETIC_LUMA_Q, 64);
+        p += 64;
+    }
+
+    // Baseline, 3 components: Y 2x1 (4:2:2), Cb and Cr 1x1 on table 1
+    p += putSegmentHeader(p, 0xC0, 17);
+    const uint8_t sof[] = {8, (uint8_t)(height >> 8), (uint8_t)height, (uint8_t)(width >> 8), (uint8_t)width, 3,
+                           1, 0x21, 0, 2, 0x11, 1, 3, 0x11, 1};
+    memcpy(p, sof, sizeof(sof));
+    p += sizeof(sof);
+
+    p += putSegmentHeader(p, 0xC4, 2 + 2 * 29 + 2 * 179);
+    p += putHuffmanTable(p, 0x00, LUMA_DC_BITS, DC_VALUES, sizeof(DC_VALUES));
+    p += putHuffmanTable(p, 0x10, LUMA_AC_BITS, LUMA_AC_VALUES, sizeof(LUMA_AC_VALUES));
+    p += putHuffmanTable(p, 0x01, CHROMA_DC_BITS, DC_VALUES, sizeof(DC_VALUES));
+    p += putHuffmanTable(p, 0x11, CHROMA_AC_BITS, CHROMA_AC_VALUES, sizeof(CHROMA_AC_VALUES));
+
+    p += putSegmentHeader(p, 0xDA, 12);
+    const uint8_t sos[] = {3, 1, 0x00, 2, 0x11, 3, 0x11, 0, 63, 0};
+    memcpy(p, sos, sizeof(sos));
+    p += sizeof(sos);
+
+    // Spread the coefficients that make up the wanted size over every block
+    const size_t blocks = blockCount(width, height);
+    const size_t floorBytes = minSize(width, height);
+    const size_t target = targetBytes < floorBytes ? floorBytes : targetBytes;
+    size_t coefficients = (target - floorBytes) * 8 / AC_ONE_LEN;
+    if (coefficients > blocks * 63)
+    {
+        coefficients = blocks * 63;
+    }
+    const size_t perBlock = coefficients / blocks;
+    const size_t extra = coefficients % blocks;
+
+    ScanWriter scan = {p, capacity - 2 - (size_t)(p - out), 0, 0, 0, false};
+    uint32_t state = seed ? seed : 1;
+    for (size_t block = 0; block < blocks && !scan.overflow; block++)
+    {
+        const bool luma = (block & 3) < 2;
+        const size_t k = perBlock + (block < extra ? 1 : 0);
+
+        scan.put(0, luma ? LUMA_DC_ZERO_LEN : CHROMA_DC_ZERO_LEN); // DC stays at mid-grey
+        for (size_t i = 0; i < k; i++)
+        {
+            // xorshift32: only the sign of each coefficient changes
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            scan.put(((luma ? LUMA_AC_ONE : CHROMA_AC_ONE) << 1) | (state & 1), AC_ONE_LEN);
+        }
+        if (k < 63)
+        {
+            scan.put(luma ? LUMA_EOB : CHROMA_EOB, luma ? LUMA_EOB_LEN : CHROMA_EOB_LEN);
+        }
+    }
+    scan.flush();
+    if (scan.overflow)
+    {
+        return 0;
+    }
+
+    p += scan.length;
+    *p++ = 0xFF;
+    *p++ = 0xD9;
+    return p - out;
+}
@@ -0,0 +1,49 @@
+/**
+ * @file SyntheticJpeg.h
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief Encoder of decodable baseline JPEG frames of a chosen size
+ */
+// SyntheticJpeg.h
+#ifndef SYNTHETIC_JPEG_H
+#define SYNTHETIC_JPEG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @class SyntheticJpeg
+ * @brief Builds baseline YUV 4:2:2 frames with the sensor's layout.
+ *
+ * The scan is real Huffman-coded data (standard Annex K tables): every
+ * block holds a run of +/-1 AC coefficients whose count is set so the
+ * file lands on the requested size. The result decodes everywhere as
+ * mid-grey noise, is RFC 2435 compatible like an OV2640 frame, and costs
+ * nothing to produce once it has been built.
+ */
+class SyntheticJpeg
+{
+public:
+    /**
+     * @brief Encode one frame
+     *
+     * @param out Output buffer
+     * @param capacity Output buffer size
+     * @param width Frame width
+     * @param height Frame height
+     * @param targetBytes Wanted file size, clamped to what the resolution can reach
+     * @param seed Seed of the coefficient signs (different seeds, different noise)
+     * @return File size, 0 if the buffer is too small
+     */
+    static size_t encode(uint8_t *out, size_t capacity, uint16_t width, uint16_t height, size_t targetBytes,
+                         uint32_t seed);
+
+    /**
+     * @brief Smallest and largest file a resolution can be encoded into
+     */
+    static size_t minSize(uint16_t width, uint16_t height);
+    static size_t maxSize(uint16_t width, uint16_t height);
+};
+
+#endif // SYNTHETIC_JPEG_H
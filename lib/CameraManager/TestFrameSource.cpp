@@ -0,0 +1,243 @@
+/**
+ * @file TestFrameSource.cpp
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief Implementation of the replay and synthetic frame sources
+ */
+// TestFrameSource.cpp
+#include "TestFrameSource.h"
+#include "SyntheticJpeg.h"
+#include "../Utils/Logger.h"
+#include <FS.h>
+#include <SPIFFS.h>
+#include <SD_MMC.h>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+TestFrameSource::LibraryFrame TestFrameSource::library[CAMERA_TEST_SOURCE_MAX_FRAMES];
+uint8_t TestFrameSource::frameCount = 0;
+CameraFrameSource TestFrameSource::source = CAMERA_SOURCE_LIVE;
+camera_fb_t TestFrameSource::pool[CAMERA_FB_COUNT];
+std::atomic<uint32_t> TestFrameSource::poolBusy(0);
+uint32_t TestFrameSource::delivered = 0;
+int64_t TestFrameSource::nextFrameMicros = 0;
+
+bool TestFrameSource::begin(CameraFrameSource mode)
+{
+    source = mode;
+    bool loaded = mode == CAMERA_SOURCE_REPLAY ? loadReplay() : generateSynthetic();
+    if (!loaded || frameCount == 0)
+    {
+        LOG_ERROR("Test frame source has no frames");
+        return false;
+    }
+
+    size_t total = 0;
+    for (uint8_t i = 0; i < frameCount; i++)
+    {
+        total += library[i].length;
+    }
+    LOG_INFOF("Test frame source ready: %s, %d frames (%u KB PSRAM), %d fps",
+              mode == CAMERA_SOURCE_REPLAY ? "replay" : "synthetic", frameCount, (unsigned)(total / 1024),
+              CAMERA_TEST_SOURCE_FPS);
+    return true;
+}
+
+camera_fb_t *TestFrameSource::grab()
+{
+    // Frames "arrive" at a fixed cadence, like VSYNC: a late caller gets
+    // one at once, an early one waits for the next tick
+    const int64_t period = 1000000 / CAMERA_TEST_SOURCE_FPS;
+    int64_t now = esp_timer_get_time();
+    if (now < nextFrameMicros)
+    {
+        vTaskDelay(pdMS_TO_TICKS((nextFrameMicros - now + 999) / 1000));
+        now = esp_timer_get_time();
+    }
+    nextFrameMicros = (now > nextFrameMicros + period ? now : nextFrameMicros) + period;
+
+    uint32_t busy = poolBusy.load(std::memory_order_acquire);
+    int index;
+    do
+    {
+        index = -1;
+        for (int i = 0; i < CAMERA_FB_COUNT; i++)
+        {
+            if (!(busy & (1u << i)))
+            {
+                index = i;
+                break;
+            }
+        }
+        if (index < 0)
+        {
+            return nullptr; // Every descriptor held, as the driver would time out
+        }
+    } while (!poolBusy.compare_exchange_weak(busy, busy | (1u << index), std::memory_order_acq_rel));
+
+    const LibraryFrame &frame = library[pickFrame()];
+    camera_fb_t *fb = &pool[index];
+    fb->buf = frame.data;
+    fb->len = frame.length;
+    fb->width = frame.width;
+    fb->height = frame.height;
+    fb->format = PIXFORMAT_JPEG;
+    fb->timestamp.tv_sec = now / 1000000;
+    fb->timestamp.tv_usec = now % 1000000;
+    delivered++;
+    return fb;
+}
+
+bool TestFrameSource::owns(const camera_fb_t *fb)
+{
+    return fb >= pool && fb < pool + CAMERA_FB_COUNT;
+}
+
+void TestFrameSource::release(camera_fb_t *fb)
+{
+    if (owns(fb))
+    {
+        poolBusy.fetch_and(~(1u << (fb - pool)), std::memory_order_release);
+    }
+}
+
+uint8_t TestFrameSource::pickFrame()
+{
+    if (source == CAMERA_SOURCE_REPLAY || frameCount == 1)
+    {
+        return delivered % frameCount; // Recorded order, looped
+    }
+
+    // Synthetic variants are sorted by size, smallest first
+    switch (CAMERA_SYNTHETIC_DISTRIBUTION)
+    {
+    case 1:
+    {
+        uint32_t step = delivered % (2 * (frameCount - 1));
+        return step < frameCount ? step : 2 * (frameCount - 1) - step;
+    }
+    case 2:
+        return (delivered + 1) % CAMERA_SYNTHETIC_SPIKE_INTERVAL == 0 ? frameCount - 1 : 0;
+    default:
+        return esp_random() % frameCount;
+    }
+}
+
+bool TestFrameSource::storeFrame(uint8_t *data, size_t length)
+{
+    camera_fb_t fb = {};
+    fb.buf = data;
+    fb.len = length;
+    JpegFrameInfo info;
+    if (!CameraManager::parseJpeg(&fb, info) || frameCount >= CAMERA_TEST_SOURCE_MAX_FRAMES)
+    {
+        heap_caps_free(data);
+        return false;
+    }
+
+    LibraryFrame &frame = library[frameCount++];
+    frame.data = data;
+    frame.length = length;
+    frame.width = info.width;
+    frame.height = info.height;
+    return true;
+}
+
+bool TestFrameSource::loadReplay()
+{
+#if CAMERA_REPLAY_STORAGE == 1
+    fs::FS &storage = SD_MMC;
+    if (!SD_MMC.begin("/sdcard", true))
+    {
+        LOG_ERROR("Replay source: SD card not mounted");
+        return false;
+    }
+#else
+    fs::FS &storage = SPIFFS;
+    if (!SPIFFS.begin(false))
+    {
+        LOG_ERROR("Replay source: SPIFFS partition not mounted");
+        return false;
+    }
+#endif
+
+    File dir = storage.open(CAMERA_REPLAY_DIR);
+    if (!dir || !dir.isDirectory())
+    {
+        LOG_ERRORF("Replay source: %s not found", CAMERA_REPLAY_DIR);
+        return false;
+    }
+
+    for (File file = dir.openNextFile(); file && frameCount < CAMERA_TEST_SOURCE_MAX_FRAMES;
+         file = dir.openNextFile())
+    {
+        const size_t length = file.size();
+        if (file.isDirectory() || length < 6 || length > CAMERA_REPLAY_MAX_FRAME_SIZE)
+        {
+            continue;
+        }
+
+        uint8_t *data = (uint8_t *)heap_caps_malloc(length, MALLOC_CAP_SPIRAM);
+        if (!data)
+        {
+            LOG_WARNF("Replay source: PSRAM full after %d frames", frameCount);
+            break;
+        }
+        if (file.read(data, length) != length)
+        {
+            LOG_WARNF("Replay source: read error on %s", file.name());
+            heap_caps_free(data);
+            continue;
+        }
+        if (!storeFrame(data, length))
+        {
+            LOG_WARNF("Replay source: skipped %s (not a valid JPEG)", file.name());
+        }
+    }
+    return frameCount > 0;
+}
+
+bool TestFrameSource::generateSynthetic()
+{
+    const uint16_t width = resolution[CAMERA_FRAME_SIZE].width;
+    const uint16_t height = resolution[CAMERA_FRAME_SIZE].height;
+    const size_t floorBytes = SyntheticJpeg::minSize(width, height);
+    const size_t ceilBytes = SyntheticJpeg::maxSize(width, height);
+    size_t low = CAMERA_SYNTHETIC_MIN_BYTES < floorBytes ? floorBytes : CAMERA_SYNTHETIC_MIN_BYTES;
+    size_t high = CAMERA_SYNTHETIC_MAX_BYTES > ceilBytes ? ceilBytes : CAMERA_SYNTHETIC_MAX_BYTES;
+    if (high < low)
+    {
+        high = low;
+    }
+    if (low != CAMERA_SYNTHETIC_MIN_BYTES || high != CAMERA_SYNTHETIC_MAX_BYTES)
+    {
+        LOG_WARNF("Synthetic source: %dx%d frames can only be %u-%u bytes", width, height,
+                  (unsigned)floorBytes, (unsigned)ceilBytes);
+    }
+
+    // Evenly spaced variants, smallest first (pickFrame() relies on the order)
+    const uint8_t variants = low == high ? 1 : CAMERA_TEST_SOURCE_MAX_FRAMES;
+    for (uint8_t i = 0; i < variants; i++)
+    {
+        const size_t target = variants == 1 ? low : low + (high - low) * i / (variants - 1);
+        uint8_t *data = (uint8_t *)heap_caps_malloc(target + 16, MALLOC_CAP_SPIRAM);
+        if (!data)
+        {
+            LOG_WARNF("Synthetic source: PSRAM full after %d frames", frameCount);
+            break;
+        }
+        size_t length = SyntheticJpeg::encode(data, target + 16, width, height, target, esp_random());
+        if (length == 0 || !storeFrame(data, length))
+        {
+            LOG_WARNF("Synthetic source: could not encode a %u byte frame", (unsigned)target);
+            if (length == 0)
+            {
+                heap_caps_free(data);
+            }
+        }
+    }
+    return frameCount > 0;
+}
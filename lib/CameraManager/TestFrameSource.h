@@ -0,0 +1,87 @@
+/**
+ * @file TestFrameSource.h
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief Replay and synthetic frame sources for on-device load testing
+ */
+// TestFrameSource.h
+#ifndef TEST_FRAME_SOURCE_H
+#define TEST_FRAME_SOURCE_H
+
+#include <esp_camera.h>
+#include <atomic>
+#include "CameraManager.h"
+#include "../../src/config.h"
+
+/**
+ * @class TestFrameSource
+ * @brief Stands in for the sensor with frames that are already in PSRAM.
+ *
+ * begin() fills a library of up to CAMERA_TEST_SOURCE_MAX_FRAMES JPEGs,
+ * either the files in CAMERA_REPLAY_DIR or SyntheticJpeg variants spread
+ * over the configured size range. grab() then behaves like
+ * esp_camera_fb_get(): it waits for the next CAMERA_TEST_SOURCE_FPS tick
+ * and hands out one of CAMERA_FB_COUNT frame buffer descriptors, pointing
+ * straight at the library frame (nothing is copied). A descriptor stays
+ * busy until release(), so slow consumers starve the source exactly as
+ * they would starve the driver. Frames are never generated on the fly:
+ * a test run measures the servers, not the source.
+ */
+class TestFrameSource
+{
+public:
+    /**
+     * @brief Build the frame library for a source
+     *
+     * @param source CAMERA_SOURCE_REPLAY or CAMERA_SOURCE_SYNTHETIC
+     * @return false if no usable frame could be loaded
+     */
+    static bool begin(CameraFrameSource source);
+
+    /**
+     * @brief Wait for the next frame tick and return the next frame
+     *
+     * @return Frame buffer, or nullptr if every descriptor is still held
+     */
+    static camera_fb_t *grab();
+
+    /**
+     * @brief Check if a frame buffer was handed out by grab()
+     */
+    static bool owns(const camera_fb_t *fb);
+
+    /**
+     * @brief Give a descriptor back (safe from any task)
+     */
+    static void release(camera_fb_t *fb);
+
+    /**
+     * @brief Number of frames in the library
+     */
+    static uint8_t getFrameCount() { return frameCount; }
+
+private:
+    struct LibraryFrame
+    {
+        uint8_t *data; // PSRAM, owned by the library
+        size_t length;
+        uint16_t width;
+        uint16_t height;
+    };
+
+    static LibraryFrame library[CAMERA_TEST_SOURCE_MAX_FRAMES];
+    static uint8_t frameCount;
+    static CameraFrameSource source;
+    static camera_fb_t pool[CAMERA_FB_COUNT];
+    static std::atomic<uint32_t> poolBusy; // Bit n set = pool[n] handed out
+    static uint32_t delivered;
+    static int64_t nextFrameMicros;
+
+    static bool loadReplay();
+    static bool generateSynthetic();
+    static bool storeFrame(uint8_t *data, size_t length);
+    static uint8_t pickFrame();
+};
+
+#endif // TEST_FRAME_SOURCE_H
@@ -11,11 +11,45 @@
 #include <esp_camera.h>
 #include "HTTPMJPEGServer.h"
 #include <Arduino.h>
+#include <errno.h>
+#include <lwip/sockets.h>
+#include <esp_heap_caps.h>
 #include "../Utils/Logger.h"
-#include "../CameraManager/CameraManager.h"
+#include "../Utils/Metrics.h"
+#include "../Utils/Helpers.h"
+#include "../CameraManager/AdaptiveBitrate.h"
+#include "../CameraManager/MotionDetector.h"
+#include "../Nano-RTSP/AdmissionControl.h"
+#include "../Recorder/SDRecorder.h"
+
+// Response header, written once per viewer
+static const char MJPEG_RESPONSE_HEADER[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: multipart/x-mixed-replace; boundary=frame\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+
+// Fixed part of every multipart header, only Content-Length changes
+static const char MJPEG_PART_PREFIX[] = "--frame\r\nContent-Type: image/jpeg\r\nContent-Length: ";
+static const char MJPEG_PART_TRAILER[] = "\r\n";
+
+// Snapshot response, Content-Length appended per frame
+static const char SNAPSHOT_RESPONSE_PREFIX[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: image/jpeg\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Connection: close\r\n"
+    "Content-Length: ";
+static const char SNAPSHOT_TIMEOUT_RESPONSE[] =
+    "HTTP/1.1 503 Service Unavailable\r\n"
+    "Retry-After: 1\r\n"
+    "Connection: close\r\n"
+    "Content-Length: 0\r\n"
+    "\r\n";
 
 HTTPMJPEGServer::HTTPMJPEGServer(int port)
-    : server(port), listenPort(port), captureCb(nullptr) {}
+    : server(port), listenPort(port), captureCb(nullptr), clientCount(0), streamCount(0) {}
 
 void HTTPMJPEGServer::setCaptureCallback(CaptureCallback cb)
 {
@@ -26,6 +60,12 @@ void HTTPMJPEGServer::begin()
 {
     server.on(HTTP_MJPEG_PATH, HTTP_GET, [this]()
               { handleMJPEG(); });
+    server.on(HTTP_SNAPSHOT_PATH, HTTP_GET, [this]()
+              { handleSnapshot(); });
+#if METRICS_ENABLED
+    server.on(HTTP_METRICS_PATH, HTTP_GET, [this]()
+              { handleMetrics(); });
+#endif
     server.begin();
     LOG_INFOF("HTTP MJPEG server started on port %d", listenPort);
 }
@@ -33,35 +73,336 @@ void HTTPMJPEGServer::begin()
 void HTTPMJPEGServer::handleClient()
 {
     server.handleClient();
+    pumpClients();
 }
 
 void HTTPMJPEGServer::handleMJPEG()
 {
-    if (!captureCb)
+    if (!CapturePipeline::isRunning() && !captureCb)
     {
         server.send(500, "text/plain", "Error: capture callback not defined");
         LOG_ERROR("Capture callback not defined for MJPEG");
         return;
     }
-    server.setContentLength(CONTENT_LENGTH_UNKNOWN);
-    server.send(200, "multipart/x-mixed-replace; boundary=frame");
-    while (server.client().connected())
+
+    if (clientCount >= HTTP_MJPEG_MAX_CLIENTS)
+    {
+        server.send(503, "text/plain", "Too many MJPEG viewers");
+        LOG_WARN("Maximum number of MJPEG clients reached, connection refused");
+        return;
+    }
+
+    // Take the socket over from WebServer: the response is written by hand
+    // so the server never starts (and later terminates) a chunked reply
+    MJPEGClient &viewer = clients[clientCount];
+    viewer = MJPEGClient();
+    viewer.client = server.client();
+    viewer.client.setNoDelay(true);
+    Helpers::setSocketDscp(viewer.client.fd(), HTTP_MJPEG_DSCP);
+    viewer.client.write((const uint8_t *)MJPEG_RESPONSE_HEADER, sizeof(MJPEG_RESPONSE_HEADER) - 1);
+    clientCount++;
+    streamCount++;
+
+    if (CapturePipeline::isRunning())
+    {
+        CapturePipeline::setDemand(PIPELINE_CONSUMER_HTTP, true);
+    }
+    LOG_INFOF("MJPEG client connected from %s (%d streaming)",
+              viewer.client.remoteIP().toString().c_str(), streamCount);
+}
+
+void HTTPMJPEGServer::handleSnapshot()
+{
+    if (!CapturePipeline::isRunning() && !captureCb)
+    {
+        server.send(500, "text/plain", "Error: capture callback not defined");
+        return;
+    }
+
+    if (clientCount >= HTTP_MJPEG_MAX_CLIENTS)
+    {
+        server.send(503, "text/plain", "Too many HTTP clients");
+        LOG_WARN("No client slot left for snapshot, request refused");
+        return;
+    }
+
+    // Answered from pumpClients() once a recent enough frame is available,
+    // usually right away from the cache
+    MJPEGClient &viewer = clients[clientCount];
+    viewer = MJPEGClient();
+    viewer.client = server.client();
+    viewer.client.setNoDelay(true);
+    Helpers::setSocketDscp(viewer.client.fd(), HTTP_MJPEG_DSCP);
+    viewer.snapshot = true;
+    viewer.requestTime = millis();
+    clientCount++;
+    LOG_DEBUGF("Snapshot requested from %s", viewer.client.remoteIP().toString().c_str());
+}
+
+void HTTPMJPEGServer::handleMetrics()
+{
+    // Rendered in place: no String growth on a scrape
+    static char body[METRICS_BUFFER_SIZE];
+    size_t length = Metrics::render(body, sizeof(body));
+
+    Metrics::appendLine(body, sizeof(body), length, "# TYPE esp32cam_frames_captured_total counter\n");
+    Metrics::appendLine(body, sizeof(body), length, "esp32cam_frames_captured_total %lu\n",
+                        (unsigned long)CapturePipeline::getCapturedFrames());
+    Metrics::appendLine(body, sizeof(body), length, "# TYPE esp32cam_frames_dropped_total counter\n");
+    Metrics::appendLine(body, sizeof(body), length, "esp32cam_frames_dropped_total %lu\n",
+                        (unsigned long)CapturePipeline::getDroppedFrames());
+    Metrics::appendLine(body, sizeof(body), length, "# TYPE esp32cam_capture_state gauge\n");
+    Metrics::appendLine(body, sizeof(body), length, "esp32cam_capture_state %d\n", (int)CapturePipeline::getPowerState());
+    Metrics::appendLine(body, sizeof(body), length, "# TYPE esp32cam_frame_source gauge\n");
+    Metrics::appendLine(body, sizeof(body), length, "esp32cam_frame_source %d\n", (int)CameraManager::getFrameSource());
+    Metrics::appendLine(body, sizeof(body), length, "# TYPE esp32cam_abr_level gauge\n");
+    Metrics::appendLine(body, sizeof(body), length, "esp32cam_abr_level %d\n", AdaptiveBitrate::getLevel());
+    Metrics::appendLine(body, sizeof(body), length, "# TYPE esp32cam_motion_static gauge\n");
+    Metrics::appendLine(body, sizeof(body), length, "esp32cam_motion_static %d\n", MotionDetector::isStatic() ? 1 : 0);
+    Metrics::appendLine(body, sizeof(body), length, "# TYPE esp32cam_motion_changed_cells gauge\n");
+    Metrics::appendLine(body, sizeof(body), length, "esp32cam_motion_changed_cells %u\n",
+                        (unsigned)MotionDetector::getChangedCells());
+    Metrics::appendLine(body, sizeof(body), length, "# TYPE esp32cam_motion_events_total counter\n");
+    Metrics::appendLine(body, sizeof(body), length, "esp32cam_motion_events_total %lu\n",
+                        (unsigned long)MotionDetector::getMotionEvents());
+    Metrics::appendLine(body, sizeof(body), length, "# TYPE esp32cam_frames_gated_total counter\n");
+    Metrics::appendLine(body, sizeof(body), length, "esp32cam_frames_gated_total %lu\n",
+                        (unsigned long)MotionDetector::getGatedFrames());
+    Metrics::appendLine(body, sizeof(body), length, "# TYPE esp32cam_motion_last_age_seconds gauge\n");
+    Metrics::appendLine(body, sizeof(body), length, "esp32cam_motion_last_age_seconds %ld\n",
+                        MotionDetector::getLastMotion() ? (long)((millis() - MotionDetector::getLastMotion()) / 1000) : -1L);
+    Metrics::appendLine(body, sizeof(body), length, "# TYPE esp32cam_rtsp_max_clients gauge\n");
+    Metrics::appendLine(body, sizeof(body), length, "esp32cam_rtsp_max_clients %d\n", RTSP_MAX_CLIENTS);
+    Metrics::appendLine(body, sizeof(body), length, "# TYPE esp32cam_rtsp_admission_capacity_bytes gauge\n");
+    Metrics::appendLine(body, sizeof(body), length, "esp32cam_rtsp_admission_capacity_bytes %lu\n",
+                        (unsigned long)AdmissionControl::getCapacity());
+    Metrics::appendLine(body, sizeof(body), length, "# TYPE esp32cam_rtsp_admission_committed_bytes gauge\n");
+    Metrics::appendLine(body, sizeof(body), length, "esp32cam_rtsp_admission_committed_bytes %lu\n",
+                        (unsigned long)AdmissionControl::getCommitted());
+    Metrics::appendLine(body, sizeof(body), length, "# TYPE esp32cam_rtsp_admission_rejected_total counter\n");
+    Metrics::appendLine(body, sizeof(body), length, "esp32cam_rtsp_admission_rejected_total %lu\n",
+                        (unsigned long)AdmissionControl::getRejected());
+    Metrics::appendLine(body, sizeof(body), length, "# TYPE esp32cam_http_mjpeg_clients gauge\n");
+    Metrics::appendLine(body, sizeof(body), length, "esp32cam_http_mjpeg_clients %u\n", streamCount);
+    Metrics::appendLine(body, sizeof(body), length, "# TYPE esp32cam_log_dropped_total counter\n");
+    Metrics::appendLine(body, sizeof(body), length, "esp32cam_log_dropped_total %lu\n",
+                        (unsigned long)Logger::getDroppedCount());
+    Metrics::appendLine(body, sizeof(body), length, "# TYPE esp32cam_heap_free_bytes gauge\n");
+    Metrics::appendLine(body, sizeof(body), length, "esp32cam_heap_free_bytes %lu\n",
+                        (unsigned long)ESP.getFreeHeap());
+    // High-water marks: fragmentation shows up as a shrinking largest block
+    Metrics::appendLine(body, sizeof(body), length, "# TYPE esp32cam_heap_min_free_bytes gauge\n");
+    Metrics::appendLine(body, sizeof(body), length, "esp32cam_heap_min_free_bytes{region=\"internal\"} %lu\n",
+                        (unsigned long)heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL));
+    Metrics::appendLine(body, sizeof(body), length, "esp32cam_heap_min_free_bytes{region=\"psram\"} %lu\n",
+                        (unsigned long)heap_caps_get_minimum_free_size(MALLOC_CAP_SPIRAM));
+    Metrics::appendLine(body, sizeof(body), length, "# TYPE esp32cam_heap_largest_free_block_bytes gauge\n");
+    Metrics::appendLine(body, sizeof(body), length, "esp32cam_heap_largest_free_block_bytes{region=\"internal\"} %lu\n",
+                        (unsigned long)heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL));
+    Metrics::appendLine(body, sizeof(body), length, "esp32cam_heap_largest_free_block_bytes{region=\"psram\"} %lu\n",
+                        (unsigned long)heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM));
+    Metrics::appendLine(body, sizeof(body), length, "# TYPE esp32cam_recorder_state gauge\n");
+    Metrics::appendLine(body, sizeof(body), length, "esp32cam_recorder_state %d\n", (int)SDRecorder::getState());
+    Metrics::appendLine(body, sizeof(body), length, "# TYPE esp32cam_recorder_frames_total counter\n");
+    Metrics::appendLine(body, sizeof(body), length, "esp32cam_recorder_frames_total %lu\n",
+                        (unsigned long)SDRecorder::getRecordedFrames());
+    Metrics::appendLine(body, sizeof(body), length, "# TYPE esp32cam_recorder_frames_dropped_total counter\n");
+    Metrics::appendLine(body, sizeof(body), length, "esp32cam_recorder_frames_dropped_total %lu\n",
+                        (unsigned long)SDRecorder::getDroppedFrames());
+    Metrics::appendLine(body, sizeof(body), length, "# TYPE esp32cam_recorder_segments_total counter\n");
+    Metrics::appendLine(body, sizeof(body), length, "esp32cam_recorder_segments_total %lu\n",
+                        (unsigned long)SDRecorder::getSegments());
+    Metrics::appendLine(body, sizeof(body), length, "# TYPE esp32cam_recorder_write_errors_total counter\n");
+    Metrics::appendLine(body, sizeof(body), length, "esp32cam_recorder_write_errors_total %lu\n",
+                        (unsigned long)SDRecorder::getWriteErrors());
+    Metrics::appendLine(body, sizeof(body), length, "# TYPE esp32cam_recorder_written_bytes_total counter\n");
+    Metrics::appendLine(body, sizeof(body), length, "esp32cam_recorder_written_bytes_total %llu\n",
+                        (unsigned long long)SDRecorder::getBytesWritten());
+
+    if (length >= sizeof(body))
+    {
+        LOG_WARN("Metrics output truncated, increase METRICS_BUFFER_SIZE");
+    }
+    server.send(200, "text/plain; version=0.0.4", body);
+}
+
+void HTTPMJPEGServer::pumpClients()
+{
+    for (uint8_t i = 0; i < clientCount;)
+    {
+        MJPEGClient &viewer = clients[i];
+        if (!viewer.client.connected())
+        {
+            removeClient(i);
+            continue;
+        }
+
+        if (viewer.partLength == 0 && !startPart(viewer))
+        {
+            if (viewer.snapshot && millis() - viewer.requestTime >= HTTP_SNAPSHOT_TIMEOUT_MS)
+            {
+                LOG_WARN("No frame for snapshot in time");
+                viewer.client.write((const uint8_t *)SNAPSHOT_TIMEOUT_RESPONSE, sizeof(SNAPSHOT_TIMEOUT_RESPONSE) - 1);
+                removeClient(i);
+                continue;
+            }
+            i++; // No new frame for this viewer yet
+            continue;
+        }
+
+        if (!writePart(viewer))
+        {
+            removeClient(i);
+            continue;
+        }
+        if (viewer.snapshot && viewer.partLength == 0)
+        {
+            removeClient(i); // Single JPEG fully written
+            continue;
+        }
+        i++;
+    }
+}
+
+bool HTTPMJPEGServer::startPart(MJPEGClient &viewer)
+{
+    camera_fb_t *fb = nullptr;
+    size_t app1Length = 0;
+
+    if (CapturePipeline::isRunning())
+    {
+        // Latest shared frame only: a slow viewer skips frames, never lags.
+        // A snapshot takes whatever recent frame exists, cached or live.
+        viewer.frame = viewer.snapshot ? CapturePipeline::acquireCached(CAPTURE_CACHE_MAX_AGE_MS)
+                                       : CapturePipeline::acquireLatest(viewer.lastFrameId);
+        if (!viewer.frame)
+        {
+            return false;
+        }
+        viewer.lastFrameId = viewer.frame->frameId;
+        fb = viewer.frame->fb;
+        app1Length = viewer.frame->jpeg.app1Length;
+    }
+    else
+    {
+        viewer.ownedFb = captureCb();
+        if (!viewer.ownedFb)
+        {
+            return false;
+        }
+        fb = viewer.ownedFb;
+    }
+
+    // Preformatted prefix + length, instead of building Strings per frame
+    const char *prefix = viewer.snapshot ? SNAPSHOT_RESPONSE_PREFIX : MJPEG_PART_PREFIX;
+    size_t prefixLen = viewer.snapshot ? sizeof(SNAPSHOT_RESPONSE_PREFIX) - 1 : sizeof(MJPEG_PART_PREFIX) - 1;
+    memcpy(viewer.partHeader, prefix, prefixLen);
+    int lengthLen = snprintf(viewer.partHeader + prefixLen, sizeof(viewer.partHeader) - prefixLen,
+                             "%u\r\n\r\n", (unsigned)(fb->len + app1Length));
+    viewer.partHeaderLen = prefixLen + lengthLen;
+
+    viewer.partSent = 0;
+    viewer.partLength = viewer.partHeaderLen + fb->len + app1Length + trailerLength(viewer);
+    return true;
+}
+
+bool HTTPMJPEGServer::writePart(MJPEGClient &viewer)
+{
+    const camera_fb_t *fb = viewer.frame ? viewer.frame->fb : viewer.ownedFb;
+    const JpegFrameInfo *jpeg = viewer.frame ? &viewer.frame->jpeg : nullptr;
+    size_t app1Length = jpeg ? jpeg->app1Length : 0;
+
+    // Optional APP1 timestamp goes right after SOI, the frame buffer is untouched
+    const uint8_t *segments[5] = {(const uint8_t *)viewer.partHeader, fb->buf,
+                                  app1Length ? jpeg->app1 : nullptr, fb->buf + 2,
+                                  (const uint8_t *)MJPEG_PART_TRAILER};
+    const size_t lengths[5] = {viewer.partHeaderLen, 2, app1Length, fb->len - 2, trailerLength(viewer)};
+
+    int fd = viewer.client.fd();
+    while (viewer.partSent < viewer.partLength)
     {
-        camera_fb_t *fb = captureCb();
-        if (!fb)
+        struct iovec iov[5];
+        int count = 0;
+        size_t skip = viewer.partSent;
+        for (int s = 0; s < 5; s++)
+        {
+            if (skip >= lengths[s])
+            {
+                skip -= lengths[s];
+                continue;
+            }
+            iov[count].iov_base = (void *)(segments[s] + skip);
+            iov[count].iov_len = lengths[s] - skip;
+            count++;
+            skip = 0;
+        }
+
+        struct msghdr msg = {};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        int written = sendmsg(fd, &msg, MSG_DONTWAIT);
+        if (written > 0)
         {
-            LOG_ERROR("Capture error for HTTP MJPEG");
+            viewer.partSent += written;
             continue;
         }
-        server.sendContent("--frame\r\n");
-        server.sendContent("Content-Type: image/jpeg\r\n");
-        server.sendContent("Content-Length: " + String(fb->len) + "\r\n\r\n");
-        server.sendContent_P((const char *)fb->buf, fb->len);
-        server.sendContent("\r\n");
+        if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return true; // Socket full, resume on the next loop
+        }
+
+        LOG_DEBUGF("MJPEG client write error (errno %d)", errno);
+        return false;
+    }
+
+    finishPart(viewer);
+    return true;
+}
+
+size_t HTTPMJPEGServer::trailerLength(const MJPEGClient &viewer)
+{
+    return viewer.snapshot ? 0 : sizeof(MJPEG_PART_TRAILER) - 1;
+}
 
+void HTTPMJPEGServer::finishPart(MJPEGClient &viewer)
+{
+    if (viewer.frame)
+    {
+        CapturePipeline::release(viewer.frame);
+        viewer.frame = nullptr;
+    }
+    if (viewer.ownedFb)
+    {
         // CRITICAL: Release frame buffer to prevent memory leaks
-        CameraManager::releaseFrame(fb);
+        CameraManager::releaseFrame(viewer.ownedFb);
+        viewer.ownedFb = nullptr;
+    }
+    viewer.partSent = 0;
+    viewer.partLength = 0;
+}
+
+void HTTPMJPEGServer::removeClient(uint8_t index)
+{
+    finishPart(clients[index]);
+    clients[index].client.stop();
+
+    // Keep the list packed
+    bool snapshot = clients[index].snapshot;
+    for (uint8_t i = index; i + 1 < clientCount; i++)
+    {
+        clients[i] = clients[i + 1];
+    }
+    clients[clientCount - 1] = MJPEGClient();
+    clientCount--;
+    if (snapshot)
+    {
+        return;
+    }
 
-        yield(); // Allow other tasks to execute (non-blocking)
+    streamCount--;
+    LOG_INFOF("MJPEG client disconnected (%d streaming)", streamCount);
+    if (streamCount == 0 && CapturePipeline::isRunning())
+    {
+        CapturePipeline::setDemand(PIPELINE_CONSUMER_HTTP, false);
     }
-}
\ No newline at end of file
+}
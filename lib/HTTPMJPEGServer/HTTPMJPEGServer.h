@@ -15,7 +15,41 @@
 #include <esp_camera.h>
 #include <WebServer.h>
 #include <functional>
+#include "../CameraManager/CameraManager.h"
+#include "../CameraManager/CapturePipeline.h"
 
+/**
+ * @brief State of one MJPEG viewer
+ *
+ * A frame part is written as up to five segments (multipart header,
+ * SOI, optional APP1 timestamp, rest of the JPEG, trailer); partSent
+ * tracks progress across non-blocking writes. A snapshot client gets a
+ * single part with a plain HTTP response header and no trailer.
+ */
+struct MJPEGClient
+{
+    WiFiClient client;
+    SharedFrame *frame = nullptr;  // Frame from the capture pipeline
+    camera_fb_t *ownedFb = nullptr; // Frame from the capture callback (no pipeline)
+    uint32_t lastFrameId = 0;
+    char partHeader[128];          // Preformatted multipart (or snapshot response) header
+    uint8_t partHeaderLen = 0;
+    size_t partSent = 0;
+    size_t partLength = 0;
+    bool snapshot = false;          // One JPEG then close (HTTP_SNAPSHOT_PATH)
+    unsigned long requestTime = 0;  // millis() of the snapshot request
+};
+
+/**
+ * @class HTTPMJPEGServer
+ * @brief Serves multipart MJPEG to several browsers without blocking.
+ *
+ * The WebServer only handles the request: the socket is then kept in a
+ * client list, and handleClient() pushes each new shared frame to every
+ * viewer with non-blocking writes, resuming where the socket filled up.
+ * Snapshots go through the same path, served from the last-good frame
+ * cache so still-image polling never triggers an extra capture.
+ */
 class HTTPMJPEGServer
 {
 public:
@@ -24,11 +58,28 @@ public:
     void begin();
     void handleClient();
 
+    /**
+     * @brief Get the number of MJPEG viewers currently streaming
+     */
+    uint8_t getClientCount() const { return streamCount; }
+
 private:
     WebServer server;
     int listenPort;
     CaptureCallback captureCb;
+    MJPEGClient clients[HTTP_MJPEG_MAX_CLIENTS];
+    uint8_t clientCount; // Used slots, snapshots included
+    uint8_t streamCount; // MJPEG viewers only
+
     void handleMJPEG();
+    void handleSnapshot();
+    void handleMetrics();
+    void pumpClients();
+    bool startPart(MJPEGClient &viewer);
+    bool writePart(MJPEGClient &viewer);
+    void finishPart(MJPEGClient &viewer);
+    static size_t trailerLength(const MJPEGClient &viewer);
+    void removeClient(uint8_t index);
 };
 
-#endif // HTTP_MJPEG_SERVER_H
\ No newline at end of file
+#endif // HTTP_MJPEG_SERVER_H
@@ -0,0 +1,171 @@
+/**
+ * @file AdmissionControl.cpp
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief Implementation of RTSP viewer admission control
+ */
+// AdmissionControl.cpp
+#include "AdmissionControl.h"
+#include "SdpBuilder.h"
+#include "../Utils/Logger.h"
+#include <esp_heap_caps.h>
+
+std::atomic<uint32_t> AdmissionControl::capacity(RTSP_ADMISSION_LINK_KBPS * 1000 / 8);
+std::atomic<uint32_t> AdmissionControl::committed(0);
+std::atomic<uint32_t> AdmissionControl::rejected(0);
+uint32_t AdmissionControl::averageFrameLen[CAPTURE_STREAM_COUNT] = {};
+uint8_t AdmissionControl::viewers[CAPTURE_STREAM_COUNT] = {};
+bool AdmissionControl::multicastActive = false;
+
+void AdmissionControl::update(const AdmissionSample &sample)
+{
+    for (uint8_t stream = 0; stream < CAPTURE_STREAM_COUNT; stream++)
+    {
+        uint32_t length = sample.frameLen[stream];
+        uint32_t &average = averageFrameLen[stream];
+        if (length)
+        {
+            average = average ? (average * 3 + length) / 4 : length;
+        }
+        viewers[stream] = sample.viewers[stream];
+    }
+    multicastActive = sample.multicastActive;
+
+    const uint32_t configured = RTSP_ADMISSION_LINK_KBPS * 1000 / 8;
+    uint32_t estimate = capacity.load();
+    uint32_t throughput = sample.elapsedMs ? (uint64_t)sample.bytes * 1000 / sample.elapsedMs : 0;
+    if (sample.saturated && throughput)
+    {
+        // Drops at this rate: the link carries no more than this
+        estimate = (estimate * 3 + throughput) / 4;
+    }
+    else
+    {
+        // Kept up: it carries at least this, and maybe what we assumed
+        if (estimate < configured)
+        {
+            estimate += (configured - estimate) / 8;
+        }
+        estimate = max(estimate, throughput);
+    }
+    capacity = estimate;
+    committed = committedCost();
+}
+
+AdmissionVerdict AdmissionControl::checkSetup(uint8_t stream, bool multicast)
+{
+    if (!RTSP_ADMISSION_ENABLED)
+    {
+        return ADMISSION_OK;
+    }
+
+    AdmissionVerdict verdict = hasFreeMemory(0) ? checkBandwidth(stream, multicast) : ADMISSION_NO_MEMORY;
+    if (verdict != ADMISSION_OK)
+    {
+        rejected++;
+    }
+    return verdict;
+}
+
+AdmissionVerdict AdmissionControl::admitPlay(uint8_t stream, bool multicast)
+{
+    if (!RTSP_ADMISSION_ENABLED)
+    {
+        return ADMISSION_OK;
+    }
+
+    AdmissionVerdict verdict = checkBandwidth(stream, multicast);
+    if (verdict != ADMISSION_OK)
+    {
+        rejected++;
+        return verdict;
+    }
+
+    // Committed until the next update() recounts the playing viewers
+    if (multicast)
+    {
+        multicastActive = true;
+    }
+    else if (stream < CAPTURE_STREAM_COUNT)
+    {
+        viewers[stream]++;
+    }
+    committed = committedCost();
+    return ADMISSION_OK;
+}
+
+void AdmissionControl::releasePlay(uint8_t stream, bool multicast)
+{
+    // The group may still have members: update() recounts it
+    if (!multicast && stream < CAPTURE_STREAM_COUNT && viewers[stream] > 0)
+    {
+        viewers[stream]--;
+        committed = committedCost();
+    }
+}
+
+bool AdmissionControl::hasMemoryFor(size_t sessionBytes)
+{
+    return !RTSP_ADMISSION_ENABLED || hasFreeMemory(sessionBytes);
+}
+
+const char *AdmissionControl::verdictName(AdmissionVerdict verdict)
+{
+    switch (verdict)
+    {
+    case ADMISSION_NO_MEMORY:
+        return "not enough memory";
+    case ADMISSION_NO_BANDWIDTH:
+        return "not enough bandwidth";
+    default:
+        return "admitted";
+    }
+}
+
+uint32_t AdmissionControl::streamCost(uint8_t stream)
+{
+    // RTP/JPEG headers add about 2% at the default fragment size
+    return (uint64_t)averageFrameLen[stream] * SdpBuilder::streamFps(stream) * 102 / 100;
+}
+
+uint32_t AdmissionControl::committedCost()
+{
+    uint32_t cost = multicastActive ? streamCost(CAPTURE_STREAM_MAIN) : 0;
+    for (uint8_t stream = 0; stream < CAPTURE_STREAM_COUNT; stream++)
+    {
+        cost += viewers[stream] * streamCost(stream);
+    }
+    return cost;
+}
+
+AdmissionVerdict AdmissionControl::checkBandwidth(uint8_t stream, bool multicast)
+{
+    if (stream >= CAPTURE_STREAM_COUNT)
+    {
+        return ADMISSION_OK;
+    }
+
+    // A multicast viewer shares frames the group already sends. The first
+    // viewer always gets in: there is nobody to protect, ABR does the rest.
+    uint32_t extra = multicast && multicastActive ? 0 : streamCost(stream);
+    uint32_t budget = (uint64_t)capacity.load() * RTSP_ADMISSION_HEADROOM_PERCENT / 100;
+    uint32_t load = committedCost();
+    if (extra && load && load + extra > budget)
+    {
+        LOG_DEBUGF("Admission: %lu + %lu B/s over the %lu B/s budget", (unsigned long)load,
+                   (unsigned long)extra, (unsigned long)budget);
+        return ADMISSION_NO_BANDWIDTH;
+    }
+    return ADMISSION_OK;
+}
+
+bool AdmissionControl::hasFreeMemory(size_t reserveBytes)
+{
+    if (heap_caps_get_free_size(MALLOC_CAP_INTERNAL) < RTSP_ADMISSION_MIN_FREE_HEAP + reserveBytes)
+    {
+        return false;
+    }
+    return heap_caps_get_total_size(MALLOC_CAP_SPIRAM) == 0 ||
+           heap_caps_get_free_size(MALLOC_CAP_SPIRAM) >= RTSP_ADMISSION_MIN_FREE_PSRAM;
+}
@@ -0,0 +1,108 @@
+/**
+ * @file AdmissionControl.h
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief Admission of RTSP viewers from measured link throughput and free memory
+ */
+// AdmissionControl.h
+#ifndef ADMISSION_CONTROL_H
+#define ADMISSION_CONTROL_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "../CameraManager/CapturePipeline.h"
+#include "../../src/config.h"
+
+enum AdmissionVerdict
+{
+    ADMISSION_OK = 0,
+    ADMISSION_NO_MEMORY,
+    ADMISSION_NO_BANDWIDTH
+};
+
+/**
+ * @brief What the RTSP server measured over one admission window
+ */
+struct AdmissionSample
+{
+    uint32_t elapsedMs = 0;
+    uint32_t bytes = 0;                          // RTSP bytes sent, unicast and multicast
+    bool saturated = false;                      // Some viewer dropped frames: the link was full
+    uint8_t viewers[CAPTURE_STREAM_COUNT] = {};  // Playing unicast viewers per stream
+    size_t frameLen[CAPTURE_STREAM_COUNT] = {};  // Latest frame size per stream (0 = none yet)
+    bool multicastActive = false;
+};
+
+/**
+ * @class AdmissionControl
+ * @brief Decides whether one more viewer fits before it is let in.
+ *
+ * Every RTSP_ADMISSION_WINDOW_MS the server reports the bytes it sent
+ * and whether any viewer fell behind. A window without drops proves the
+ * link carries at least that much; a window with drops shows what it
+ * carries at most. The capacity estimate follows both, and drifts back
+ * towards RTSP_ADMISSION_LINK_KBPS while nothing is dropped.
+ *
+ * A viewer costs the average frame size of its stream times the stream
+ * fps; a multicast viewer costs nothing once the group is sending. SETUP
+ * and PLAY are refused when the committed cost plus the newcomer exceeds
+ * RTSP_ADMISSION_HEADROOM_PERCENT of the capacity, and SETUP also when
+ * the heap or PSRAM would be left too low. An admitted PLAY is committed
+ * at once, so two viewers starting in the same window cannot overbook.
+ * Everything but the getters runs in the RTSP sender task.
+ */
+class AdmissionControl
+{
+public:
+    /**
+     * @brief Feed the measurements of a window
+     */
+    static void update(const AdmissionSample &sample);
+
+    /**
+     * @brief Check if a SETUP can be answered 200 (memory and bandwidth)
+     *
+     * @param stream CAPTURE_STREAM_* the session is bound to
+     * @param multicast true if the session joins the multicast group
+     */
+    static AdmissionVerdict checkSetup(uint8_t stream, bool multicast);
+
+    /**
+     * @brief Check a PLAY and count the viewer as committed if it fits
+     */
+    static AdmissionVerdict admitPlay(uint8_t stream, bool multicast);
+
+    /**
+     * @brief Uncommit a unicast viewer that stopped playing, without waiting for the next window
+     */
+    static void releasePlay(uint8_t stream, bool multicast);
+
+    /**
+     * @brief Check if there is heap left for one more RTSP connection
+     *
+     * @param sessionBytes Heap a new session object takes
+     */
+    static bool hasMemoryFor(size_t sessionBytes);
+
+    // Reported state (safe from any task)
+    static uint32_t getCapacity() { return capacity.load(); }   // bytes/s
+    static uint32_t getCommitted() { return committed.load(); } // bytes/s
+    static uint32_t getRejected() { return rejected.load(); }
+    static const char *verdictName(AdmissionVerdict verdict);
+
+private:
+    static std::atomic<uint32_t> capacity;
+    static std::atomic<uint32_t> committed;
+    static std::atomic<uint32_t> rejected;
+    static uint32_t averageFrameLen[CAPTURE_STREAM_COUNT];
+    static uint8_t viewers[CAPTURE_STREAM_COUNT];
+    static bool multicastActive;
+
+    static uint32_t streamCost(uint8_t stream);
+    static uint32_t committedCost();
+    static AdmissionVerdict checkBandwidth(uint8_t stream, bool multicast);
+    static bool hasFreeMemory(size_t reserveBytes);
+};
+
+#endif // ADMISSION_CONTROL_H
@@ -0,0 +1,49 @@
+/**
+ * @file FrameBroadcaster.cpp
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief Implementation of the shared RTSP frame broadcaster
+ */
+// FrameBroadcaster.cpp
+#include "FrameBroadcaster.h"
+#include "../Utils/Logger.h"
+
+FrameBroadcaster::FrameBroadcaster(uint8_t stream)
+    : stream(stream), lastFrameId(0), broadcastCount(0), skippedCount(0), lastFrameSize(0), active(false), resync(true) {}
+
+void FrameBroadcaster::setActive(bool enable)
+{
+    if (enable == active)
+    {
+        return;
+    }
+
+    active = enable;
+    resync = true;
+    CapturePipeline::setDemand(stream == CAPTURE_STREAM_SUB ? PIPELINE_CONSUMER_RTSP_SUB : PIPELINE_CONSUMER_RTSP, enable);
+    LOG_DEBUGF("RTSP capture demand (stream %d) %s", stream, enable ? "on" : "off");
+}
+
+SharedFrame *FrameBroadcaster::nextFrame()
+{
+    SharedFrame *frame = CapturePipeline::acquireLatest(lastFrameId, stream);
+    if (!frame)
+    {
+        return nullptr;
+    }
+
+    // Latest frame wins: anything published in between is skipped
+    if (!resync && frame->frameId > lastFrameId + 1)
+    {
+        skippedCount += frame->frameId - lastFrameId - 1;
+    }
+    resync = false;
+    lastFrameId = frame->frameId;
+    lastFrameSize = frame->fb->len;
+    broadcastCount++;
+
+    LOG_DEBUGF("Broadcast frame %lu - Size: %d bytes, PTS: %lu",
+               frame->frameId, frame->fb->len, frame->timecode.pts);
+    return frame;
+}
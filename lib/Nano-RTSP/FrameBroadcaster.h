@@ -0,0 +1,86 @@
+/**
+ * @file FrameBroadcaster.h
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief Fans out frames from the capture pipeline to all RTSP sessions
+ */
+// FrameBroadcaster.h
+#ifndef FRAME_BROADCASTER_H
+#define FRAME_BROADCASTER_H
+
+#include "../CameraManager/CapturePipeline.h"
+#include "../../src/config.h"
+
+/**
+ * @class FrameBroadcaster
+ * @brief RTSP-side consumer of the capture pipeline.
+ *        Picks up each new frame once and hands the same ref-counted
+ *        SharedFrame to every playing RTSP session.
+ *        One broadcaster per CAPTURE_STREAM_* profile.
+ */
+class FrameBroadcaster
+{
+public:
+    /**
+     * @param stream CAPTURE_STREAM_* profile this broadcaster serves
+     */
+    explicit FrameBroadcaster(uint8_t stream = CAPTURE_STREAM_MAIN);
+
+    /**
+     * @brief Enable or disable frame capture on behalf of RTSP sessions
+     *
+     * @param active true while at least one session is playing
+     */
+    void setActive(bool active);
+
+    /**
+     * @brief Get the next frame not yet broadcast
+     *
+     * Never blocks. Frames published while the sender was busy are
+     * skipped: only the latest one is returned.
+     *
+     * @return Retained frame (drop with release()), or nullptr if none is new
+     */
+    SharedFrame *nextFrame();
+
+    /**
+     * @brief Add a reference to a shared frame
+     *
+     * @param frame Frame to retain
+     */
+    static void retain(SharedFrame *frame) { CapturePipeline::retain(frame); }
+
+    /**
+     * @brief Drop a reference; the camera buffer is returned on the last one
+     *
+     * @param frame Frame to release
+     */
+    static void release(SharedFrame *frame) { CapturePipeline::release(frame); }
+
+    /**
+     * @brief Get the number of frames broadcast since startup
+     */
+    uint32_t getFrameCount() const { return broadcastCount; }
+
+    /**
+     * @brief Get the number of pipeline frames this broadcaster never picked up
+     */
+    uint32_t getSkippedCount() const { return skippedCount; }
+
+    /**
+     * @brief Get the size in bytes of the last frame broadcast
+     */
+    size_t getLastFrameSize() const { return lastFrameSize; }
+
+private:
+    uint8_t stream;
+    uint32_t lastFrameId;
+    uint32_t broadcastCount;
+    uint32_t skippedCount;
+    size_t lastFrameSize;
+    bool active;
+    bool resync; // Don't count frames captured while we were inactive as skipped
+};
+
+#endif // FRAME_BROADCASTER_H
@@ -9,21 +9,101 @@
 #include "NanoRTSPServer.h"
 #include "RTSPClientSession.h"
 #include "../Utils/Logger.h"
+#include "../Utils/Metrics.h"
 
-NanoRTSPServer::NanoRTSPServer(int port) : server(port), listenPort(port) {}
+NanoRTSPServer::NanoRTSPServer(int port)
+    : server(port), listenPort(port), senderTask(nullptr), paceTimer(nullptr), paceWaitMicros(0),
+      activeClientCount(0), lastAbrRound(0), lastMetricsPublish(0), lastAdmissionRound(0),
+      multicastSampledBytes(0), multicastSampledDropped(0),
+      broadcasters{FrameBroadcaster(CAPTURE_STREAM_MAIN), FrameBroadcaster(CAPTURE_STREAM_SUB)} {}
 
 void NanoRTSPServer::begin()
 {
+    // Every session lives in a slot reserved now: reconnecting viewers
+    // never allocate (or fragment) the heap the camera driver and lwIP need
+    clients.reserve(RTSP_MAX_CLIENTS);
+    if (sessionPool.begin())
+    {
+        LOG_INFOF("RTSP session pool: %d slots, %u bytes", RTSP_MAX_CLIENTS, (unsigned)sessionPool.getStorageBytes());
+    }
+    else
+    {
+        LOG_ERRORF("No memory for %d RTSP session slots, RTSP connections will be refused", RTSP_MAX_CLIENTS);
+    }
+
     server.begin();
-    LOG_INFOF("RTSP server started on port %d", listenPort);
+
+    // Sender task: RTSP parsing and RTP packetization off the Arduino loop
+    BaseType_t created = xTaskCreatePinnedToCore(senderTaskEntry, "rtsp",
+                                                 RTSP_TASK_STACK_SIZE, this,
+                                                 RTSP_TASK_PRIORITY, &senderTask,
+                                                 RTSP_TASK_CORE);
+    if (created != pdPASS)
+    {
+        LOG_ERROR("Failed to create RTSP sender task");
+        senderTask = nullptr;
+        return;
+    }
+    CapturePipeline::registerConsumerTask(senderTask);
+
+    // Hardware-timer wake-up for paced packets, finer than a FreeRTOS tick
+    esp_timer_create_args_t timerArgs = {};
+    timerArgs.callback = paceTimerCallback;
+    timerArgs.arg = this;
+    timerArgs.dispatch_method = ESP_TIMER_TASK;
+    timerArgs.name = "rtsp_pace";
+    if (esp_timer_create(&timerArgs, &paceTimer) != ESP_OK)
+    {
+        LOG_WARN("Pacing timer unavailable, paced packets wait one tick");
+        paceTimer = nullptr;
+    }
+
+    LOG_INFOF("RTSP server started on port %d (core %d)", listenPort, RTSP_TASK_CORE);
     LOG_INFO("Waiting for RTSP connections...");
 }
 
-void NanoRTSPServer::handleClients()
+void NanoRTSPServer::senderTaskEntry(void *arg)
+{
+    NanoRTSPServer *self = static_cast<NanoRTSPServer *>(arg);
+    bool backlog = false;
+    for (;;)
+    {
+        // Woken by the capture task on each new frame; the timeout keeps
+        // RTSP control requests responsive while nothing is streaming,
+        // and is stretched while the capture scheduler is idle.
+        // With packets still queued, only yield one tick before resuming,
+        // or sleep until the pacing timer when only the pacer holds them.
+        const bool idle = CapturePipeline::getPowerState() == CAPTURE_STATE_IDLE;
+        TickType_t timeout = pdMS_TO_TICKS(idle ? RTSP_TASK_IDLE_POLL_MS : RTSP_TASK_POLL_MS);
+        if (backlog && self->paceWaitMicros > 0 && self->paceTimer)
+        {
+            esp_timer_stop(self->paceTimer);
+            esp_timer_start_once(self->paceTimer, self->paceWaitMicros);
+        }
+        else if (backlog)
+        {
+            timeout = 1;
+        }
+        ulTaskNotifyTake(pdTRUE, timeout);
+        backlog = self->handleClients();
+    }
+}
+
+void NanoRTSPServer::paceTimerCallback(void *arg)
+{
+    // esp_timer task context, not an ISR
+    NanoRTSPServer *self = static_cast<NanoRTSPServer *>(arg);
+    xTaskNotifyGive(self->senderTask);
+}
+
+bool NanoRTSPServer::handleClients()
 {
     acceptNewClients();
     removeDisconnectedClients();
 
+    // A connected session is about to PLAY: have the sensor awake by then
+    CapturePipeline::setDemand(PIPELINE_CONSUMER_WARM, !clients.empty());
+
     // Handle active clients
     for (auto it = clients.begin(); it != clients.end(); ++it)
     {
@@ -32,6 +112,236 @@ void NanoRTSPServer::handleClients()
             (*it)->handle();
         }
     }
+
+    broadcastFrame();
+    bool backlog = pumpClients();
+    arbitrateBitrate();
+    measureAdmission();
+    publishMetrics();
+    return backlog;
+}
+
+void NanoRTSPServer::measureAdmission()
+{
+#if RTSP_ADMISSION_ENABLED
+    unsigned long now = millis();
+    if (now - lastAdmissionRound < RTSP_ADMISSION_WINDOW_MS)
+    {
+        return;
+    }
+
+    AdmissionSample sample;
+    sample.elapsedMs = lastAdmissionRound ? now - lastAdmissionRound : 0;
+    lastAdmissionRound = now;
+
+    uint32_t dropped = 0;
+    for (auto &client : clients)
+    {
+        client->sampleAdmission(sample.bytes, dropped);
+        if (client->isConnected() && client->isPlaying() && !client->isMulticast())
+        {
+            sample.viewers[client->getStream()]++;
+        }
+    }
+
+    // The group restarts its counters when it is set up again
+    const MetricsSessionCounters &group = multicastGroup.getCounters();
+    if (group.bytesSent < multicastSampledBytes || group.framesDropped < multicastSampledDropped)
+    {
+        multicastSampledBytes = 0;
+        multicastSampledDropped = 0;
+    }
+    sample.bytes += group.bytesSent - multicastSampledBytes;
+    dropped += group.framesDropped - multicastSampledDropped;
+    multicastSampledBytes = group.bytesSent;
+    multicastSampledDropped = group.framesDropped;
+    sample.multicastActive = multicastGroup.isActive();
+
+    sample.saturated = dropped > 0;
+    for (uint8_t stream = 0; stream < CAPTURE_STREAM_COUNT; stream++)
+    {
+        sample.frameLen[stream] = broadcasters[stream].getLastFrameSize();
+    }
+    AdmissionControl::update(sample);
+#endif
+}
+
+void NanoRTSPServer::arbitrateBitrate()
+{
+#if RTSP_ABR_ENABLED
+    unsigned long now = millis();
+    if (now - lastAbrRound < RTSP_ABR_WINDOW_MS)
+    {
+        return;
+    }
+    lastAbrRound = now;
+
+    // One setting for everyone: the worst playing viewer decides.
+    // Substream viewers run a fixed profile and do not vote.
+    AdaptiveBitrate::beginRound(broadcasters[CAPTURE_STREAM_MAIN].getLastFrameSize());
+    for (auto &client : clients)
+    {
+        if (client->isConnected() && client->isPlaying() && client->getStream() == CAPTURE_STREAM_MAIN)
+        {
+            AdaptiveBitrate::submit(client->sampleLink());
+        }
+    }
+    AdaptiveBitrate::endRound();
+#endif
+}
+
+void NanoRTSPServer::publishMetrics()
+{
+#if METRICS_ENABLED
+    unsigned long now = millis();
+    if (now - lastMetricsPublish < METRICS_PUBLISH_MS)
+    {
+        return;
+    }
+    lastMetricsPublish = now;
+
+    // Session stats belong to this task: hand a snapshot to the HTTP side
+    uint8_t slot = 0;
+    for (const auto &client : clients)
+    {
+        if (slot >= METRICS_MAX_SESSIONS)
+        {
+            break;
+        }
+        const RTSPSessionStats &stats = client->getStats();
+        MetricsSessionCounters counters;
+        counters.framesSent = stats.framesSent;
+        counters.framesDropped = stats.framesSkipped + stats.framesAborted;
+        counters.bytesSent = stats.bytesSent;
+        counters.retries = stats.retries;
+        counters.tcpFallbacks = stats.tcpFallbacks;
+        counters.retransmits = stats.retransmits;
+        const RTSPReceiverStats &receiver = client->getReceiverStats();
+        counters.lossPercent = receiver.lossPercent;
+        counters.jitterMs = receiver.jitterMs;
+        counters.rttMs = receiver.rttMs;
+        Metrics::publishSession(slot++, client->getSessionId(), counters);
+    }
+    if (multicastGroup.isActive() && slot < METRICS_MAX_SESSIONS)
+    {
+        Metrics::publishSession(slot++, "multicast", multicastGroup.getCounters());
+    }
+    Metrics::setSessionCount(slot);
+    Metrics::setSessionPool(sessionPool.getInUse(), sessionPool.getHighWater(), sessionPool.capacity());
+#endif
+}
+
+bool NanoRTSPServer::pumpClients()
+{
+    // Round-robin over the sessions, a few packets each, so a viewer with
+    // a full socket never holds back the others
+    bool backlog = false;
+    for (int pass = 0; pass < RTSP_TX_MAX_PASSES; pass++)
+    {
+        bool progress = multicastGroup.pump();
+        backlog = multicastGroup.hasBacklog();
+        for (auto &client : clients)
+        {
+            if (client->pump())
+            {
+                progress = true;
+            }
+            if (client->hasBacklog())
+            {
+                backlog = true;
+            }
+        }
+
+        if (!progress || !backlog)
+        {
+            break;
+        }
+    }
+
+    // Earliest pacing deadline, unless a session waits on its socket:
+    // that one needs the short poll anyway
+    paceWaitMicros = 0;
+    if (backlog)
+    {
+        uint32_t earliest = UINT32_MAX;
+        bool socketBound = false;
+        if (multicastGroup.hasBacklog())
+        {
+            uint32_t wait = multicastGroup.getPaceWaitMicros();
+            socketBound = wait == 0;
+            earliest = wait ? wait : earliest;
+        }
+        for (auto &client : clients)
+        {
+            if (!client->hasBacklog())
+            {
+                continue;
+            }
+            uint32_t wait = client->getPaceWaitMicros();
+            if (wait == 0)
+            {
+                socketBound = true;
+            }
+            else if (wait < earliest)
+            {
+                earliest = wait;
+            }
+        }
+        paceWaitMicros = socketBound ? 0 : earliest;
+    }
+    return backlog;
+}
+
+void NanoRTSPServer::broadcastFrame()
+{
+    for (uint8_t stream = 0; stream < CAPTURE_STREAM_COUNT; stream++)
+    {
+        broadcastStream(stream);
+    }
+}
+
+void NanoRTSPServer::broadcastStream(uint8_t stream)
+{
+    // Only keep the sensor busy while at least one session is playing
+    bool anyPlaying = false;
+    for (const auto &client : clients)
+    {
+        if (client->isConnected() && client->isPlaying() && client->getStream() == stream)
+        {
+            anyPlaying = true;
+            break;
+        }
+    }
+    FrameBroadcaster &broadcaster = broadcasters[stream];
+    broadcaster.setActive(anyPlaying);
+    if (!anyPlaying)
+    {
+        return;
+    }
+
+    SharedFrame *frame = broadcaster.nextFrame();
+    if (!frame)
+    {
+        return;
+    }
+
+    // Same buffer and PTS for every viewer of this stream
+    for (auto &client : clients)
+    {
+        if (client->isConnected() && client->getStream() == stream && client->wantsFrame(frame->captureTime))
+        {
+            client->enqueueFrame(frame);
+        }
+    }
+
+    // One packetized copy for every multicast member (main stream only)
+    if (stream == CAPTURE_STREAM_MAIN && multicastGroup.isActive())
+    {
+        multicastGroup.enqueueFrame(frame);
+    }
+
+    // Drop the capture reference; sessions hold their own while the frame is queued
+    FrameBroadcaster::release(frame);
 }
 
 void NanoRTSPServer::acceptNewClients()
@@ -40,19 +350,29 @@ void NanoRTSPServer::acceptNewClients()
     if (client)
     {
         LOG_INFO("=== NEW RTSP CONNECTION ===");
-        LOG_INFOF("Client connected from: %s", client.remoteIP().toString().c_str());
+        IPAddress remote = client.remoteIP();
+        LOG_INFOF("Client connected from: %u.%u.%u.%u", remote[0], remote[1], remote[2], remote[3]);
         LOG_INFOF("Client port: %d", client.remotePort());
         LOG_DEBUG("Creating RTSP session...");
 
-        // Limit number of simultaneous clients
-        if (clients.size() >= 5)
+        // Free slot and heap floor; bandwidth is checked at SETUP / PLAY,
+        // where the client can be told why
+        if (!AdmissionControl::hasMemoryFor(0))
+        {
+            LOG_WARN("Free heap below RTSP_ADMISSION_MIN_FREE_HEAP, connection refused");
+            client.stop();
+            return;
+        }
+        RTSPClientSession *session = sessionPool.create(client, &multicastGroup);
+        if (!session)
         {
-            LOG_WARN("Maximum number of clients reached, connection refused");
+            LOG_WARNF("All %d RTSP session slots in use, connection refused", RTSP_MAX_CLIENTS);
             client.stop();
             return;
         }
 
-        clients.push_back(new RTSPClientSession(client));
+        clients.push_back(session);
+        activeClientCount = clients.size();
         LOG_INFOF("Total clients: %d", clients.size());
     }
 }
@@ -64,8 +384,9 @@ void NanoRTSPServer::removeDisconnectedClients()
         if (!(*it)->isConnected())
         {
             LOG_INFO("RTSP client disconnected");
-            delete *it;
-            it = clients.erase(it);
+            sessionPool.destroy(*it);
+            it = clients.erase(it); // Capacity reserved in begin(): nothing is freed
+            activeClientCount = clients.size();
             LOG_INFOF("Remaining clients: %d", clients.size());
         }
         else
@@ -77,12 +398,6 @@ void NanoRTSPServer::removeDisconnectedClients()
 
 bool NanoRTSPServer::hasActiveClients() const
 {
-    for (const auto &client : clients)
-    {
-        if (client && client->isConnected())
-        {
-            return true;
-        }
-    }
-    return false;
+    // Session list belongs to the sender task; other tasks only see the count
+    return activeClientCount.load() > 0;
 }
@@ -12,28 +12,64 @@
 
 #include <WiFi.h>
 #include <vector>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_timer.h>
 #include "RTSPClientSession.h"
+#include "FrameBroadcaster.h"
+#include "RTPMulticastGroup.h"
+#include "../Utils/ObjectPool.h"
 #include "../../src/config.h"
 
 /**
  * @class NanoRTSPServer
  * @brief Multi-client RTSP server for streaming MJPEG via RTP.
  *        Manages client acceptance, session creation/deletion and frame distribution.
+ *        A single frame is captured per interval and fanned out to every playing session.
+ *        Sessions are routed by path to the main stream or the low-resolution substream.
+ *        Runs in its own sender task pinned to RTSP_TASK_CORE, woken by the capture pipeline.
  */
 class NanoRTSPServer
 {
 public:
     NanoRTSPServer(int port = RTSP_PORT);
     void begin();
-    void handleClients();
+
+    /**
+     * @brief Accept, serve and pump all sessions once
+     *
+     * @return true if some session still has packets queued
+     */
+    bool handleClients();
     bool hasActiveClients() const;
 
 private:
     WiFiServer server;
     int listenPort;
-    std::vector<RTSPClientSession *> clients;
+    TaskHandle_t senderTask;
+    esp_timer_handle_t paceTimer;           // One-shot wake-up when paced packets are due
+    uint32_t paceWaitMicros;                // Set by pumpClients(): 0 unless only the pacer holds packets
+    std::atomic<uint8_t> activeClientCount; // Readable from other tasks
+    unsigned long lastAbrRound;
+    unsigned long lastMetricsPublish;
+    unsigned long lastAdmissionRound;
+    uint32_t multicastSampledBytes; // Group counters at the previous admission window
+    uint32_t multicastSampledDropped;
+    std::vector<RTSPClientSession *> clients;              // Reserved once, points into sessionPool
+    ObjectPool<RTSPClientSession, RTSP_MAX_CLIENTS> sessionPool; // Session slots allocated at begin()
+    FrameBroadcaster broadcasters[CAPTURE_STREAM_COUNT]; // Main stream and substream
+    RTPMulticastGroup multicastGroup; // One stream for all multicast sessions
     void acceptNewClients();
     void removeDisconnectedClients();
+    void broadcastFrame();
+    void broadcastStream(uint8_t stream);
+    bool pumpClients();
+    void arbitrateBitrate();
+    void measureAdmission();
+    void publishMetrics();
+    static void senderTaskEntry(void *arg);
+    static void paceTimerCallback(void *arg);
 };
 
 #endif // NANO_RTSP_SERVER_H
@@ -0,0 +1,113 @@
+/**
+ * @file PacketPacer.cpp
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief Implementation of the RTP packet token bucket
+ */
+// PacketPacer.cpp
+#include "PacketPacer.h"
+
+#define PACER_SCALE 1000000LL
+
+PacketPacer::PacketPacer()
+    : tokens(0), lastRefill(0), rate(0), burst(RTSP_PACING_MAX_BURST_BYTES), throughput(0),
+      waitingBytes(0), throttledSince(0), throttledMicros(0) {}
+
+void PacketPacer::beginFrame(size_t wireBytes, uint32_t intervalMs)
+{
+    // Spread the frame over part of its interval, the rest is slack for jitter
+    uint64_t windowMicros = (uint64_t)intervalMs * 1000 * RTSP_PACING_SPREAD_PERCENT / 100;
+    rate = windowMicros ? (uint32_t)((uint64_t)wireBytes * PACER_SCALE / windowMicros) : 0;
+
+    // Depth from the measured throughput, never less than one full packet
+    uint32_t depth = throughput ? (uint32_t)((uint64_t)throughput * RTSP_PACING_BURST_MS / 1000)
+                                : RTSP_PACING_MAX_BURST_BYTES;
+    burst = min(max(depth, (uint32_t)RTSP_MAX_FRAGMENT_SIZE), (uint32_t)RTSP_PACING_MAX_BURST_BYTES);
+
+    waitingBytes = 0;
+    throttledSince = 0;
+    throttledMicros = 0;
+    refill(esp_timer_get_time());
+}
+
+void PacketPacer::refill(int64_t now)
+{
+    const int64_t full = (int64_t)burst * PACER_SCALE;
+    if (lastRefill == 0 || rate == 0)
+    {
+        tokens = full;
+    }
+    else
+    {
+        tokens += (now - lastRefill) * rate;
+        if (tokens > full)
+        {
+            tokens = full;
+        }
+    }
+    lastRefill = now;
+}
+
+bool PacketPacer::tryConsume(size_t bytes)
+{
+    if (rate == 0)
+    {
+        return true;
+    }
+
+    int64_t now = esp_timer_get_time();
+    refill(now);
+    const int64_t needed = (int64_t)bytes * PACER_SCALE;
+    if (tokens < needed)
+    {
+        waitingBytes = bytes;
+        if (throttledSince == 0)
+        {
+            throttledSince = now;
+        }
+        return false;
+    }
+
+    tokens -= needed;
+    waitingBytes = 0;
+    if (throttledSince)
+    {
+        throttledMicros += now - throttledSince;
+        throttledSince = 0;
+    }
+    return true;
+}
+
+void PacketPacer::endFrame(size_t wireBytes, uint32_t elapsedMicros)
+{
+    // Only the time actually spent sending says what the link can take
+    uint32_t active = elapsedMicros > throttledMicros ? elapsedMicros - throttledMicros : 0;
+    if (active > 0)
+    {
+        uint32_t sample = (uint32_t)((uint64_t)wireBytes * PACER_SCALE / active);
+        throughput = throughput ? (throughput * 3 + sample) / 4 : sample;
+    }
+    waitingBytes = 0;
+    throttledSince = 0;
+}
+
+uint32_t PacketPacer::getWaitMicros() const
+{
+    if (waitingBytes == 0 || rate == 0)
+    {
+        return 0;
+    }
+
+    int64_t missing = (int64_t)waitingBytes * PACER_SCALE - tokens - (esp_timer_get_time() - lastRefill) * rate;
+    if (missing <= 0)
+    {
+        return 1;
+    }
+    return (uint32_t)((missing + rate - 1) / rate);
+}
+
+uint32_t PacketPacer::getThrottledMicros() const
+{
+    return throttledMicros + (throttledSince ? (uint32_t)(esp_timer_get_time() - throttledSince) : 0);
+}
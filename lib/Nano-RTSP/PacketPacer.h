@@ -0,0 +1,89 @@
+/**
+ * @file PacketPacer.h
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief Token bucket spreading the RTP packets of a frame over its interval
+ */
+// PacketPacer.h
+#ifndef PACKET_PACER_H
+#define PACKET_PACER_H
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include "../../src/config.h"
+
+/**
+ * @class PacketPacer
+ * @brief Per-stream token bucket for UDP RTP packets.
+ *
+ * Writing a whole JPEG back to back overflows the lwIP pbuf pool and the
+ * AP queue, and the tail of the frame is what gets lost. The bucket is
+ * refilled at the rate that spreads one frame over
+ * RTSP_PACING_SPREAD_PERCENT of the frame interval; its depth is
+ * RTSP_PACING_BURST_MS of the throughput measured while not throttled,
+ * so a fast link still leaves in a few short bursts. Time comes from
+ * esp_timer_get_time(); the caller sleeps until getWaitMicros() and never
+ * calls delay().
+ */
+class PacketPacer
+{
+public:
+    PacketPacer();
+
+    /**
+     * @brief Size the refill rate for a new frame
+     *
+     * @param wireBytes Bytes the frame will take on the wire, headers included
+     * @param intervalMs Frame interval of the stream
+     */
+    void beginFrame(size_t wireBytes, uint32_t intervalMs);
+
+    /**
+     * @brief Take tokens for one packet
+     *
+     * Called once per packet: a packet retried after a full socket keeps
+     * the tokens it already took.
+     *
+     * @param bytes Packet size on the wire
+     * @return false if the packet must wait (see getWaitMicros())
+     */
+    bool tryConsume(size_t bytes);
+
+    /**
+     * @brief Close the frame and update the measured throughput
+     *
+     * @param wireBytes Bytes written for the frame
+     * @param elapsedMicros Time from first to last packet
+     */
+    void endFrame(size_t wireBytes, uint32_t elapsedMicros);
+
+    /**
+     * @brief Time until the packet refused by tryConsume() may go out
+     *
+     * @return Microseconds, 0 if not throttled
+     */
+    uint32_t getWaitMicros() const;
+
+    /**
+     * @brief Time spent throttled in the current frame
+     */
+    uint32_t getThrottledMicros() const;
+
+    uint32_t getRate() const { return rate; }
+    uint32_t getThroughput() const { return throughput; }
+
+private:
+    int64_t tokens;         // Bytes x 1e6, so refills keep sub-byte precision
+    int64_t lastRefill;     // esp_timer_get_time() of the last refill
+    uint32_t rate;          // Refill rate, bytes/s (0 = unpaced)
+    uint32_t burst;         // Bucket depth, bytes
+    uint32_t throughput;    // Unthrottled send rate, bytes/s (EWMA, 0 = unknown)
+    size_t waitingBytes;    // Packet refused by tryConsume(), 0 if none
+    int64_t throttledSince; // Start of the current wait, 0 if none
+    uint32_t throttledMicros;
+
+    void refill(int64_t now);
+};
+
+#endif // PACKET_PACER_H
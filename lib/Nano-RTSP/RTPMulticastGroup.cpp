@@ -0,0 +1,255 @@
+/**
+ * @file RTPMulticastGroup.cpp
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief Implementation of the shared RTP multicast stream
+ */
+// RTPMulticastGroup.cpp
+#include "RTPMulticastGroup.h"
+#include "../Utils/Logger.h"
+#include "../Utils/TimecodeManager.h"
+#include "../Utils/Helpers.h"
+#include <errno.h>
+#include <esp_timer.h>
+
+RTPMulticastGroup::RTPMulticastGroup()
+    : members(0), rtpSocket(-1), groupDest(), sequenceNumber(0), txFrame(nullptr),
+      queuedFrame(nullptr), txPacketStaged(false), txPacketPaced(false), txPacketRetries(0),
+      txFrameStartMicros(0), txFrameBytes(0), packetsSent(0),
+      rtpOctetCount(0), rtpTimestampOffset(esp_random()),
+      lastRtcpReport(0) {}
+
+RTPMulticastGroup::~RTPMulticastGroup()
+{
+    dropQueue();
+    closeSocket();
+}
+
+bool RTPMulticastGroup::join()
+{
+    if (members == 0 && !openSocket())
+    {
+        LOG_ERROR("Unable to open RTP multicast socket");
+        return false;
+    }
+
+    members++;
+    LOG_INFOF("Multicast member joined %s:%d (%d members)", RTSP_MULTICAST_GROUP, RTSP_MULTICAST_PORT, members);
+    return true;
+}
+
+void RTPMulticastGroup::leave()
+{
+    if (members == 0)
+    {
+        return;
+    }
+
+    members--;
+    LOG_INFOF("Multicast member left (%d members)", members);
+    if (members == 0)
+    {
+        // Nobody watching anymore: stop sending to the group
+        dropQueue();
+        closeSocket();
+    }
+}
+
+void RTPMulticastGroup::enqueueFrame(SharedFrame *frame)
+{
+    if (!frame || members == 0)
+    {
+        return;
+    }
+
+    FrameBroadcaster::retain(frame);
+    if (queuedFrame)
+    {
+        FrameBroadcaster::release(queuedFrame);
+        counters.framesDropped++;
+    }
+    queuedFrame = frame;
+
+    if (!txFrame)
+    {
+        startNextFrame();
+    }
+}
+
+bool RTPMulticastGroup::pump()
+{
+    bool progress = false;
+    for (int budget = RTSP_TX_PACKETS_PER_PUMP; budget > 0 && txFrame; budget--)
+    {
+        if (!txPacketStaged)
+        {
+            METRIC_TIMER_START(packetizeStart);
+            packetizer.next(txPacket, sequenceNumber);
+            METRIC_TIMER_STOP(METRIC_PACKETIZE, packetizeStart);
+            txPacketStaged = true;
+            txPacketPaced = !RTSP_PACING_ENABLED;
+            txPacketRetries = 0;
+        }
+
+        const size_t packetLen = txPacket.length(false);
+        if (!txPacketPaced)
+        {
+            if (!pacer.tryConsume(packetLen))
+            {
+                break;
+            }
+            txPacketPaced = true;
+        }
+
+        struct iovec iov[3];
+        struct msghdr msg = {};
+        msg.msg_name = &groupDest;
+        msg.msg_namelen = sizeof(groupDest);
+        msg.msg_iov = iov;
+        msg.msg_iovlen = RtpJpegPacketizer::toIovec(txPacket, false, 0, iov);
+
+        METRIC_TIMER_START(sendStart);
+        int written = sendmsg(rtpSocket, &msg, MSG_DONTWAIT);
+        METRIC_TIMER_STOP(METRIC_FRAGMENT_SEND, sendStart);
+        if (written != (int)packetLen)
+        {
+            // lwIP out of buffers: retry on the next pump, then give the frame up
+            counters.retries++;
+            if (++txPacketRetries < RTSP_UDP_MAX_RETRIES)
+            {
+                break;
+            }
+            LOG_WARNF("Multicast packet failed after %d attempts (errno %d)", txPacketRetries, errno);
+            finishFrame(false);
+            break;
+        }
+
+        progress = true;
+        counters.bytesSent += packetLen;
+        txFrameBytes += packetLen;
+        packetsSent++;
+        rtpOctetCount += packetLen - RTP_HEADER_SIZE;
+        txPacketStaged = false;
+        sequenceNumber++;
+
+        if (!packetizer.hasMore())
+        {
+            finishFrame(true);
+        }
+    }
+
+    unsigned long now = millis();
+    if (RTSP_RTCP_ENABLED && rtpSocket >= 0 && packetsSent > 0 && now - lastRtcpReport >= RTSP_RTCP_INTERVAL_MS)
+    {
+        lastRtcpReport = now;
+        sendSenderReport();
+    }
+    return progress;
+}
+
+void RTPMulticastGroup::sendSenderReport()
+{
+    // Same media clock as the frame PTS, see RTSPClientSession::sendSenderReport()
+    RtcpSenderInfo info;
+    info.ssrc = RTP_JPEG_SSRC;
+    info.ntpTime = TimecodeManager::getNTPTime();
+    info.rtpTimestamp = TimecodeManager::media().mediaTimestamp(esp_timer_get_time()) + rtpTimestampOffset;
+    info.packetCount = packetsSent;
+    info.octetCount = rtpOctetCount;
+
+    uint8_t packet[RTCP_SR_MAX_SIZE];
+    size_t length = RtcpCodec::buildSenderReport(packet, sizeof(packet), info);
+    struct sockaddr_in dest = groupDest;
+    dest.sin_port = htons(RTSP_MULTICAST_PORT + 1);
+    sendto(rtpSocket, packet, length, MSG_DONTWAIT, (struct sockaddr *)&dest, sizeof(dest));
+}
+
+bool RTPMulticastGroup::openSocket()
+{
+    closeSocket();
+
+    rtpSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (rtpSocket < 0)
+    {
+        return false;
+    }
+
+    uint8_t ttl = RTSP_MULTICAST_TTL;
+    setsockopt(rtpSocket, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+    fcntl(rtpSocket, F_SETFL, fcntl(rtpSocket, F_GETFL, 0) | O_NONBLOCK);
+    Helpers::setSocketDscp(rtpSocket, RTSP_RTP_DSCP);
+
+    groupDest = {};
+    groupDest.sin_family = AF_INET;
+    groupDest.sin_port = htons(RTSP_MULTICAST_PORT);
+    groupDest.sin_addr.s_addr = inet_addr(RTSP_MULTICAST_GROUP);
+    return true;
+}
+
+void RTPMulticastGroup::closeSocket()
+{
+    if (rtpSocket >= 0)
+    {
+        close(rtpSocket);
+        rtpSocket = -1;
+    }
+}
+
+void RTPMulticastGroup::startNextFrame()
+{
+    txFrame = queuedFrame;
+    queuedFrame = nullptr;
+    txPacketStaged = false;
+    txFrameStartMicros = micros();
+    txFrameBytes = 0;
+    if (txFrame)
+    {
+        const size_t payload = RTSP_MAX_FRAGMENT_SIZE - RTP_HEADER_SIZE - RTP_JPEG_HEADER_SIZE;
+        packetizer.beginFrame(txFrame, payload, 0, rtpTimestampOffset);
+        if (RTSP_PACING_ENABLED)
+        {
+            pacer.beginFrame(packetizer.getFrameWireBytes(), 1000 / RTSP_FPS);
+        }
+    }
+}
+
+void RTPMulticastGroup::finishFrame(bool complete)
+{
+    if (complete)
+    {
+        counters.framesSent++;
+        if (RTSP_PACING_ENABLED)
+        {
+            pacer.endFrame(txFrameBytes, micros() - txFrameStartMicros);
+        }
+        METRIC_RECORD_US(METRIC_FRAME_AGE, micros() - txFrame->captureMicros);
+    }
+    else
+    {
+        counters.framesDropped++;
+    }
+
+    packetizer.reset();
+    FrameBroadcaster::release(txFrame);
+    txFrame = nullptr;
+    txPacketStaged = false;
+
+    if (queuedFrame)
+    {
+        startNextFrame();
+    }
+}
+
+void RTPMulticastGroup::dropQueue()
+{
+    if (txFrame)
+    {
+        finishFrame(false);
+    }
+    if (txFrame)
+    {
+        // Frame promoted from the queue by finishFrame()
+        finishFrame(false);
+    }
+}
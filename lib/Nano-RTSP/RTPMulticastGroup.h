@@ -0,0 +1,106 @@
+/**
+ * @file RTPMulticastGroup.h
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief Single RTP multicast stream shared by every multicast RTSP session
+ */
+// RTPMulticastGroup.h
+#ifndef RTP_MULTICAST_GROUP_H
+#define RTP_MULTICAST_GROUP_H
+
+#include <lwip/sockets.h>
+#include "FrameBroadcaster.h"
+#include "RtpJpegPacketizer.h"
+#include "RtcpCodec.h"
+#include "PacketPacer.h"
+#include "../Utils/Metrics.h"
+#include "../../src/config.h"
+
+/**
+ * @class RTPMulticastGroup
+ * @brief Sends one packetized copy of each frame to RTSP_MULTICAST_GROUP.
+ *
+ * Sessions that SETUP with "Transport: RTP/AVP;multicast" join the group
+ * on PLAY and leave it on PAUSE, TEARDOWN or disconnect. The socket is
+ * opened by the first member and closed with the last one, so airtime
+ * and CPU cost are the same for one viewer or fifty. Like a unicast
+ * session, the group never blocks: a frame that cannot be written on
+ * time is dropped and the next one starts clean. RTCP sender reports go
+ * to the group on port + 1 so every member gets the NTP/RTP mapping.
+ */
+class RTPMulticastGroup
+{
+public:
+    RTPMulticastGroup();
+    ~RTPMulticastGroup();
+
+    /**
+     * @brief Add a playing member, opening the socket for the first one
+     *
+     * @return false if the multicast socket could not be opened
+     */
+    bool join();
+
+    /**
+     * @brief Remove a member, closing the socket after the last one
+     */
+    void leave();
+
+    bool isActive() const { return members > 0; }
+    uint8_t getMemberCount() const { return members; }
+
+    /**
+     * @brief Queue a frame for the group, latest wins (see RTSPClientSession::enqueueFrame)
+     */
+    void enqueueFrame(SharedFrame *frame);
+
+    /**
+     * @brief Push up to RTSP_TX_PACKETS_PER_PUMP packets without blocking
+     *
+     * @return true if any packet was written
+     */
+    bool pump();
+
+    bool hasBacklog() const { return txFrame != nullptr; }
+
+    /**
+     * @brief Time until the pacer lets the next packet out, 0 if not held back
+     */
+    uint32_t getPaceWaitMicros() const { return txFrame && RTSP_PACING_ENABLED ? pacer.getWaitMicros() : 0; }
+
+    /**
+     * @brief Get the transmit counters of the group stream
+     */
+    const MetricsSessionCounters &getCounters() const { return counters; }
+
+private:
+    uint8_t members;
+    int rtpSocket;
+    struct sockaddr_in groupDest;
+    uint16_t sequenceNumber;
+    SharedFrame *txFrame;
+    SharedFrame *queuedFrame;
+    RtpJpegPacketizer packetizer;
+    RtpJpegPacket txPacket;
+    bool txPacketStaged;
+    bool txPacketPaced;
+    uint8_t txPacketRetries;
+    PacketPacer pacer;
+    unsigned long txFrameStartMicros;
+    size_t txFrameBytes;
+    MetricsSessionCounters counters;
+    uint32_t packetsSent;
+    uint32_t rtpOctetCount;
+    uint32_t rtpTimestampOffset; // Random per group, added to the shared PTS
+    unsigned long lastRtcpReport;
+
+    bool openSocket();
+    void closeSocket();
+    void startNextFrame();
+    void finishFrame(bool complete);
+    void dropQueue();
+    void sendSenderReport();
+};
+
+#endif // RTP_MULTICAST_GROUP_H
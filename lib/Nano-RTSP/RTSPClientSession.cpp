@@ -7,21 +7,34 @@
  */
 // RTSPClientSession.cpp
 #include "RTSPClientSession.h"
-#include "../CameraManager/CameraManager.h"
 #include "../../src/config.h"
 #include "../Utils/Logger.h"
+#include "../Utils/Metrics.h"
+#include "../Utils/Helpers.h"
 #include <stdlib.h> // For abs()
+#include <errno.h>
+#include <esp_timer.h>
 
-RTSPClientSession::RTSPClientSession(WiFiClient client) : client(client)
+RTSPClientSession::RTSPClientSession(WiFiClient client, RTPMulticastGroup *multicastGroup)
+    : client(client), multicastGroup(multicastGroup), rtpTimestampOffset(esp_random())
 {
     LOG_INFO("New RTSP session created");
-    sessionId = generateSessionId();
+    generateSessionId();
+    lastActivity = millis();
+
+    // Interleaved RTP batches are already MSS sized: Nagle would only delay them
+    this->client.setNoDelay(true);
+    Helpers::setSocketDscp(this->client.fd(), RTSP_CONTROL_DSCP);
     lastFrameTime = DEFAULT_FRAME_TIME;
     frameInterval = 1000 / RTSP_FPS; // Interval between frames in ms
 
-    // Initialize timecode manager
-    timecodeManager.begin();
-    LOG_INFO("TimecodeManager initialized for RTSP session");
+    // RTCP from TCP interleaved clients arrives on the RTSP socket
+    parser.setInterleavedHandler([this](uint8_t channel, const uint8_t *data, size_t length)
+                                 {
+                                     if (channel == rtcpChannel)
+                                     {
+                                         handleRtcp(data, length);
+                                     } });
 
     // UDP will be initialized on first use
     LOG_INFO("RTSP session ready for UDP/TCP");
@@ -29,6 +42,8 @@ RTSPClientSession::RTSPClientSession(WiFiClient client) : client(client)
 
 RTSPClientSession::~RTSPClientSession()
 {
+    stopPlaying();
+    closeRtpSocket();
     if (client.connected())
         client.stop();
 }
@@ -40,17 +55,24 @@ void RTSPClientSession::handle()
         return;
     }
 
-    if (client.available())
+    // Never interleave an RTSP response into a half-written RTP or RTCP packet
+    bool midPacket = (txPacketSent > 0 && txPacketSent < txPacketLen) || rtcpPendingSent > 0;
+    if (client.available() && !midPacket)
     {
         processRequest();
     }
 
-    // Send frames only if in playback mode and client is connected
+    if (RTSP_RTCP_ENABLED && playing && !useMulticast)
+    {
+        serviceRtcp();
+    }
+
+    // Adjust framerate if necessary (adaptive framerate)
+    // Frames themselves are queued by the server broadcaster via enqueueFrame()
     if (playing && isClientStillConnected())
     {
         unsigned long currentTime = millis();
 
-        // Adjust framerate if necessary (adaptive framerate)
         if (RTSP_ADAPTIVE_FRAMERATE && (currentTime - lastFramerateAdjustment) > 5000)
         {
             lastFramerateAdjustment = currentTime;
@@ -65,66 +87,38 @@ void RTSPClientSession::handle()
                     LOG_INFOF("Framerate reduced to %d FPS due to UDP errors", currentFramerate);
                 }
             }
-            else if (udpErrorCount == 0 && currentFramerate < RTSP_FPS)
+            else if (udpErrorCount == 0 && currentFramerate < SdpBuilder::streamFps(stream))
             {
                 // Increase framerate if no more errors
-                currentFramerate = min(RTSP_FPS, currentFramerate + 1);
+                currentFramerate = min(SdpBuilder::streamFps(stream), currentFramerate + 1);
                 frameInterval = 1000 / currentFramerate;
                 LOG_INFOF("Framerate increased to %d FPS", currentFramerate);
             }
         }
-
-        if (currentTime - lastFrameTime >= frameInterval)
-        {
-            LOG_DEBUGF("Frame interval check - current: %lu, last: %lu, interval: %lu, need: %lu",
-                       currentTime, lastFrameTime, currentTime - lastFrameTime, frameInterval);
-
-            // Validate timing - should be approximately 66.67ms for 15 FPS
-            unsigned long actualInterval = currentTime - lastFrameTime;
-
-// Only log timing warnings if enabled (debug mode)
-#if RTSP_DISABLE_TIMING_WARNINGS == 0
-            if (actualInterval < RTSP_TIMING_TOLERANCE_MIN || actualInterval > RTSP_TIMING_TOLERANCE_MAX)
-            {
-                Logger::warnf("Timing deviation detected - expected ~67ms, got %lu ms", actualInterval);
-            }
-#endif
-
-// Timing compensation (if enabled)
-#if RTSP_TIMING_COMPENSATION == 1
-            if (currentTime - lastCompensationTime > 500) // Every 500ms for more responsive compensation
-            {
-                // Calculate drift and apply compensation
-                int32_t expectedInterval = frameInterval;
-                int32_t drift = actualInterval - expectedInterval;
-                timingDrift += drift;
-
-                // Apply compensation to next frame interval
-                if (abs(timingDrift) > RTSP_COMPENSATION_FACTOR)
-                {
-                    int32_t newInterval = max(50, (int32_t)frameInterval - (timingDrift / 500));
-                    if (newInterval != frameInterval)
-                    {
-                        frameInterval = newInterval;
-                        LOG_DEBUGF("Timing compensation applied: new interval %lu ms", frameInterval);
-                    }
-                    timingDrift = 0; // Reset drift after compensation
-                }
-
-                lastCompensationTime = currentTime;
-            }
-#endif
-
-            LOG_DEBUGF("About to send RTP frame - Interval: %lu ms, FPS: %d", actualInterval, currentFramerate);
-            sendRTPFrame();
-            LOG_DEBUG("RTP frame sent successfully");
-            lastFrameTime = currentTime;
-        }
     }
     else if (playing && !isClientStillConnected())
     {
         LOG_WARN("Client disconnected during playback - stopping stream");
-        playing = false;
+        stopPlaying();
+    }
+
+    // Ghost viewer: stop streaming and hang up so the slot is freed on the next pass
+    if (hasExpired(millis()))
+    {
+        LOG_WARNF("RTSP session %s timed out (no request or RTCP for %d s)", sessionId, RTSP_SESSION_TIMEOUT_S);
+        stopPlaying();
+        closeRtpSocket();
+        client.stop();
+        return;
+    }
+
+    // Periodic transmit statistics
+    static unsigned long lastStatsLog = 0;
+    if (playing && (millis() - lastStatsLog) > 10000)
+    {
+        lastStatsLog = millis();
+        LOG_DEBUGF("RTSP TX - sent: %lu, skipped: %lu, aborted: %lu, stalls: %lu, backlog: %d packets",
+                   stats.framesSent, stats.framesSkipped, stats.framesAborted, stats.sendStalls, getBacklogPackets());
     }
 
     // Periodic UDP health check (every 10 seconds)
@@ -148,6 +142,51 @@ bool RTSPClientSession::isConnected()
     return client.connected();
 }
 
+bool RTSPClientSession::wantsFrame(unsigned long now) const
+{
+    if (!playing || useMulticast)
+    {
+        return false;
+    }
+
+    // First frame after PLAY goes out immediately
+    if (lastFrameTime == DEFAULT_FRAME_TIME)
+    {
+        return true;
+    }
+
+    // Broadcaster ticks at RTSP_FPS; a session running a reduced adaptive
+    // framerate skips ticks until its own interval has elapsed. Half a tick
+    // of slack keeps jitter on the broadcast clock from dropping frames.
+    return (now - lastFrameTime) + (1000 / RTSP_FPS) / 2 >= frameInterval;
+}
+
+bool RTSPClientSession::hasExpired(unsigned long now) const
+{
+    // A playing interleaved viewer is held by TCP: a vanished peer fills
+    // the socket and the send error closes the session
+    if (!RTSP_SESSION_TIMEOUT_S || (playing && isInterleaved() && !useMulticast))
+    {
+        return false;
+    }
+    return now - lastActivity > RTSP_SESSION_TIMEOUT_S * 1000UL;
+}
+
+void RTSPClientSession::stopPlaying()
+{
+    if (playing)
+    {
+        AdmissionControl::releasePlay(stream, useMulticast);
+        if (isInterleaved())
+        {
+            Helpers::setSocketDscp(client.fd(), RTSP_CONTROL_DSCP);
+        }
+    }
+    playing = false;
+    leaveMulticast();
+    dropQueue();
+}
+
 bool RTSPClientSession::isClientStillConnected()
 {
     // More robust client connection check
@@ -165,16 +204,12 @@ void RTSPClientSession::resetUDPConnection()
 {
     LOG_INFO("Complete UDP connection reset");
 
-    // Properly stop UDP connection
-    udp.stop();
-    delay(50); // Longer delay to allow connection to close
-
     // Reset UDP parameters
     udpErrorCount = 0;
     lastUdpErrorTime = 0;
 
-    // Restart UDP on server port
-    if (udp.begin(serverUdpPort))
+    // Reopen the RTP socket on the same server port (close is synchronous in lwIP)
+    if (openRtpSocket())
     {
         LOG_INFOF("UDP reset successfully on port %d", serverUdpPort);
     }
@@ -182,67 +217,54 @@ void RTSPClientSession::resetUDPConnection()
     {
         LOG_ERRORF("UDP reset failed on port %d", serverUdpPort);
     }
-
-    // Wait a bit to stabilize the new connection
-    delay(100);
 }
 
 void RTSPClientSession::processRequest()
 {
-    String request = "";
-    String line;
-
-    // Read complete header
-    while (client.available())
+    parser.feed(client);
+    if (parser.overflowed())
     {
-        line = client.readStringUntil('\n');
-        request += line + "\n";
-        if (line.length() <= 1)
-            break; // Header ended
+        LOG_WARN("RTSP request too large - discarded");
+        char headers[HEADERS_BUFFER_SIZE];
+        snprintf(headers, sizeof(headers), "CSeq: %d\r\n", DEFAULT_CSEQ);
+        sendRTSPResponse("400 Bad Request", headers);
+        return;
     }
 
-    LOG_DEBUG("RTSP request received:");
-    LOG_VERBOSE(request);
-
-    // Extract first line to identify method
-    int firstLineEnd = request.indexOf('\n');
-    String firstLine = request.substring(0, firstLineEnd);
-
-    // Check if path is supported
-    bool validPath = false;
-    if (firstLine.indexOf(HTTP_MJPEG_PATH) != -1 || firstLine.indexOf(RTSP_PATH) != -1)
+    // Several requests may arrive in one read (pipelining)
+    RTSPRequest request;
+    while (parser.next(request))
     {
-        validPath = true;
+        handleRequest(request);
     }
+}
 
-    // Extract CSeq dynamically
-    int cseq = DEFAULT_CSEQ; // Default value
-    int cseqIndex = request.indexOf("CSeq:");
-    if (cseqIndex != -1)
-    {
-        int cseqEnd = request.indexOf('\n', cseqIndex);
-        String cseqLine = request.substring(cseqIndex, cseqEnd);
-        cseqLine.trim();
-        int sep = cseqLine.indexOf(':');
-        if (sep != -1)
-        {
-            String cseqValue = cseqLine.substring(sep + 1);
-            cseqValue.trim();
-            cseq = cseqValue.toInt();
-        }
-    }
+void RTSPClientSession::handleRequest(const RTSPRequest &request)
+{
+    LOG_DEBUGF("RTSP request received: %.*s %.*s (CSeq %d)",
+               request.method.length, request.method.data,
+               request.uri.length, request.uri.data, request.cseq);
+
+    // Check if path is supported; the path also picks the stream
+    const bool subPath = RTSP_SUBSTREAM_ENABLED && request.uri.contains(RTSP_SUBSTREAM_PATH);
+    const bool validPath = subPath || request.uri.contains(HTTP_MJPEG_PATH) || request.uri.contains(RTSP_PATH);
+    const uint8_t requestStream = subPath ? CAPTURE_STREAM_SUB : CAPTURE_STREAM_MAIN;
+    const int cseq = request.cseq;
+
+    // Every request (and RTCP packet) is a keepalive
+    lastActivity = millis();
 
     char headers[HEADERS_BUFFER_SIZE];
-    if (firstLine.startsWith("OPTIONS"))
+    if (request.method.equals("OPTIONS"))
     {
         snprintf(headers, sizeof(headers),
                  "CSeq: %d\r\n"
-                 "Public: OPTIONS, DESCRIBE, SETUP, PLAY, PAUSE, TEARDOWN\r\n"
+                 "Public: OPTIONS, DESCRIBE, SETUP, PLAY, PAUSE, TEARDOWN, GET_PARAMETER\r\n"
                  "Server: " RTSP_SERVER_NAME "\r\n",
                  cseq);
         sendRTSPResponse("200 OK", headers);
     }
-    else if (firstLine.startsWith("DESCRIBE"))
+    else if (request.method.equals("DESCRIBE"))
     {
         if (!validPath)
         {
@@ -251,24 +273,29 @@ void RTSPClientSession::processRequest()
             return;
         }
 
-        // Advanced SDP with metadata for FFmpeg
-        String sdp;
-        generateAdvancedSDP(sdp);
-
-        int sdpLength = sdp.length();
+        // Static part of the SDP is built once per resolution, only the
+        // clock lines are formatted per DESCRIBE
+        const RTSPTextBuffer &sdp = getCachedSDP(requestStream);
+        char clockLines[256];
+        RTSPTextBuffer clock(clockLines, sizeof(clockLines));
+        if (RTSP_ENABLE_CLOCK_METADATA)
+        {
+            SdpBuilder::appendClockLines(clock, TimecodeManager::media());
+        }
 
         snprintf(headers, sizeof(headers),
                  "CSeq: %d\r\n"
                  "Content-Type: application/sdp\r\n"
                  "Content-Length: %d\r\n"
                  "Server: " RTSP_SERVER_NAME "\r\n",
-                 cseq, sdpLength);
+                 cseq, (int)(sdp.length + clock.length));
         sendRTSPResponse("200 OK", headers);
 
         // Send SDP in response body
-        client.print(sdp);
+        client.write((const uint8_t *)sdp.data, sdp.length);
+        client.write((const uint8_t *)clock.data, clock.length);
     }
-    else if (firstLine.startsWith("SETUP"))
+    else if (request.method.equals("SETUP"))
     {
         if (!validPath)
         {
@@ -278,133 +305,130 @@ void RTSPClientSession::processRequest()
         }
 
         // Extract client UDP ports and other Transport parameters
-        int transportIndex = request.indexOf("Transport:");
-        if (transportIndex != -1)
+        const RTSPStringView &transport = request.transport;
+        if (transport.empty())
         {
-            // Extract complete Transport line
-            int transportEnd = request.indexOf('\r', transportIndex);
-            String transportLine = request.substring(transportIndex, transportEnd);
+            LOG_ERROR("Transport header missing in SETUP request");
+            snprintf(headers, sizeof(headers), "CSeq: %d\r\n", cseq);
+            sendRTSPResponse("400 Bad Request", headers);
+            return;
+        }
 
-            LOG_DEBUG("Transport header received: " + transportLine);
-            LOG_DEBUG("Analyzing requested transport...");
+        LOG_DEBUGF("Transport header received: %.*s", transport.length, transport.data);
 
-            // Check if client requests TCP interleaved or if we force TCP mode
-            if (transportLine.indexOf("interleaved") != -1 || transportLine.indexOf("RTP/AVP/TCP") != -1 || RTSP_UDP_TCP_FALLBACK == 2)
+        RTSPStringView value;
+        const bool wantsMulticast = transport.contains("multicast") && !transport.contains("RTP/AVP/TCP");
+        if (wantsMulticast && (!RTSP_MULTICAST_ENABLED || !multicastGroup || requestStream != CAPTURE_STREAM_MAIN))
+        {
+            LOG_WARN("Multicast transport requested but disabled for this stream");
+            snprintf(headers, sizeof(headers), "CSeq: %d\r\n", cseq);
+            sendRTSPResponse("461 Unsupported Transport", headers);
+            return;
+        }
+
+        if (requestStream != stream)
+        {
+            stream = requestStream;
+            lastQueuedFrameId = 0; // Frame ids are counted per stream
+            LOG_INFOF("Session bound to %s", stream == CAPTURE_STREAM_SUB ? "substream " RTSP_SUBSTREAM_PATH : "main stream");
+        }
+
+        // Check if client requests multicast, TCP interleaved or if we force TCP mode
+        if (wantsMulticast)
+        {
+            useMulticast = true;
+            useTcpInterleaved = false;
+            LOG_INFOF("Client requests multicast - group %s:%d", RTSP_MULTICAST_GROUP, RTSP_MULTICAST_PORT);
+        }
+        else if (transport.getParam("interleaved", value) || transport.contains("RTP/AVP/TCP") || RTSP_UDP_TCP_FALLBACK == 2)
+        {
+            useTcpInterleaved = true;
+            if (RTSP_UDP_TCP_FALLBACK == 2)
             {
-                useTcpInterleaved = true;
-                if (RTSP_UDP_TCP_FALLBACK == 2)
-                {
-                    LOG_INFO("Forcing TCP interleaved mode (UDP disabled)");
-                }
-                else
-                {
-                    LOG_INFO("Client requests TCP interleaved");
-                }
+                LOG_INFO("Forcing TCP interleaved mode (UDP disabled)");
+            }
+            else
+            {
+                LOG_INFO("Client requests TCP interleaved");
+            }
 
-                // Extract interleaved channels
-                int channelIndex = transportLine.indexOf("interleaved=");
-                if (channelIndex != -1)
-                {
-                    int channelStart = channelIndex + 12;
-                    int channelEnd = transportLine.indexOf(';', channelStart);
-                    if (channelEnd == -1)
-                        channelEnd = transportLine.length();
-
-                    String channelStr = transportLine.substring(channelStart, channelEnd);
-                    int dashPos = channelStr.indexOf('-');
-                    if (dashPos != -1)
-                    {
-                        rtpChannel = channelStr.substring(0, dashPos).toInt();
-                        rtcpChannel = channelStr.substring(dashPos + 1).toInt();
-                        LOG_INFOF("Interleaved channels: RTP=%d, RTCP=%d", rtpChannel, rtcpChannel);
-                    }
-                    else
-                    {
-                        // If no range, use default channels
-                        rtpChannel = 0;
-                        rtcpChannel = 1;
-                        LOG_INFO("Default interleaved channels: RTP=0, RTCP=1");
-                    }
-                }
-                else
-                {
-                    // Default channels if not specified
-                    rtpChannel = 0;
-                    rtcpChannel = 1;
-                    LOG_INFO("Default interleaved channels: RTP=0, RTCP=1");
-                }
+            // Extract interleaved channels, default 0-1
+            uint16_t rtp = 0, rtcp = 1;
+            if (transport.getParam("interleaved", value) && value.toRange(rtp, rtcp))
+            {
+                LOG_INFOF("Interleaved channels: RTP=%d, RTCP=%d", rtp, rtcp);
             }
             else
             {
-                if (RTSP_UDP_TCP_FALLBACK == 2)
-                {
-                    useTcpInterleaved = true;
-                    LOG_INFO("Client requested UDP but forcing TCP mode");
-                }
-                else
-                {
-                    useTcpInterleaved = false;
-                    LOG_INFO("Client requests UDP");
-                }
+                rtp = 0;
+                rtcp = 1;
+                LOG_INFO("Default interleaved channels: RTP=0, RTCP=1");
+            }
+            rtpChannel = rtp;
+            rtcpChannel = rtcp;
+        }
+        else
+        {
+            useTcpInterleaved = false;
+            LOG_INFO("Client requests UDP");
 
-                // Extract client_port for UDP
-                int clientPortIndex = transportLine.indexOf("client_port=");
-                if (clientPortIndex != -1)
-                {
-                    int portStart = clientPortIndex + 12;
-                    int portSep = transportLine.indexOf('-', portStart);
-                    int portEnd = transportLine.indexOf(';', portStart);
-                    if (portEnd == -1)
-                        portEnd = transportLine.length();
-
-                    String port1 = transportLine.substring(portStart, portSep);
-                    String port2 = transportLine.substring(portSep + 1, portEnd);
-                    clientRtpPort = port1.toInt();
-                    clientRtcpPort = port2.toInt();
-                    clientRtpIp = client.remoteIP();
-
-                    // Port validation
-                    if (clientRtpPort == 0 || clientRtcpPort == 0)
-                    {
-                        LOG_ERROR("Invalid client ports in SETUP");
-                        snprintf(headers, sizeof(headers), "CSeq: %d\r\n", cseq);
-                        sendRTSPResponse("400 Bad Request", headers);
-                        return;
-                    }
-
-                    LOG_INFOF("SETUP: client RTP IP=%s, port=%d-%d", clientRtpIp.toString().c_str(), clientRtpPort, clientRtcpPort);
-                }
-                else
-                {
-                    LOG_ERROR("Invalid Transport header - client_port missing for UDP");
-                    snprintf(headers, sizeof(headers), "CSeq: %d\r\n", cseq);
-                    sendRTSPResponse("400 Bad Request", headers);
-                    return;
-                }
+            // Extract client_port for UDP
+            if (!transport.getParam("client_port", value) || !value.toRange(clientRtpPort, clientRtcpPort))
+            {
+                LOG_ERROR("Invalid Transport header - client_port missing for UDP");
+                snprintf(headers, sizeof(headers), "CSeq: %d\r\n", cseq);
+                sendRTSPResponse("400 Bad Request", headers);
+                return;
             }
+            clientRtpIp = client.remoteIP();
 
-            // Extract source (if present)
-            String source = "";
-            int sourceIndex = transportLine.indexOf("source=");
-            if (sourceIndex != -1)
+            // Port validation
+            if (clientRtpPort == 0 || clientRtcpPort == 0)
             {
-                int sourceStart = sourceIndex + 7;
-                int sourceEnd = transportLine.indexOf(';', sourceStart);
-                if (sourceEnd == -1)
-                    sourceEnd = transportLine.length();
-                source = transportLine.substring(sourceStart, sourceEnd);
+                LOG_ERROR("Invalid client ports in SETUP");
+                snprintf(headers, sizeof(headers), "CSeq: %d\r\n", cseq);
+                sendRTSPResponse("400 Bad Request", headers);
+                return;
             }
+
+            LOG_INFOF("SETUP: client RTP IP=%u.%u.%u.%u, port=%d-%d", clientRtpIp[0], clientRtpIp[1], clientRtpIp[2],
+                      clientRtpIp[3], clientRtpPort, clientRtcpPort);
         }
-        else
+
+        // Refuse a viewer the link or the heap cannot carry, before any socket is opened
+        AdmissionVerdict verdict = playing ? ADMISSION_OK : AdmissionControl::checkSetup(stream, useMulticast);
+        if (verdict != ADMISSION_OK)
         {
-            LOG_ERROR("Transport header missing in SETUP request");
+            LOG_WARNF("SETUP refused: %s", AdmissionControl::verdictName(verdict));
             snprintf(headers, sizeof(headers), "CSeq: %d\r\n", cseq);
-            sendRTSPResponse("400 Bad Request", headers);
+            sendRTSPResponse("453 Not Enough Bandwidth", headers);
             return;
         }
 
+        // SETUP announces how long the session lives without a keepalive
+        char sessionField[48];
+        if (RTSP_SESSION_TIMEOUT_S)
+        {
+            snprintf(sessionField, sizeof(sessionField), "%s;timeout=%d", sessionId, RTSP_SESSION_TIMEOUT_S);
+        }
+        else
+        {
+            snprintf(sessionField, sizeof(sessionField), "%s", sessionId);
+        }
+
         // Build response according to transport mode
-        if (useTcpInterleaved)
+        if (useMulticast)
+        {
+            // Same group for everyone, nothing to allocate per session
+            snprintf(headers, sizeof(headers),
+                     "CSeq: %d\r\n"
+                     "Transport: RTP/AVP;multicast;destination=%s;port=%d-%d;ttl=%d\r\n"
+                     "Session: %s\r\n"
+                     "Server: " RTSP_SERVER_NAME "\r\n",
+                     cseq, RTSP_MULTICAST_GROUP, RTSP_MULTICAST_PORT, RTSP_MULTICAST_PORT + 1,
+                     RTSP_MULTICAST_TTL, sessionField);
+        }
+        else if (useTcpInterleaved)
         {
             // TCP interleaved mode - no UDP needed
             LOG_INFO("TCP interleaved configuration");
@@ -414,13 +438,13 @@ void RTSPClientSession::processRequest()
                      "Transport: RTP/AVP/TCP;unicast;interleaved=%d-%d\r\n"
                      "Session: %s\r\n"
                      "Server: " RTSP_SERVER_NAME "\r\n",
-                     cseq, rtpChannel, rtcpChannel, sessionId.c_str());
+                     cseq, rtpChannel, rtcpChannel, sessionField);
         }
         else
         {
             // UDP mode - initialize UDP
             serverUdpPort = 20000 + (esp_random() % 10000);
-            if (!udp.begin(serverUdpPort))
+            if (!openRtpSocket())
             {
                 LOG_ERROR("UDP initialization error");
                 snprintf(headers, sizeof(headers), "CSeq: %d\r\n", cseq);
@@ -439,17 +463,15 @@ void RTSPClientSession::processRequest()
                      "Transport: RTP/AVP;unicast;client_port=%d-%d;server_port=%d-%d\r\n"
                      "Session: %s\r\n"
                      "Server: " RTSP_SERVER_NAME "\r\n",
-                     cseq, clientRtpPort, clientRtcpPort, serverRtpPort, serverRtcpPort, sessionId.c_str());
+                     cseq, clientRtpPort, clientRtcpPort, serverRtpPort, serverRtcpPort, sessionField);
         }
 
-        LOG_DEBUG("SETUP response:");
-        LOG_DEBUG("RTSP/1.0 200 OK");
-        LOG_DEBUG(String(headers));
-        LOG_DEBUG("Transport mode configured: " + String(useTcpInterleaved ? "TCP interleaved" : "UDP"));
+        LOG_DEBUGF("SETUP response: RTSP/1.0 200 OK - transport mode %s",
+                   useMulticast ? "multicast" : useTcpInterleaved ? "TCP interleaved" : "UDP");
 
         sendRTSPResponse("200 OK", headers);
     }
-    else if (firstLine.startsWith("PLAY"))
+    else if (request.method.equals("PLAY"))
     {
         if (!validPath)
         {
@@ -458,50 +480,98 @@ void RTSPClientSession::processRequest()
             return;
         }
 
+        // Conditions may have changed since SETUP (or during a PAUSE)
+        AdmissionVerdict verdict = playing ? ADMISSION_OK : AdmissionControl::admitPlay(stream, useMulticast);
+        if (verdict != ADMISSION_OK)
+        {
+            LOG_WARNF("PLAY refused: %s", AdmissionControl::verdictName(verdict));
+            snprintf(headers, sizeof(headers), "CSeq: %d\r\n", cseq);
+            sendRTSPResponse("453 Not Enough Bandwidth", headers);
+            return;
+        }
+
+        if (useMulticast && !multicastJoined)
+        {
+            if (!multicastGroup->join())
+            {
+                snprintf(headers, sizeof(headers), "CSeq: %d\r\n", cseq);
+                sendRTSPResponse("500 Internal Server Error", headers);
+                return;
+            }
+            multicastJoined = true;
+        }
+
         snprintf(headers, sizeof(headers),
                  "CSeq: %d\r\n"
                  "Session: %s\r\n"
                  "Range: npt=0.000-\r\n"
                  "Server: " RTSP_SERVER_NAME "\r\n",
-                 cseq, sessionId.c_str());
+                 cseq, sessionId);
         sendRTSPResponse("200 OK", headers);
         playing = true;
+        if (isInterleaved())
+        {
+            // From now on the connection is mostly media
+            Helpers::setSocketDscp(client.fd(), RTSP_INTERLEAVED_DSCP);
+        }
         lastFrameTime = DEFAULT_FRAME_TIME; // Reset timer
 
         // Reset parameters for new playback
-        currentFramerate = RTSP_FPS;
-        frameInterval = 1000 / RTSP_FPS;
+        currentFramerate = SdpBuilder::streamFps(stream);
+        frameInterval = 1000 / currentFramerate;
         udpErrorCount = 0;
         lastUdpErrorTime = 0;
 
-        // Reset frame counter and sequence number for new session
-        timecodeManager.resetFrameCounter();
-        sequenceNumber = 0; // Reset RTP sequence number for new session
+        // Reset sequence number for new session (timestamps follow the shared clock)
+        sequenceNumber = 0;
+
+        // Instant start: the last good frame now, not after the next capture
+        if (!useMulticast && CapturePipeline::isRunning())
+        {
+            SharedFrame *frame = stream == CAPTURE_STREAM_MAIN ? CapturePipeline::acquireCached(CAPTURE_CACHE_MAX_AGE_MS)
+                                                               : CapturePipeline::acquireLatest(0, stream);
+            if (frame)
+            {
+                enqueueFrame(frame);
+                FrameBroadcaster::release(frame);
+            }
+        }
 
         LOG_INFOF("RTSP playback started - FPS: %d", currentFramerate);
     }
-    else if (firstLine.startsWith("PAUSE"))
+    else if (request.method.equals("PAUSE"))
     {
         snprintf(headers, sizeof(headers),
                  "CSeq: %d\r\n"
                  "Session: %s\r\n"
                  "Server: " RTSP_SERVER_NAME "\r\n",
-                 cseq, sessionId.c_str());
+                 cseq, sessionId);
         sendRTSPResponse("200 OK", headers);
-        playing = false;
+        stopPlaying();
         LOG_INFO("RTSP playback paused");
     }
-    else if (firstLine.startsWith("TEARDOWN"))
+    else if (request.method.equals("TEARDOWN"))
     {
         snprintf(headers, sizeof(headers),
                  "CSeq: %d\r\n"
                  "Session: %s\r\n"
                  "Server: " RTSP_SERVER_NAME "\r\n",
-                 cseq, sessionId.c_str());
+                 cseq, sessionId);
         sendRTSPResponse("200 OK", headers);
-        playing = false;
+        stopPlaying();
+        closeRtpSocket(); // UDP ports back now, not when the viewer hangs up
         LOG_INFO("RTSP session closed");
     }
+    else if (request.method.equals("GET_PARAMETER"))
+    {
+        // Empty body = keepalive (RFC 2326 10.8); no parameter can be read
+        snprintf(headers, sizeof(headers),
+                 "CSeq: %d\r\n"
+                 "Session: %s\r\n"
+                 "Server: " RTSP_SERVER_NAME "\r\n",
+                 cseq, sessionId);
+        sendRTSPResponse(request.contentLength ? "451 Parameter Not Understood" : "200 OK", headers);
+    }
     else
     {
         snprintf(headers, sizeof(headers), "CSeq: %d\r\n", cseq);
@@ -511,561 +581,726 @@ void RTSPClientSession::processRequest()
 
 void RTSPClientSession::sendRTSPResponse(const char *status, const char *headers)
 {
-    client.print("RTSP/1.0 ");
-    client.print(status);
-    client.print("\r\n");
-    client.print(headers);
-    client.print("\r\n");
+    // Status line, headers and blank line in one write
+    int length = snprintf(response, sizeof(response), "RTSP/1.0 %s\r\n%s\r\n", status, headers);
+    if (length >= (int)sizeof(response))
+    {
+        length = sizeof(response) - 1;
+    }
+    client.write((const uint8_t *)response, length);
 }
 
-void RTSPClientSession::sendRTPFrame()
+void RTSPClientSession::enqueueFrame(SharedFrame *frame)
 {
-    // Check configuration according to transport mode
-    if (useTcpInterleaved || RTSP_UDP_TCP_FALLBACK == 2)
+    if (!frame || !frame->fb || !isClientStillConnected())
     {
-        sendRTPFrameTCP();
         return;
     }
-
-    if (clientRtpPort == 0)
+    if (frame->frameId <= lastQueuedFrameId)
     {
-        LOG_WARN("RTP port not configured, cannot send frame");
-        return; // No UDP port configured
+        return; // Already sent from the cache on PLAY
     }
+    lastQueuedFrameId = frame->frameId;
 
-    // Update timecodes for this frame
-    updateTimecodeForFrame();
+    // Hold a reference while the frame sits in our queue
+    FrameBroadcaster::retain(frame);
+    stats.framesQueued++;
+    lastFrameTime = frame->captureTime;
 
-    // Optimized capture for RTSP timing
-    camera_fb_t *fb = CameraManager::captureForced();
-    if (!fb)
+    // Latest frame wins: a frame still waiting behind the one in flight is
+    // stale once a newer one arrives, skip it at the frame boundary
+    if (queuedFrame)
     {
-        LOG_ERROR("Capture error for RTSP");
-        return;
+        FrameBroadcaster::release(queuedFrame);
+        stats.framesSkipped++;
+        LOG_DEBUGF("Client behind - stale frame skipped (total skipped: %lu)", stats.framesSkipped);
     }
-    LOG_DEBUGF("Frame captured successfully - Size: %d bytes, %dx%d", fb->len, fb->width, fb->height);
-
-    // Fragment image with optimized size for UDP (800 bytes max)
-    const int MAX_PACKET_SIZE = RTSP_MAX_FRAGMENT_SIZE; // Use optimized config
-    const int RTP_HEADER_SIZE = 12;
-    const int JPEG_HEADER_SIZE = 8;
-    const int MAX_PAYLOAD_SIZE = MAX_PACKET_SIZE - RTP_HEADER_SIZE - JPEG_HEADER_SIZE;
+    queuedFrame = frame;
 
-    int offset = 0;
-    bool isFirstFragment = true;
-    int fragments_sent = 0;
-    bool frameSentSuccessfully = true;
-
-    while (offset < fb->len)
+    if (!txFrame)
     {
-        int fragmentSize = fb->len - offset;
-        if (fragmentSize > MAX_PAYLOAD_SIZE)
-            fragmentSize = MAX_PAYLOAD_SIZE;
-
-        bool isLastFragment = (offset + fragmentSize) >= fb->len;
-
-        // Prepare RTP header
-        uint8_t rtpHeader[RTP_HEADER_SIZE + JPEG_HEADER_SIZE];
+        startNextFrame();
+    }
+}
 
-        // RTP Header (12 bytes) compliant with RTP/JPEG standards
-        rtpHeader[0] = 0x80; // Version 2, padding 0, extension 0, CSRC count 0
+bool RTSPClientSession::hasBacklog() const
+{
+    return txFrame != nullptr;
+}
 
-        // Payload type 26 (JPEG) + marker bit for last fragment
-        uint8_t payload_flags = 0x1A; // Payload type 26 (JPEG) - CORRECT for MJPEG
-        if (isLastFragment)
-        {
-            payload_flags |= 0x80; // Marker bit for last fragment
-        }
-        rtpHeader[1] = payload_flags;
+uint32_t RTSPClientSession::getPaceWaitMicros() const
+{
+    return txFrame && isPaced() ? pacer.getWaitMicros() : 0;
+}
 
-        // Validate payload type
-        if ((payload_flags & 0x7F) != 26)
-        {
-            Logger::errorf("Invalid RTP payload type - expected 26 (MJPEG), got %d", payload_flags & 0x7F);
-        }
-        rtpHeader[2] = (sequenceNumber >> 8) & 0xFF;
-        rtpHeader[3] = sequenceNumber & 0xFF;
-        // Use advanced PTS timecode
-        uint32_t rtpTimestamp = currentTimecode.pts;
-        rtpHeader[4] = (rtpTimestamp >> 24) & 0xFF;
-        rtpHeader[5] = (rtpTimestamp >> 16) & 0xFF;
-        rtpHeader[6] = (rtpTimestamp >> 8) & 0xFF;
-        rtpHeader[7] = rtpTimestamp & 0xFF;
-        // SSRC with synchronization metadata
-        rtpHeader[8] = 0x13; // SSRC identifier
-        rtpHeader[9] = 0xf9;
-        rtpHeader[10] = 0x7e;
-        rtpHeader[11] = 0x67;
-
-        // JPEG Header (8 bytes) compliant with RTP/JPEG standards
-        rtpHeader[12] = 0x00;                  // Type specific
-        rtpHeader[13] = (offset >> 16) & 0xFF; // Fragment offset (3 bytes)
-        rtpHeader[14] = (offset >> 8) & 0xFF;
-        rtpHeader[15] = offset & 0xFF;
-        rtpHeader[16] = 0x00;                             // Type (0 = 4:2:2, 1 = 4:2:0)
-        rtpHeader[17] = RTSP_MJPEG_COMPATIBILITY_QUALITY; // Configured quality factor
-        rtpHeader[18] = fb->width / 8;                    // Width in 8-pixel units
-        rtpHeader[19] = fb->height / 8;                   // Height in 8-pixel units
-
-        // Add keyframe information for HLS compatibility (UDP)
-        if (isFirstFragment)
-        {
-            // Signal that this is a keyframe (every MJPEG frame is a keyframe)
-            rtpHeader[12] |= 0x80; // Set keyframe bit in type specific field
-        }
+uint16_t RTSPClientSession::getBacklogPackets() const
+{
+    uint16_t packets = packetizer.getRemainingPackets();
+    packets += txPacketLen > 0 ? txPacketCount : 0;
+    if (queuedFrame)
+    {
+        packets += RtpJpegPacketizer::packetCount(queuedFrame, getMaxPayloadSize());
+    }
+    return packets;
+}
 
-        // Send RTP packet with improved robust error handling
-        bool packetSent = false;
-        int retryCount = 0;
+AbrLinkSample RTSPClientSession::sampleLink()
+{
+    AbrLinkSample sample;
+    sample.frames = stats.framesSent - sampledStats.framesSent;
+    sample.dropped = (stats.framesSkipped - sampledStats.framesSkipped) +
+                     (stats.framesAborted - sampledStats.framesAborted);
+    sample.sendTimeMs = stats.sendTimeMs - sampledStats.sendTimeMs;
+    sample.bytes = stats.bytesSent - sampledStats.bytesSent;
+    sample.backlogPackets = getBacklogPackets();
+
+    // Receiver view: worst RR loss of the window, or the NACKed share if higher
+    uint32_t packets = stats.packetsSent - sampledStats.packetsSent;
+    uint32_t nacked = receiver.nackedPackets - sampledNackedPackets;
+    uint32_t nackLoss = packets ? min(nacked * 100 / packets, (uint32_t)100) : 0;
+    sample.lossPercent = max((uint32_t)windowLossPercent, nackLoss);
+    sample.jitterMs = receiver.jitterMs;
+    sample.hasReceiverReport = receiver.reports > 0;
+
+    sampledStats = stats;
+    sampledNackedPackets = receiver.nackedPackets;
+    windowLossPercent = 0;
+    return sample;
+}
 
-        while (!packetSent && retryCount < RTSP_UDP_MAX_RETRIES)
-        {
-            // Check UDP connection before sending
-            if (!udp.beginPacket(clientRtpIp, clientRtpPort))
-            {
-                LOG_WARNF("UDP beginPacket error (attempt %d/%d) - buffer full or invalid port",
-                          retryCount + 1, RTSP_UDP_MAX_RETRIES);
-                retryCount++;
-                delay(RTSP_UDP_RETRY_DELAY);
+void RTSPClientSession::sampleAdmission(uint32_t &bytes, uint32_t &dropped)
+{
+    uint32_t droppedTotal = stats.framesSkipped + stats.framesAborted;
+    bytes += stats.bytesSent - admissionSampledBytes;
+    dropped += droppedTotal - admissionSampledDropped;
+    admissionSampledBytes = stats.bytesSent;
+    admissionSampledDropped = droppedTotal;
+}
 
-                // If too many beginPacket errors, try to reset UDP
-                if (retryCount >= RTSP_UDP_MAX_RETRIES / 2)
-                {
-                    LOG_WARN("Too many beginPacket errors - UDP reset");
-                    resetUDPConnection();
-                }
-                continue;
-            }
+bool RTSPClientSession::isInterleaved() const
+{
+    return useTcpInterleaved || RTSP_UDP_TCP_FALLBACK == 2;
+}
 
-            // Write data with verification
-            size_t headerWritten = udp.write(rtpHeader, RTP_HEADER_SIZE + JPEG_HEADER_SIZE);
-            size_t dataWritten = udp.write(fb->buf + offset, fragmentSize);
+bool RTSPClientSession::usesRetransmitCache() const
+{
+    return RTSP_NACK_ENABLED && RTSP_RTCP_ENABLED && !useMulticast && !isInterleaved() && rtcpSocket >= 0;
+}
 
-            if (headerWritten != (RTP_HEADER_SIZE + JPEG_HEADER_SIZE) || dataWritten != fragmentSize)
-            {
-                LOG_WARNF("UDP write error (attempt %d) - partial data", retryCount + 1);
-                retryCount++;
-                delay(RTSP_UDP_RETRY_DELAY);
-                continue;
-            }
+bool RTSPClientSession::isPaced() const
+{
+    // TCP paces itself through its window
+    return RTSP_PACING_ENABLED && !isInterleaved();
+}
 
-            // Send packet with timeout
-            if (!udp.endPacket())
-            {
-                LOG_WARNF("UDP endPacket error (attempt %d/%d) - packet lost or client disconnected",
-                          retryCount + 1, RTSP_UDP_MAX_RETRIES);
-                retryCount++;
+bool RTSPClientSession::pump()
+{
+    if (!txFrame)
+    {
+        return false;
+    }
 
-                // If last attempt and UDP fails, try TCP
-                if (retryCount >= RTSP_UDP_MAX_RETRIES && client.connected() && RTSP_UDP_TCP_FALLBACK >= 1)
-                {
-                    LOG_INFO("Fallback to TCP interleaved after repeated UDP errors");
-                    useTcpInterleaved = true;
-                    rtpChannel = 0;
-                    rtcpChannel = 1;
-                    frameSentSuccessfully = false;
-                    break; // Exit retry loop
-                }
+    if (!playing || !client.connected())
+    {
+        dropQueue();
+        return false;
+    }
 
-                delay(RTSP_UDP_RETRY_DELAY * 2); // Longer delay before retry
-                continue;
-            }
+    if (!isInterleaved() && (clientRtpPort == 0 || rtpSocket < 0))
+    {
+        LOG_WARN("RTP port not configured, cannot send frame");
+        dropQueue();
+        return false;
+    }
 
-            packetSent = true;
+    // Bounded packet budget per call so every session gets a turn
+    bool progress = false;
+    for (int budget = RTSP_TX_PACKETS_PER_PUMP; budget > 0 && txFrame; budget--)
+    {
+        // An interleaved SR goes out whole between two RTP packets
+        if (txPacketSent == 0 && rtcpPendingLen && !flushRtcpPending())
+        {
+            stats.sendStalls++;
+            break;
         }
 
-        if (!packetSent)
+        if (txPacketLen == 0)
         {
-            LOG_ERROR("Unable to send RTP packet after all attempts");
-            udpErrorCount++;
-            lastUdpErrorTime = millis();
-            frameSentSuccessfully = false;
+            METRIC_TIMER_START(packetizeStart);
+            stagePackets();
+            METRIC_TIMER_STOP(METRIC_PACKETIZE, packetizeStart);
+        }
 
-            // If too many consecutive UDP errors, reset connection
-            if (udpErrorCount >= RTSP_UDP_RESET_THRESHOLD && RTSP_UDP_AUTO_RESET)
+        // Token bucket: hold the packet until its share of the interval comes
+        if (!txPacketPaced)
+        {
+            if (!pacer.tryConsume(txPacketLen))
             {
-                LOG_WARN("Too many consecutive UDP errors - automatic reset");
-                resetUDPConnection();
-                udpErrorCount = 0;
-                delay(RTSP_UDP_RESET_DELAY);
+                stats.pacingWaits++;
+                break;
             }
-
-            break; // Exit loop if all attempts fail
+            txPacketPaced = true;
         }
-        else
+
+        size_t sentBefore = txPacketSent;
+        METRIC_TIMER_START(sendStart);
+        TxResult result = isInterleaved() ? writePacketTCP() : writePacketUDP();
+        METRIC_TIMER_STOP(METRIC_FRAGMENT_SEND, sendStart);
+        if (txPacketSent != sentBefore)
         {
-            // Reset error counter if send succeeds
-            if (udpErrorCount > 0)
-            {
-                udpErrorCount = (udpErrorCount - 1 > 0) ? (udpErrorCount - 1) : 0; // Decrement progressively
-            }
+            progress = true;
         }
 
-        fragments_sent++;
-        offset += fragmentSize;
-        // Sequence number is incremented per packet (RTP standard)
-        sequenceNumber++;
+        if (result == TX_PENDING)
+        {
+            // Socket full: resume from here on the next pump, never block
+            stats.sendStalls++;
+            break;
+        }
+        if (result == TX_FAILED)
+        {
+            break;
+        }
 
-        // Validate sequence number increment
-        if (sequenceNumber == 0) // Overflow protection
+        // Packets fully out
+        progress = true;
+        static bool firstPacketLogged = false;
+        if (!firstPacketLogged)
         {
-            LOG_WARN("RTP sequence number overflow - resetting to 1");
-            sequenceNumber = 1;
+            // Boot-to-first-RTP figure (see the boot timings in setup())
+            firstPacketLogged = true;
+            LOG_INFOF("First RTP packet %lu ms after reset", millis());
         }
+        stats.packetsSent += txPacketCount;
+        stats.bytesSent += txPacketLen;
+        txFrameBytes += txPacketLen;
+        for (uint8_t i = 0; i < txPacketCount; i++)
+        {
+            rtpOctetCount += txPackets[i].length(false) - RTP_HEADER_SIZE;
+        }
+        if (usesRetransmitCache())
+        {
+            retransmitCache.store(txPackets[0], sequenceNumber);
+        }
+        txPacketLen = 0;
+        txPacketSent = 0;
+        sequenceNumber += txPacketCount; // Sequence number is incremented per packet (RTP standard)
 
-        // Buffer management and delay between fragments to avoid overload
-        if (!isLastFragment)
+        if (!packetizer.hasMore())
         {
-            // Minimal delay for better timing - only if errors detected
-            if (udpErrorCount > 0 && fragments_sent % 3 == 0)
-            {
-                delay(RTSP_UDP_FRAGMENT_DELAY);
-            }
-            else
-            {
-                yield(); // Allow other tasks to execute
-            }
+            finishFrame(true);
         }
     }
+    return progress;
+}
 
-    // CRITICAL: Release frame buffer to prevent memory leaks
-    CameraManager::releaseFrame(fb);
+void RTSPClientSession::startNextFrame()
+{
+    txFrame = queuedFrame;
+    queuedFrame = nullptr;
+    txPacketLen = 0;
+    txPacketSent = 0;
+    txPacketRetries = 0;
+    txFrameStartMicros = micros();
+    txFrameBytes = 0;
+    if (txFrame)
+    {
+        packetizer.beginFrame(txFrame, getMaxPayloadSize(), rtpChannel, rtpTimestampOffset);
+        if (usesRetransmitCache())
+        {
+            retransmitCache.beginFrame(txFrame);
+        }
+        if (isPaced())
+        {
+            // Wire size: payload plus the RTP/JPEG (and RFC 2435) headers of every packet
+            pacer.beginFrame(packetizer.getFrameWireBytes(), frameInterval);
+        }
+        lastRtpTimestamp = txFrame->timecode.pts + rtpTimestampOffset;
+    }
+}
 
-    // If UDP failed and TCP fallback is enabled, send via TCP
-    if (!frameSentSuccessfully && (useTcpInterleaved || RTSP_UDP_TCP_FALLBACK >= 1) && client.connected())
+void RTSPClientSession::finishFrame(bool complete)
+{
+    if (complete)
     {
-        LOG_INFO("Sending frame via TCP after UDP failure");
-        sendRTPFrameTCP();
+        stats.framesSent++;
+        // Pacing waits say nothing about the link, keep them out of the ABR throughput
+        uint32_t elapsedMicros = micros() - txFrameStartMicros;
+        uint32_t throttledMicros = isPaced() ? pacer.getThrottledMicros() : 0;
+        stats.sendTimeMs += (elapsedMicros - min(throttledMicros, elapsedMicros)) / 1000;
+        if (isPaced())
+        {
+            pacer.endFrame(txFrameBytes, elapsedMicros);
+        }
+        // micros() is the esp_timer clock shared by both cores
+        METRIC_RECORD_US(METRIC_FRAME_AGE, micros() - txFrame->captureMicros);
+        LOG_DEBUGF("RTP frame %lu sent - Sequence: %d, Timestamp: %lu",
+                   txFrame->frameId, sequenceNumber, lastRtpTimestamp);
     }
-    else if (frameSentSuccessfully)
+    else
     {
-        LOG_DEBUGF("UDP frame sent successfully - Fragments: %d, Sequence: %d, Timestamp: %lu, Frame: %lu",
-                   fragments_sent, sequenceNumber, currentTimecode.pts, timecodeManager.getFrameCounter());
+        stats.framesAborted++;
     }
 
-    esp_camera_fb_return(fb);
-    // Timestamp is managed by TimecodeManager, no manual increment needed
+    // Frame buffer goes back to the pipeline once every session is done
+    // (and once the retransmit cache lets go of it)
+    packetizer.reset();
+    retransmitCache.endFrame(millis());
+    FrameBroadcaster::release(txFrame);
+    txFrame = nullptr;
+    txPacketLen = 0;
+    txPacketSent = 0;
+
+    if (queuedFrame)
+    {
+        startNextFrame();
+    }
 }
 
-void RTSPClientSession::sendRTPFrameTCP()
+void RTSPClientSession::leaveMulticast()
 {
-    // Update timecodes for this frame (CRITICAL for TCP mode)
-    updateTimecodeForFrame();
-
-    // In TCP mode, use forced capture without timing restrictions
-    camera_fb_t *fb = CameraManager::captureForced();
-    if (!fb)
+    // Reference held from PLAY to PAUSE/TEARDOWN/disconnect
+    if (multicastJoined)
     {
-        LOG_ERROR("Forced capture error for RTSP TCP");
-        return;
+        multicastGroup->leave();
+        multicastJoined = false;
     }
+}
 
-    LOG_DEBUGF("TCP frame captured - Size: %d bytes, Width: %d, Height: %d", fb->len, fb->width, fb->height);
-
-    // Fragment image if necessary (max ~1400 bytes per TCP packet)
-    const int MAX_PACKET_SIZE = 1400;
-    const int RTP_HEADER_SIZE = 12;
-    const int JPEG_HEADER_SIZE = 8;
-    const int MAX_PAYLOAD_SIZE = MAX_PACKET_SIZE - RTP_HEADER_SIZE - JPEG_HEADER_SIZE;
-
-    int offset = 0;
-    bool isFirstFragment = true;
-    int fragments_sent = 0;
-
-    while (offset < fb->len)
+void RTSPClientSession::dropQueue()
+{
+    if (txFrame)
     {
-        int fragmentSize = fb->len - offset;
-        if (fragmentSize > MAX_PAYLOAD_SIZE)
-            fragmentSize = MAX_PAYLOAD_SIZE;
-
-        bool isLastFragment = (offset + fragmentSize) >= fb->len;
-
-        // Prepare RTP header
-        uint8_t rtpHeader[RTP_HEADER_SIZE + JPEG_HEADER_SIZE];
+        finishFrame(false);
+    }
+    if (txFrame)
+    {
+        // Frame promoted from the queue by finishFrame()
+        finishFrame(false);
+    }
+    retransmitCache.clear();
+}
 
-        // RTP Header (12 bytes) compliant with RTP/JPEG standards
-        rtpHeader[0] = 0x80; // Version 2, padding 0, extension 0, CSRC count 0
+size_t RTSPClientSession::getMaxPayloadSize() const
+{
+    const size_t maxPacketSize = isInterleaved() ? RTSP_TCP_MAX_PACKET_SIZE : RTSP_MAX_FRAGMENT_SIZE;
+    return maxPacketSize - RTP_HEADER_SIZE - RTP_JPEG_HEADER_SIZE;
+}
 
-        // Payload type 26 (JPEG) + marker bit for last fragment
-        uint8_t payload_flags = 0x1A; // Payload type 26 (JPEG) - CORRECT for MJPEG
-        if (isLastFragment)
-        {
-            payload_flags |= 0x80; // Marker bit for last fragment only
-        }
-        rtpHeader[1] = payload_flags;
+void RTSPClientSession::stagePackets()
+{
+    txPacketCount = 0;
+    txPacketLen = 0;
+    txPacketSent = 0;
+    txPacketRetries = 0;
+    txPacketPaced = !isPaced();
+
+    // UDP: one datagram at a time. TCP: whole interleaved packets up to
+    // RTSP_TCP_COALESCE_BYTES, written by a single sendmsg()
+    const bool interleaved = isInterleaved();
+    do
+    {
+        RtpJpegPacket &packet = txPackets[txPacketCount];
+        packetizer.next(packet, sequenceNumber + txPacketCount);
+        txPacketLen += packet.length(interleaved);
+        txPacketCount++;
+    } while (interleaved && txPacketCount < RTSP_TCP_BATCH_PACKETS && packetizer.hasMore() &&
+             txPacketLen + RTSP_TCP_MAX_PACKET_SIZE + RTP_INTERLEAVED_HEADER_SIZE <= RTSP_TCP_COALESCE_BYTES);
+}
 
-        // Validate payload type for TCP mode
-        if ((payload_flags & 0x7F) != 26)
-        {
-            Logger::errorf("Invalid RTP payload type (TCP) - expected 26 (MJPEG), got %d", payload_flags & 0x7F);
-        }
-        rtpHeader[2] = (sequenceNumber >> 8) & 0xFF;
-        rtpHeader[3] = sequenceNumber & 0xFF;
-        // Use advanced PTS timecode
-        uint32_t rtpTimestamp = currentTimecode.pts;
-        rtpHeader[4] = (rtpTimestamp >> 24) & 0xFF;
-        rtpHeader[5] = (rtpTimestamp >> 16) & 0xFF;
-        rtpHeader[6] = (rtpTimestamp >> 8) & 0xFF;
-        rtpHeader[7] = rtpTimestamp & 0xFF;
-        // SSRC with synchronization metadata
-        rtpHeader[8] = 0x13; // SSRC identifier
-        rtpHeader[9] = 0xf9;
-        rtpHeader[10] = 0x7e;
-        rtpHeader[11] = 0x67;
-
-        // JPEG Header (8 bytes) compliant with RTP/JPEG standards
-        rtpHeader[12] = 0x00;                  // Type specific
-        rtpHeader[13] = (offset >> 16) & 0xFF; // Fragment offset (3 bytes)
-        rtpHeader[14] = (offset >> 8) & 0xFF;
-        rtpHeader[15] = offset & 0xFF;
-        rtpHeader[16] = 0x00;                             // Type (0 = 4:2:2, 1 = 4:2:0)
-        rtpHeader[17] = RTSP_MJPEG_COMPATIBILITY_QUALITY; // Configured quality factor
-        rtpHeader[18] = fb->width / 8;                    // Width in 8-pixel units
-        rtpHeader[19] = fb->height / 8;                   // Height in 8-pixel units
-
-        // Add keyframe information for HLS compatibility (TCP)
-        if (isFirstFragment)
+RTSPClientSession::TxResult RTSPClientSession::writePacketTCP()
+{
+    // One non-blocking sendmsg() for the whole batch: headers + payloads
+    // straight from the frame buffer. Partial progress is kept in txPacketSent.
+    int fd = client.fd();
+    while (txPacketSent < txPacketLen)
+    {
+        struct iovec iov[3 * RTSP_TCP_BATCH_PACKETS];
+        struct msghdr msg = {};
+        msg.msg_iov = iov;
+        size_t skip = txPacketSent;
+        int count = 0;
+        for (uint8_t i = 0; i < txPacketCount; i++)
         {
-            // Signal that this is a keyframe (every MJPEG frame is a keyframe)
-            rtpHeader[12] |= 0x80; // Set keyframe bit in type specific field
+            size_t length = txPackets[i].length(true);
+            if (skip >= length)
+            {
+                skip -= length;
+                continue;
+            }
+            count += RtpJpegPacketizer::toIovec(txPackets[i], true, skip, iov + count);
+            skip = 0;
         }
+        msg.msg_iovlen = count;
 
-        // Send RTP packet via TCP interleaved
-        // Format: '$' + channel + length + RTP data
-        uint16_t packetLength = RTP_HEADER_SIZE + JPEG_HEADER_SIZE + fragmentSize;
-
-        // TCP interleaved header (4 bytes)
-        uint8_t tcpHeader[4];
-        tcpHeader[0] = '$';                        // TCP interleaved marker
-        tcpHeader[1] = rtpChannel;                 // RTP channel
-        tcpHeader[2] = (packetLength >> 8) & 0xFF; // High length
-        tcpHeader[3] = packetLength & 0xFF;        // Low length
-
-        // Send TCP header
-        if (client.write(tcpHeader, 4) != 4)
+        int written = sendmsg(fd, &msg, MSG_DONTWAIT);
+        if (written > 0)
         {
-            LOG_WARN("TCP interleaved header send error");
-            break;
+            txPacketSent += written;
+            continue;
         }
 
-        // Send RTP data
-        if (client.write(rtpHeader, RTP_HEADER_SIZE + JPEG_HEADER_SIZE) != RTP_HEADER_SIZE + JPEG_HEADER_SIZE)
+        if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
         {
-            LOG_WARN("RTP header send error via TCP");
-            break;
+            return TX_PENDING;
         }
 
-        if (client.write(fb->buf + offset, fragmentSize) != fragmentSize)
-        {
-            LOG_WARN("RTP data send error via TCP");
-            // Don't break immediately, try to continue
-            if (!client.connected())
-            {
-                LOG_ERROR("TCP client disconnected during send");
-                break;
-            }
-            // Small delay before retry
-            delay(1);
-            continue;
-        }
+        LOG_ERRORF("TCP interleaved send error (errno %d) - closing session", errno);
+        dropQueue();
+        client.stop();
+        return TX_FAILED;
+    }
+    return TX_SENT;
+}
 
-        fragments_sent++;
-        offset += fragmentSize;
-        sequenceNumber++; // Increment sequence number by 1 per packet (RTP standard)
+RTSPClientSession::TxResult RTSPClientSession::writePacketUDP()
+{
+    struct iovec iov[3];
+    struct msghdr msg = {};
+    msg.msg_name = &rtpDest;
+    msg.msg_namelen = sizeof(rtpDest);
+    msg.msg_iov = iov;
+    msg.msg_iovlen = RtpJpegPacketizer::toIovec(txPackets[0], false, 0, iov);
+
+    if (sendmsg(rtpSocket, &msg, MSG_DONTWAIT) == (int)txPacketLen)
+    {
+        txPacketSent = txPacketLen;
 
-        // Validate sequence number increment for TCP mode
-        if (sequenceNumber == 0) // Overflow protection
+        // Decrement error counter progressively on success
+        if (udpErrorCount > 0)
         {
-            LOG_WARN("RTP sequence number overflow (TCP) - resetting to 1");
-            sequenceNumber = 1;
+            udpErrorCount--;
         }
+        return TX_SENT;
+    }
 
-        // Small delay between fragments to avoid overload (non-blocking)
-        if (!isLastFragment)
-        {
-            yield(); // Allow other tasks to execute
-        }
+    // lwIP out of pbufs: retry this packet on the next pump instead of delay()
+    stats.retries++;
+    txPacketRetries++;
+    if (txPacketRetries < RTSP_UDP_MAX_RETRIES)
+    {
+        return TX_PENDING;
     }
 
-    LOG_DEBUGF("TCP frame sent - Fragments: %d, Sequence: %d, Timestamp: %lu, Frame: %lu",
-               fragments_sent, sequenceNumber, currentTimecode.pts, timecodeManager.getFrameCounter());
+    LOG_WARNF("UDP packet failed after %d attempts (errno %d)", txPacketRetries, errno);
+    udpErrorCount++;
+    lastUdpErrorTime = millis();
 
-    // CRITICAL: Release frame buffer to prevent memory leaks
-    CameraManager::releaseFrame(fb);
-    // Timestamp is managed by TimecodeManager, no manual increment needed
-}
+    // Continue the rest of this frame over TCP if fallback is allowed
+    if (RTSP_UDP_TCP_FALLBACK >= 1 && client.connected())
+    {
+        LOG_INFO("Fallback to TCP interleaved after repeated UDP errors");
+        useTcpInterleaved = true;
+        Helpers::setSocketDscp(client.fd(), RTSP_INTERLEAVED_DSCP);
+        rtpChannel = 0;
+        rtcpChannel = 1;
+        stats.tcpFallbacks++;
+        retransmitCache.clear(); // NACKs only make sense over UDP
+        packetizer.setChannel(rtpChannel);
+        txPackets[0].header[1] = rtpChannel;
+        txPacketLen = txPackets[0].length(true);
+        txPacketRetries = 0;
+        return TX_PENDING;
+    }
 
-String RTSPClientSession::generateSessionId()
-{
-    static int sessionCounter = 0;
-    sessionCounter++;
-    return String(sessionCounter) + String(millis());
-}
+    // No fallback: give up on this frame, the next one starts clean
+    finishFrame(false);
 
-// ===== NEW METHODS FOR ADVANCED TIMECODES =====
+    // If too many consecutive UDP errors, reset connection
+    if (udpErrorCount >= RTSP_UDP_RESET_THRESHOLD && RTSP_UDP_AUTO_RESET)
+    {
+        LOG_WARN("Too many consecutive UDP errors - automatic reset");
+        resetUDPConnection();
+        udpErrorCount = 0;
+    }
+    return TX_FAILED;
+}
 
-void RTSPClientSession::generateAdvancedSDP(String &sdp)
+bool RTSPClientSession::openRtpSocket()
 {
-    // Complete SDP compliant with RTSP standards
-    sdp = "v=0\r\n";
-    sdp += "o=- " + String(timecodeManager.getWallClockMs()) + " " + String(timecodeManager.getWallClockMs()) + " IN IP4 " + WiFi.localIP().toString() + "\r\n";
-    sdp += "s=ESP32CAM-RTSP-Multi Stream\r\n";
-    sdp += "i=ESP32CAM MJPEG Stream compliant with RTSP\r\n";
-    sdp += "c=IN IP4 " + WiFi.localIP().toString() + "\r\n";
-    sdp += "t=0 0\r\n";
-    sdp += "a=control:*\r\n";
-
-    // RTSP session metadata
-    sdp += "a=type:broadcast\r\n";
-    sdp += "a=range:npt=0-\r\n";
-
-    // Video stream information with CORRECT framerate
-    sdp += "m=video 0 RTP/AVP 26\r\n";
-    sdp += "a=rtpmap:26 JPEG/" + String(RTSP_CLOCK_RATE) + "\r\n";
-    sdp += "a=control:" RTSP_PATH "\r\n";
-    sdp += "a=framerate:" + String(RTSP_SDP_FRAMERATE) + "\r\n";
-    sdp += "a=framerate:15.0\r\n"; // Explicit framerate for compatibility
+    closeRtpSocket();
 
-    // Add clock metadata if enabled
-    if (RTSP_ENABLE_CLOCK_METADATA)
+    rtpSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (rtpSocket < 0)
     {
-        addClockMetadataToSDP(sdp);
+        return false;
     }
 
-    // Add MJPEG metadata if enabled
-    if (RTSP_ENABLE_MJPEG_METADATA)
+    struct sockaddr_in local = {};
+    local.sin_family = AF_INET;
+    local.sin_port = htons(serverUdpPort);
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(rtpSocket, (struct sockaddr *)&local, sizeof(local)) < 0)
     {
-        // Use default dimensions for SDP
-        addMJPEGMetadataToSDP(sdp, 800, 600);
+        closeRtpSocket();
+        return false;
     }
+    fcntl(rtpSocket, F_SETFL, fcntl(rtpSocket, F_GETFL, 0) | O_NONBLOCK);
+    Helpers::setSocketDscp(rtpSocket, RTSP_RTP_DSCP);
+
+    rtpDest = {};
+    rtpDest.sin_family = AF_INET;
+    rtpDest.sin_port = htons(clientRtpPort);
+    rtpDest.sin_addr.s_addr = (uint32_t)clientRtpIp;
 
-    LOG_DEBUG("Complete RTSP-compliant SDP generated");
+    // RTCP on the next port, as announced in server_port. Streaming still
+    // works without it, only reports are lost.
+    if (RTSP_RTCP_ENABLED)
+    {
+        rtcpSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        local.sin_port = htons(serverUdpPort + 1);
+        if (rtcpSocket >= 0 && bind(rtcpSocket, (struct sockaddr *)&local, sizeof(local)) == 0)
+        {
+            fcntl(rtcpSocket, F_SETFL, fcntl(rtcpSocket, F_GETFL, 0) | O_NONBLOCK);
+            Helpers::setSocketDscp(rtcpSocket, RTSP_RTP_DSCP);
+            rtcpDest = rtpDest;
+            rtcpDest.sin_port = htons(clientRtcpPort);
+        }
+        else
+        {
+            LOG_WARNF("RTCP socket unavailable on port %d", serverUdpPort + 1);
+            if (rtcpSocket >= 0)
+            {
+                close(rtcpSocket);
+                rtcpSocket = -1;
+            }
+        }
+    }
+    return true;
 }
 
-void RTSPClientSession::addClockMetadataToSDP(String &sdp)
+void RTSPClientSession::closeRtpSocket()
 {
-    RTSPClockMetadata_t clockMeta = timecodeManager.getClockMetadata();
-
-    // Add clock metadata
-    sdp += "a=clock:" + String(clockMeta.rtp_timestamp) + "\r\n";
-    sdp += "a=wallclock:" + String(clockMeta.wall_clock_ms) + "\r\n";
-
-    if (clockMeta.clock_sync_status == RTSP_CLOCK_SYNC_OK)
+    retransmitCache.clear();
+    if (rtpSocket >= 0)
     {
-        sdp += "a=ntp:" + String(clockMeta.ntp_timestamp) + "\r\n";
-        sdp += "a=clock-sync:1\r\n";
+        close(rtpSocket);
+        rtpSocket = -1;
     }
-    else
+    if (rtcpSocket >= 0)
     {
-        sdp += "a=clock-sync:0\r\n";
+        close(rtcpSocket);
+        rtcpSocket = -1;
     }
-
-    sdp += "a=timecode-mode:" + String(clockMeta.timecode_mode) + "\r\n";
 }
 
-void RTSPClientSession::addMJPEGMetadataToSDP(String &sdp, uint16_t width, uint16_t height)
+void RTSPClientSession::serviceRtcp()
 {
-    RTSPMJPEGMetadata_t mjpegMeta = timecodeManager.getMJPEGMetadata(width, height);
-
-    // Add MJPEG metadata
-    sdp += "a=quality:" + String(mjpegMeta.quality_factor) + "\r\n";
-    sdp += "a=width:" + String(mjpegMeta.width) + "\r\n";
-    sdp += "a=height:" + String(mjpegMeta.height) + "\r\n";
-    sdp += "a=precision:" + String(mjpegMeta.precision) + "\r\n";
-
-    if (mjpegMeta.fragmentation_info)
+    // Receiver reports and NACKs on the UDP RTCP port
+    if (rtcpSocket >= 0)
     {
-        sdp += "a=fragmentation:1\r\n";
-        sdp += "a=max-fragment-size:" + String(RTSP_MAX_FRAGMENT_SIZE) + "\r\n";
+        uint8_t packet[RTSP_RTCP_BUFFER_SIZE];
+        int received;
+        while ((received = recv(rtcpSocket, packet, sizeof(packet), MSG_DONTWAIT)) > 0)
+        {
+            handleRtcp(packet, received);
+        }
     }
+    retransmitCache.expire(millis());
 
-    // MJPEG specific information
-    sdp += "a=mjpeg:1\r\n";
-    sdp += "a=keyframe-only:1\r\n"; // MJPEG = 100% keyframes
+    // Finish an interleaved SR the socket could not take at once
+    bool midPacket = txPacketSent > 0 && txPacketSent < txPacketLen;
+    if (rtcpPendingLen && !midPacket)
+    {
+        flushRtcpPending();
+    }
 
-    // Keyframe signaling according to RTSP standards
-    if (RTSP_SIGNAL_KEYFRAMES_IN_SDP)
+    unsigned long now = millis();
+    if (stats.packetsSent > 0 && now - lastRtcpReport >= RTSP_RTCP_INTERVAL_MS)
     {
-        sdp += "a=keyframe-interval:" + String(RTSP_KEYFRAME_INTERVAL) + "\r\n";
+        lastRtcpReport = now;
+        sendSenderReport();
     }
+}
 
-    // HLS compatibility metadata
-    if (RTSP_ENABLE_HLS_COMPATIBILITY)
+void RTSPClientSession::sendSenderReport()
+{
+    // Map "now" on both clocks: the RTP side reads the capture-time media
+    // clock the frame PTS come from, not an extrapolated frame timestamp
+    RtcpSenderInfo info;
+    info.ssrc = RTP_JPEG_SSRC;
+    info.ntpTime = TimecodeManager::getNTPTime();
+    info.rtpTimestamp = TimecodeManager::media().mediaTimestamp(esp_timer_get_time()) + rtpTimestampOffset;
+    info.packetCount = stats.packetsSent;
+    info.octetCount = rtpOctetCount;
+
+    if (isInterleaved())
     {
-        sdp += "a=segment-duration:" + String(RTSP_HLS_SEGMENT_DURATION) + "\r\n"; // Configurable segment duration
-        sdp += "a=segment-type:keyframe\r\n";                                      // Keyframe-based segmentation
-        sdp += "a=gop-size:" + String(RTSP_HLS_GOP_SIZE) + "\r\n";                 // Configurable GOP size
-        sdp += "a=closed-gop:" + String(RTSP_HLS_CLOSED_GOP) + "\r\n";             // Configurable closed GOP
+        if (rtcpPendingLen)
+        {
+            return; // Previous report still going out
+        }
+        size_t length = RtcpCodec::buildSenderReport(rtcpPending + RTP_INTERLEAVED_HEADER_SIZE,
+                                                     sizeof(rtcpPending) - RTP_INTERLEAVED_HEADER_SIZE, info);
+        rtcpPending[0] = '$';
+        rtcpPending[1] = rtcpChannel;
+        rtcpPending[2] = (length >> 8) & 0xFF;
+        rtcpPending[3] = length & 0xFF;
+        rtcpPendingLen = RTP_INTERLEAVED_HEADER_SIZE + length;
+        rtcpPendingSent = 0;
+
+        // Written now if no RTP packet is half out, else by pump()
+        if (!(txPacketSent > 0 && txPacketSent < txPacketLen))
+        {
+            flushRtcpPending();
+        }
+        return;
     }
 
-    // Video compatibility metadata
-    if (RTSP_ENABLE_VIDEO_COMPATIBILITY_METADATA)
+    if (rtcpSocket >= 0)
     {
-        sdp += "a=video-compatibility:1\r\n";
-        sdp += "a=mjpeg-quality:" + String(RTSP_MJPEG_COMPATIBILITY_QUALITY) + "\r\n";
+        uint8_t packet[RTCP_SR_MAX_SIZE];
+        size_t length = RtcpCodec::buildSenderReport(packet, sizeof(packet), info);
+        sendto(rtcpSocket, packet, length, MSG_DONTWAIT, (struct sockaddr *)&rtcpDest, sizeof(rtcpDest));
+    }
+}
 
-        if (RTSP_MJPEG_PROFILE_BASELINE)
+bool RTSPClientSession::flushRtcpPending()
+{
+    while (rtcpPendingSent < rtcpPendingLen)
+    {
+        int written = send(client.fd(), rtcpPending + rtcpPendingSent, rtcpPendingLen - rtcpPendingSent, MSG_DONTWAIT);
+        if (written > 0)
         {
-            sdp += "a=mjpeg-profile:baseline\r\n";
+            rtcpPendingSent += written;
+            continue;
         }
+        if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return false;
+        }
+        // Socket error: the next RTP write reports it and closes the session
+        break;
     }
+    rtcpPendingLen = 0;
+    rtcpPendingSent = 0;
+    return true;
+}
 
-    // Detailed codec information
-    if (RTSP_ENABLE_CODEC_INFO)
+void RTSPClientSession::retransmit(const RtcpFeedback &feedback)
+{
+    // Each entry names a packet (PID) and up to 16 following ones (BLP bits).
+    // Resent packets skip the pacer: they replace bytes the link already took.
+    uint8_t sent = 0;
+    for (uint8_t i = 0; i < feedback.nackCount; i++)
     {
-        sdp += "a=codec:mjpeg\r\n";
-        sdp += "a=codec-version:1.0\r\n";
-        sdp += "a=codec-profile:baseline\r\n";
-        sdp += "a=codec-level:1\r\n";
-    }
+        uint32_t mask = 1 | ((uint32_t)feedback.nackBlp[i] << 1);
+        for (uint8_t bit = 0; mask; bit++, mask >>= 1)
+        {
+            if (!(mask & 1))
+            {
+                continue;
+            }
+            if (sent >= RTSP_NACK_MAX_BURST)
+            {
+                LOG_DEBUGF("NACK burst capped at %d packets", RTSP_NACK_MAX_BURST);
+                return;
+            }
 
-    // Timing information for compatibility
-    sdp += "a=frame-duration:" + String(1000 / RTSP_FPS) + "ms\r\n";
-    sdp += "a=clock-rate:" + String(RTSP_CLOCK_RATE) + "\r\n";
+            const uint16_t seq = feedback.nackPid[i] + bit;
+            const RtpJpegPacket *packet = retransmitCache.find(seq);
+            if (!packet)
+            {
+                stats.retransmitMisses++;
+                continue;
+            }
 
-    // HLS-specific metadata for better compatibility
-    addHLSMetadataToSDP(sdp);
+            struct iovec iov[3];
+            struct msghdr msg = {};
+            msg.msg_name = &rtpDest;
+            msg.msg_namelen = sizeof(rtpDest);
+            msg.msg_iov = iov;
+            msg.msg_iovlen = RtpJpegPacketizer::toIovec(*packet, false, 0, iov);
+            if (sendmsg(rtpSocket, &msg, MSG_DONTWAIT) != (int)packet->length(false))
+            {
+                return; // Socket full: the viewer will NACK again if it still cares
+            }
+            stats.retransmits++;
+            sent++;
+        }
+    }
 }
 
-void RTSPClientSession::addHLSMetadataToSDP(String &sdp)
+void RTSPClientSession::handleRtcp(const uint8_t *data, size_t length)
 {
-    // Only add HLS metadata if enabled
-    if (!RTSP_ENABLE_HLS_COMPATIBILITY)
+    RtcpFeedback feedback;
+    if (!RtcpCodec::parse(data, length, RTP_JPEG_SSRC, feedback))
     {
+        LOG_DEBUGF("Invalid RTCP packet (%d bytes) ignored", length);
         return;
     }
+    lastActivity = millis(); // Receiver reports keep UDP viewers alive
+
+    if (feedback.hasReport)
+    {
+        receiver.reports++;
+        receiver.lossPercent = feedback.fractionLost * 100 / 256;
+        receiver.jitterMs = feedback.jitter / (RTSP_CLOCK_RATE / 1000);
+        int32_t rtt = RtcpCodec::roundTripMs(feedback, TimecodeManager::getNTPTime());
+        if (rtt >= 0)
+        {
+            receiver.rttMs = rtt;
+        }
+        windowLossPercent = max(windowLossPercent, receiver.lossPercent);
+        LOG_VERBOSEF("RTCP RR - loss %d%%, cumulative %ld, jitter %d ms, RTT %ld ms",
+                     receiver.lossPercent, (long)feedback.cumulativeLost, receiver.jitterMs, (long)receiver.rttMs);
+    }
+
+    if (feedback.nackedPackets)
+    {
+        receiver.nackedPackets += feedback.nackedPackets;
+        LOG_DEBUGF("RTCP NACK - %d packets reported lost", feedback.nackedPackets);
+        if (usesRetransmitCache())
+        {
+            retransmit(feedback);
+        }
+    }
 
-    // HLS-specific metadata for better compatibility with FFmpeg
-    sdp += "a=hls-version:3\r\n";                                                  // HLS version 3
-    sdp += "a=hls-segment-duration:" + String(RTSP_HLS_SEGMENT_DURATION) + "\r\n"; // Configurable segment duration
-    sdp += "a=hls-playlist-type:VOD\r\n";                                          // Video on Demand
-    sdp += "a=hls-target-duration:" + String(RTSP_HLS_SEGMENT_DURATION) + "\r\n";  // Target segment duration
-    sdp += "a=hls-allow-cache:1\r\n";                                              // Allow caching
-
-    // Keyframe information for HLS
-    sdp += "a=hls-keyframe-interval:" + String(RTSP_KEYFRAME_INTERVAL) + "\r\n"; // Configurable keyframe interval
-    sdp += "a=hls-gop-size:" + String(RTSP_HLS_GOP_SIZE) + "\r\n";               // Configurable GOP size
-    sdp += "a=hls-closed-gop:" + String(RTSP_HLS_CLOSED_GOP) + "\r\n";           // Configurable closed GOP
-
-    // Stream information
-    sdp += "a=hls-stream-type:video\r\n";
-    sdp += "a=hls-codec:mjpeg\r\n";
-    sdp += "a=hls-framerate:" + String(RTSP_FPS) + "\r\n"; // Use configured framerate
-    sdp += "a=hls-resolution:800x600\r\n";
-
-    // FFmpeg compatibility
-    sdp += "a=ffmpeg-compatible:1\r\n";
-    sdp += "a=ffmpeg-keyframe-mode:all\r\n"; // All frames are keyframes
-    sdp += "a=ffmpeg-gop-mode:closed\r\n";   // Closed GOP mode
+    if (feedback.bye)
+    {
+        LOG_DEBUG("RTCP BYE received");
+    }
 }
 
-void RTSPClientSession::updateTimecodeForFrame()
+void RTSPClientSession::generateSessionId()
 {
-    // Generate new timecode for current frame
-    currentTimecode = timecodeManager.generateTimecode();
+    static int sessionCounter = 0;
+    sessionCounter++;
+    snprintf(sessionId, sizeof(sessionId), "%d%lu", sessionCounter, millis());
+}
+
+// ===== NEW METHODS FOR ADVANCED TIMECODES =====
 
-    // Update RTP timestamp - use PTS directly
-    timestamp = currentTimecode.pts;
+char RTSPClientSession::sdpCacheData[CAPTURE_STREAM_COUNT][RTSP_SDP_BUFFER_SIZE];
+RTSPTextBuffer RTSPClientSession::sdpCache[CAPTURE_STREAM_COUNT] = {
+    RTSPTextBuffer(sdpCacheData[CAPTURE_STREAM_MAIN], RTSP_SDP_BUFFER_SIZE),
+    RTSPTextBuffer(sdpCacheData[CAPTURE_STREAM_SUB], RTSP_SDP_BUFFER_SIZE)};
+int RTSPClientSession::sdpCacheFrameSize[CAPTURE_STREAM_COUNT] = {-1, -1};
+uint32_t RTSPClientSession::sdpCacheAddress[CAPTURE_STREAM_COUNT] = {0, 0};
 
-    LOG_DEBUGF("Timecode updated - PTS: %lu, DTS: %lu, Frame: %lu", currentTimecode.pts, currentTimecode.dts, timecodeManager.getFrameCounter());
+const RTSPTextBuffer &RTSPClientSession::getCachedSDP(uint8_t sdpStream)
+{
+    // Rebuilt only when the resolution (ABR) or our address changes.
+    // Sessions all run in the RTSP task, so the shared cache needs no lock.
+    framesize_t frameSize = sdpStream == CAPTURE_STREAM_SUB ? RTSP_SUBSTREAM_FRAME_SIZE : AdaptiveBitrate::getFrameSize();
+    uint32_t address = (uint32_t)WiFi.localIP();
+    RTSPTextBuffer &cache = sdpCache[sdpStream];
+    if (frameSize != sdpCacheFrameSize[sdpStream] || address != sdpCacheAddress[sdpStream])
+    {
+        cache.clear();
+        const IPAddress ip = WiFi.localIP();
+        char localIp[16];
+        snprintf(localIp, sizeof(localIp), "%d.%d.%d.%d", ip[0], ip[1], ip[2], ip[3]);
+        SdpBuilder::build(cache, TimecodeManager::media(), sdpStream, resolution[frameSize].width, resolution[frameSize].height,
+                          localIp, millis());
+        if (cache.truncated)
+        {
+            LOG_WARNF("SDP truncated to %d bytes - increase RTSP_SDP_BUFFER_SIZE", cache.length);
+        }
+        sdpCacheFrameSize[sdpStream] = frameSize;
+        sdpCacheAddress[sdpStream] = address;
+        LOG_DEBUGF("SDP cached for stream %d, %dx%d (%d bytes)", sdpStream,
+                   resolution[frameSize].width, resolution[frameSize].height, cache.length);
+    }
+    return cache;
 }
@@ -10,8 +10,49 @@
 #define RTSP_CLIENT_SESSION_H
 
 #include <WiFi.h>
-#include <WiFiUdp.h>
 #include "../Utils/TimecodeManager.h"
+#include "FrameBroadcaster.h"
+#include "RtpJpegPacketizer.h"
+#include "RTSPRequestParser.h"
+#include "RTPMulticastGroup.h"
+#include "RtcpCodec.h"
+#include "RtpRetransmitCache.h"
+#include "PacketPacer.h"
+#include "AdmissionControl.h"
+#include "SdpBuilder.h"
+#include "../CameraManager/AdaptiveBitrate.h"
+
+/**
+ * @brief Per-session transmit counters
+ */
+struct RTSPSessionStats
+{
+    uint32_t framesQueued = 0;  // Frames handed over by the broadcaster
+    uint32_t framesSent = 0;    // Frames fully written
+    uint32_t framesSkipped = 0; // Stale frames replaced by a newer one before starting
+    uint32_t framesAborted = 0; // Frames dropped mid-way (UDP failure, teardown)
+    uint32_t packetsSent = 0;
+    uint32_t bytesSent = 0;
+    uint32_t sendStalls = 0;    // Pumps that stopped on a full socket
+    uint32_t retries = 0;       // UDP packets that had to be retried
+    uint32_t tcpFallbacks = 0;
+    uint32_t sendTimeMs = 0;    // Time from first to last packet of sent frames, pacing waits excluded
+    uint32_t pacingWaits = 0;   // Pumps that stopped because the pacer held the next packet
+    uint32_t retransmits = 0;   // UDP packets sent again for a NACK
+    uint32_t retransmitMisses = 0; // NACKed packets no longer in the retransmit cache
+};
+
+/**
+ * @brief What the viewer reports about the stream it receives (RTCP RR/NACK)
+ */
+struct RTSPReceiverStats
+{
+    uint32_t reports = 0;       // Receiver report blocks about our stream
+    uint32_t nackedPackets = 0; // Packets requested again by generic NACKs
+    uint8_t lossPercent = 0;    // Loss fraction of the last report
+    uint16_t jitterMs = 0;      // Interarrival jitter of the last report
+    int32_t rttMs = -1;         // Round trip from the last report, -1 = unknown
+};
 
 /**
  * @class RTSPClientSession
@@ -21,21 +62,73 @@
 class RTSPClientSession
 {
 public:
-    RTSPClientSession(WiFiClient client);
+    /**
+     * @param client Accepted RTSP control connection
+     * @param multicastGroup Shared multicast stream (nullptr = unicast only)
+     */
+    RTSPClientSession(WiFiClient client, RTPMulticastGroup *multicastGroup = nullptr);
     ~RTSPClientSession();
     void handle();
     bool isConnected();
+    bool isPlaying() const { return playing; }
+    bool isMulticast() const { return useMulticast; }
+    uint8_t getStream() const { return stream; } // CAPTURE_STREAM_* chosen by the SETUP path
+    bool wantsFrame(unsigned long now) const;
+
+    /**
+     * @brief Queue a frame for transmission, never blocks
+     *
+     * At most one frame waits behind the one in flight: a newer frame
+     * replaces it so a slow viewer skips frames instead of lagging.
+     *
+     * @param frame Shared frame (retained by the session while queued)
+     */
+    void enqueueFrame(SharedFrame *frame);
+
+    /**
+     * @brief Push up to RTSP_TX_PACKETS_PER_PUMP packets without blocking
+     *
+     * @return true if any byte was written
+     */
+    bool pump();
+
+    bool hasBacklog() const;
+    uint16_t getBacklogPackets() const;
+
+    /**
+     * @brief Time until the pacer lets the next packet out
+     *
+     * @return Microseconds, 0 if the session is not held back by pacing
+     */
+    uint32_t getPaceWaitMicros() const;
+    const RTSPSessionStats &getStats() const { return stats; }
+    const RTSPReceiverStats &getReceiverStats() const { return receiver; }
+    const char *getSessionId() const { return sessionId; }
+
+    /**
+     * @brief Get link statistics since the previous call (ABR window)
+     */
+    AbrLinkSample sampleLink();
+
+    /**
+     * @brief Add the bytes sent and frames dropped since the previous call (admission window)
+     */
+    void sampleAdmission(uint32_t &bytes, uint32_t &dropped);
 
 private:
     WiFiClient client;
     bool playing = false;
-    String sessionId;
-    WiFiUDP udp;
+    char sessionId[24];
+    RTSPRequestParser parser;
+    char response[RTSP_RESPONSE_BUFFER_SIZE]; // Reused for every response
+    int rtpSocket = -1;          // Non-blocking lwIP UDP socket for RTP
+    struct sockaddr_in rtpDest;  // Client RTP address
     IPAddress clientRtpIp;
     uint16_t clientRtpPort = 0;
     uint16_t clientRtcpPort = 0;
     unsigned long lastFrameTime = 0;
-    unsigned long frameInterval = 50; // Interval between frames in ms
+    unsigned long lastActivity = 0;   // millis() of the last request or RTCP packet (session timeout)
+    unsigned long frameInterval = 50; // Minimum interval between frames in ms (adaptive)
     uint16_t sequenceNumber = 0;      // Unique RTP sequence number per session
     uint32_t timestamp = 0;           // Unique RTP timestamp per session
 
@@ -44,6 +137,14 @@ private:
     uint8_t rtpChannel = 0;  // RTP channel for TCP interleaved
     uint8_t rtcpChannel = 1; // RTCP channel for TCP interleaved
 
+    // Main stream (RTSP_PATH) or low-resolution substream (RTSP_SUBSTREAM_PATH)
+    uint8_t stream = CAPTURE_STREAM_MAIN;
+
+    // Multicast: frames are sent once by the shared group, not by the session
+    RTPMulticastGroup *multicastGroup;
+    bool useMulticast = false;
+    bool multicastJoined = false;
+
     // Local UDP port used for RTP
     uint16_t serverUdpPort = 0;
 
@@ -55,28 +156,81 @@ private:
     uint8_t currentFramerate = RTSP_FPS;
     uint32_t lastFramerateAdjustment = 0;
 
-    // Advanced timecode manager
-    TimecodeManager timecodeManager;
-    RTSPTimecode_t currentTimecode;
-    
-    // Timing compensation variables
-    int32_t timingDrift = 0;           // Accumulated timing drift
-    unsigned long lastCompensationTime = 0; // Last compensation adjustment
+    // Non-blocking transmit queue
+    enum TxResult
+    {
+        TX_SENT,    // Packet fully written
+        TX_PENDING, // Socket busy, resume on next pump
+        TX_FAILED   // Frame or session dropped
+    };
+    SharedFrame *txFrame = nullptr;     // Frame being sent
+    SharedFrame *queuedFrame = nullptr; // Next frame (latest wins)
+    uint32_t lastQueuedFrameId = 0;     // Never queue the same capture twice
+    RtpJpegPacketizer packetizer;
+    RtpJpegPacket txPackets[RTSP_TCP_BATCH_PACKETS]; // Staged packets (payload points into txFrame)
+    uint8_t txPacketCount = 0;          // Packets staged: always 1 over UDP, a coalesced batch over TCP
+    size_t txPacketLen = 0;             // Staged bytes on the wire (0 = none staged)
+    size_t txPacketSent = 0;            // Staged bytes already written
+    uint8_t txPacketRetries = 0;
+    unsigned long txFrameStartMicros = 0; // micros() when txFrame was started
+    size_t txFrameBytes = 0;            // Bytes of txFrame written so far
+    PacketPacer pacer;                  // UDP token bucket
+    bool txPacketPaced = false;         // Staged packet already took its tokens
+    RTSPSessionStats stats;
+    RTSPSessionStats sampledStats;      // Snapshot at the previous sampleLink()
+    uint32_t admissionSampledBytes = 0; // Counters at the previous sampleAdmission()
+    uint32_t admissionSampledDropped = 0;
+
+    // RTCP: SR out on the server RTCP port / interleaved channel, RR and NACK in
+    int rtcpSocket = -1;                // Non-blocking UDP socket bound to serverUdpPort + 1
+    struct sockaddr_in rtcpDest;        // Client RTCP address
+    unsigned long lastRtcpReport = 0;
+    uint32_t rtpOctetCount = 0;         // RTP payload bytes sent (SR octet count)
+    uint32_t rtpTimestampOffset;        // Added to the shared PTS: the only per-session clock state
+    uint32_t lastRtpTimestamp = 0;      // RTP timestamp of the latest frame started
+    uint8_t rtcpPending[RTP_INTERLEAVED_HEADER_SIZE + RTCP_SR_MAX_SIZE]; // Interleaved SR being written
+    size_t rtcpPendingLen = 0;
+    size_t rtcpPendingSent = 0;
+    RTSPReceiverStats receiver;
+    uint8_t windowLossPercent = 0;      // Worst reported loss since the previous sampleLink()
+    uint32_t sampledNackedPackets = 0;
+    RtpRetransmitCache retransmitCache; // Last UDP packets, for RTSP_NACK_ENABLED
 
     void processRequest();
-    void sendRTPFrame();
-    void sendRTPFrameTCP(); // New method for TCP interleaved
+    void handleRequest(const RTSPRequest &request);
+    void startNextFrame();
+    void finishFrame(bool complete);
+    void dropQueue();
+    void leaveMulticast();
+    size_t getMaxPayloadSize() const;
+    bool isInterleaved() const;
+    bool isPaced() const;
+    void stagePackets();
+    TxResult writePacketTCP();
+    TxResult writePacketUDP();
+    bool openRtpSocket();
+    void closeRtpSocket();
+    void serviceRtcp();
+    void sendSenderReport();
+    bool flushRtcpPending();
+    void handleRtcp(const uint8_t *data, size_t length);
+    void retransmit(const RtcpFeedback &feedback);
+    bool usesRetransmitCache() const;
     void sendRTSPResponse(const char *status, const char *headers);
-    String generateSessionId();
+    void generateSessionId();
     bool isClientStillConnected(); // New method to detect disconnection
+    bool hasExpired(unsigned long now) const; // RTSP_SESSION_TIMEOUT_S without a request or RTCP
+    void stopPlaying();
     void resetUDPConnection();     // New method to reset UDP
 
     // New methods for advanced timecodes
-    void generateAdvancedSDP(String &sdp);
-    void addClockMetadataToSDP(String &sdp);
-    void addMJPEGMetadataToSDP(String &sdp, uint16_t width, uint16_t height);
-    void addHLSMetadataToSDP(String &sdp);
-    void updateTimecodeForFrame();
+    // SDP body shared by all sessions, rebuilt when the resolution changes
+    // (one per stream)
+    static char sdpCacheData[CAPTURE_STREAM_COUNT][RTSP_SDP_BUFFER_SIZE];
+    static RTSPTextBuffer sdpCache[CAPTURE_STREAM_COUNT];
+    static int sdpCacheFrameSize[CAPTURE_STREAM_COUNT];
+    static uint32_t sdpCacheAddress[CAPTURE_STREAM_COUNT];
+    const RTSPTextBuffer &getCachedSDP(uint8_t sdpStream);
 };
 
 #endif // RTSP_CLIENT_SESSION_H
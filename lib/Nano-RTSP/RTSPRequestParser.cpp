@@ -0,0 +1,339 @@
+/**
+ * @file RTSPRequestParser.cpp
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief Implementation of the allocation-free RTSP request parser
+ */
+// RTSPRequestParser.cpp
+#include "RTSPRequestParser.h"
+#include <strings.h>
+#include <stdarg.h>
+
+// ===== RTSPTextBuffer =====
+
+void RTSPTextBuffer::clear()
+{
+    length = 0;
+    truncated = false;
+    if (capacity)
+        data[0] = '\0';
+}
+
+void RTSPTextBuffer::append(const char *text)
+{
+    appendf("%s", text);
+}
+
+void RTSPTextBuffer::appendf(const char *format, ...)
+{
+    if (truncated || length >= capacity)
+    {
+        truncated = true;
+        return;
+    }
+
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(data + length, capacity - length, format, args);
+    va_end(args);
+
+    if (n < 0 || (size_t)n >= capacity - length)
+    {
+        // Keep the buffer terminated at the last complete piece
+        data[length] = '\0';
+        truncated = true;
+        return;
+    }
+    length += n;
+}
+
+// ===== RTSPStringView =====
+
+bool RTSPStringView::equals(const char *text) const
+{
+    size_t n = strlen(text);
+    return n == length && strncasecmp(data, text, n) == 0;
+}
+
+bool RTSPStringView::startsWith(const char *prefix) const
+{
+    size_t n = strlen(prefix);
+    return n <= length && strncmp(data, prefix, n) == 0;
+}
+
+bool RTSPStringView::contains(const char *text) const
+{
+    size_t n = strlen(text);
+    if (n == 0 || n > length)
+    {
+        return n == 0;
+    }
+    for (size_t i = 0; i + n <= length; i++)
+    {
+        if (strncmp(data + i, text, n) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+long RTSPStringView::toInt() const
+{
+    long value = 0;
+    for (uint16_t i = 0; i < length && data[i] >= '0' && data[i] <= '9'; i++)
+    {
+        value = value * 10 + (data[i] - '0');
+    }
+    return value;
+}
+
+bool RTSPStringView::getParam(const char *name, RTSPStringView &value) const
+{
+    const size_t n = strlen(name);
+    const char *p = data;
+    const char *end = data + length;
+
+    // Parameters are ';' separated: RTP/AVP;unicast;client_port=5000-5001
+    while (p < end)
+    {
+        const char *sep = (const char *)memchr(p, ';', end - p);
+        const char *paramEnd = sep ? sep : end;
+        if ((size_t)(paramEnd - p) >= n && strncasecmp(p, name, n) == 0 &&
+            (p + n == paramEnd || p[n] == '='))
+        {
+            value.data = p + n + (p + n < paramEnd ? 1 : 0);
+            value.length = paramEnd - value.data;
+            return true;
+        }
+        p = paramEnd + 1;
+    }
+    return false;
+}
+
+bool RTSPStringView::toRange(uint16_t &a, uint16_t &b) const
+{
+    if (empty() || data[0] < '0' || data[0] > '9')
+    {
+        return false;
+    }
+    a = toInt();
+    const char *dash = (const char *)memchr(data, '-', length);
+    if (dash && dash + 1 < data + length)
+    {
+        RTSPStringView second;
+        second.data = dash + 1;
+        second.length = data + length - second.data;
+        b = second.toInt();
+    }
+    else
+    {
+        b = a + 1;
+    }
+    return true;
+}
+
+// ===== RTSPRequestParser =====
+
+RTSPRequestParser::RTSPRequestParser()
+    : length(0), pendingConsume(0), interleavedSkip(0), skippedInterleaved(0), overflow(false) {}
+
+size_t RTSPRequestParser::feed(WiFiClient &client)
+{
+    size_t total = 0;
+    int available;
+    while ((available = client.available()) > 0 && length < sizeof(buffer))
+    {
+        size_t room = sizeof(buffer) - length;
+        int n = client.read((uint8_t *)buffer + length, min((size_t)available, room));
+        if (n <= 0)
+        {
+            break;
+        }
+        length += n;
+        total += n;
+    }
+    return total;
+}
+
+void RTSPRequestParser::compact(size_t count)
+{
+    if (count >= length)
+    {
+        length = 0;
+        return;
+    }
+    memmove(buffer, buffer + count, length - count);
+    length -= count;
+}
+
+int RTSPRequestParser::findHeaderEnd(const char *data, size_t length)
+{
+    // Accept both CRLF CRLF and bare LF LF
+    for (size_t i = 0; i + 1 < length; i++)
+    {
+        if (data[i] == '\n')
+        {
+            if (data[i + 1] == '\n')
+            {
+                return i + 2;
+            }
+            if (i + 2 < length && data[i + 1] == '\r' && data[i + 2] == '\n')
+            {
+                return i + 3;
+            }
+        }
+    }
+    return -1;
+}
+
+RTSPStringView RTSPRequestParser::trim(const char *start, const char *end)
+{
+    while (start < end && (*start == ' ' || *start == '\t'))
+        start++;
+    while (end > start && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r'))
+        end--;
+    RTSPStringView view;
+    view.data = start;
+    view.length = end - start;
+    return view;
+}
+
+bool RTSPRequestParser::next(RTSPRequest &request)
+{
+    if (pendingConsume)
+    {
+        consume();
+    }
+
+    // Pass on or drop interleaved binary data ($ + channel + 16-bit length
+    // + payload) and drop stray line breaks between requests
+    for (;;)
+    {
+        if (interleavedSkip)
+        {
+            size_t n = min(interleavedSkip, length);
+            compact(n);
+            interleavedSkip -= n;
+            if (interleavedSkip)
+            {
+                return false;
+            }
+        }
+        if (length > 0 && (buffer[0] == '\r' || buffer[0] == '\n'))
+        {
+            compact(1);
+            continue;
+        }
+        if (length > 0 && buffer[0] == '$')
+        {
+            if (length < 4)
+            {
+                return false;
+            }
+            size_t packetLen = 4 + (((uint8_t)buffer[2] << 8) | (uint8_t)buffer[3]);
+            if (interleavedHandler && packetLen <= sizeof(buffer))
+            {
+                if (length < packetLen)
+                {
+                    return false; // Wait for the rest of the packet
+                }
+                interleavedHandler((uint8_t)buffer[1], (const uint8_t *)buffer + 4, packetLen - 4);
+                compact(packetLen);
+                continue;
+            }
+            interleavedSkip = packetLen;
+            skippedInterleaved++;
+            continue;
+        }
+        break;
+    }
+
+    int headerEnd = findHeaderEnd(buffer, length);
+    if (headerEnd < 0)
+    {
+        if (length == sizeof(buffer))
+        {
+            overflow = true;
+            length = 0;
+        }
+        return false;
+    }
+
+    request = RTSPRequest();
+    const char *end = buffer + headerEnd;
+
+    // Request line: METHOD SP URI SP VERSION
+    const char *lineEnd = (const char *)memchr(buffer, '\n', headerEnd);
+    const char *sp1 = (const char *)memchr(buffer, ' ', lineEnd - buffer);
+    const char *sp2 = sp1 ? (const char *)memchr(sp1 + 1, ' ', lineEnd - sp1 - 1) : nullptr;
+    request.method = trim(buffer, sp1 ? sp1 : lineEnd);
+    if (sp1)
+    {
+        request.uri = trim(sp1 + 1, sp2 ? sp2 : lineEnd);
+    }
+
+    // Header lines: Name: value
+    for (const char *line = lineEnd + 1; line < end;)
+    {
+        const char *eol = (const char *)memchr(line, '\n', end - line);
+        if (!eol)
+            eol = end;
+        const char *colon = (const char *)memchr(line, ':', eol - line);
+        if (colon)
+        {
+            RTSPStringView name = trim(line, colon);
+            RTSPStringView value = trim(colon + 1, eol);
+            if (name.equals("CSeq"))
+            {
+                request.cseq = value.toInt();
+            }
+            else if (name.equals("Session"))
+            {
+                // Strip ";timeout=" suffix if the client echoes it
+                const char *semi = (const char *)memchr(value.data, ';', value.length);
+                if (semi)
+                    value.length = semi - value.data;
+                request.session = value;
+            }
+            else if (name.equals("Transport"))
+            {
+                request.transport = value;
+            }
+            else if (name.equals("Content-Length"))
+            {
+                request.contentLength = value.toInt();
+            }
+        }
+        line = eol + 1;
+    }
+
+    size_t total = headerEnd + request.contentLength;
+    if (total > sizeof(buffer))
+    {
+        overflow = true;
+        length = 0;
+        return false;
+    }
+    if (total > length)
+    {
+        return false; // Body not fully received yet
+    }
+
+    pendingConsume = total;
+    return true;
+}
+
+void RTSPRequestParser::consume()
+{
+    compact(pendingConsume);
+    pendingConsume = 0;
+}
+
+bool RTSPRequestParser::overflowed()
+{
+    bool result = overflow;
+    overflow = false;
+    return result;
+}
@@ -0,0 +1,162 @@
+/**
+ * @file RTSPRequestParser.h
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief Allocation-free incremental RTSP request parser
+ */
+// RTSPRequestParser.h
+#ifndef RTSP_REQUEST_PARSER_H
+#define RTSP_REQUEST_PARSER_H
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include <functional>
+#include "../../src/config.h"
+
+/**
+ * @brief Non-owning view on a run of characters in the parser buffer
+ */
+struct RTSPStringView
+{
+    const char *data = nullptr;
+    uint16_t length = 0;
+
+    bool empty() const { return length == 0; }
+    bool equals(const char *text) const;
+    bool startsWith(const char *prefix) const;
+    bool contains(const char *text) const;
+    long toInt() const;
+
+    /**
+     * @brief Find a ";name=value" parameter (Transport header)
+     *
+     * @param name Parameter name without '='
+     * @param value Set to the parameter value
+     * @return true if the parameter is present (a flag without value counts)
+     */
+    bool getParam(const char *name, RTSPStringView &value) const;
+
+    /**
+     * @brief Parse an "a-b" range (client_port, interleaved)
+     *
+     * @return false if the first number is missing; b defaults to a + 1
+     */
+    bool toRange(uint16_t &a, uint16_t &b) const;
+};
+
+/**
+ * @brief snprintf-style appender on a caller-provided buffer
+ *
+ * Used to build RTSP responses and the SDP without String. Output that
+ * does not fit is dropped and flagged, never written past the end.
+ */
+struct RTSPTextBuffer
+{
+    char *data;
+    size_t capacity;
+    size_t length = 0;
+    bool truncated = false;
+
+    RTSPTextBuffer(char *buffer, size_t size) : data(buffer), capacity(size)
+    {
+        if (capacity)
+            data[0] = '\0';
+    }
+
+    void clear();
+    void append(const char *text);
+    void appendf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+/**
+ * @brief Parsed RTSP request, views into the parser buffer
+ *
+ * Valid until RTSPRequestParser::consume().
+ */
+struct RTSPRequest
+{
+    RTSPStringView method;
+    RTSPStringView uri;
+    RTSPStringView session;
+    RTSPStringView transport;
+    int cseq = DEFAULT_CSEQ;
+    size_t contentLength = 0;
+};
+
+/**
+ * @brief Receives interleaved binary packets ($ + channel + length) found on the RTSP socket
+ */
+typedef std::function<void(uint8_t channel, const uint8_t *data, size_t length)> RTSPInterleavedHandler;
+
+/**
+ * @class RTSPRequestParser
+ * @brief Incremental RTSP request parser on a fixed buffer.
+ *
+ * Bytes are appended as they arrive with feed(); next() returns a
+ * request only once its header (and body, if any) is complete, so
+ * partial reads and pipelined requests are both handled. Interleaved
+ * binary packets sent by the client on the RTSP socket (RTCP over TCP)
+ * are handed to the interleaved handler, or skipped without one.
+ * Nothing is allocated on the heap.
+ */
+class RTSPRequestParser
+{
+public:
+    RTSPRequestParser();
+
+    /**
+     * @brief Read whatever the client has available, without blocking
+     *
+     * @return Number of bytes appended
+     */
+    size_t feed(WiFiClient &client);
+
+    /**
+     * @brief Get the next complete request
+     *
+     * @param request Filled with views into the buffer
+     * @return true if a complete request is available
+     */
+    bool next(RTSPRequest &request);
+
+    /**
+     * @brief Drop the request returned by next() from the buffer
+     */
+    void consume();
+
+    /**
+     * @brief Check if the buffer filled up without a complete request
+     *
+     * The buffer is cleared when this happens; the caller should answer
+     * 400 Bad Request.
+     */
+    bool overflowed();
+
+    /**
+     * @brief Deliver complete interleaved packets to a handler instead of skipping them
+     *
+     * Packets larger than the request buffer are still skipped.
+     */
+    void setInterleavedHandler(RTSPInterleavedHandler handler) { interleavedHandler = handler; }
+
+    /**
+     * @brief Get the number of interleaved packets skipped since startup
+     */
+    uint32_t getSkippedInterleaved() const { return skippedInterleaved; }
+
+private:
+    char buffer[RTSP_REQUEST_BUFFER_SIZE];
+    size_t length;
+    size_t pendingConsume;  // Size of the request returned by next()
+    size_t interleavedSkip; // Bytes of an interleaved packet still to discard
+    uint32_t skippedInterleaved;
+    bool overflow;
+    RTSPInterleavedHandler interleavedHandler;
+
+    void compact(size_t count);
+    static int findHeaderEnd(const char *data, size_t length);
+    static RTSPStringView trim(const char *start, const char *end);
+};
+
+#endif // RTSP_REQUEST_PARSER_H
@@ -0,0 +1,165 @@
+/**
+ * @file RtcpCodec.cpp
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief Implementation of the RTCP sender report builder and feedback parser
+ */
+// RtcpCodec.cpp
+#include "RtcpCodec.h"
+
+static const char RTCP_CNAME[] = "esp32cam";
+
+static inline void put16(uint8_t *p, uint16_t v)
+{
+    p[0] = v >> 8;
+    p[1] = v & 0xFF;
+}
+
+static inline void put32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = (v >> 16) & 0xFF;
+    p[2] = (v >> 8) & 0xFF;
+    p[3] = v & 0xFF;
+}
+
+static inline uint16_t get16(const uint8_t *p)
+{
+    return ((uint16_t)p[0] << 8) | p[1];
+}
+
+static inline uint32_t get32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+size_t RtcpCodec::buildSenderReport(uint8_t *buffer, size_t size, const RtcpSenderInfo &info)
+{
+    // SR without report blocks (we receive nothing) = 28 bytes
+    const size_t srLen = 28;
+    // SDES: header + SSRC + CNAME item + terminating null, padded to 32 bits
+    const size_t cnameLen = sizeof(RTCP_CNAME) - 1;
+    const size_t sdesLen = (8 + 2 + cnameLen + 1 + 3) & ~(size_t)3;
+    if (size < srLen + sdesLen)
+    {
+        return 0;
+    }
+
+    uint8_t *p = buffer;
+    p[0] = 0x80; // V=2, P=0, RC=0
+    p[1] = RTCP_PT_SR;
+    put16(p + 2, srLen / 4 - 1);
+    put32(p + 4, info.ssrc);
+    put32(p + 8, (uint32_t)(info.ntpTime >> 32));
+    put32(p + 12, (uint32_t)info.ntpTime);
+    put32(p + 16, info.rtpTimestamp);
+    put32(p + 20, info.packetCount);
+    put32(p + 24, info.octetCount);
+
+    p = buffer + srLen;
+    memset(p, 0, sdesLen);
+    p[0] = 0x81; // V=2, SC=1
+    p[1] = RTCP_PT_SDES;
+    put16(p + 2, sdesLen / 4 - 1);
+    put32(p + 4, info.ssrc);
+    p[8] = 1; // CNAME
+    p[9] = cnameLen;
+    memcpy(p + 10, RTCP_CNAME, cnameLen);
+    // Item list end and padding are already zero
+
+    return srLen + sdesLen;
+}
+
+bool RtcpCodec::parse(const uint8_t *data, size_t length, uint32_t ssrc, RtcpFeedback &feedback)
+{
+    feedback = RtcpFeedback();
+    if (length < 4 || (data[0] & 0xC0) != 0x80)
+    {
+        return false;
+    }
+
+    // Walk the compound packet one RTCP packet at a time
+    size_t offset = 0;
+    while (offset + 4 <= length)
+    {
+        const uint8_t *p = data + offset;
+        if ((p[0] & 0xC0) != 0x80)
+        {
+            return false;
+        }
+        const uint8_t count = p[0] & 0x1F; // RC, SC or FMT
+        const uint8_t type = p[1];
+        const size_t packetLen = ((size_t)get16(p + 2) + 1) * 4;
+        if (offset + packetLen > length)
+        {
+            return false;
+        }
+
+        if (type == RTCP_PT_SR || type == RTCP_PT_RR)
+        {
+            size_t blocks = 8 + (type == RTCP_PT_SR ? 20 : 0);
+            for (uint8_t i = 0; i < count && blocks + 24 <= packetLen; i++, blocks += 24)
+            {
+                const uint8_t *b = p + blocks;
+                if (get32(b) != ssrc)
+                {
+                    continue;
+                }
+                feedback.hasReport = true;
+                feedback.fractionLost = b[4];
+                // 24-bit signed cumulative count
+                int32_t lost = ((int32_t)b[5] << 16) | ((int32_t)b[6] << 8) | b[7];
+                if (lost & 0x800000)
+                {
+                    lost -= 0x1000000;
+                }
+                feedback.cumulativeLost = lost;
+                feedback.highestSequence = get32(b + 8);
+                feedback.jitter = get32(b + 12);
+                feedback.lastSR = get32(b + 16);
+                feedback.delaySinceLastSR = get32(b + 20);
+            }
+        }
+        else if (type == RTCP_PT_RTPFB && count == 1 && packetLen >= 12 && get32(p + 8) == ssrc)
+        {
+            // Generic NACK: PID + bitmask of the 16 following packets
+            for (size_t fci = 12; fci + 4 <= packetLen; fci += 4)
+            {
+                uint16_t pid = get16(p + fci);
+                uint16_t blp = get16(p + fci + 2);
+                feedback.nackedPackets += 1 + __builtin_popcount(blp);
+                if (feedback.nackCount < RTSP_RTCP_MAX_NACKS)
+                {
+                    feedback.nackPid[feedback.nackCount] = pid;
+                    feedback.nackBlp[feedback.nackCount] = blp;
+                    feedback.nackCount++;
+                }
+            }
+        }
+        else if (type == RTCP_PT_BYE)
+        {
+            feedback.bye = true;
+        }
+
+        offset += packetLen;
+    }
+    return true;
+}
+
+int32_t RtcpCodec::roundTripMs(const RtcpFeedback &feedback, uint64_t now)
+{
+    if (!feedback.hasReport || feedback.lastSR == 0)
+    {
+        return -1;
+    }
+
+    // All three values are in 1/65536 s (middle 32 bits of NTP time)
+    uint32_t arrival = (uint32_t)(now >> 16);
+    uint32_t rtt = arrival - feedback.lastSR - feedback.delaySinceLastSR;
+    if ((int32_t)rtt < 0)
+    {
+        return 0;
+    }
+    return (int32_t)(((uint64_t)rtt * 1000) >> 16);
+}
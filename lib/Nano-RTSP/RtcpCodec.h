@@ -0,0 +1,98 @@
+/**
+ * @file RtcpCodec.h
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief RTCP sender report builder and receiver feedback parser (RFC 3550, RFC 4585)
+ */
+// RtcpCodec.h
+#ifndef RTCP_CODEC_H
+#define RTCP_CODEC_H
+
+#include <Arduino.h>
+#include "../../src/config.h"
+
+// RTCP packet types
+#define RTCP_PT_SR 200
+#define RTCP_PT_RR 201
+#define RTCP_PT_SDES 202
+#define RTCP_PT_BYE 203
+#define RTCP_PT_RTPFB 205 // Transport-layer feedback, FMT 1 = generic NACK
+
+// Worst case compound SR: header + sender info + SDES CNAME
+#define RTCP_SR_MAX_SIZE 64
+
+/**
+ * @brief Sender side state for one SR
+ */
+struct RtcpSenderInfo
+{
+    uint32_t ssrc = 0;
+    uint64_t ntpTime = 0;      // NTP timestamp (32.32 fixed point) at the time of the report
+    uint32_t rtpTimestamp = 0; // RTP timestamp matching ntpTime
+    uint32_t packetCount = 0;  // RTP packets sent since the start
+    uint32_t octetCount = 0;   // RTP payload bytes sent since the start
+};
+
+/**
+ * @brief What a receiver told us in one compound RTCP packet
+ */
+struct RtcpFeedback
+{
+    bool hasReport = false;   // A report block about our SSRC was found
+    uint8_t fractionLost = 0; // Loss since the previous report, 1/256 units
+    int32_t cumulativeLost = 0;
+    uint32_t highestSequence = 0; // Extended highest sequence number received
+    uint32_t jitter = 0;          // Interarrival jitter, RTP timestamp units
+    uint32_t lastSR = 0;          // Middle 32 bits of the NTP time of our last SR
+    uint32_t delaySinceLastSR = 0; // 1/65536 s
+    uint8_t nackCount = 0;        // Generic NACK entries kept below
+    uint16_t nackPid[RTSP_RTCP_MAX_NACKS];
+    uint16_t nackBlp[RTSP_RTCP_MAX_NACKS];
+    uint16_t nackedPackets = 0; // Packets requested by every NACK entry, kept or not
+    bool bye = false;
+};
+
+/**
+ * @class RtcpCodec
+ * @brief Stateless RTCP encoding and decoding on caller buffers.
+ *
+ * Sessions build a compound SR + SDES packet every RTSP_RTCP_INTERVAL_MS
+ * and feed every RTCP packet a client sends (UDP port or interleaved
+ * channel) to parse(). Nothing is allocated.
+ */
+class RtcpCodec
+{
+public:
+    /**
+     * @brief Build a compound SR + SDES (CNAME) packet
+     *
+     * @param buffer Output buffer
+     * @param size Buffer size (RTCP_SR_MAX_SIZE is always enough)
+     * @param info Sender state
+     * @return Packet size, 0 if the buffer is too small
+     */
+    static size_t buildSenderReport(uint8_t *buffer, size_t size, const RtcpSenderInfo &info);
+
+    /**
+     * @brief Parse a compound RTCP packet from a receiver
+     *
+     * @param data Packet bytes
+     * @param length Packet size
+     * @param ssrc Our SSRC: only report blocks and NACKs about it are kept
+     * @param feedback Filled with what was found
+     * @return false if the packet is not valid RTCP
+     */
+    static bool parse(const uint8_t *data, size_t length, uint32_t ssrc, RtcpFeedback &feedback);
+
+    /**
+     * @brief Round-trip time from a report block (RFC 3550 6.4.1)
+     *
+     * @param feedback Parsed report
+     * @param now NTP time when the report was received
+     * @return RTT in ms, or -1 if the receiver has not seen an SR yet
+     */
+    static int32_t roundTripMs(const RtcpFeedback &feedback, uint64_t now);
+};
+
+#endif // RTCP_CODEC_H
@@ -0,0 +1,263 @@
+/**
+ * @file RtpJpegPacketizer.cpp
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief Implementation of the zero-copy RTP/JPEG packetizer
+ */
+// RtpJpegPacketizer.cpp
+#include "RtpJpegPacketizer.h"
+
+// Offsets inside RtpJpegPacket::header
+static constexpr size_t RTP_OFFSET = RTP_INTERLEAVED_HEADER_SIZE;
+static constexpr size_t JPEG_OFFSET = RTP_INTERLEAVED_HEADER_SIZE + RTP_HEADER_SIZE;
+
+// Q values >= 128 announce in-band quantization tables; 255 = tables may change every frame
+static constexpr uint8_t RTP_JPEG_DYNAMIC_Q = 255;
+
+RtpJpegPacketizer::RtpJpegPacketizer()
+    : frame(nullptr), data(nullptr), dataLen(0), offset(0), maxPayload(0),
+      headerLen(RTP_PACKET_HEADER_SIZE), qtableHeaderLen(0)
+{
+    memset(headerTemplate, 0, sizeof(headerTemplate));
+}
+
+bool RtpJpegPacketizer::useScanPayload(const SharedFrame *frame)
+{
+    return RTSP_JPEG_RFC2435 && frame->jpeg.rfc2435;
+}
+
+void RtpJpegPacketizer::beginFrame(const SharedFrame *newFrame, size_t newMaxPayload, uint8_t channel,
+                                   uint32_t timestampOffset)
+{
+    frame = newFrame;
+    offset = 0;
+    maxPayload = newMaxPayload;
+    headerLen = RTP_PACKET_HEADER_SIZE;
+    qtableHeaderLen = 0;
+
+    const camera_fb_t *fb = frame->fb;
+    const JpegFrameInfo &jpeg = frame->jpeg;
+    const bool scanPayload = useScanPayload(frame);
+
+    uint8_t *t = headerTemplate;
+
+    // TCP interleaved header (4 bytes): '$' + channel + length (patched per packet)
+    t[0] = '$';
+    t[1] = channel;
+
+    uint8_t *rtp = t + RTP_OFFSET;
+    rtp[0] = 0x80; // Version 2, padding 0, extension 0, CSRC count 0
+    rtp[1] = 0x1A; // Payload type 26 (JPEG) - marker bit patched on last packet
+    // Shared PTS timecode, identical for every packet of the frame
+    const uint32_t rtpTimestamp = frame->timecode.pts + timestampOffset;
+    rtp[4] = (rtpTimestamp >> 24) & 0xFF;
+    rtp[5] = (rtpTimestamp >> 16) & 0xFF;
+    rtp[6] = (rtpTimestamp >> 8) & 0xFF;
+    rtp[7] = rtpTimestamp & 0xFF;
+    // SSRC identifier
+    rtp[8] = (RTP_JPEG_SSRC >> 24) & 0xFF;
+    rtp[9] = (RTP_JPEG_SSRC >> 16) & 0xFF;
+    rtp[10] = (RTP_JPEG_SSRC >> 8) & 0xFF;
+    rtp[11] = RTP_JPEG_SSRC & 0xFF;
+
+    // JPEG Header (8 bytes) compliant with RTP/JPEG standards
+    uint8_t *jpegHeader = t + JPEG_OFFSET;
+    if (scanPayload)
+    {
+        jpegHeader[0] = 0x00; // Type specific
+        jpegHeader[4] = jpeg.type;
+        jpegHeader[5] = RTP_JPEG_DYNAMIC_Q;
+        jpegHeader[6] = (jpeg.width + 7) / 8;  // Width in 8-pixel units
+        jpegHeader[7] = (jpeg.height + 7) / 8; // Height in 8-pixel units
+
+        if (jpeg.restartInterval)
+        {
+            // Types 64-127: restart marker header, F = L = 1, count 0x3FFF
+            // (fragments are not aligned on restart intervals)
+            jpegHeader[4] |= 64;
+            uint8_t *restart = t + RTP_PACKET_HEADER_SIZE;
+            restart[0] = (jpeg.restartInterval >> 8) & 0xFF;
+            restart[1] = jpeg.restartInterval & 0xFF;
+            restart[2] = 0xFF;
+            restart[3] = 0xFF;
+            headerLen += RTP_JPEG_RESTART_HEADER_SIZE;
+        }
+
+        buildQuantizationHeader(jpeg);
+        data = fb->buf + jpeg.scanOffset;
+        dataLen = jpeg.scanLength;
+    }
+    else
+    {
+        jpegHeader[0] = 0x80;                             // Type specific (keyframe flag for HLS compatibility)
+        jpegHeader[4] = 0x00;                             // Type (0 = 4:2:2, 1 = 4:2:0)
+        jpegHeader[5] = RTSP_MJPEG_COMPATIBILITY_QUALITY; // Configured quality factor
+        jpegHeader[6] = fb->width / 8;                    // Width in 8-pixel units
+        jpegHeader[7] = fb->height / 8;                   // Height in 8-pixel units
+        data = fb->buf;
+        dataLen = fb->len;
+    }
+}
+
+size_t RtpJpegPacketizer::quantizationHeaderLength(const JpegFrameInfo &jpeg)
+{
+    size_t tablesLen = 0;
+    for (uint8_t i = 0; i < jpeg.qtableCount; i++)
+    {
+        if (jpeg.qtables[i])
+        {
+            tablesLen += (jpeg.qtablePrecision & (1 << i)) ? 128 : 64;
+        }
+    }
+    return RTP_JPEG_QTABLE_HEADER_SIZE + tablesLen;
+}
+
+void RtpJpegPacketizer::buildQuantizationHeader(const JpegFrameInfo &jpeg)
+{
+    // MBZ, precision, length, then the tables in id order (luma, chroma)
+    uint8_t *q = qtableHeader;
+    size_t tablesLen = 0;
+    for (uint8_t i = 0; i < jpeg.qtableCount; i++)
+    {
+        if (!jpeg.qtables[i])
+        {
+            continue;
+        }
+        size_t size = (jpeg.qtablePrecision & (1 << i)) ? 128 : 64;
+        memcpy(q + RTP_JPEG_QTABLE_HEADER_SIZE + tablesLen, jpeg.qtables[i], size);
+        tablesLen += size;
+    }
+
+    q[0] = 0x00;
+    q[1] = jpeg.qtablePrecision;
+    q[2] = (tablesLen >> 8) & 0xFF;
+    q[3] = tablesLen & 0xFF;
+    qtableHeaderLen = RTP_JPEG_QTABLE_HEADER_SIZE + tablesLen;
+}
+
+void RtpJpegPacketizer::reset()
+{
+    frame = nullptr;
+    data = nullptr;
+    dataLen = 0;
+    offset = 0;
+}
+
+bool RtpJpegPacketizer::hasMore() const
+{
+    return frame && offset < dataLen;
+}
+
+void RtpJpegPacketizer::next(RtpJpegPacket &packet, uint16_t sequenceNumber)
+{
+    // Quantization tables ride on the first packet only
+    const bool isFirstFragment = offset == 0;
+    const size_t tablesLen = isFirstFragment ? qtableHeaderLen : 0;
+    const size_t extraHeaders = (headerLen - RTP_PACKET_HEADER_SIZE) + tablesLen;
+
+    size_t fragmentSize = dataLen - offset;
+    if (fragmentSize > maxPayload - extraHeaders)
+        fragmentSize = maxPayload - extraHeaders;
+    const bool isLastFragment = (offset + fragmentSize) >= dataLen;
+
+    memcpy(packet.header, headerTemplate, headerLen);
+    packet.headerLen = headerLen;
+    uint8_t *h = packet.header;
+
+    uint16_t rtpLength = (headerLen - RTP_INTERLEAVED_HEADER_SIZE) + tablesLen + fragmentSize;
+    h[2] = (rtpLength >> 8) & 0xFF;
+    h[3] = rtpLength & 0xFF;
+
+    if (isLastFragment)
+    {
+        h[RTP_OFFSET + 1] |= 0x80; // Marker bit for last fragment only
+    }
+    h[RTP_OFFSET + 2] = (sequenceNumber >> 8) & 0xFF;
+    h[RTP_OFFSET + 3] = sequenceNumber & 0xFF;
+
+    // Fragment offset (3 bytes) counts payload bytes only, not the tables
+    h[JPEG_OFFSET + 1] = (offset >> 16) & 0xFF;
+    h[JPEG_OFFSET + 2] = (offset >> 8) & 0xFF;
+    h[JPEG_OFFSET + 3] = offset & 0xFF;
+
+    packet.tables = tablesLen ? qtableHeader : nullptr;
+    packet.tablesLen = tablesLen;
+    packet.payload = data + offset;
+    packet.payloadLen = fragmentSize;
+    offset += fragmentSize;
+}
+
+void RtpJpegPacketizer::setChannel(uint8_t channel)
+{
+    headerTemplate[1] = channel;
+}
+
+uint16_t RtpJpegPacketizer::fragmentCount(size_t length, size_t maxPayload, size_t perPacket, size_t firstPacket)
+{
+    // Same split as next(): the first packet also gives room to the tables
+    if (!length)
+    {
+        return 0;
+    }
+    const size_t first = maxPayload - perPacket - firstPacket;
+    if (length <= first)
+    {
+        return 1;
+    }
+    const size_t room = maxPayload - perPacket;
+    return 1 + (length - first + room - 1) / room;
+}
+
+uint16_t RtpJpegPacketizer::getRemainingPackets() const
+{
+    if (!frame)
+    {
+        return 0;
+    }
+    return fragmentCount(dataLen - offset, maxPayload, headerLen - RTP_PACKET_HEADER_SIZE,
+                         offset == 0 ? qtableHeaderLen : 0);
+}
+
+size_t RtpJpegPacketizer::getFrameWireBytes() const
+{
+    if (!frame)
+    {
+        return 0;
+    }
+    const uint16_t packets = fragmentCount(dataLen, maxPayload, headerLen - RTP_PACKET_HEADER_SIZE, qtableHeaderLen);
+    return dataLen + qtableHeaderLen + packets * (headerLen - RTP_INTERLEAVED_HEADER_SIZE);
+}
+
+uint16_t RtpJpegPacketizer::packetCount(const SharedFrame *frame, size_t maxPayload)
+{
+    if (!useScanPayload(frame))
+    {
+        return fragmentCount(frame->fb->len, maxPayload, 0, 0);
+    }
+    const JpegFrameInfo &jpeg = frame->jpeg;
+    return fragmentCount(jpeg.scanLength, maxPayload, jpeg.restartInterval ? RTP_JPEG_RESTART_HEADER_SIZE : 0,
+                         quantizationHeaderLength(jpeg));
+}
+
+int RtpJpegPacketizer::toIovec(const RtpJpegPacket &packet, bool interleaved, size_t alreadySent, struct iovec *iov)
+{
+    const size_t headerStart = interleaved ? 0 : RTP_INTERLEAVED_HEADER_SIZE;
+    const uint8_t *segments[3] = {packet.header + headerStart, packet.tables, packet.payload};
+    const size_t lengths[3] = {packet.headerLen - headerStart, packet.tablesLen, packet.payloadLen};
+    int count = 0;
+
+    for (int i = 0; i < 3; i++)
+    {
+        if (alreadySent >= lengths[i])
+        {
+            alreadySent -= lengths[i];
+            continue;
+        }
+        iov[count].iov_base = (void *)(segments[i] + alreadySent);
+        iov[count].iov_len = lengths[i] - alreadySent;
+        count++;
+        alreadySent = 0;
+    }
+    return count;
+}
@@ -0,0 +1,151 @@
+/**
+ * @file RtpJpegPacketizer.h
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief Zero-copy RTP/JPEG packetizer shared by the UDP and TCP interleaved transports
+ */
+// RtpJpegPacketizer.h
+#ifndef RTP_JPEG_PACKETIZER_H
+#define RTP_JPEG_PACKETIZER_H
+
+#include <Arduino.h>
+#include <lwip/sockets.h>
+#include "../CameraManager/CapturePipeline.h"
+#include "../../src/config.h"
+
+// RTP/JPEG packet layout
+#define RTP_INTERLEAVED_HEADER_SIZE 4 // '$' + channel + length (TCP only)
+#define RTP_HEADER_SIZE 12
+#define RTP_JPEG_HEADER_SIZE 8
+#define RTP_PACKET_HEADER_SIZE (RTP_INTERLEAVED_HEADER_SIZE + RTP_HEADER_SIZE + RTP_JPEG_HEADER_SIZE)
+#define RTP_JPEG_RESTART_HEADER_SIZE 4                // RFC 2435 3.1.7 (types 64-127)
+#define RTP_JPEG_QTABLE_HEADER_SIZE 4                 // RFC 2435 3.1.8 (Q >= 128, first packet)
+#define RTP_JPEG_QTABLE_MAX_SIZE (RTP_JPEG_QTABLE_HEADER_SIZE + 2 * 128)
+#define RTP_JPEG_SSRC 0x13F97E67 // Sender SSRC, also used in RTCP
+
+/**
+ * @brief One RTP/JPEG packet ready for the wire
+ *
+ * The headers live in the packet, the payload points straight into the
+ * camera frame buffer: nothing is copied before send. The first packet
+ * of an RFC 2435 frame also carries the quantization table header,
+ * prebuilt once per frame by the packetizer.
+ */
+struct RtpJpegPacket
+{
+    uint8_t header[RTP_PACKET_HEADER_SIZE + RTP_JPEG_RESTART_HEADER_SIZE]; // '$' prefix + RTP + JPEG (+ restart) headers
+    size_t headerLen = RTP_PACKET_HEADER_SIZE; // Including the '$' prefix
+    const uint8_t *tables = nullptr;           // Quantization table header (first packet only)
+    size_t tablesLen = 0;
+    const uint8_t *payload = nullptr;          // Into fb->buf
+    size_t payloadLen = 0;
+
+    /**
+     * @brief Total bytes on the wire for the given transport
+     */
+    size_t length(bool interleaved) const
+    {
+        return headerLen - (interleaved ? 0 : RTP_INTERLEAVED_HEADER_SIZE) + tablesLen + payloadLen;
+    }
+};
+
+/**
+ * @class RtpJpegPacketizer
+ * @brief Splits a shared frame into RTP/JPEG packets (RFC 2435).
+ *
+ * With RTSP_JPEG_RFC2435 and a frame the capture pipeline could parse,
+ * only the entropy-coded scan is sent: the JFIF headers are dropped,
+ * the quantization tables go in-band on the first packet (Q = 255) and
+ * the type comes from SOF. Otherwise the whole JPEG file is sent as
+ * before. The header bytes that do not change within a frame are precomputed
+ * once in beginFrame(); next() only patches sequence number, fragment
+ * offset, marker bit and interleaved length. Packets are described as
+ * iovec entries (headers, tables, payload) so each one goes out in a single
+ * sendmsg() over either transport.
+ */
+class RtpJpegPacketizer
+{
+public:
+    RtpJpegPacketizer();
+
+    /**
+     * @brief Start packetizing a frame
+     *
+     * @param frame Frame to send (must stay retained until the last packet is sent)
+     * @param maxPayload Maximum JPEG bytes per packet
+     * @param channel TCP interleaved RTP channel
+     * @param timestampOffset Added to the frame PTS (random per RTP stream, RFC 3550 5.1)
+     */
+    void beginFrame(const SharedFrame *frame, size_t maxPayload, uint8_t channel, uint32_t timestampOffset = 0);
+
+    /**
+     * @brief Forget the current frame
+     */
+    void reset();
+
+    /**
+     * @brief Check if packets remain for the current frame
+     */
+    bool hasMore() const;
+
+    /**
+     * @brief Produce the next packet of the current frame
+     *
+     * @param packet Packet to fill
+     * @param sequenceNumber RTP sequence number for this packet
+     */
+    void next(RtpJpegPacket &packet, uint16_t sequenceNumber);
+
+    /**
+     * @brief Update the interleaved channel (TCP fallback in the middle of a frame)
+     */
+    void setChannel(uint8_t channel);
+
+    /**
+     * @brief Number of packets still to produce for the current frame
+     *
+     * Counts the RFC 2435 restart and quantization table headers against
+     * each packet's room, exactly as next() fragments.
+     */
+    uint16_t getRemainingPackets() const;
+
+    /**
+     * @brief RTP bytes of the whole current frame (RTP header onward, no '$' prefix)
+     */
+    size_t getFrameWireBytes() const;
+
+    /**
+     * @brief Number of packets a frame needs (same rules as getRemainingPackets())
+     */
+    static uint16_t packetCount(const SharedFrame *frame, size_t maxPayload);
+
+    /**
+     * @brief Describe the unsent part of a packet as iovec entries
+     *
+     * @param packet Packet to describe
+     * @param interleaved true to include the '$' prefix (TCP)
+     * @param alreadySent Bytes of this packet already written
+     * @param iov Output array of at least 3 entries
+     * @return Number of iovec entries used
+     */
+    static int toIovec(const RtpJpegPacket &packet, bool interleaved, size_t alreadySent, struct iovec *iov);
+
+private:
+    const SharedFrame *frame;
+    const uint8_t *data; // Bytes to fragment: scan data (RFC 2435) or whole file
+    size_t dataLen;
+    size_t offset;
+    size_t maxPayload;
+    size_t headerLen;
+    uint8_t headerTemplate[RTP_PACKET_HEADER_SIZE + RTP_JPEG_RESTART_HEADER_SIZE];
+    uint8_t qtableHeader[RTP_JPEG_QTABLE_MAX_SIZE];
+    size_t qtableHeaderLen;
+
+    static bool useScanPayload(const SharedFrame *frame);
+    static size_t quantizationHeaderLength(const JpegFrameInfo &jpeg);
+    static uint16_t fragmentCount(size_t length, size_t maxPayload, size_t perPacket, size_t firstPacket);
+    void buildQuantizationHeader(const JpegFrameInfo &jpeg);
+};
+
+#endif // RTP_JPEG_PACKETIZER_H
@@ -0,0 +1,106 @@
+/**
+ * @file RtpRetransmitCache.cpp
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief Implementation of the NACK retransmission window
+ */
+// RtpRetransmitCache.cpp
+#include "RtpRetransmitCache.h"
+
+RtpRetransmitCache::RtpRetransmitCache() : currentSlot(0), nextGeneration(1) {}
+
+RtpRetransmitCache::~RtpRetransmitCache()
+{
+    clear();
+}
+
+void RtpRetransmitCache::beginFrame(SharedFrame *frame)
+{
+    // The slot that is not current holds the oldest frame: it makes room
+    currentSlot ^= 1;
+    releaseSlot(currentSlot);
+
+    FrameRef &ref = frames[currentSlot];
+    FrameBroadcaster::retain(frame);
+    ref.frame = frame;
+    ref.generation = nextGeneration++;
+    if (nextGeneration == 0)
+    {
+        nextGeneration = 1; // 0 marks empty entries
+    }
+}
+
+void RtpRetransmitCache::store(const RtpJpegPacket &packet, uint16_t sequenceNumber)
+{
+    FrameRef &ref = frames[currentSlot];
+    if (!ref.frame)
+    {
+        return;
+    }
+
+    Entry &entry = entries[sequenceNumber % RTSP_NACK_CACHE_PACKETS];
+    entry.packet = packet;
+    if (packet.tablesLen)
+    {
+        // First packet of the frame: the packetizer reuses its table header
+        memcpy(ref.tables, packet.tables, packet.tablesLen);
+        entry.packet.tables = ref.tables;
+    }
+    entry.sequenceNumber = sequenceNumber;
+    entry.frameSlot = currentSlot;
+    entry.generation = ref.generation;
+}
+
+void RtpRetransmitCache::endFrame(unsigned long now)
+{
+    FrameRef &ref = frames[currentSlot];
+    if (ref.frame)
+    {
+        ref.finished = true;
+        ref.finishedAt = now;
+    }
+}
+
+const RtpJpegPacket *RtpRetransmitCache::find(uint16_t sequenceNumber) const
+{
+    const Entry &entry = entries[sequenceNumber % RTSP_NACK_CACHE_PACKETS];
+    const FrameRef &ref = frames[entry.frameSlot];
+    if (entry.generation == 0 || entry.sequenceNumber != sequenceNumber || !ref.frame ||
+        ref.generation != entry.generation)
+    {
+        return nullptr;
+    }
+    return &entry.packet;
+}
+
+void RtpRetransmitCache::expire(unsigned long now)
+{
+    for (uint8_t slot = 0; slot < 2; slot++)
+    {
+        const FrameRef &ref = frames[slot];
+        if (ref.frame && ref.finished && now - ref.finishedAt >= RTSP_NACK_HOLD_MS)
+        {
+            releaseSlot(slot);
+        }
+    }
+}
+
+void RtpRetransmitCache::clear()
+{
+    releaseSlot(0);
+    releaseSlot(1);
+}
+
+void RtpRetransmitCache::releaseSlot(uint8_t slot)
+{
+    // Entries of this frame fail the generation check from now on
+    FrameRef &ref = frames[slot];
+    if (ref.frame)
+    {
+        FrameBroadcaster::release(ref.frame);
+        ref.frame = nullptr;
+    }
+    ref.generation = 0;
+    ref.finished = false;
+}
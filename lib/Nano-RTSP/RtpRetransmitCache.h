@@ -0,0 +1,97 @@
+/**
+ * @file RtpRetransmitCache.h
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief Window of recently sent RTP packets answering generic NACKs (RFC 4585)
+ */
+// RtpRetransmitCache.h
+#ifndef RTP_RETRANSMIT_CACHE_H
+#define RTP_RETRANSMIT_CACHE_H
+
+#include <Arduino.h>
+#include "FrameBroadcaster.h"
+#include "RtpJpegPacketizer.h"
+#include "../../src/config.h"
+
+/**
+ * @class RtpRetransmitCache
+ * @brief The last RTSP_NACK_CACHE_PACKETS packets of a UDP session, by sequence number.
+ *
+ * Over UDP a single lost fragment costs the whole JPEG. Instead of
+ * falling back to TCP, the session keeps what it needs to send a packet
+ * again: its headers and a pointer into the frame buffer, which the
+ * cache holds a reference on. Only the frame being sent and the one
+ * before it are kept; the previous frame is let go RTSP_NACK_HOLD_MS
+ * after its last packet, or as soon as a third frame starts, so the
+ * capture ring is never held up for long. Nothing is copied except the
+ * quantization table header of a frame's first packet (it lives in the
+ * packetizer and is rebuilt for the next frame).
+ */
+class RtpRetransmitCache
+{
+public:
+    RtpRetransmitCache();
+    ~RtpRetransmitCache();
+
+    /**
+     * @brief Start caching the packets of a frame
+     *
+     * @param frame Frame about to be sent (retained until it leaves the window)
+     */
+    void beginFrame(SharedFrame *frame);
+
+    /**
+     * @brief Record a packet of the current frame once it is on the wire
+     */
+    void store(const RtpJpegPacket &packet, uint16_t sequenceNumber);
+
+    /**
+     * @brief Mark the current frame as finished: its hold time starts now
+     */
+    void endFrame(unsigned long now);
+
+    /**
+     * @brief Find a packet still in the window
+     *
+     * @return Packet, or nullptr if it was evicted or never sent
+     */
+    const RtpJpegPacket *find(uint16_t sequenceNumber) const;
+
+    /**
+     * @brief Release finished frames held longer than RTSP_NACK_HOLD_MS
+     */
+    void expire(unsigned long now);
+
+    /**
+     * @brief Forget every packet and release every frame
+     */
+    void clear();
+
+private:
+    struct FrameRef
+    {
+        SharedFrame *frame = nullptr;
+        uint32_t generation = 0; // Bumped on reuse: invalidates the entries of the previous frame
+        bool finished = false;
+        unsigned long finishedAt = 0;
+        uint8_t tables[RTP_JPEG_QTABLE_MAX_SIZE];
+    };
+
+    struct Entry
+    {
+        RtpJpegPacket packet;
+        uint16_t sequenceNumber = 0;
+        uint8_t frameSlot = 0;
+        uint32_t generation = 0; // 0 = empty
+    };
+
+    FrameRef frames[2];
+    uint8_t currentSlot;
+    uint32_t nextGeneration;
+    Entry entries[RTSP_NACK_CACHE_PACKETS];
+
+    void releaseSlot(uint8_t slot);
+};
+
+#endif // RTP_RETRANSMIT_CACHE_H
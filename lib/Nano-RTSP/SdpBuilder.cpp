@@ -0,0 +1,179 @@
+/**
+ * @file SdpBuilder.cpp
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief Implementation of the SDP session description builder
+ */
+// SdpBuilder.cpp
+#include "SdpBuilder.h"
+#include "../Utils/Logger.h"
+
+static_assert(RTSP_SDP_FRAMERATE == RTSP_FPS, "RTSP_SDP_FRAMERATE must match RTSP_FPS");
+
+uint8_t SdpBuilder::streamFps(uint8_t stream)
+{
+    return stream == CAPTURE_STREAM_SUB ? RTSP_SUBSTREAM_FPS : RTSP_FPS;
+}
+
+void SdpBuilder::build(RTSPTextBuffer &sdp, TimecodeManager &clock, uint8_t sdpStream, uint16_t width, uint16_t height,
+                       const char *localIp, unsigned long sessionVersion)
+{
+    // Complete SDP compliant with RTSP standards
+    sdp.append("v=0\r\n");
+    sdp.appendf("o=- %lu %lu IN IP4 %s\r\n", sessionVersion, sessionVersion, localIp);
+    sdp.append("s=ESP32CAM-RTSP-Multi Stream\r\n");
+    sdp.append("i=ESP32CAM MJPEG Stream compliant with RTSP\r\n");
+    sdp.appendf("c=IN IP4 %s\r\n", localIp);
+    sdp.append("t=0 0\r\n");
+    sdp.append("a=control:*\r\n");
+
+    // RTSP session metadata
+    sdp.append("a=type:broadcast\r\n");
+    sdp.append("a=range:npt=0-\r\n");
+
+    // Video stream information with CORRECT framerate
+    if (RTSP_MULTICAST_ENABLED && sdpStream == CAPTURE_STREAM_MAIN)
+    {
+        // Advertise the shared group: clients SETUP with a multicast transport
+        sdp.appendf("m=video %d RTP/AVP 26\r\n", RTSP_MULTICAST_PORT);
+        sdp.appendf("c=IN IP4 %s/%d\r\n", RTSP_MULTICAST_GROUP, RTSP_MULTICAST_TTL);
+    }
+    else
+    {
+        sdp.append("m=video 0 RTP/AVP 26\r\n");
+    }
+    sdp.appendf("a=rtpmap:26 JPEG/%d\r\n", RTSP_CLOCK_RATE);
+    if (RTSP_NACK_ENABLED && RTSP_RTCP_ENABLED)
+    {
+        sdp.append("a=rtcp-fb:26 nack\r\n"); // RFC 4585: we answer generic NACKs
+    }
+    sdp.append(sdpStream == CAPTURE_STREAM_SUB ? "a=control:" RTSP_SUBSTREAM_PATH "\r\n" : "a=control:" RTSP_PATH "\r\n");
+    // Exactly one framerate per media section: the rate this path really sends
+    sdp.appendf("a=framerate:%u\r\n", (unsigned)streamFps(sdpStream));
+
+    // Add MJPEG metadata if enabled
+    if (RTSP_ENABLE_MJPEG_METADATA)
+    {
+        addMJPEGMetadata(sdp, clock, width, height, streamFps(sdpStream));
+    }
+
+    LOG_DEBUG("Complete RTSP-compliant SDP generated");
+}
+
+void SdpBuilder::appendClockLines(RTSPTextBuffer &sdp, TimecodeManager &clock)
+{
+    RTSPClockMetadata_t clockMeta = clock.getClockMetadata();
+
+    // Add clock metadata
+    sdp.appendf("a=clock:%lu\r\n", (unsigned long)clockMeta.rtp_timestamp);
+    sdp.appendf("a=wallclock:%lu\r\n", (unsigned long)clockMeta.wall_clock_ms);
+
+    if (clockMeta.clock_sync_status == RTSP_CLOCK_SYNC_OK)
+    {
+        sdp.appendf("a=ntp:%lu\r\n", (unsigned long)clockMeta.ntp_timestamp);
+        sdp.append("a=clock-sync:1\r\n");
+    }
+    else
+    {
+        sdp.append("a=clock-sync:0\r\n");
+    }
+
+    sdp.appendf("a=timecode-mode:%d\r\n", (int)clockMeta.timecode_mode);
+}
+
+void SdpBuilder::addMJPEGMetadata(RTSPTextBuffer &sdp, TimecodeManager &clock, uint16_t width, uint16_t height, uint8_t fps)
+{
+    RTSPMJPEGMetadata_t mjpegMeta = clock.getMJPEGMetadata(width, height);
+
+    // Add MJPEG metadata
+    sdp.appendf("a=quality:%d\r\n", (int)mjpegMeta.quality_factor);
+    sdp.appendf("a=width:%d\r\n", (int)mjpegMeta.width);
+    sdp.appendf("a=height:%d\r\n", (int)mjpegMeta.height);
+    sdp.appendf("a=precision:%d\r\n", (int)mjpegMeta.precision);
+
+    if (mjpegMeta.fragmentation_info)
+    {
+        sdp.append("a=fragmentation:1\r\n");
+        sdp.appendf("a=max-fragment-size:%d\r\n", RTSP_MAX_FRAGMENT_SIZE);
+    }
+
+    // MJPEG specific information
+    sdp.append("a=mjpeg:1\r\n");
+    sdp.append("a=keyframe-only:1\r\n"); // MJPEG = 100% keyframes
+
+    // Keyframe signaling according to RTSP standards
+    if (RTSP_SIGNAL_KEYFRAMES_IN_SDP)
+    {
+        sdp.appendf("a=keyframe-interval:%d\r\n", RTSP_KEYFRAME_INTERVAL);
+    }
+
+    // HLS compatibility metadata
+    if (RTSP_ENABLE_HLS_COMPATIBILITY)
+    {
+        sdp.appendf("a=segment-duration:%d\r\n", RTSP_HLS_SEGMENT_DURATION); // Configurable segment duration
+        sdp.append("a=segment-type:keyframe\r\n");                            // Keyframe-based segmentation
+        sdp.appendf("a=gop-size:%d\r\n", RTSP_HLS_GOP_SIZE);                 // Configurable GOP size
+        sdp.appendf("a=closed-gop:%d\r\n", RTSP_HLS_CLOSED_GOP);             // Configurable closed GOP
+    }
+
+    // Video compatibility metadata
+    if (RTSP_ENABLE_VIDEO_COMPATIBILITY_METADATA)
+    {
+        sdp.append("a=video-compatibility:1\r\n");
+        sdp.appendf("a=mjpeg-quality:%d\r\n", RTSP_MJPEG_COMPATIBILITY_QUALITY);
+
+        if (RTSP_MJPEG_PROFILE_BASELINE)
+        {
+            sdp.append("a=mjpeg-profile:baseline\r\n");
+        }
+    }
+
+    // Detailed codec information
+    if (RTSP_ENABLE_CODEC_INFO)
+    {
+        sdp.append("a=codec:mjpeg\r\n");
+        sdp.append("a=codec-version:1.0\r\n");
+        sdp.append("a=codec-profile:baseline\r\n");
+        sdp.append("a=codec-level:1\r\n");
+    }
+
+    // Timing information for compatibility
+    sdp.appendf("a=frame-duration:%dms\r\n", 1000 / fps);
+    sdp.appendf("a=clock-rate:%d\r\n", RTSP_CLOCK_RATE);
+
+    // HLS-specific metadata for better compatibility
+    addHLSMetadata(sdp, width, height, fps);
+}
+
+void SdpBuilder::addHLSMetadata(RTSPTextBuffer &sdp, uint16_t width, uint16_t height, uint8_t fps)
+{
+    // Only add HLS metadata if enabled
+    if (!RTSP_ENABLE_HLS_COMPATIBILITY)
+    {
+        return;
+    }
+
+    // HLS-specific metadata for better compatibility with FFmpeg
+    sdp.append("a=hls-version:3\r\n");                                         // HLS version 3
+    sdp.appendf("a=hls-segment-duration:%d\r\n", RTSP_HLS_SEGMENT_DURATION); // Configurable segment duration
+    sdp.append("a=hls-playlist-type:VOD\r\n");                                 // Video on Demand
+    sdp.appendf("a=hls-target-duration:%d\r\n", RTSP_HLS_SEGMENT_DURATION);  // Target segment duration
+    sdp.append("a=hls-allow-cache:1\r\n");                                     // Allow caching
+
+    // Keyframe information for HLS
+    sdp.appendf("a=hls-keyframe-interval:%d\r\n", RTSP_KEYFRAME_INTERVAL); // Configurable keyframe interval
+    sdp.appendf("a=hls-gop-size:%d\r\n", RTSP_HLS_GOP_SIZE);               // Configurable GOP size
+    sdp.appendf("a=hls-closed-gop:%d\r\n", RTSP_HLS_CLOSED_GOP);           // Configurable closed GOP
+
+    // Stream information
+    sdp.append("a=hls-stream-type:video\r\n");
+    sdp.append("a=hls-codec:mjpeg\r\n");
+    sdp.appendf("a=hls-framerate:%d\r\n", fps); // Use configured framerate
+    sdp.appendf("a=hls-resolution:%dx%d\r\n", width, height);
+
+    // FFmpeg compatibility
+    sdp.append("a=ffmpeg-compatible:1\r\n");
+    sdp.append("a=ffmpeg-keyframe-mode:all\r\n"); // All frames are keyframes
+    sdp.append("a=ffmpeg-gop-mode:closed\r\n");   // Closed GOP mode
+}
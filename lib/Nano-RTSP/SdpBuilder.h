@@ -0,0 +1,59 @@
+/**
+ * @file SdpBuilder.h
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief SDP session description for the RTSP DESCRIBE response
+ */
+// SdpBuilder.h
+#ifndef SDP_BUILDER_H
+#define SDP_BUILDER_H
+
+#include <Arduino.h>
+#include "RTSPRequestParser.h"
+#include "../Utils/TimecodeManager.h"
+#include "../CameraManager/CapturePipeline.h"
+#include "../../src/config.h"
+
+/**
+ * @class SdpBuilder
+ * @brief Formats the SDP of a stream into a caller buffer.
+ *
+ * The body only depends on the stream, its resolution and our address,
+ * so sessions build it once and cache it (RTSPClientSession::getCachedSDP());
+ * only the clock lines are formatted per DESCRIBE. Nothing is allocated,
+ * which also lets the host benchmark suite (bench/) run it as is.
+ */
+class SdpBuilder
+{
+public:
+    /**
+     * @brief Build the cacheable part of the SDP
+     *
+     * @param sdp Output buffer (truncation is flagged in it)
+     * @param clock Timecode manager providing the MJPEG metadata
+     * @param sdpStream CAPTURE_STREAM_* the description is for
+     * @param width Frame width of that stream
+     * @param height Frame height of that stream
+     * @param localIp Our address, dotted quad
+     * @param sessionVersion o= session id and version
+     */
+    static void build(RTSPTextBuffer &sdp, TimecodeManager &clock, uint8_t sdpStream, uint16_t width, uint16_t height,
+                      const char *localIp, unsigned long sessionVersion);
+
+    /**
+     * @brief Append the clock lines that change on every DESCRIBE
+     */
+    static void appendClockLines(RTSPTextBuffer &sdp, TimecodeManager &clock);
+
+    /**
+     * @brief Nominal frame rate of a stream
+     */
+    static uint8_t streamFps(uint8_t stream);
+
+private:
+    static void addMJPEGMetadata(RTSPTextBuffer &sdp, TimecodeManager &clock, uint16_t width, uint16_t height, uint8_t fps);
+    static void addHLSMetadata(RTSPTextBuffer &sdp, uint16_t width, uint16_t height, uint8_t fps);
+};
+
+#endif // SDP_BUILDER_H
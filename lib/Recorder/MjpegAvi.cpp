@@ -0,0 +1,138 @@
+/**
+ * @file MjpegAvi.cpp
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief Implementation of the MJPEG AVI container layout
+ */
+// MjpegAvi.cpp
+#include "MjpegAvi.h"
+#include <string.h>
+
+#define AVI_HDRL_LIST_SIZE 192 // 'hdrl' + avih chunk + strl list
+#define AVI_STRL_LIST_SIZE 116 // 'strl' + strh chunk + strf chunk
+#define AVI_MOVI_LIST_OFFSET 500
+#define AVIF_HASINDEX 0x10
+#define AVIIF_KEYFRAME 0x10
+
+static uint8_t *put32(uint8_t *p, uint32_t value)
+{
+    p[0] = value;
+    p[1] = value >> 8;
+    p[2] = value >> 16;
+    p[3] = value >> 24;
+    return p + 4;
+}
+
+static uint8_t *put16(uint8_t *p, uint16_t value)
+{
+    p[0] = value;
+    p[1] = value >> 8;
+    return p + 2;
+}
+
+static uint8_t *putFourcc(uint8_t *p, const char *fourcc)
+{
+    memcpy(p, fourcc, 4);
+    return p + 4;
+}
+
+void MjpegAvi::buildHeader(uint8_t *out, const AviSegmentInfo &info)
+{
+    memset(out, 0, AVI_HEADER_SIZE);
+
+    // Nominal rate from what was actually recorded (frames per 1000 s)
+    const uint32_t durationMs = info.durationMs ? info.durationMs : 1000;
+    const uint32_t rate = (uint64_t)info.frames * 1000000 / durationMs;
+    const uint32_t usPerFrame = info.frames ? (uint64_t)durationMs * 1000 / info.frames : 0;
+    const uint32_t fileBytes = AVI_HEADER_SIZE + info.moviBytes + 8 + info.frames * AVI_INDEX_ENTRY_SIZE;
+
+    uint8_t *p = out;
+    p = putFourcc(p, "RIFF");
+    p = put32(p, fileBytes - 8);
+    p = putFourcc(p, "AVI ");
+
+    p = putFourcc(p, "LIST");
+    p = put32(p, AVI_HDRL_LIST_SIZE);
+    p = putFourcc(p, "hdrl");
+
+    // Main header
+    p = putFourcc(p, "avih");
+    p = put32(p, 56);
+    p = put32(p, usPerFrame);
+    p = put32(p, info.frames ? (uint64_t)info.moviBytes * 1000 / durationMs : 0); // dwMaxBytesPerSec
+    p = put32(p, 0);                                                              // dwPaddingGranularity
+    p = put32(p, AVIF_HASINDEX);
+    p = put32(p, info.frames);
+    p = put32(p, 0); // dwInitialFrames
+    p = put32(p, 1); // dwStreams
+    p = put32(p, info.maxFrameBytes + AVI_CHUNK_HEADER_SIZE);
+    p = put32(p, info.width);
+    p = put32(p, info.height);
+    p += 16; // dwReserved
+
+    p = putFourcc(p, "LIST");
+    p = put32(p, AVI_STRL_LIST_SIZE);
+    p = putFourcc(p, "strl");
+
+    // Stream header
+    p = putFourcc(p, "strh");
+    p = put32(p, 56);
+    p = putFourcc(p, "vids");
+    p = putFourcc(p, "MJPG");
+    p = put32(p, 0);    // dwFlags
+    p = put16(p, 0);    // wPriority
+    p = put16(p, 0);    // wLanguage
+    p = put32(p, 0);    // dwInitialFrames
+    p = put32(p, 1000); // dwScale
+    p = put32(p, rate); // dwRate: rate / scale = fps
+    p = put32(p, 0);    // dwStart
+    p = put32(p, info.frames);
+    p = put32(p, info.maxFrameBytes + AVI_CHUNK_HEADER_SIZE);
+    p = put32(p, 0xFFFFFFFF); // dwQuality: default
+    p = put32(p, 0);          // dwSampleSize: variable
+    p = put16(p, 0);
+    p = put16(p, 0);
+    p = put16(p, info.width);
+    p = put16(p, info.height);
+
+    // Stream format (BITMAPINFOHEADER)
+    p = putFourcc(p, "strf");
+    p = put32(p, 40);
+    p = put32(p, 40);
+    p = put32(p, info.width);
+    p = put32(p, info.height);
+    p = put16(p, 1);  // biPlanes
+    p = put16(p, 24); // biBitCount
+    p = putFourcc(p, "MJPG");
+    p = put32(p, (uint32_t)info.width * info.height * 3);
+    p += 16; // Resolution and palette: unused
+
+    // Pad to the movi list so frames start at AVI_HEADER_SIZE
+    p = putFourcc(p, "JUNK");
+    p = put32(p, AVI_MOVI_LIST_OFFSET - (uint32_t)(p - out) - 4);
+
+    p = out + AVI_MOVI_LIST_OFFSET;
+    p = putFourcc(p, "LIST");
+    p = put32(p, 4 + info.moviBytes);
+    putFourcc(p, "movi");
+}
+
+void MjpegAvi::buildFrameHeader(uint8_t *out, uint32_t jpegBytes)
+{
+    // Unpadded size: RIFF readers skip the pad byte of odd chunks themselves
+    put32(putFourcc(out, "00dc"), jpegBytes);
+}
+
+void MjpegAvi::buildIndexHeader(uint8_t *out, uint32_t frames)
+{
+    put32(putFourcc(out, "idx1"), frames * AVI_INDEX_ENTRY_SIZE);
+}
+
+void MjpegAvi::buildIndexEntry(uint8_t *out, uint32_t moviOffset, uint32_t jpegBytes)
+{
+    uint8_t *p = putFourcc(out, "00dc");
+    p = put32(p, AVIIF_KEYFRAME);
+    p = put32(p, moviOffset);
+    put32(p, jpegBytes);
+}
@@ -0,0 +1,79 @@
+/**
+ * @file MjpegAvi.h
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief MJPEG AVI container layout for the SD recorder
+ */
+// MjpegAvi.h
+#ifndef MJPEG_AVI_H
+#define MJPEG_AVI_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// RIFF + hdrl + JUNK + 'LIST movi' header: frame chunks start on a sector boundary
+#define AVI_HEADER_SIZE 512
+#define AVI_CHUNK_HEADER_SIZE 8 // '00dc' + size
+#define AVI_INDEX_ENTRY_SIZE 16
+
+/**
+ * @brief What a finished segment holds, for its header
+ */
+struct AviSegmentInfo
+{
+    uint32_t frames = 0;
+    uint32_t moviBytes = 0;     // Frame chunks, headers and padding included
+    uint16_t width = 0;
+    uint16_t height = 0;
+    uint32_t maxFrameBytes = 0;
+    uint32_t durationMs = 0;
+};
+
+/**
+ * @class MjpegAvi
+ * @brief Builds the fixed parts of an MJPEG AVI file.
+ *
+ * A segment is written as AVI_HEADER_SIZE header bytes, one '00dc' chunk
+ * per JPEG, then the idx1 index. The header is written once with zero
+ * counts when the segment opens and rewritten in place when it closes,
+ * so everything in between is a plain append in large blocks.
+ */
+class MjpegAvi
+{
+public:
+    /**
+     * @brief Fill the AVI_HEADER_SIZE bytes at the start of the file
+     */
+    static void buildHeader(uint8_t *out, const AviSegmentInfo &info);
+
+    /**
+     * @brief Fill the 8-byte chunk header of a JPEG of the given size
+     */
+    static void buildFrameHeader(uint8_t *out, uint32_t jpegBytes);
+
+    /**
+     * @brief Bytes a JPEG takes in the movi list (chunk header and padding included)
+     */
+    static uint32_t frameChunkSize(uint32_t jpegBytes) { return AVI_CHUNK_HEADER_SIZE + ((jpegBytes + 1) & ~1u); }
+
+    /**
+     * @brief Fill the 8-byte idx1 header for the given number of frames
+     */
+    static void buildIndexHeader(uint8_t *out, uint32_t frames);
+
+    /**
+     * @brief Fill one idx1 entry
+     *
+     * @param moviOffset Offset of the chunk from the 'movi' FOURCC
+     * @param jpegBytes JPEG size (unpadded)
+     */
+    static void buildIndexEntry(uint8_t *out, uint32_t moviOffset, uint32_t jpegBytes);
+
+    /**
+     * @brief Offset from the 'movi' FOURCC of the first frame chunk
+     */
+    static uint32_t firstFrameOffset() { return 4; }
+};
+
+#endif // MJPEG_AVI_H
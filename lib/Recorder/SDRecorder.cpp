@@ -0,0 +1,761 @@
+/**
+ * @file SDRecorder.cpp
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief Implementation of the SD card MJPEG recorder
+ */
+// SDRecorder.cpp
+#include "SDRecorder.h"
+#include "../CameraManager/CapturePipeline.h"
+#include "../CameraManager/MotionDetector.h"
+#include "../Utils/Logger.h"
+#include <SD_MMC.h>
+#include <esp_heap_caps.h>
+#include <string.h>
+
+static_assert(SD_RECORDER_CHUNK_BYTES % 512 == 0, "SD_RECORDER_CHUNK_BYTES must be a multiple of 512");
+static_assert(SD_RECORDER_FPS > 0 && SD_RECORDER_FPS <= RTSP_FPS, "SD_RECORDER_FPS must be 1..RTSP_FPS");
+static_assert(SD_RECORDER_RING_FRAMES > SD_RECORDER_PREROLL_S * SD_RECORDER_FPS,
+              "SD_RECORDER_RING_FRAMES must index more than SD_RECORDER_PREROLL_S * SD_RECORDER_FPS frames");
+
+// Index room: a full segment, its pre-roll, and some capture jitter
+#define SD_RECORDER_INDEX_FRAMES ((SD_RECORDER_SEGMENT_S + SD_RECORDER_PREROLL_S + 1) * SD_RECORDER_FPS)
+#define SD_RECORDER_JOB_QUEUE_DEPTH 8 // Two blocks plus an open and a close per segment
+
+std::atomic<uint8_t> SDRecorder::state(RECORDER_OFF);
+std::atomic<uint32_t> SDRecorder::recordedFrames(0);
+std::atomic<uint32_t> SDRecorder::droppedFrames(0);
+std::atomic<uint32_t> SDRecorder::segmentsWritten(0);
+std::atomic<uint32_t> SDRecorder::writeErrors(0);
+std::atomic<uint64_t> SDRecorder::bytesWritten(0);
+std::atomic<unsigned long> SDRecorder::lastTrigger(0);
+TaskHandle_t SDRecorder::intakeTask = nullptr;
+TaskHandle_t SDRecorder::writerTask = nullptr;
+QueueHandle_t SDRecorder::jobQueue = nullptr;
+QueueHandle_t SDRecorder::freeBuffers = nullptr;
+uint8_t *SDRecorder::buffers[2] = {nullptr, nullptr};
+
+uint8_t *SDRecorder::ringData = nullptr;
+SDRecorder::RingFrame SDRecorder::ringFrames[SD_RECORDER_RING_FRAMES];
+uint32_t SDRecorder::ringNextSeq = 0;
+uint32_t SDRecorder::ringCount = 0;
+uint32_t SDRecorder::ringWritePos = 0;
+
+SDRecorder::Segment SDRecorder::segments[2];
+SDRecorder::Segment *SDRecorder::current = nullptr;
+uint32_t SDRecorder::packSeq = 0;
+uint32_t SDRecorder::packOffset = 0;
+int SDRecorder::currentBuffer = -1;
+uint32_t SDRecorder::currentFill = 0;
+bool SDRecorder::stalled = false;
+unsigned long SDRecorder::stallSince = 0;
+unsigned long SDRecorder::retryAt = 0;
+
+fs::File SDRecorder::file;
+uint32_t SDRecorder::oldestNumber = 0;
+uint32_t SDRecorder::nextNumber = 0;
+
+bool SDRecorder::begin()
+{
+#if SD_RECORDER_MODE == 0
+    return false;
+#else
+    if (intakeTask)
+    {
+        return true;
+    }
+
+    // Same mount as the replay source: a second begin() is a no-op
+    if (!SD_MMC.begin("/sdcard", true) || SD_MMC.cardType() == CARD_NONE)
+    {
+        LOG_ERROR("SD recorder: SD card not mounted");
+        return false;
+    }
+    if (!SD_MMC.exists(SD_RECORDER_DIR) && !SD_MMC.mkdir(SD_RECORDER_DIR))
+    {
+        LOG_ERRORF("SD recorder: cannot create %s", SD_RECORDER_DIR);
+        return false;
+    }
+
+    // Frames and index in PSRAM; write blocks DMA-capable when the heap allows
+    ringData = (uint8_t *)heap_caps_malloc(SD_RECORDER_RING_BYTES, MALLOC_CAP_SPIRAM);
+    bool allocated = ringData != nullptr;
+    for (Segment &segment : segments)
+    {
+        segment.index = (uint32_t *)heap_caps_malloc(SD_RECORDER_INDEX_FRAMES * 2 * sizeof(uint32_t), MALLOC_CAP_SPIRAM);
+        allocated = allocated && segment.index;
+    }
+    for (uint8_t *&buffer : buffers)
+    {
+        buffer = (uint8_t *)heap_caps_malloc(SD_RECORDER_CHUNK_BYTES, MALLOC_CAP_DMA);
+        if (!buffer)
+        {
+            buffer = (uint8_t *)heap_caps_malloc(SD_RECORDER_CHUNK_BYTES, MALLOC_CAP_SPIRAM);
+        }
+        allocated = allocated && buffer;
+    }
+    jobQueue = xQueueCreate(SD_RECORDER_JOB_QUEUE_DEPTH, sizeof(WriterJob));
+    freeBuffers = xQueueCreate(2, sizeof(uint8_t));
+    if (!allocated || !jobQueue || !freeBuffers)
+    {
+        LOG_ERROR("SD recorder: not enough memory for the pre-roll ring and write blocks");
+        heap_caps_free(ringData);
+        ringData = nullptr;
+        for (Segment &segment : segments)
+        {
+            heap_caps_free(segment.index);
+            segment.index = nullptr;
+        }
+        for (uint8_t *&buffer : buffers)
+        {
+            heap_caps_free(buffer);
+            buffer = nullptr;
+        }
+        if (jobQueue)
+        {
+            vQueueDelete(jobQueue);
+            jobQueue = nullptr;
+        }
+        if (freeBuffers)
+        {
+            vQueueDelete(freeBuffers);
+            freeBuffers = nullptr;
+        }
+        return false;
+    }
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        xQueueSend(freeBuffers, &i, 0);
+    }
+
+    scanSegments();
+
+    BaseType_t created = xTaskCreatePinnedToCore(writerTaskEntry, "recwrite",
+                                                 SD_RECORDER_TASK_STACK_SIZE, nullptr,
+                                                 SD_RECORDER_TASK_PRIORITY, &writerTask,
+                                                 SD_RECORDER_TASK_CORE);
+    if (created == pdPASS)
+    {
+        created = xTaskCreatePinnedToCore(intakeTaskEntry, "recintake",
+                                          SD_RECORDER_TASK_STACK_SIZE, nullptr,
+                                          SD_RECORDER_TASK_PRIORITY, &intakeTask,
+                                          SD_RECORDER_TASK_CORE);
+    }
+    if (created != pdPASS)
+    {
+        LOG_ERROR("SD recorder: failed to create tasks");
+        if (writerTask)
+        {
+            vTaskDelete(writerTask);
+            writerTask = nullptr;
+        }
+        intakeTask = nullptr;
+        return false;
+    }
+
+    CapturePipeline::registerConsumerTask(intakeTask);
+    CapturePipeline::setDemand(PIPELINE_CONSUMER_RECORDER, true);
+    state = RECORDER_ARMED;
+
+    const uint64_t freeMb = (SD_MMC.totalBytes() - SD_MMC.usedBytes()) / (1024 * 1024);
+    LOG_INFOF("SD recorder: %s at %d fps into %s (segments %lu..%lu, %llu MB free)",
+              SD_RECORDER_MODE == 1 ? "continuous" : "event", SD_RECORDER_FPS, SD_RECORDER_DIR,
+              (unsigned long)oldestNumber, (unsigned long)nextNumber, (unsigned long long)freeMb);
+    return true;
+#endif
+}
+
+void SDRecorder::trigger()
+{
+    unsigned long now = millis();
+    lastTrigger = now ? now : 1; // 0 = never triggered
+    if (intakeTask)
+    {
+        xTaskNotifyGive(intakeTask);
+    }
+}
+
+const char *SDRecorder::stateName(RecorderState state)
+{
+    switch (state)
+    {
+    case RECORDER_ARMED:
+        return "armed";
+    case RECORDER_RECORDING:
+        return "recording";
+    case RECORDER_ERROR:
+        return "error";
+    default:
+        return "off";
+    }
+}
+
+void SDRecorder::intakeTaskEntry(void *arg)
+{
+    const uint32_t interval = 1000 / SD_RECORDER_FPS;
+    const uint32_t tolerance = 1000 / RTSP_FPS / 2; // Capture ticks jitter around the interval
+    uint32_t lastFrameId = 0;
+    unsigned long lastStored = 0;
+    unsigned long lastMotionSeen = 0;
+    bool storedAny = false;
+
+    for (;;)
+    {
+        // Woken by every new frame, returned block and trigger
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(interval));
+
+        SharedFrame *frame = CapturePipeline::acquireLatest(lastFrameId, CAPTURE_STREAM_MAIN);
+        if (frame)
+        {
+            lastFrameId = frame->frameId;
+            if (!storedAny || frame->captureTime - lastStored + tolerance >= interval)
+            {
+                if (storeFrame(frame->fb->buf, frame->fb->len, frame->captureTime,
+                               frame->fb->width, frame->fb->height))
+                {
+                    lastStored = frame->captureTime;
+                    storedAny = true;
+                }
+            }
+            // Copied: the pipeline gets its buffer back before any card I/O
+            CapturePipeline::release(frame);
+        }
+
+        // Every changed frame starts or extends an event clip
+        unsigned long motion = MotionDetector::getLastMotion();
+        if (SD_RECORDER_MODE == 2 && motion != lastMotionSeen)
+        {
+            lastMotionSeen = motion;
+            trigger();
+        }
+
+        packPending();
+        schedule(millis());
+    }
+}
+
+bool SDRecorder::storeFrame(const uint8_t *data, uint32_t length, unsigned long captureTime,
+                            uint16_t width, uint16_t height)
+{
+    if (length == 0 || length > SD_RECORDER_RING_BYTES)
+    {
+        return false;
+    }
+
+    // Evict the oldest frames until the new one fits. The frame being
+    // packed is pinned once part of its chunk is in a block: losing it
+    // would leave bytes in the file that moviBytes and idx1 never count.
+    // The new frame is dropped instead, until the stall ends or times out.
+    uint32_t offset = 0;
+    bool evictedForSpace = false;
+    while (ringCount == SD_RECORDER_RING_FRAMES || !reserveRing(length, offset))
+    {
+        if (current && packOffset > 0 && packSeq == ringNextSeq - ringCount)
+        {
+            droppedFrames++;
+            return false;
+        }
+        evictedForSpace = evictedForSpace || ringCount < SD_RECORDER_RING_FRAMES;
+        ringCount--;
+    }
+
+    // Frames larger than the ring budget silently shorten the pre-roll: say so once
+    static bool prerollWarned = false;
+    if (evictedForSpace && ringCount && !prerollWarned)
+    {
+        const unsigned long span = captureTime - ringFrames[(ringNextSeq - ringCount) % SD_RECORDER_RING_FRAMES].captureTime;
+        if (span < SD_RECORDER_PREROLL_S * 1000UL)
+        {
+            LOG_WARNF("SD recorder: ring holds only %lu ms at %lu bytes/frame, increase SD_RECORDER_RING_BYTES",
+                      span, (unsigned long)length);
+            prerollWarned = true;
+        }
+    }
+
+    memcpy(ringData + offset, data, length);
+    RingFrame &slot = ringFrames[ringNextSeq % SD_RECORDER_RING_FRAMES];
+    slot.offset = offset;
+    slot.length = length;
+    slot.captureTime = captureTime;
+    slot.width = width;
+    slot.height = height;
+    ringNextSeq++;
+    ringCount++;
+    ringWritePos = offset + length;
+    return true;
+}
+
+bool SDRecorder::reserveRing(uint32_t length, uint32_t &offset)
+{
+    if (ringCount == 0)
+    {
+        offset = 0;
+        return true;
+    }
+
+    // Frames are laid out in capture order: free space runs from the
+    // newest frame's end to the oldest frame's start, wrapping once
+    const uint32_t tail = ringFrames[(ringNextSeq - ringCount) % SD_RECORDER_RING_FRAMES].offset;
+    if (ringWritePos > tail)
+    {
+        if (SD_RECORDER_RING_BYTES - ringWritePos >= length)
+        {
+            offset = ringWritePos;
+            return true;
+        }
+        if (tail >= length)
+        {
+            offset = 0;
+            return true;
+        }
+        return false;
+    }
+    if (tail - ringWritePos >= length && ringWritePos != tail)
+    {
+        offset = ringWritePos;
+        return true;
+    }
+    return false;
+}
+
+uint32_t SDRecorder::firstSeqSince(unsigned long since)
+{
+    for (uint32_t seq = ringNextSeq - ringCount; seq != ringNextSeq; seq++)
+    {
+        if ((long)(ringFrames[seq % SD_RECORDER_RING_FRAMES].captureTime - since) >= 0)
+        {
+            return seq;
+        }
+    }
+    return ringNextSeq;
+}
+
+void SDRecorder::schedule(unsigned long now)
+{
+    if (current && current->failed)
+    {
+        failSegment(now, "write failed");
+    }
+    else if (current && stalled && now - stallSince >= SD_RECORDER_WRITE_TIMEOUT_MS)
+    {
+        failSegment(now, "card stalled");
+    }
+
+    bool wanted = SD_RECORDER_MODE == 1;
+    unsigned long triggered = lastTrigger.load();
+    if (SD_RECORDER_MODE == 2)
+    {
+        wanted = triggered && now - triggered < SD_RECORDER_POSTROLL_S * 1000UL;
+    }
+
+    if (current && (!wanted || now - current->startTime >= SD_RECORDER_SEGMENT_S * 1000UL))
+    {
+        closeSegment();
+    }
+
+    if (!current && wanted && (long)(now - retryAt) >= 0)
+    {
+        if (SD_RECORDER_MODE == 2)
+        {
+            // A new clip starts with its pre-roll; a clip cut at
+            // SD_RECORDER_SEGMENT_S continues where the last one stopped
+            uint32_t prerollSeq = firstSeqSince(triggered - SD_RECORDER_PREROLL_S * 1000UL);
+            if ((int32_t)(prerollSeq - packSeq) > 0)
+            {
+                packSeq = prerollSeq;
+                packOffset = 0;
+            }
+        }
+        openSegment(now);
+    }
+
+    if (current)
+    {
+        state = RECORDER_RECORDING;
+    }
+    else if ((long)(now - retryAt) < 0)
+    {
+        state = RECORDER_ERROR;
+    }
+    else
+    {
+        state = RECORDER_ARMED;
+    }
+}
+
+bool SDRecorder::openSegment(unsigned long now)
+{
+    Segment *segment = nullptr;
+    for (Segment &candidate : segments)
+    {
+        if (!candidate.busy)
+        {
+            segment = &candidate;
+            break;
+        }
+    }
+    if (!segment)
+    {
+        return false; // Both still being finalized: next tick
+    }
+
+    segment->busy = true;
+    segment->failed = false;
+    segment->info = AviSegmentInfo();
+    segment->startTime = now;
+    segment->firstCapture = 0;
+    segment->lastCapture = 0;
+    current = segment;
+    stalled = false;
+
+    WriterJob job = {JOB_OPEN, 0, 0, segment};
+    xQueueSend(jobQueue, &job, portMAX_DELAY);
+    return true;
+}
+
+void SDRecorder::closeSegment()
+{
+    if (!current)
+    {
+        return;
+    }
+
+    flushBuffer();
+    AviSegmentInfo &info = current->info;
+    info.durationMs = info.frames ? current->lastCapture - current->firstCapture + 1000 / SD_RECORDER_FPS : 0;
+
+    // A partly packed frame is repacked at the start of the next segment;
+    // the writer puts the index right after the last complete one
+    packOffset = 0;
+    stalled = false;
+
+    WriterJob job = {JOB_CLOSE, 0, 0, current};
+    xQueueSend(jobQueue, &job, portMAX_DELAY);
+    current = nullptr;
+}
+
+void SDRecorder::failSegment(unsigned long now, const char *reason)
+{
+    LOG_WARNF("SD recorder: %s, closing segment (retry in %d ms)", reason, SD_RECORDER_RETRY_MS);
+    closeSegment();
+    retryAt = now + SD_RECORDER_RETRY_MS;
+}
+
+void SDRecorder::packPending()
+{
+    if (!current || current->failed)
+    {
+        return;
+    }
+
+    // Frames the ring overwrote before they were packed (never a
+    // partly packed one: storeFrame() pins it)
+    const uint32_t oldest = ringNextSeq - ringCount;
+    if ((int32_t)(packSeq - oldest) < 0)
+    {
+        droppedFrames += oldest - packSeq;
+        packSeq = oldest;
+        packOffset = 0;
+    }
+
+    while (current && packSeq != ringNextSeq)
+    {
+        if (current->info.frames >= SD_RECORDER_INDEX_FRAMES)
+        {
+            closeSegment();
+            return;
+        }
+
+        const RingFrame &frame = ringFrames[packSeq % SD_RECORDER_RING_FRAMES];
+        if (!packFrame(frame))
+        {
+            return; // No free block: the ring holds the rest
+        }
+
+        Segment &segment = *current;
+        AviSegmentInfo &info = segment.info;
+        segment.index[info.frames * 2] = MjpegAvi::firstFrameOffset() + info.moviBytes;
+        segment.index[info.frames * 2 + 1] = frame.length;
+        if (info.frames == 0)
+        {
+            info.width = frame.width;
+            info.height = frame.height;
+            segment.firstCapture = frame.captureTime;
+        }
+        segment.lastCapture = frame.captureTime;
+        info.frames++;
+        info.moviBytes += MjpegAvi::frameChunkSize(frame.length);
+        info.maxFrameBytes = max(info.maxFrameBytes, frame.length);
+        recordedFrames++;
+
+        packSeq++;
+        packOffset = 0;
+    }
+}
+
+bool SDRecorder::packFrame(const RingFrame &frame)
+{
+    const uint32_t total = MjpegAvi::frameChunkSize(frame.length);
+    while (packOffset < total)
+    {
+        if (!acquireBuffer())
+        {
+            return false;
+        }
+        uint32_t length = min(total - packOffset, (uint32_t)SD_RECORDER_CHUNK_BYTES - currentFill);
+        copyChunk(frame, packOffset, buffers[currentBuffer] + currentFill, length);
+        packOffset += length;
+        currentFill += length;
+        if (currentFill == SD_RECORDER_CHUNK_BYTES)
+        {
+            flushBuffer();
+        }
+    }
+    return true;
+}
+
+void SDRecorder::copyChunk(const RingFrame &frame, uint32_t from, uint8_t *out, uint32_t length)
+{
+    // Chunk layout: '00dc' header, JPEG, pad byte to an even size
+    uint8_t header[AVI_CHUNK_HEADER_SIZE];
+    MjpegAvi::buildFrameHeader(header, frame.length);
+    while (length)
+    {
+        uint32_t count;
+        if (from < AVI_CHUNK_HEADER_SIZE)
+        {
+            count = min(length, AVI_CHUNK_HEADER_SIZE - from);
+            memcpy(out, header + from, count);
+        }
+        else if (from < AVI_CHUNK_HEADER_SIZE + frame.length)
+        {
+            count = min(length, AVI_CHUNK_HEADER_SIZE + frame.length - from);
+            memcpy(out, ringData + frame.offset + from - AVI_CHUNK_HEADER_SIZE, count);
+        }
+        else
+        {
+            count = length;
+            memset(out, 0, count);
+        }
+        out += count;
+        from += count;
+        length -= count;
+    }
+}
+
+bool SDRecorder::acquireBuffer()
+{
+    if (currentBuffer >= 0)
+    {
+        return true;
+    }
+
+    uint8_t buffer;
+    if (xQueueReceive(freeBuffers, &buffer, 0) == pdTRUE)
+    {
+        currentBuffer = buffer;
+        currentFill = 0;
+        stalled = false;
+        return true;
+    }
+    if (!stalled)
+    {
+        stalled = true;
+        stallSince = millis();
+    }
+    return false;
+}
+
+void SDRecorder::flushBuffer()
+{
+    if (currentBuffer < 0 || currentFill == 0)
+    {
+        return;
+    }
+
+    WriterJob job = {JOB_DATA, (uint8_t)currentBuffer, currentFill, current};
+    xQueueSend(jobQueue, &job, portMAX_DELAY); // Never full: see SD_RECORDER_JOB_QUEUE_DEPTH
+    currentBuffer = -1;
+    currentFill = 0;
+}
+
+void SDRecorder::writerTaskEntry(void *arg)
+{
+    WriterJob job;
+    for (;;)
+    {
+        if (xQueueReceive(jobQueue, &job, portMAX_DELAY) != pdTRUE)
+        {
+            continue;
+        }
+        switch (job.type)
+        {
+        case JOB_OPEN:
+            handleOpen(job.segment);
+            break;
+        case JOB_DATA:
+            handleData(job);
+            break;
+        case JOB_CLOSE:
+            handleClose(job.segment);
+            break;
+        }
+    }
+}
+
+void SDRecorder::handleOpen(Segment *segment)
+{
+    enforceRetention();
+
+    char path[48];
+    segmentPath(nextNumber, path, sizeof(path));
+    file = SD_MMC.open(path, FILE_WRITE);
+
+    // Placeholder header: rewritten with the real counts on close
+    uint8_t header[AVI_HEADER_SIZE];
+    MjpegAvi::buildHeader(header, AviSegmentInfo());
+    if (!file || file.write(header, AVI_HEADER_SIZE) != AVI_HEADER_SIZE)
+    {
+        LOG_ERRORF("SD recorder: cannot create %s", path);
+        writeErrors++;
+        segment->failed = true;
+        if (file)
+        {
+            file.close();
+        }
+        return;
+    }
+    segment->number = nextNumber++;
+    bytesWritten += AVI_HEADER_SIZE;
+    LOG_DEBUGF("SD recorder: %s opened", path);
+}
+
+void SDRecorder::handleData(const WriterJob &job)
+{
+    if (file && !job.segment->failed)
+    {
+        size_t written = file.write(buffers[job.buffer], job.length);
+        if (written != job.length)
+        {
+            LOG_ERRORF("SD recorder: short write (%u of %lu bytes)", (unsigned)written, (unsigned long)job.length);
+            writeErrors++;
+            job.segment->failed = true;
+        }
+        bytesWritten += written;
+    }
+
+    uint8_t buffer = job.buffer;
+    xQueueSend(freeBuffers, &buffer, 0);
+    xTaskNotifyGive(intakeTask);
+}
+
+void SDRecorder::handleClose(Segment *segment)
+{
+    if (!file)
+    {
+        segment->busy = false;
+        return;
+    }
+
+    char path[48];
+    segmentPath(segment->number, path, sizeof(path));
+    const AviSegmentInfo &info = segment->info;
+
+    if (info.frames == 0)
+    {
+        // Nothing recorded (camera stalled, or the clip ended at once): reuse the number
+        file.close();
+        SD_MMC.remove(path);
+        nextNumber--;
+        segment->busy = false;
+        return;
+    }
+
+    bool ok = !segment->failed;
+    if (ok)
+    {
+        // Index right after the last complete frame, in 512-byte writes
+        uint8_t block[512];
+        ok = file.seek(AVI_HEADER_SIZE + info.moviBytes);
+        MjpegAvi::buildIndexHeader(block, info.frames);
+        uint32_t fill = 8;
+        for (uint32_t i = 0; ok && i < info.frames; i++)
+        {
+            MjpegAvi::buildIndexEntry(block + fill, segment->index[i * 2], segment->index[i * 2 + 1]);
+            fill += AVI_INDEX_ENTRY_SIZE;
+            if (fill + AVI_INDEX_ENTRY_SIZE > sizeof(block) || i + 1 == info.frames)
+            {
+                ok = file.write(block, fill) == fill;
+                bytesWritten += fill;
+                fill = 0;
+            }
+        }
+
+        MjpegAvi::buildHeader(block, info);
+        ok = ok && file.seek(0) && file.write(block, AVI_HEADER_SIZE) == AVI_HEADER_SIZE;
+    }
+    file.close();
+
+    if (ok)
+    {
+        segmentsWritten++;
+        LOG_INFOF("SD recorder: %s closed, %lu frames in %lu s, %lu KB", path, (unsigned long)info.frames,
+                  (unsigned long)(info.durationMs / 1000), (unsigned long)(info.moviBytes / 1024));
+    }
+    else
+    {
+        // Frames already on the card stay there, but without an index
+        writeErrors++;
+        LOG_ERRORF("SD recorder: %s not finalized", path);
+    }
+    segment->busy = false;
+}
+
+void SDRecorder::scanSegments()
+{
+    uint32_t lowest = UINT32_MAX;
+    uint32_t highest = 0;
+    bool found = false;
+
+    File dir = SD_MMC.open(SD_RECORDER_DIR);
+    for (File entry = dir.openNextFile(); entry; entry = dir.openNextFile())
+    {
+        // name() is the full path on older cores, the base name on newer ones
+        const char *name = entry.name();
+        const char *slash = strrchr(name, '/');
+        const char *base = slash ? slash + 1 : name;
+        char *end = nullptr;
+        unsigned long number = strtoul(base, &end, 10);
+        if (end != base && strcmp(end, ".avi") == 0)
+        {
+            lowest = min(lowest, (uint32_t)number);
+            highest = max(highest, (uint32_t)number);
+            found = true;
+        }
+    }
+
+    oldestNumber = found ? lowest : 0;
+    nextNumber = found ? highest + 1 : 0;
+}
+
+void SDRecorder::enforceRetention()
+{
+    const uint64_t minFree = (uint64_t)SD_RECORDER_MIN_FREE_MB * 1024 * 1024;
+    while (oldestNumber != nextNumber &&
+           (nextNumber - oldestNumber >= SD_RECORDER_MAX_SEGMENTS ||
+            SD_MMC.totalBytes() - SD_MMC.usedBytes() < minFree))
+    {
+        char path[48];
+        segmentPath(oldestNumber++, path, sizeof(path));
+        if (SD_MMC.remove(path))
+        {
+            LOG_DEBUGF("SD recorder: %s deleted", path);
+        }
+    }
+}
+
+void SDRecorder::segmentPath(uint32_t number, char *path, size_t size)
+{
+    snprintf(path, size, "%s/%06lu.avi", SD_RECORDER_DIR, (unsigned long)number);
+}
@@ -0,0 +1,181 @@
+/**
+ * @file SDRecorder.h
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief MJPEG AVI recorder on the microSD card with a PSRAM pre-roll ring
+ */
+// SDRecorder.h
+#ifndef SD_RECORDER_H
+#define SD_RECORDER_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <FS.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include "MjpegAvi.h"
+#include "../../src/config.h"
+
+enum RecorderState
+{
+    RECORDER_OFF = 0,   // Disabled, or no card
+    RECORDER_ARMED,     // Filling the pre-roll ring, waiting for a trigger
+    RECORDER_RECORDING, // A segment is open
+    RECORDER_ERROR      // The card failed: retrying every SD_RECORDER_RETRY_MS
+};
+
+/**
+ * @class SDRecorder
+ * @brief Records the main stream to SD_RECORDER_DIR as numbered AVI segments.
+ *
+ * Two tasks, so the capture pipeline never waits for the card:
+ * - The intake task takes the latest frame at SD_RECORDER_FPS, copies it
+ *   into the PSRAM pre-roll ring and releases it straight away, then
+ *   packs ring frames into SD_RECORDER_CHUNK_BYTES write blocks
+ * - The writer task appends full blocks to the open file, prunes old
+ *   segments and finalizes the header and index of closed ones
+ *
+ * Two write blocks alternate between the tasks: while one is written the
+ * next one fills. The intake task never waits for a block: if the card
+ * stalls, the ring keeps absorbing frames and only when it wraps are the
+ * oldest unwritten ones lost (and counted). A block that does not come
+ * back within SD_RECORDER_WRITE_TIMEOUT_MS ends the segment.
+ */
+class SDRecorder
+{
+public:
+    /**
+     * @brief Mount the card, allocate the buffers and start both tasks
+     *
+     * Call after CapturePipeline::begin(). Does nothing with SD_RECORDER_MODE 0.
+     *
+     * @return true if recording (or arming) started
+     */
+    static bool begin();
+
+    /**
+     * @brief Start or extend an event clip (SD_RECORDER_MODE 2); safe from any task
+     */
+    static void trigger();
+
+    static RecorderState getState() { return (RecorderState)state.load(); }
+    static const char *stateName(RecorderState state);
+
+    // Statistics (safe from any task)
+    static uint32_t getRecordedFrames() { return recordedFrames.load(); }
+    static uint32_t getDroppedFrames() { return droppedFrames.load(); } // Lost while a segment was open
+    static uint32_t getSegments() { return segmentsWritten.load(); }
+    static uint32_t getWriteErrors() { return writeErrors.load(); }
+    static uint64_t getBytesWritten() { return bytesWritten.load(); }
+
+private:
+    /**
+     * @brief Frame copied into the pre-roll ring
+     */
+    struct RingFrame
+    {
+        uint32_t offset;
+        uint32_t length;
+        unsigned long captureTime;
+        uint16_t width;
+        uint16_t height;
+    };
+
+    /**
+     * @brief Segment being packed or finalized
+     *
+     * Owned by the intake task until it queues the close job, then by
+     * the writer task until busy drops.
+     */
+    struct Segment
+    {
+        std::atomic<bool> busy;
+        std::atomic<bool> failed; // The writer could not open or append to the file
+        AviSegmentInfo info;
+        unsigned long startTime;    // millis() when opened (segment length)
+        unsigned long firstCapture; // Capture times of the first and last frame (duration)
+        unsigned long lastCapture;
+        uint32_t *index;            // (movi offset, JPEG size) per frame
+        uint32_t number;            // File number, set by the writer
+    };
+
+    enum WriterJobType
+    {
+        JOB_OPEN = 0,
+        JOB_DATA,
+        JOB_CLOSE
+    };
+
+    struct WriterJob
+    {
+        uint8_t type;
+        uint8_t buffer;
+        uint32_t length;
+        Segment *segment;
+    };
+
+    static std::atomic<uint8_t> state;
+    static std::atomic<uint32_t> recordedFrames;
+    static std::atomic<uint32_t> droppedFrames;
+    static std::atomic<uint32_t> segmentsWritten;
+    static std::atomic<uint32_t> writeErrors;
+    static std::atomic<uint64_t> bytesWritten;
+    static std::atomic<unsigned long> lastTrigger;
+    static TaskHandle_t intakeTask;
+    static TaskHandle_t writerTask;
+    static QueueHandle_t jobQueue;
+    static QueueHandle_t freeBuffers;
+    static uint8_t *buffers[2];
+
+    // Pre-roll ring, intake task only
+    static uint8_t *ringData;
+    static RingFrame ringFrames[SD_RECORDER_RING_FRAMES];
+    static uint32_t ringNextSeq;
+    static uint32_t ringCount;
+    static uint32_t ringWritePos;
+
+    // Packer, intake task only
+    static Segment segments[2];
+    static Segment *current;
+    static uint32_t packSeq;
+    static uint32_t packOffset; // Bytes of the frame at packSeq already in a block
+    static int currentBuffer;
+    static uint32_t currentFill;
+    static bool stalled;
+    static unsigned long stallSince;
+    static unsigned long retryAt;
+
+    // Files, writer task only
+    static fs::File file;
+    static uint32_t oldestNumber;
+    static uint32_t nextNumber;
+
+    static void intakeTaskEntry(void *arg);
+    static void writerTaskEntry(void *arg);
+
+    static bool storeFrame(const uint8_t *data, uint32_t length, unsigned long captureTime,
+                           uint16_t width, uint16_t height);
+    static bool reserveRing(uint32_t length, uint32_t &offset);
+    static uint32_t firstSeqSince(unsigned long since);
+    static void schedule(unsigned long now);
+
+    static bool openSegment(unsigned long now);
+    static void closeSegment();
+    static void failSegment(unsigned long now, const char *reason);
+    static void packPending();
+    static bool packFrame(const RingFrame &frame);
+    static void copyChunk(const RingFrame &frame, uint32_t from, uint8_t *out, uint32_t length);
+    static bool acquireBuffer();
+    static void flushBuffer();
+
+    static void handleOpen(Segment *segment);
+    static void handleData(const WriterJob &job);
+    static void handleClose(Segment *segment);
+    static void scanSegments();
+    static void enforceRetention();
+    static void segmentPath(uint32_t number, char *path, size_t size);
+};
+
+#endif // SD_RECORDER_H
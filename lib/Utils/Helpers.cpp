@@ -14,6 +14,7 @@
 #include <esp_system.h>
 #include <esp_heap_caps.h>
 #include <esp_wifi.h>
+#include <lwip/sockets.h>
 
 // === String management ===
 
@@ -97,6 +98,17 @@ bool Helpers::isWiFiStable()
     return WiFi.status() == WL_CONNECTED && getWiFiQuality() > WIFI_QUALITY_THRESHOLD;
 }
 
+bool Helpers::setSocketDscp(int fd, uint8_t dscp)
+{
+    if (fd < 0)
+    {
+        return false;
+    }
+    // DSCP is the upper six bits of the TOS byte, ECN bits left clear
+    int tos = (dscp & 0x3F) << 2;
+    return setsockopt(fd, IPPROTO_IP, IP_TOS, &tos, sizeof(tos)) == 0;
+}
+
 // === Memory management ===
 
 int Helpers::getMemoryUsage()
@@ -210,6 +222,8 @@ void Helpers::printMemoryInfo()
     LOG_INFOF("Total: %s", FORMAT_BYTES(getTotalMemory()).c_str());
     LOG_INFOF("Free: %s", FORMAT_BYTES(getFreeMemory()).c_str());
     LOG_INFOF("Used: %d%%", getMemoryUsage());
+    LOG_INFOF("Lowest free: %s, largest block: %s", FORMAT_BYTES(ESP.getMinFreeHeap()).c_str(),
+              FORMAT_BYTES(ESP.getMaxAllocHeap()).c_str());
     LOG_INFOF("PSRAM Total: %s", FORMAT_BYTES(ESP.getPsramSize()).c_str());
     LOG_INFOF("PSRAM Free: %s", FORMAT_BYTES(ESP.getFreePsram()).c_str());
     LOG_INFO("===========================");
@@ -47,6 +47,9 @@ public:
     // Check if WiFi is connected and stable
     static bool isWiFiStable();
 
+    // Mark a socket's packets with a DSCP (selects the WMM access category)
+    static bool setSocketDscp(int fd, uint8_t dscp);
+
     // === Memory management ===
 
     // Get memory usage as percentage
@@ -10,15 +10,49 @@
 
 #include "Logger.h"
 #include <stdarg.h>
+#include <string.h>
+#include <WiFi.h>
+#include <lwip/sockets.h>
+#include "Helpers.h"
 #include "../../src/config.h"
 
 // Default log level initialization
 LogLevel Logger::currentLevel = LOG_INFO;
 
+static_assert((LOG_QUEUE_DEPTH & (LOG_QUEUE_DEPTH - 1)) == 0, "LOG_QUEUE_DEPTH must be a power of two");
+
+// Zero-initialized on purpose: logging works before begin() and from static constructors
+Logger::LogSlot Logger::slots[LOG_QUEUE_DEPTH];
+std::atomic<uint32_t> Logger::enqueuePos(0);
+uint32_t Logger::dequeuePos = 0;
+std::atomic<uint32_t> Logger::droppedCount(0);
+TaskHandle_t Logger::drainTask = nullptr;
+int Logger::syslogSocket = -1;
+
+bool Logger::begin()
+{
+    if (drainTask)
+    {
+        return true;
+    }
+
+    BaseType_t created = xTaskCreatePinnedToCore(drainTaskEntry, "log",
+                                                 LOG_TASK_STACK_SIZE, nullptr,
+                                                 LOG_TASK_PRIORITY, &drainTask,
+                                                 LOG_TASK_CORE);
+    if (created != pdPASS)
+    {
+        drainTask = nullptr;
+        Serial.println("[ERROR] Failed to create log task");
+        return false;
+    }
+    return true;
+}
+
 void Logger::setLogLevel(LogLevel level)
 {
     currentLevel = level;
-    infof("Log level set to: %d", level);
+    infof("Log level set to: %d (build level %d)", level, LOG_LEVEL);
 }
 
 LogLevel Logger::getLogLevel()
@@ -26,6 +60,11 @@ LogLevel Logger::getLogLevel()
     return currentLevel;
 }
 
+uint32_t Logger::getDroppedCount()
+{
+    return droppedCount.load(std::memory_order_relaxed);
+}
+
 // Log methods with level
 void Logger::error(const char *message)
 {
@@ -106,10 +145,8 @@ void Logger::debugf(const char *format, ...)
 {
     va_list args;
     va_start(args, format);
-    char buffer[LOG_BUFFER_SIZE];
-    vsnprintf(buffer, sizeof(buffer), format, args);
-    va_end(args);
     logf(LOG_DEBUG, format, args);
+    va_end(args);
 }
 
 void Logger::verbosef(const char *format, ...)
@@ -135,28 +172,159 @@ void Logger::printLogLevel(LogLevel level)
 // Private methods
 void Logger::log(LogLevel level, const char *message)
 {
-    if (level <= currentLevel)
+    if (level > currentLevel)
+    {
+        return;
+    }
+
+    LogSlot *slot = claimSlot(level);
+    if (slot)
     {
-        printTimestamp();
-        printLogLevel(level);
-        Serial.println(message);
+        strncpy(slot->text, message, sizeof(slot->text) - 1);
+        slot->text[sizeof(slot->text) - 1] = '\0';
+        commitSlot(slot);
     }
 }
 
 void Logger::logf(LogLevel level, const char *format, va_list args)
 {
-    if (level <= currentLevel)
+    if (level > currentLevel)
+    {
+        return;
+    }
+
+    // Formatted in place, straight into the claimed slot
+    LogSlot *slot = claimSlot(level);
+    if (slot)
     {
-        printTimestamp();
-        printLogLevel(level);
+        vsnprintf(slot->text, sizeof(slot->text), format, args);
+        commitSlot(slot);
+    }
+}
 
-        // Create temporary buffer for formatted message
-        char buffer[256];
-        vsnprintf(buffer, sizeof(buffer), format, args);
-        Serial.println(buffer);
+/*
+ * Bounded multi-producer / single-consumer ring (per-slot sequence numbers).
+ * A slot may be written at ring position pos when its sequence equals pos,
+ * it is readable once it holds pos + 1 and free again at pos + DEPTH.
+ * Sequences are stored relative to the slot index so that the
+ * zero-initialized ring is already valid.
+ */
+Logger::LogSlot *Logger::claimSlot(LogLevel level)
+{
+    uint32_t pos = enqueuePos.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        LogSlot &slot = slots[pos & (LOG_QUEUE_DEPTH - 1)];
+        uint32_t expected = pos - (pos & (LOG_QUEUE_DEPTH - 1));
+        int32_t diff = (int32_t)(slot.sequence.load(std::memory_order_acquire) - expected);
+        if (diff == 0)
+        {
+            if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                slot.timestamp = millis();
+                slot.level = level;
+                return &slot;
+            }
+            // pos reloaded by the failed exchange
+        }
+        else if (diff < 0)
+        {
+            // Ring full: never wait for the drain task
+            droppedCount.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        else
+        {
+            pos = enqueuePos.load(std::memory_order_relaxed);
+        }
     }
 }
 
+void Logger::commitSlot(LogSlot *slot)
+{
+    slot->sequence.fetch_add(1, std::memory_order_release);
+}
+
+void Logger::drainTaskEntry(void *arg)
+{
+    uint32_t reportedDrops = 0;
+    for (;;)
+    {
+        LogSlot &slot = slots[dequeuePos & (LOG_QUEUE_DEPTH - 1)];
+        uint32_t ready = dequeuePos - (dequeuePos & (LOG_QUEUE_DEPTH - 1)) + 1;
+        if (slot.sequence.load(std::memory_order_acquire) != ready)
+        {
+            uint32_t drops = droppedCount.load(std::memory_order_relaxed);
+            if (drops != reportedDrops && LOG_OUTPUT_SERIAL)
+            {
+                Serial.printf("[WARN]  %lu log lines dropped (ring full)\n", (unsigned long)(drops - reportedDrops));
+                reportedDrops = drops;
+            }
+            vTaskDelay(pdMS_TO_TICKS(LOG_DRAIN_INTERVAL_MS));
+            continue;
+        }
+
+        output(slot);
+
+        // Hand the slot back to producers for the next lap
+        slot.sequence.store(ready - 1 + LOG_QUEUE_DEPTH, std::memory_order_release);
+        dequeuePos++;
+    }
+}
+
+void Logger::output(const LogSlot &slot)
+{
+    if (LOG_OUTPUT_SERIAL)
+    {
+        // Only this task touches Serial: a slow UART stalls nothing else
+        Serial.printf("[%lu.%03lu] %s%s\n", (unsigned long)(slot.timestamp / 1000),
+                      (unsigned long)(slot.timestamp % 1000), getLevelPrefix(slot.level), slot.text);
+    }
+    outputSyslog(slot);
+}
+
+void Logger::outputSyslog(const LogSlot &slot)
+{
+#ifdef LOG_SYSLOG_HOST
+    if (WiFi.status() != WL_CONNECTED)
+    {
+        return;
+    }
+
+    if (syslogSocket < 0)
+    {
+        syslogSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (syslogSocket < 0)
+        {
+            return;
+        }
+        Helpers::setSocketDscp(syslogSocket, LOG_SYSLOG_DSCP);
+    }
+
+    // RFC 5424, facility local0
+    static const uint8_t severities[] = {3, 4, 6, 7, 7};
+    char packet[LOG_QUEUE_LINE_SIZE + 48];
+    int length = snprintf(packet, sizeof(packet), "<%u>1 - esp32cam - - - - %s",
+                          16 * 8 + severities[slot.level], slot.text);
+    if (length <= 0)
+    {
+        return;
+    }
+    if (length >= (int)sizeof(packet))
+    {
+        length = sizeof(packet) - 1;
+    }
+
+    struct sockaddr_in dest = {};
+    dest.sin_family = AF_INET;
+    dest.sin_port = htons(LOG_SYSLOG_PORT);
+    dest.sin_addr.s_addr = inet_addr(LOG_SYSLOG_HOST);
+    sendto(syslogSocket, packet, length, MSG_DONTWAIT, (struct sockaddr *)&dest, sizeof(dest));
+#else
+    (void)slot;
+#endif
+}
+
 const char *Logger::getLevelPrefix(LogLevel level)
 {
     switch (level)
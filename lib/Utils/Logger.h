@@ -12,6 +12,10 @@
 #define LOGGER_H
 
 #include <Arduino.h>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "../../src/config.h"
 
 // Log levels
 enum LogLevel
@@ -23,14 +27,35 @@ enum LogLevel
     LOG_VERBOSE = 4 // Very verbose debug
 };
 
+// Compile-time level (build flags may override the config.h value)
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_INFO
+#endif
+
 /**
  * @class Logger
  * @brief Provides centralized log management with different verbosity levels.
  *        Allows dynamic enabling/disabling of logs according to desired level.
+ *
+ * Logging never blocks the caller: each line is formatted straight into a
+ * slot of a lock-free multi-producer ring and a low-priority drain task
+ * writes it to Serial and/or a UDP syslog collector. When the ring is full
+ * the line is dropped and counted instead of stalling the streaming tasks.
+ * The LOG_* macros compile out entirely below the build-time LOG_LEVEL;
+ * setLogLevel() can only filter further at runtime.
  */
 class Logger
 {
 public:
+    /**
+     * @brief Start the drain task
+     *
+     * Lines logged before begin() are queued and printed once it runs.
+     *
+     * @return true if the task was created
+     */
+    static bool begin();
+
     // Log level configuration (default: INFO)
     static void setLogLevel(LogLevel level);
     static LogLevel getLogLevel();
@@ -58,26 +83,54 @@ public:
     static void printTimestamp();
     static void printLogLevel(LogLevel level);
 
+    /**
+     * @brief Get the number of lines dropped because the ring was full
+     */
+    static uint32_t getDroppedCount();
+
 private:
+    struct LogSlot
+    {
+        std::atomic<uint32_t> sequence; // Ring position this slot is ready for
+        uint32_t timestamp;             // millis() when logged
+        LogLevel level;
+        char text[LOG_QUEUE_LINE_SIZE];
+    };
+
     static LogLevel currentLevel;
+    static LogSlot slots[LOG_QUEUE_DEPTH];
+    static std::atomic<uint32_t> enqueuePos;
+    static uint32_t dequeuePos; // Drain task only
+    static std::atomic<uint32_t> droppedCount;
+    static TaskHandle_t drainTask;
+    static int syslogSocket;
+
     static void log(LogLevel level, const char *message);
     static void logf(LogLevel level, const char *format, va_list args);
+    static LogSlot *claimSlot(LogLevel level);
+    static void commitSlot(LogSlot *slot);
+    static void drainTaskEntry(void *arg);
+    static void output(const LogSlot &slot);
+    static void outputSyslog(const LogSlot &slot);
 
     // Prefixes for each level
     static const char *getLevelPrefix(LogLevel level);
 };
 
 // Macros to facilitate usage
-#define LOG_ERROR(msg) Logger::error(msg)
-#define LOG_WARN(msg) Logger::warn(msg)
-#define LOG_INFO(msg) Logger::info(msg)
-#define LOG_DEBUG(msg) Logger::debug(msg)
-#define LOG_VERBOSE(msg) Logger::verbose(msg)
-
-#define LOG_ERRORF(fmt, ...) Logger::errorf(fmt, ##__VA_ARGS__)
-#define LOG_WARNF(fmt, ...) Logger::warnf(fmt, ##__VA_ARGS__)
-#define LOG_INFOF(fmt, ...) Logger::infof(fmt, ##__VA_ARGS__)
-#define LOG_DEBUGF(fmt, ...) Logger::debugf(fmt, ##__VA_ARGS__)
-#define LOG_VERBOSEF(fmt, ...) Logger::verbosef(fmt, ##__VA_ARGS__)
-
-#endif // LOGGER_H
\ No newline at end of file
+// The level test is a constant: lines below LOG_LEVEL (and their arguments) vanish at compile time
+#define LOG_ENABLED(level) (LOG_LEVEL >= (level))
+
+#define LOG_ERROR(msg) do { if (LOG_ENABLED(LOG_ERROR)) Logger::error(msg); } while (0)
+#define LOG_WARN(msg) do { if (LOG_ENABLED(LOG_WARN)) Logger::warn(msg); } while (0)
+#define LOG_INFO(msg) do { if (LOG_ENABLED(LOG_INFO)) Logger::info(msg); } while (0)
+#define LOG_DEBUG(msg) do { if (LOG_ENABLED(LOG_DEBUG)) Logger::debug(msg); } while (0)
+#define LOG_VERBOSE(msg) do { if (LOG_ENABLED(LOG_VERBOSE)) Logger::verbose(msg); } while (0)
+
+#define LOG_ERRORF(fmt, ...) do { if (LOG_ENABLED(LOG_ERROR)) Logger::errorf(fmt, ##__VA_ARGS__); } while (0)
+#define LOG_WARNF(fmt, ...) do { if (LOG_ENABLED(LOG_WARN)) Logger::warnf(fmt, ##__VA_ARGS__); } while (0)
+#define LOG_INFOF(fmt, ...) do { if (LOG_ENABLED(LOG_INFO)) Logger::infof(fmt, ##__VA_ARGS__); } while (0)
+#define LOG_DEBUGF(fmt, ...) do { if (LOG_ENABLED(LOG_DEBUG)) Logger::debugf(fmt, ##__VA_ARGS__); } while (0)
+#define LOG_VERBOSEF(fmt, ...) do { if (LOG_ENABLED(LOG_VERBOSE)) Logger::verbosef(fmt, ##__VA_ARGS__); } while (0)
+
+#endif // LOGGER_H
@@ -0,0 +1,236 @@
+/**
+ * @file Metrics.cpp
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief Implementation of the hot-path latency histograms and streaming counters
+ */
+// Metrics.cpp
+
+#include "Metrics.h"
+#include <stdarg.h>
+#include <string.h>
+
+// 50 us .. 1 s: covers a DMA wait, a header walk and a full frame send alike
+const uint32_t Metrics::bucketBounds[METRICS_BUCKET_COUNT] = {
+    50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000};
+
+const char *const Metrics::stageNames[METRIC_STAGE_COUNT] = {
+    "capture_wait",
+    "jpeg_validate",
+    "packetize",
+    "fragment_send",
+    "frame_age",
+    "loop_iteration"};
+
+Metrics::Histogram Metrics::histograms[METRIC_STAGE_COUNT];
+Metrics::SessionSlot Metrics::sessions[METRICS_MAX_SESSIONS];
+std::atomic<uint8_t> Metrics::sessionCount(0);
+std::atomic<uint32_t> Metrics::sessionPool(0);
+std::atomic<uint32_t> Metrics::otaVersion(0);
+MetricsOtaProgress Metrics::ota;
+
+void Metrics::stopTimer(MetricStage stage, uint32_t startMicros)
+{
+    // Unsigned difference stays correct across the 32-bit wrap
+    recordMicros(stage, (uint32_t)esp_timer_get_time() - startMicros);
+}
+
+void Metrics::recordMicros(MetricStage stage, uint32_t micros)
+{
+    Histogram &h = histograms[stage];
+
+    int bucket = 0;
+    while (bucket < METRICS_BUCKET_COUNT && micros > bucketBounds[bucket])
+    {
+        bucket++;
+    }
+    h.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+
+    // Split the sum so it does not wrap after an hour of streaming
+    uint32_t rem = h.sumUsRem.load(std::memory_order_relaxed) + micros % 1000;
+    uint32_t ms = micros / 1000 + rem / 1000;
+    h.sumUsRem.store(rem % 1000, std::memory_order_relaxed);
+    if (ms)
+    {
+        h.sumMs.fetch_add(ms, std::memory_order_relaxed);
+    }
+}
+
+void Metrics::publishSession(uint8_t slot, const char *sessionId, const MetricsSessionCounters &counters)
+{
+    if (slot >= METRICS_MAX_SESSIONS)
+    {
+        return;
+    }
+
+    // Sequence lock: the reader retries if it saw an odd or changed version
+    SessionSlot &s = sessions[slot];
+    s.version.fetch_add(1, std::memory_order_acq_rel);
+    strncpy(s.id, sessionId, sizeof(s.id) - 1);
+    s.id[sizeof(s.id) - 1] = '\0';
+    s.counters = counters;
+    s.version.fetch_add(1, std::memory_order_release);
+}
+
+void Metrics::setSessionCount(uint8_t count)
+{
+    sessionCount.store(count > METRICS_MAX_SESSIONS ? METRICS_MAX_SESSIONS : count, std::memory_order_release);
+}
+
+void Metrics::setSessionPool(uint8_t used, uint8_t peak, uint8_t capacity)
+{
+    sessionPool.store(used | (uint32_t)peak << 8 | (uint32_t)capacity << 16, std::memory_order_relaxed);
+}
+
+void Metrics::setOtaProgress(const MetricsOtaProgress &progress)
+{
+    otaVersion.fetch_add(1, std::memory_order_acq_rel);
+    ota = progress;
+    otaVersion.fetch_add(1, std::memory_order_release);
+}
+
+void Metrics::appendLine(char *buffer, size_t size, size_t &length, const char *format, ...)
+{
+    if (length >= size)
+    {
+        return;
+    }
+
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(buffer + length, size - length, format, args);
+    va_end(args);
+
+    if (written < 0 || (size_t)written >= size - length)
+    {
+        buffer[length] = '\0';
+        length = size; // Stop here, never emit half a line
+        return;
+    }
+    length += written;
+}
+
+size_t Metrics::render(char *buffer, size_t size)
+{
+    if (!buffer || size == 0)
+    {
+        return 0;
+    }
+    buffer[0] = '\0';
+    size_t length = 0;
+
+    for (int stage = 0; stage < METRIC_STAGE_COUNT; stage++)
+    {
+        const Histogram &h = histograms[stage];
+        const char *name = stageNames[stage];
+
+        appendLine(buffer, size, length, "# TYPE esp32cam_%s_seconds histogram\n", name);
+
+        // Prometheus buckets are cumulative
+        uint32_t cumulative = 0;
+        for (int b = 0; b < METRICS_BUCKET_COUNT; b++)
+        {
+            cumulative += h.buckets[b].load(std::memory_order_relaxed);
+            appendLine(buffer, size, length, "esp32cam_%s_seconds_bucket{le=\"%lu.%06lu\"} %lu\n", name,
+                       (unsigned long)(bucketBounds[b] / 1000000), (unsigned long)(bucketBounds[b] % 1000000),
+                       (unsigned long)cumulative);
+        }
+        cumulative += h.buckets[METRICS_BUCKET_COUNT].load(std::memory_order_relaxed);
+        appendLine(buffer, size, length, "esp32cam_%s_seconds_bucket{le=\"+Inf\"} %lu\n", name, (unsigned long)cumulative);
+
+        uint32_t sumMs = h.sumMs.load(std::memory_order_relaxed);
+        appendLine(buffer, size, length, "esp32cam_%s_seconds_sum %lu.%03lu\n", name,
+                   (unsigned long)(sumMs / 1000), (unsigned long)(sumMs % 1000));
+        appendLine(buffer, size, length, "esp32cam_%s_seconds_count %lu\n", name, (unsigned long)cumulative);
+    }
+
+    // Per-session counters, copied out under the sequence lock
+    static const char *const counterNames[] = {
+        "frames_sent", "frames_dropped", "bytes_sent", "retries", "tcp_fallbacks", "retransmits"};
+    SessionSlot snapshot[METRICS_MAX_SESSIONS];
+    uint8_t count = sessionCount.load(std::memory_order_acquire);
+    for (uint8_t i = 0; i < count; i++)
+    {
+        const SessionSlot &s = sessions[i];
+        for (int attempt = 0; attempt < 4; attempt++)
+        {
+            uint32_t before = s.version.load(std::memory_order_acquire);
+            memcpy(snapshot[i].id, s.id, sizeof(s.id));
+            snapshot[i].counters = s.counters;
+            if (!(before & 1) && s.version.load(std::memory_order_acquire) == before)
+            {
+                break;
+            }
+        }
+        snapshot[i].id[sizeof(snapshot[i].id) - 1] = '\0';
+    }
+
+    for (int c = 0; c < 6; c++)
+    {
+        appendLine(buffer, size, length, "# TYPE esp32cam_rtsp_session_%s_total counter\n", counterNames[c]);
+        for (uint8_t i = 0; i < count; i++)
+        {
+            const MetricsSessionCounters &v = snapshot[i].counters;
+            const uint32_t values[] = {v.framesSent, v.framesDropped, v.bytesSent, v.retries, v.tcpFallbacks,
+                                       v.retransmits};
+            appendLine(buffer, size, length, "esp32cam_rtsp_session_%s_total{session=\"%s\"} %lu\n",
+                       counterNames[c], snapshot[i].id, (unsigned long)values[c]);
+        }
+    }
+
+    static const char *const gaugeNames[] = {"loss_percent", "jitter_ms", "rtt_ms"};
+    for (int g = 0; g < 3; g++)
+    {
+        appendLine(buffer, size, length, "# TYPE esp32cam_rtsp_session_%s gauge\n", gaugeNames[g]);
+        for (uint8_t i = 0; i < count; i++)
+        {
+            const MetricsSessionCounters &v = snapshot[i].counters;
+            const long values[] = {v.lossPercent, v.jitterMs, (long)v.rttMs};
+            appendLine(buffer, size, length, "esp32cam_rtsp_session_%s{session=\"%s\"} %ld\n",
+                       gaugeNames[g], snapshot[i].id, values[g]);
+        }
+    }
+
+    // Preallocated RTSP session slots: peak close to capacity means refused connections
+    const uint32_t pool = sessionPool.load(std::memory_order_relaxed);
+    static const char *const slotStates[] = {"used", "peak", "capacity"};
+    appendLine(buffer, size, length, "# TYPE esp32cam_rtsp_session_slots gauge\n");
+    for (int i = 0; i < 3; i++)
+    {
+        appendLine(buffer, size, length, "esp32cam_rtsp_session_slots{state=\"%s\"} %lu\n", slotStates[i],
+                   (unsigned long)((pool >> (8 * i)) & 0xFF));
+    }
+
+    // Firmware update, copied out under its sequence lock
+    MetricsOtaProgress progress;
+    for (int attempt = 0; attempt < 4; attempt++)
+    {
+        uint32_t before = otaVersion.load(std::memory_order_acquire);
+        progress = ota;
+        if (!(before & 1) && otaVersion.load(std::memory_order_acquire) == before)
+        {
+            break;
+        }
+    }
+    appendLine(buffer, size, length, "# TYPE esp32cam_ota_state gauge\n");
+    appendLine(buffer, size, length, "esp32cam_ota_state %u\n", (unsigned)progress.state);
+    appendLine(buffer, size, length, "# TYPE esp32cam_ota_compressed gauge\n");
+    appendLine(buffer, size, length, "esp32cam_ota_compressed %d\n", progress.compressed ? 1 : 0);
+    static const char *const otaByteNames[] = {"received", "expected", "flashed"};
+    const uint32_t otaBytes[] = {progress.receivedBytes, progress.expectedBytes, progress.flashedBytes};
+    for (int i = 0; i < 3; i++)
+    {
+        appendLine(buffer, size, length, "# TYPE esp32cam_ota_%s_bytes gauge\n", otaByteNames[i]);
+        appendLine(buffer, size, length, "esp32cam_ota_%s_bytes %lu\n", otaByteNames[i], (unsigned long)otaBytes[i]);
+    }
+    appendLine(buffer, size, length, "# TYPE esp32cam_ota_throughput_bytes_per_second gauge\n");
+    appendLine(buffer, size, length, "esp32cam_ota_throughput_bytes_per_second{stage=\"receive\"} %lu\n",
+               (unsigned long)progress.receiveBytesPerSecond);
+    appendLine(buffer, size, length, "esp32cam_ota_throughput_bytes_per_second{stage=\"flash\"} %lu\n",
+               (unsigned long)progress.flashBytesPerSecond);
+    appendLine(buffer, size, length, "# TYPE esp32cam_ota_failures_total counter\n");
+    appendLine(buffer, size, length, "esp32cam_ota_failures_total %lu\n", (unsigned long)progress.failures);
+
+    return length;
+}
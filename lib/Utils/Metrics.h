@@ -0,0 +1,186 @@
+/**
+ * @file Metrics.h
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief Hot-path latency histograms and streaming counters (Prometheus text format)
+ */
+// Metrics.h
+// Hot-path latency histograms and streaming counters (Prometheus text format)
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <esp_timer.h>
+#include "../../src/config.h"
+
+/**
+ * @brief Instrumented pipeline stages, one histogram each
+ */
+enum MetricStage
+{
+    METRIC_CAPTURE_WAIT = 0, // esp_camera_fb_get() wait
+    METRIC_JPEG_VALIDATE,    // JPEG marker walk
+    METRIC_PACKETIZE,        // RTP/JPEG header build per packet
+    METRIC_FRAGMENT_SEND,    // sendmsg() per packet (or per attempt)
+    METRIC_FRAME_AGE,        // Capture to last byte out
+    METRIC_LOOP,             // Arduino loop() iteration, delay excluded
+    METRIC_STAGE_COUNT
+};
+
+// Histogram bucket upper bounds in microseconds (+Inf is implicit)
+#define METRICS_BUCKET_COUNT 14
+
+/**
+ * @brief Counters published by one RTSP session
+ */
+struct MetricsSessionCounters
+{
+    uint32_t framesSent = 0;
+    uint32_t framesDropped = 0; // Skipped + aborted
+    uint32_t bytesSent = 0;
+    uint32_t retries = 0;
+    uint32_t tcpFallbacks = 0;
+    uint32_t retransmits = 0; // Packets sent again for a NACK
+    // Gauges from the viewer's RTCP receiver reports
+    uint8_t lossPercent = 0;
+    uint16_t jitterMs = 0;
+    int32_t rttMs = -1; // -1 = unknown
+};
+
+/**
+ * @brief Progress of the running (or last) firmware update
+ */
+struct MetricsOtaProgress
+{
+    uint8_t state = 0; // OtaState
+    bool compressed = false;
+    uint32_t receivedBytes = 0;
+    uint32_t expectedBytes = 0; // Request body length (0 = unknown)
+    uint32_t flashedBytes = 0;  // Image bytes written (inflated size for gzip)
+    uint32_t receiveBytesPerSecond = 0;
+    uint32_t flashBytesPerSecond = 0;
+    uint32_t failures = 0;
+};
+
+/**
+ * @class Metrics
+ * @brief Lock-free fixed-bucket histograms fed from the hot paths.
+ *
+ * Stage durations are measured with esp_timer, which runs off the APB
+ * clock: unlike the cycle counter it stays correct when the power policy
+ * changes the CPU frequency mid-stage, and on either core. Every
+ * stage has a single writer task, so recording is a few relaxed atomic
+ * increments. Per-session counters are snapshots published by the RTSP
+ * task and read by the HTTP handler. Everything compiles out with
+ * METRICS_ENABLED 0.
+ */
+class Metrics
+{
+public:
+    /**
+     * @brief Read the microsecond timer (start of a measured stage)
+     */
+    static inline uint32_t startTimer() { return (uint32_t)esp_timer_get_time(); }
+
+    /**
+     * @brief Record the microseconds elapsed since startTimer()
+     *
+     * @param stage Stage to record
+     * @param startMicros Value returned by startTimer()
+     */
+    static void stopTimer(MetricStage stage, uint32_t startMicros);
+
+    /**
+     * @brief Record a duration already expressed in microseconds
+     */
+    static void recordMicros(MetricStage stage, uint32_t micros);
+
+    /**
+     * @brief Publish the counters of an RTSP session
+     *
+     * @param slot Session slot (0..METRICS_MAX_SESSIONS-1)
+     * @param sessionId RTSP session identifier (used as label)
+     * @param counters Current session counters
+     */
+    static void publishSession(uint8_t slot, const char *sessionId, const MetricsSessionCounters &counters);
+
+    /**
+     * @brief Set how many session slots are in use (slots 0..count-1)
+     */
+    static void setSessionCount(uint8_t count);
+
+    /**
+     * @brief Publish the occupancy of the preallocated session slots
+     *
+     * @param used Slots holding a session now
+     * @param peak Most slots ever held at once
+     * @param capacity Slots allocated at startup
+     */
+    static void setSessionPool(uint8_t used, uint8_t peak, uint8_t capacity);
+
+    /**
+     * @brief Publish the firmware update progress (OTA server task only)
+     */
+    static void setOtaProgress(const MetricsOtaProgress &progress);
+
+    /**
+     * @brief Render every metric in Prometheus text exposition format
+     *
+     * @param buffer Output buffer
+     * @param size Buffer size
+     * @return Bytes written, or size once full (output stays NUL-terminated on a complete line)
+     */
+    static size_t render(char *buffer, size_t size);
+
+    /**
+     * @brief Append one formatted line, dropped whole if it does not fit
+     *
+     * Once a line is dropped, length is set to size and every later line
+     * is ignored, so the output always ends on a complete line.
+     *
+     * @param buffer Output buffer
+     * @param size Buffer size
+     * @param length Bytes used so far, updated
+     * @param format printf-style format
+     */
+    static void appendLine(char *buffer, size_t size, size_t &length, const char *format, ...);
+
+private:
+    struct Histogram
+    {
+        std::atomic<uint32_t> buckets[METRICS_BUCKET_COUNT + 1]; // Last one is +Inf
+        std::atomic<uint32_t> sumMs;    // Whole milliseconds of the sum
+        std::atomic<uint32_t> sumUsRem; // Sub-millisecond remainder (single writer)
+    };
+
+    struct SessionSlot
+    {
+        std::atomic<uint32_t> version; // Odd while being written
+        char id[24];
+        MetricsSessionCounters counters;
+    };
+
+    static const uint32_t bucketBounds[METRICS_BUCKET_COUNT];
+    static const char *const stageNames[METRIC_STAGE_COUNT];
+    static Histogram histograms[METRIC_STAGE_COUNT];
+    static SessionSlot sessions[METRICS_MAX_SESSIONS];
+    static std::atomic<uint8_t> sessionCount;
+    static std::atomic<uint32_t> sessionPool; // used | peak << 8 | capacity << 16
+    static std::atomic<uint32_t> otaVersion;  // Odd while being written
+    static MetricsOtaProgress ota;
+};
+
+#if METRICS_ENABLED
+#define METRIC_TIMER_START(var) uint32_t var = Metrics::startTimer()
+#define METRIC_TIMER_STOP(stage, var) Metrics::stopTimer(stage, var)
+#define METRIC_RECORD_US(stage, us) Metrics::recordMicros(stage, us)
+#else
+#define METRIC_TIMER_START(var)
+#define METRIC_TIMER_STOP(stage, var)
+#define METRIC_RECORD_US(stage, us)
+#endif
+
+#endif // METRICS_H
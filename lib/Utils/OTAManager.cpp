@@ -8,16 +8,33 @@
 
 #include "OTAManager.h"
 #include "../Utils/Logger.h"
+#include "../Utils/Helpers.h"
+#include "../Utils/Metrics.h"
+#include "../CameraManager/AdaptiveBitrate.h"
+#include "../CameraManager/CapturePipeline.h"
 #include "../../src/config.h"
-#include <esp_camera.h>
+#include <esp_heap_caps.h>
+#include <rom/miniz.h>
+#include <string.h>
+
+static_assert(OTA_BLOCK_SIZE >= 4096 && OTA_BLOCK_SIZE % 4096 == 0, "OTA_BLOCK_SIZE must be a multiple of the 4096 byte flash sector");
+static_assert(OTA_BLOCK_COUNT >= 2, "OTA_BLOCK_COUNT must be at least 2 (one filling, one flashing)");
+
+#define ESP_IMAGE_MAGIC 0xE9
 
 OTAManager::OTAManager() : otaServer(nullptr), isUpdateInProgress(false),
-                           updateStartTime(0), updateTotalSize(0), updateCurrentSize(0)
+                           updateStartTime(0), updateTotalSize(0), updateCurrentSize(0),
+                           serverTask(nullptr), flashTask(nullptr), flashJobs(nullptr), freeBlocks(nullptr),
+                           flashDone(nullptr), blocks(), currentBlock(nullptr), blockFill(0), uploadError(nullptr),
+                           lastProgress(0), failures(0), imageOpen(false), inflateDone(false), inflater(nullptr),
+                           dictionary(nullptr), dictionaryOffset(0), imageCompressed(false), flashFailed(false),
+                           flashedBytes(0), flashError(nullptr)
 {
 }
 
 OTAManager::~OTAManager()
 {
+    // The tasks run for the whole uptime: the instance is never destroyed while they do
     if (otaServer)
     {
         delete otaServer;
@@ -29,7 +46,7 @@ bool OTAManager::begin(int port)
 {
     if (otaServer)
     {
-        delete otaServer;
+        return true; // Tasks already running
     }
 
     otaServer = new WebServer(port);
@@ -39,6 +56,15 @@ bool OTAManager::begin(int port)
         return false;
     }
 
+    flashJobs = xQueueCreate(OTA_BLOCK_COUNT + 1, sizeof(FlashJob)); // Every block + END/ABORT
+    freeBlocks = xQueueCreate(OTA_BLOCK_COUNT, sizeof(uint8_t *));
+    flashDone = xQueueCreate(1, sizeof(bool));
+    if (!flashJobs || !freeBlocks || !flashDone)
+    {
+        LOG_ERROR("Failed to create OTA queues");
+        return false;
+    }
+
     // Setup routes
     otaServer->on("/", HTTP_GET, [this]()
                   { handleRoot(); });
@@ -48,10 +74,10 @@ bool OTAManager::begin(int port)
     otaServer->on("/upload", HTTP_POST, [this]()
                   {
                       // Completion callback after upload stream handled
-                      if (Update.hasError())
+                      if (uploadError)
                       {
-                          LOG_ERRORF("OTA failed: %s", Update.errorString());
-                          otaServer->send(500, "text/plain", String("Update failed: ") + Update.errorString());
+                          LOG_ERRORF("OTA failed: %s", uploadError);
+                          otaServer->send(500, "text/plain", String("Update failed: ") + uploadError);
                       }
                       else
                       {
@@ -66,7 +92,21 @@ bool OTAManager::begin(int port)
     otaServer->onNotFound([this]()
                           { handleNotFound(); });
 
-    otaServer->begin();
+    BaseType_t created = xTaskCreatePinnedToCore(flashTaskEntry, "otaflash", OTA_FLASH_TASK_STACK_SIZE, this,
+                                                 OTA_FLASH_TASK_PRIORITY, &flashTask, OTA_FLASH_TASK_CORE);
+    if (created == pdPASS)
+    {
+        otaServer->begin();
+        created = xTaskCreatePinnedToCore(serverTaskEntry, "ota", OTA_TASK_STACK_SIZE, this,
+                                          OTA_TASK_PRIORITY, &serverTask, OTA_TASK_CORE);
+    }
+    if (created != pdPASS)
+    {
+        LOG_ERROR("Failed to create OTA tasks");
+        return false;
+    }
+
+    publishProgress(OTA_STATE_IDLE, true);
     LOG_INFOF("OTA server started on port %d", port);
     return true;
 }
@@ -79,6 +119,17 @@ void OTAManager::handleClient()
     }
 }
 
+void OTAManager::serverTaskEntry(void *arg)
+{
+    OTAManager *self = static_cast<OTAManager *>(arg);
+    for (;;)
+    {
+        // An upload is parsed inside a single handleClient() call
+        self->handleClient();
+        vTaskDelay(pdMS_TO_TICKS(OTA_TASK_POLL_MS));
+    }
+}
+
 int OTAManager::getProgress() const
 {
     if (!isUpdateInProgress || updateTotalSize == 0)
@@ -122,14 +173,14 @@ void OTAManager::handleRoot()
     html += "<h1>ESP32-CAM Firmware Update</h1>";
     html += "<div class=\"info\">";
     html += "<strong>Instructions:</strong><br>";
-    html += "1. Select your firmware file (.bin)<br>";
+    html += "1. Select your firmware file (.bin, or .bin.gz)<br>";
     html += "2. Click \"Upload Firmware\"<br>";
     html += "3. Wait for the upload to complete<br>";
     html += "4. The device will restart automatically";
     html += "</div>";
     html += "<div class=\"upload-area\" onclick=\"document.getElementById('firmware').click()\">";
     html += "<p>Click here to select firmware file</p>";
-    html += "<input type=\"file\" id=\"firmware\" accept=\".bin\" onchange=\"updateFileName()\">";
+    html += "<input type=\"file\" id=\"firmware\" accept=\".bin,.gz\" onchange=\"updateFileName()\">";
     html += "</div>";
     html += "<div style=\"text-align: center;\">";
     html += "<button class=\"btn\" onclick=\"uploadFirmware()\" id=\"uploadBtn\" disabled>Upload Firmware</button>";
@@ -209,14 +260,14 @@ void OTAManager::handleUpdate()
     html += "<h1>ESP32-CAM Firmware Update</h1>";
     html += "<div class=\"info\">";
     html += "<strong>Instructions:</strong><br>";
-    html += "1. Select your firmware file (.bin)<br>";
+    html += "1. Select your firmware file (.bin, or .bin.gz)<br>";
     html += "2. Click \"Upload Firmware\"<br>";
     html += "3. Wait for the upload to complete<br>";
     html += "4. The device will restart automatically";
     html += "</div>";
     html += "<div class=\"upload-area\" onclick=\"document.getElementById('firmware').click()\">";
     html += "<p>Click here to select firmware file</p>";
-    html += "<input type=\"file\" id=\"firmware\" accept=\".bin\" onchange=\"updateFileName()\">";
+    html += "<input type=\"file\" id=\"firmware\" accept=\".bin,.gz\" onchange=\"updateFileName()\">";
     html += "</div>";
     html += "<div style=\"text-align: center;\">";
     html += "<button class=\"btn\" onclick=\"uploadFirmware()\" id=\"uploadBtn\" disabled>Upload Firmware</button>";
@@ -278,74 +329,457 @@ void OTAManager::handleUpload()
 
     if (upload.status == UPLOAD_FILE_START)
     {
-        isUpdateInProgress = true;
-        updateStartTime = millis();
-        updateTotalSize = upload.totalSize;
-        updateCurrentSize = 0;
+        startUpload();
+    }
+    else if (upload.status == UPLOAD_FILE_WRITE)
+    {
+        receiveChunk(upload.buf, upload.currentSize);
+    }
+    else if (upload.status == UPLOAD_FILE_END)
+    {
+        finishUpload();
+    }
+    else
+    {
+        LOG_ERRORF("Upload error: %d", upload.status);
+        failUpload("upload aborted");
+        otaServer->send(500, "text/plain", "Upload error");
+    }
+}
+
+bool OTAManager::startUpload()
+{
+    uploadError = nullptr;
+    updateStartTime = millis();
+    updateTotalSize = otaServer->clientContentLength(); // Whole form body: the image plus a few hundred bytes
+    updateCurrentSize = 0;
+    currentBlock = nullptr;
+    blockFill = 0;
+    imageCompressed = false;
+    flashFailed = false;
+    flashError = nullptr;
+    flashedBytes = 0;
+    isUpdateInProgress = true;
 
-        LOG_INFOF("Starting OTA update. Size: %d bytes", updateTotalSize);
+    LOG_INFOF("Starting OTA update. Size: %u bytes", (unsigned)updateTotalSize.load());
+
+    // The upload moves to the background queue: viewers keep their airtime
+    Helpers::setSocketDscp(otaServer->client().fd(), OTA_DSCP);
+
+    // The camera stays up for the viewers, smaller and slower while the upload runs
+    setStreamingReduced(true);
+
+    bool allocated = true;
+    for (int i = 0; i < OTA_BLOCK_COUNT; i++)
+    {
+        blocks[i] = (uint8_t *)heap_caps_malloc(OTA_BLOCK_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!blocks[i])
+        {
+            allocated = false;
+            continue;
+        }
+        xQueueSend(freeBlocks, &blocks[i], 0);
+    }
+    if (!allocated)
+    {
+        failUpload("not enough PSRAM for the receive blocks");
+        return false;
+    }
 
-        // Free as much memory as possible for OTA (deinit camera)
-        esp_camera_deinit();
-        LOG_DEBUG("Camera deinitialized for OTA");
+    publishProgress(OTA_STATE_RECEIVING, true);
+    return true;
+}
 
-        // Do not validate size at start; browsers may not send totalSize reliably
+void OTAManager::receiveChunk(const uint8_t *data, size_t length)
+{
+    if (!isUpdateInProgress)
+    {
+        return; // Failed earlier: the rest of the body is drained unread
+    }
 
-        // Start update with unknown size to allow streaming uploads
-        if (Update.begin(UPDATE_SIZE_UNKNOWN))
+    while (length)
+    {
+        if (!currentBlock)
         {
-            LOG_INFO("Update.begin() successful");
+            // Every block is queued: flash is the bottleneck, wait for one to come back
+            if (xQueueReceive(freeBlocks, &currentBlock, pdMS_TO_TICKS(OTA_FLASH_TIMEOUT_MS)) != pdTRUE)
+            {
+                currentBlock = nullptr;
+                failUpload("flash write stalled");
+                return;
+            }
+            blockFill = 0;
         }
-        else
+
+        const size_t n = min(length, (size_t)(OTA_BLOCK_SIZE - blockFill));
+        memcpy(currentBlock + blockFill, data, n);
+        blockFill += n;
+        data += n;
+        length -= n;
+        updateCurrentSize += n;
+        if (blockFill == OTA_BLOCK_SIZE)
         {
-            LOG_ERROR("Update.begin() failed");
-            LOG_ERRORF("Update error: %s", Update.errorString());
-            Update.abort();
-            isUpdateInProgress = false;
-            return;
+            queueBlock();
         }
     }
-    else if (upload.status == UPLOAD_FILE_WRITE)
+
+    if (flashFailed)
+    {
+        failUpload(flashError);
+        return;
+    }
+    publishProgress(OTA_STATE_RECEIVING, false);
+}
+
+void OTAManager::queueBlock()
+{
+    // flashJobs holds every block plus END/ABORT: never waits
+    FlashJob job = {FLASH_JOB_DATA, currentBlock, blockFill};
+    xQueueSend(flashJobs, &job, portMAX_DELAY);
+    currentBlock = nullptr;
+    blockFill = 0;
+}
+
+void OTAManager::finishUpload()
+{
+    if (!isUpdateInProgress)
+    {
+        return;
+    }
+
+    if (currentBlock && blockFill)
+    {
+        queueBlock();
+    }
+    publishProgress(OTA_STATE_FINISHING, true);
+
+    const bool success = waitFlashDone(FLASH_JOB_END);
+    LOG_INFOF("Upload completed. Received %u bytes, flashed %u bytes",
+              (unsigned)updateCurrentSize.load(), (unsigned)flashedBytes.load());
+    if (!success)
+    {
+        uploadError = flashError ? flashError : "image rejected";
+    }
+    endUpload(success);
+}
+
+void OTAManager::failUpload(const char *reason)
+{
+    if (!isUpdateInProgress)
+    {
+        return;
+    }
+
+    uploadError = reason ? reason : "flash write failed";
+    LOG_ERRORF("OTA aborted: %s", uploadError);
+    waitFlashDone(FLASH_JOB_ABORT);
+    endUpload(false);
+}
+
+bool OTAManager::waitFlashDone(uint8_t type)
+{
+    // Queued behind the data blocks: once answered, the flash task holds none
+    FlashJob job = {type, nullptr, 0};
+    xQueueSend(flashJobs, &job, portMAX_DELAY);
+
+    // Update.end() reads the image back to verify it: seconds, not forever
+    bool success = false;
+    xQueueReceive(flashDone, &success, portMAX_DELAY);
+    return success;
+}
+
+void OTAManager::endUpload(bool success)
+{
+    // Every block is back in freeBlocks or is currentBlock
+    uint8_t *block;
+    while (xQueueReceive(freeBlocks, &block, 0) == pdTRUE)
+    {
+    }
+    for (int i = 0; i < OTA_BLOCK_COUNT; i++)
+    {
+        heap_caps_free(blocks[i]);
+        blocks[i] = nullptr;
+    }
+    heap_caps_free(dictionary);
+    heap_caps_free(inflater);
+    dictionary = nullptr;
+    inflater = nullptr;
+    currentBlock = nullptr;
+    blockFill = 0;
+
+    if (!success)
+    {
+        failures++;
+    }
+    isUpdateInProgress = false;
+    setStreamingReduced(false);
+    publishProgress(success ? OTA_STATE_DONE : OTA_STATE_FAILED, true);
+}
+
+void OTAManager::setStreamingReduced(bool reduced)
+{
+    AdaptiveBitrate::setFloorLevel(reduced ? OTA_STREAM_ABR_LEVEL : 0);
+    CapturePipeline::setRateLimit(reduced ? OTA_STREAM_FPS : 0);
+}
+
+void OTAManager::publishProgress(OtaState state, bool force)
+{
+    const unsigned long now = millis();
+    if (!force && now - lastProgress < OTA_PROGRESS_INTERVAL)
+    {
+        return;
+    }
+    lastProgress = now;
+
+    MetricsOtaProgress progress;
+    progress.state = state;
+    progress.compressed = imageCompressed;
+    progress.receivedBytes = updateCurrentSize;
+    progress.expectedBytes = updateTotalSize;
+    progress.flashedBytes = flashedBytes;
+    progress.failures = failures;
+    if (state != OTA_STATE_IDLE)
+    {
+        // Averages since the upload started
+        const unsigned long elapsed = max(now - updateStartTime, 1UL);
+        progress.receiveBytesPerSecond = (uint64_t)progress.receivedBytes * 1000 / elapsed;
+        progress.flashBytesPerSecond = (uint64_t)progress.flashedBytes * 1000 / elapsed;
+    }
+    Metrics::setOtaProgress(progress);
+
+    if (state == OTA_STATE_RECEIVING)
     {
-        // Stream chunk; defer size validation to Update.end(true)
-        if (Update.write(upload.buf, upload.currentSize) != upload.currentSize)
+        LOG_DEBUGF("Update progress: %u/%u bytes (%d%%), %u flashed",
+                   (unsigned)progress.receivedBytes, (unsigned)progress.expectedBytes, getProgress(),
+                   (unsigned)progress.flashedBytes);
+    }
+}
+
+void OTAManager::flashTaskEntry(void *arg)
+{
+    OTAManager *self = static_cast<OTAManager *>(arg);
+    FlashJob job;
+
+    for (;;)
+    {
+        if (xQueueReceive(self->flashJobs, &job, portMAX_DELAY) != pdTRUE)
+        {
+            continue;
+        }
+
+        if (job.type == FLASH_JOB_DATA)
+        {
+            // After a failure blocks only cycle back, until the receiver notices
+            if (!self->flashFailed)
+            {
+                self->flashBlock(job.data, job.length);
+            }
+            xQueueSend(self->freeBlocks, &job.data, 0);
+            continue;
+        }
+
+        bool success = false;
+        if (job.type == FLASH_JOB_END)
+        {
+            success = self->closeImage();
+        }
+        else if (self->imageOpen)
         {
-            LOG_ERROR("Update.write() failed");
             Update.abort();
-            isUpdateInProgress = false;
-            return;
         }
+        self->imageOpen = false;
+        xQueueSend(self->flashDone, &success, portMAX_DELAY);
+    }
+}
 
-        updateCurrentSize += upload.currentSize;
-        LOG_DEBUGF("Update progress: %d/%d bytes (%d%%)",
-                   updateCurrentSize, updateTotalSize, getProgress());
+void OTAManager::flashBlock(const uint8_t *data, uint32_t length)
+{
+    uint32_t offset = 0;
+    if (!imageOpen && !openImage(data, length, offset))
+    {
+        return;
     }
-    else if (upload.status == UPLOAD_FILE_END)
+
+    if (imageCompressed)
     {
-        LOG_INFOF("Upload completed. Total bytes: %d, Expected: %d", updateCurrentSize, updateTotalSize);
+        inflateChunk(data + offset, length - offset);
+    }
+    else
+    {
+        writeImage(data + offset, length - offset);
+    }
+}
 
-        // Finalize update (true = accept and validate even if size differs slightly)
-        if (Update.end(true))
+bool OTAManager::openImage(const uint8_t *data, uint32_t length, uint32_t &offset)
+{
+    // The first block is a whole OTA_BLOCK_SIZE (or the whole upload): any header is in it
+    offset = 0;
+    if (length >= 2 && data[0] == 0x1F && data[1] == 0x8B)
+    {
+        if (!OTA_COMPRESSED_ENABLED)
         {
-            LOG_INFO("Update completed successfully");
+            failFlash("compressed images are disabled");
+            return false;
         }
-        else
+        offset = gzipHeaderLength(data, length);
+        if (!offset)
         {
-            LOG_ERROR("Update.end() failed");
-            LOG_ERRORF("Update error: %s", Update.errorString());
-            LOG_ERRORF("Update error code: %d", Update.getError());
-            LOG_ERRORF("Update size: %d bytes", Update.size());
-            LOG_ERRORF("Update progress: %d bytes", Update.progress());
+            failFlash("bad gzip header");
+            return false;
         }
 
-        isUpdateInProgress = false;
+        inflater = (tinfl_decompressor *)heap_caps_malloc(sizeof(tinfl_decompressor), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        dictionary = (uint8_t *)heap_caps_malloc(TINFL_LZ_DICT_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!inflater || !dictionary)
+        {
+            failFlash("not enough PSRAM to inflate");
+            return false;
+        }
+        tinfl_init(inflater);
+        dictionaryOffset = 0;
+        inflateDone = false;
+        imageCompressed = true;
     }
-    else
+    else if (!length || data[0] != ESP_IMAGE_MAGIC)
     {
-        LOG_ERRORF("Upload error: %d", upload.status);
-        otaServer->send(500, "text/plain", "Upload error");
-        isUpdateInProgress = false;
+        failFlash("not a firmware image");
+        return false;
+    }
+
+    // Do not validate size at start; browsers may not send it and gzip hides it
+    if (!Update.begin(UPDATE_SIZE_UNKNOWN))
+    {
+        failFlash(Update.errorString());
+        return false;
+    }
+    imageOpen = true;
+    LOG_INFOF("Update.begin() successful (%s image)", imageCompressed ? "gzip" : "raw");
+    return true;
+}
+
+bool OTAManager::inflateChunk(const uint8_t *data, size_t length)
+{
+    // The 32 KB window is the output buffer: it wraps, and every stretch is
+    // flashed before tinfl can overwrite it
+    tinfl_status status = TINFL_STATUS_NEEDS_MORE_INPUT;
+    while (!inflateDone && (length || status == TINFL_STATUS_HAS_MORE_OUTPUT))
+    {
+        size_t in = length;
+        size_t out = TINFL_LZ_DICT_SIZE - dictionaryOffset;
+        status = tinfl_decompress(inflater, data, &in, dictionary, dictionary + dictionaryOffset, &out,
+                                  TINFL_FLAG_HAS_MORE_INPUT);
+        data += in;
+        length -= in;
+
+        if (out && !writeImage(dictionary + dictionaryOffset, out))
+        {
+            return false;
+        }
+        dictionaryOffset = (dictionaryOffset + out) & (TINFL_LZ_DICT_SIZE - 1);
+
+        if (status < TINFL_STATUS_DONE)
+        {
+            failFlash("corrupt compressed image");
+            return false;
+        }
+        inflateDone = status == TINFL_STATUS_DONE;
+    }
+
+    // Past the deflate stream is the gzip trailer: Update.end() checks the
+    // image's own checksum and digest instead
+    return true;
+}
+
+bool OTAManager::writeImage(const uint8_t *data, size_t length)
+{
+    if (!length)
+    {
+        return true;
+    }
+
+    // Update.write() takes a non-const buffer but only reads it
+    if (Update.write(const_cast<uint8_t *>(data), length) != length)
+    {
+        failFlash(Update.errorString());
+        return false;
+    }
+    flashedBytes += length;
+    return true;
+}
+
+bool OTAManager::closeImage()
+{
+    if (!imageOpen)
+    {
+        if (!flashFailed)
+        {
+            failFlash("empty upload");
+        }
+        return false;
+    }
+    if (!flashFailed && imageCompressed && !inflateDone)
+    {
+        failFlash("compressed image is truncated");
+    }
+    if (flashFailed)
+    {
+        Update.abort();
+        return false;
+    }
+
+    // Finalize update (true = accept whatever size was written)
+    if (!Update.end(true))
+    {
+        LOG_ERRORF("Update error code: %d", Update.getError());
+        failFlash(Update.errorString());
+        return false;
+    }
+
+    LOG_INFOF("Update completed successfully (%u bytes)", (unsigned)Update.size());
+    return true;
+}
+
+void OTAManager::failFlash(const char *reason)
+{
+    flashError = reason;
+    flashFailed = true;
+    LOG_ERRORF("OTA flash failed: %s", reason);
+}
+
+size_t OTAManager::gzipHeaderLength(const uint8_t *data, size_t length)
+{
+    // RFC 1952: fixed 10 bytes, then the optional fields announced in FLG
+    if (length < 10 || data[2] != 8) // CM 8 = deflate
+    {
+        return 0;
+    }
+    const uint8_t flags = data[3];
+    size_t offset = 10;
+    if (flags & 0x04) // FEXTRA
+    {
+        if (offset + 2 > length)
+        {
+            return 0;
+        }
+        offset += 2 + (data[offset] | data[offset + 1] << 8);
+    }
+    if (flags & 0x08) // FNAME
+    {
+        while (offset < length && data[offset++])
+        {
+        }
+    }
+    if (flags & 0x10) // FCOMMENT
+    {
+        while (offset < length && data[offset++])
+        {
+        }
+    }
+    if (flags & 0x02) // FHCRC
+    {
+        offset += 2;
     }
+    return offset < length ? offset : 0;
 }
 
 void OTAManager::handleProgress()
@@ -5,7 +5,8 @@
  * @date 2025
  * @brief OTA (Over-The-Air) firmware update manager for ESP32-CAM
  *
- * Provides simple OTA functionality for firmware updates via HTTP
+ * Provides streaming OTA firmware updates via HTTP: the camera keeps
+ * serving viewers (at a reduced rate) while the image is written
  */
 
 #ifndef OTA_MANAGER_H
@@ -15,30 +16,97 @@
 #include <WebServer.h>
 #include <Update.h>
 #include <WiFi.h>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
 #include "../../src/config.h"
 
+struct tinfl_decompressor_tag;
+
+enum OtaState
+{
+    OTA_STATE_IDLE = 0,  // No update since boot
+    OTA_STATE_RECEIVING, // Upload in progress
+    OTA_STATE_FINISHING, // Last block queued, image being verified
+    OTA_STATE_DONE,      // Image accepted, restarting
+    OTA_STATE_FAILED     // Last update failed, old firmware still running
+};
+
+/**
+ * @class OTAManager
+ * @brief Firmware upload server writing the image from a background task.
+ *
+ * The server runs in its own task, so a long upload does not hold the
+ * loop and its HTTP viewers. Received data is copied into OTA_BLOCK_COUNT
+ * PSRAM blocks of OTA_BLOCK_SIZE bytes (whole flash sectors); the flash
+ * task writes full blocks while the next ones fill, and the receiver only
+ * waits when every block is queued. A gzip image (OTA_COMPRESSED_ENABLED)
+ * is inflated by the ROM inflater on its way to flash.
+ *
+ * The camera stays up: during the upload the main stream is held at
+ * ABR level OTA_STREAM_ABR_LEVEL or coarser and capped at OTA_STREAM_FPS.
+ */
 class OTAManager
 {
 private:
+    enum FlashJobType
+    {
+        FLASH_JOB_DATA = 0,
+        FLASH_JOB_END,
+        FLASH_JOB_ABORT
+    };
+
+    struct FlashJob
+    {
+        uint8_t type;
+        uint8_t *data;
+        uint32_t length;
+    };
+
     WebServer *otaServer;
-    bool isUpdateInProgress;
+    std::atomic<bool> isUpdateInProgress;
     unsigned long updateStartTime;
-    size_t updateTotalSize;
-    size_t updateCurrentSize;
+    std::atomic<size_t> updateTotalSize;
+    std::atomic<size_t> updateCurrentSize;
+    TaskHandle_t serverTask;
+    TaskHandle_t flashTask;
+    QueueHandle_t flashJobs;
+    QueueHandle_t freeBlocks;
+    QueueHandle_t flashDone;
+
+    // Receiver, server task only
+    uint8_t *blocks[OTA_BLOCK_COUNT];
+    uint8_t *currentBlock;
+    uint32_t blockFill;
+    const char *uploadError; // nullptr while the upload is healthy
+    unsigned long lastProgress;
+    uint32_t failures;
+
+    // Writer, flash task only while an upload runs (freed by the receiver after it)
+    bool imageOpen;
+    bool inflateDone;
+    tinfl_decompressor_tag *inflater;
+    uint8_t *dictionary;
+    size_t dictionaryOffset;
+    std::atomic<bool> imageCompressed;
+    std::atomic<bool> flashFailed;
+    std::atomic<uint32_t> flashedBytes;
+    const char *flashError;
 
 public:
     OTAManager();
     ~OTAManager();
 
     /**
-     * @brief Initialize OTA server
+     * @brief Initialize OTA server and its tasks
      * @param port Port for OTA server (default: OTA_SERVER_PORT from config.h)
      * @return true if initialization successful
      */
     bool begin(int port = OTA_SERVER_PORT);
 
     /**
-     * @brief Handle OTA client requests
+     * @brief Handle OTA client requests (called by the server task)
      */
     void handleClient();
 
@@ -66,6 +134,29 @@ private:
     void handleUpload();
     void handleNotFound();
     void handleProgress();
+
+    static void serverTaskEntry(void *arg);
+    static void flashTaskEntry(void *arg);
+
+    // Receiver side
+    bool startUpload();
+    void receiveChunk(const uint8_t *data, size_t length);
+    void queueBlock();
+    void finishUpload();
+    void failUpload(const char *reason);
+    bool waitFlashDone(uint8_t type);
+    void endUpload(bool success);
+    void setStreamingReduced(bool reduced);
+    void publishProgress(OtaState state, bool force);
+
+    // Flash side
+    void flashBlock(const uint8_t *data, uint32_t length);
+    bool openImage(const uint8_t *data, uint32_t length, uint32_t &offset);
+    bool inflateChunk(const uint8_t *data, size_t length);
+    bool writeImage(const uint8_t *data, size_t length);
+    bool closeImage();
+    void failFlash(const char *reason);
+    static size_t gzipHeaderLength(const uint8_t *data, size_t length);
 };
 
 #endif // OTA_MANAGER_H
@@ -0,0 +1,114 @@
+/**
+ * @file ObjectPool.h
+ * @author Jeremy Noverraz
+ * @version 1.0
+ * @date 2025
+ * @brief Fixed-capacity object slots allocated once, for long-running connection churn
+ */
+// ObjectPool.h
+#ifndef OBJECT_POOL_H
+#define OBJECT_POOL_H
+
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+#include <new>
+#include <utility>
+
+/**
+ * @class ObjectPool
+ * @brief N slots for objects of type T, carved out of one allocation made at begin().
+ *
+ * create() constructs an object in a free slot with placement new and
+ * destroy() runs its destructor and frees the slot: the object still
+ * starts from its constructor every time, but the heap never sees it.
+ * A camera that serves reconnecting NVRs for weeks keeps the same
+ * largest free block it had at boot. Storage goes to internal RAM when
+ * it fits, PSRAM otherwise. Not thread-safe: one owner task.
+ */
+template <typename T, uint8_t N>
+class ObjectPool
+{
+    static_assert(N <= 32, "ObjectPool tracks slots in a 32-bit mask");
+
+public:
+    ObjectPool() : storage(nullptr), used(0), inUse(0), highWater(0) {}
+
+    /**
+     * @brief Reserve the storage for every slot
+     *
+     * @return false if neither internal RAM nor PSRAM could hold it
+     */
+    bool begin()
+    {
+        if (storage)
+        {
+            return true;
+        }
+        const size_t bytes = slotSize() * N;
+        storage = (uint8_t *)heap_caps_aligned_alloc(alignof(T), bytes, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        if (!storage)
+        {
+            storage = (uint8_t *)heap_caps_aligned_alloc(alignof(T), bytes, MALLOC_CAP_SPIRAM);
+        }
+        return storage != nullptr;
+    }
+
+    /**
+     * @brief Construct an object in a free slot
+     *
+     * @return Object, or nullptr if every slot is taken (or begin() failed)
+     */
+    template <typename... Args>
+    T *create(Args &&...args)
+    {
+        if (!storage)
+        {
+            return nullptr;
+        }
+        for (uint8_t i = 0; i < N; i++)
+        {
+            if (!(used & (1u << i)))
+            {
+                used |= 1u << i;
+                inUse++;
+                highWater = max(highWater, inUse);
+                return new (storage + i * slotSize()) T(std::forward<Args>(args)...);
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief Destroy an object created by this pool and free its slot
+     */
+    void destroy(T *object)
+    {
+        if (!object || !storage)
+        {
+            return;
+        }
+        const size_t index = ((uint8_t *)object - storage) / slotSize();
+        if (index >= N || !(used & (1u << index)))
+        {
+            return;
+        }
+        object->~T();
+        used &= ~(1u << index);
+        inUse--;
+    }
+
+    uint8_t capacity() const { return N; }
+    uint8_t getInUse() const { return inUse; }
+    uint8_t getHighWater() const { return highWater; } // Most slots ever taken at once
+    size_t getStorageBytes() const { return storage ? slotSize() * N : 0; }
+
+private:
+    uint8_t *storage;
+    uint32_t used; // Bit n set = slot n holds an object
+    uint8_t inUse;
+    uint8_t highWater;
+
+    static constexpr size_t slotSize() { return (sizeof(T) + alignof(T) - 1) / alignof(T) * alignof(T); }
+};
+
+#endif // OBJECT_POOL_H
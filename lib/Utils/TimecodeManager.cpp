@@ -8,23 +8,26 @@
 // TimecodeManager.cpp
 #include "TimecodeManager.h"
 #include "Logger.h"
+#include <sys/time.h>
+#include <esp_sntp.h>
+
+std::atomic<uint8_t> TimecodeManager::sync_status(RTSP_CLOCK_SYNC_ERROR);
+std::atomic<uint32_t> TimecodeManager::ntp_timestamp(0);
+std::atomic<unsigned long> TimecodeManager::last_sync_ms(0);
+TaskHandle_t TimecodeManager::ntp_task = nullptr;
 
 TimecodeManager::TimecodeManager()
 {
     clock_reference = 0;
     start_time_ms = 0;
-    last_sync_time = 0;
-    sync_status = RTSP_CLOCK_SYNC_ERROR;
     timecode_mode = RTSP_TIMECODE_MODE;
     frame_counter = 0;
     last_frame_timestamp = 0;
-    ntp_timestamp = 0;
-    ntp_synced = false;
 
     // Initialize reference clock immediately
     start_time_ms = millis();
-    clock_reference = esp_timer_get_time() / 1000;
-    last_sync_time = start_time_ms;
+    start_time_us = esp_timer_get_time();
+    clock_reference = start_time_us / 1000;
 
     LOG_DEBUG("TimecodeManager: Reference clock initialized");
 }
@@ -34,6 +37,13 @@ TimecodeManager::~TimecodeManager()
     // Cleanup if needed
 }
 
+TimecodeManager &TimecodeManager::media()
+{
+    // Built on first use: no dependency on static initialization order
+    static TimecodeManager clock;
+    return clock;
+}
+
 void TimecodeManager::begin()
 {
     LOG_INFO("Initializing TimecodeManager");
@@ -41,9 +51,15 @@ void TimecodeManager::begin()
     // Initialize reference clock
     initializeClock();
 
-    // Sync with NTP if enabled
 #ifdef RTSP_NTP_SERVER
-        syncWithNTP();
+    // In the background: no caller ever waits for an NTP answer
+    if (!ntp_task &&
+        xTaskCreatePinnedToCore(ntpTaskEntry, "ntp", RTSP_NTP_TASK_STACK_SIZE, nullptr,
+                                RTSP_NTP_TASK_PRIORITY, &ntp_task, RTSP_NTP_TASK_CORE) != pdPASS)
+    {
+        ntp_task = nullptr;
+        LOG_WARN("NTP task not started, wall clock stays on boot time");
+    }
 #endif
 
     LOG_INFOF("TimecodeManager initialized - Mode: %d", timecode_mode);
@@ -52,69 +68,73 @@ void TimecodeManager::begin()
 void TimecodeManager::initializeClock()
 {
     start_time_ms = millis();
-    clock_reference = esp_timer_get_time() / 1000; // Microseconds to milliseconds
-    last_sync_time = start_time_ms;
+    start_time_us = esp_timer_get_time();
+    clock_reference = start_time_us / 1000; // Microseconds to milliseconds
 
     LOG_DEBUG("Reference clock initialized");
 }
 
-void TimecodeManager::syncWithNTP()
+void TimecodeManager::ntpTaskEntry(void *arg)
 {
-    if (!WiFi.isConnected())
+#ifdef RTSP_NTP_SERVER
+    // SNTP itself runs in the lwIP task: this one starts it once the
+    // network is up, then only watches that it keeps answering
+    while (!WiFi.isConnected())
     {
-        LOG_WARN("No WiFi connection for NTP synchronization");
-        return;
+        vTaskDelay(pdMS_TO_TICKS(1000));
     }
 
-    LOG_INFO("Synchronizing with NTP server...");
-
-    // Configure NTP server
+    // Smooth mode slews the system clock with adjtime() instead of stepping
+    // it, so RTCP wall-clock times never jump under a running stream; only
+    // an offset over 35 minutes (the first sync after boot) is stepped
+    sntp_set_sync_mode(SNTP_SYNC_MODE_SMOOTH);
+    sntp_set_sync_interval(RTSP_NTP_SYNC_INTERVAL * 1000UL);
+    sntp_set_time_sync_notification_cb(onTimeSync);
     configTime(0, 0, RTSP_NTP_SERVER);
+    LOG_INFO("NTP synchronization started");
 
-    // Wait for synchronization
-    unsigned long start_wait = millis();
-    while (!time(nullptr) && (millis() - start_wait) < RTSP_NTP_TIMEOUT)
+    const unsigned long started = millis();
+    bool warned = false;
+    for (;;)
     {
-        delay(100);
-        yield();
+        vTaskDelay(pdMS_TO_TICKS(1000));
+        const unsigned long last = last_sync_ms.load();
+        if (!last && !warned && millis() - started > RTSP_NTP_TIMEOUT)
+        {
+            LOG_WARN("NTP not answering yet, wall clock stays on boot time");
+            warned = true;
+        }
+        else if (last && sync_status == RTSP_CLOCK_SYNC_OK && millis() - last > 3UL * RTSP_NTP_SYNC_INTERVAL * 1000UL)
+        {
+            LOG_WARN("NTP lost: no sync for three intervals");
+            sync_status = RTSP_CLOCK_SYNC_ERROR;
+        }
     }
+#else
+    vTaskDelete(nullptr);
+#endif
+}
 
-    if (time(nullptr))
-    {
-        ntp_synced = true;
-        ntp_timestamp = time(nullptr);
-        sync_status = RTSP_CLOCK_SYNC_OK;
-        last_sync_time = millis();
-
-        LOG_INFO("NTP synchronization successful");
-        LOG_INFOF("NTP timestamp: %lu", ntp_timestamp);
-    }
-    else
+void TimecodeManager::onTimeSync(struct timeval *tv)
+{
+    ntp_timestamp = tv->tv_sec;
+    last_sync_ms = max(millis(), 1UL);
+    if (sync_status.exchange(RTSP_CLOCK_SYNC_OK) != RTSP_CLOCK_SYNC_OK)
     {
-        LOG_WARN("NTP synchronization failed");
-        sync_status = RTSP_CLOCK_SYNC_ERROR;
+        LOG_INFOF("NTP synchronization successful, timestamp: %lu", (unsigned long)tv->tv_sec);
     }
 }
 
 void TimecodeManager::updateClockReference()
 {
-    uint32_t current_time = millis();
-
-    // Update clock reference
+    // Update clock reference (NTP is disciplined in the background)
     clock_reference = esp_timer_get_time() / 1000;
-
-    // Check if NTP resynchronization is needed
-#ifdef RTSP_NTP_SERVER
-    if ((current_time - last_sync_time) > (RTSP_NTP_SYNC_INTERVAL * 1000))
-    {
-        syncWithNTP();
-    }
-#endif
 }
 
-RTSPTimecode_t TimecodeManager::generateTimecode()
+RTSPTimecode_t TimecodeManager::generateTimecode(int64_t captureMicros)
 {
     RTSPTimecode_t timecode;
+    const uint32_t frame_duration_rtp = RTSP_CLOCK_RATE / RTSP_FPS;
 
     updateClockReference();
     updateFrameCounter();
@@ -128,35 +148,37 @@ RTSPTimecode_t TimecodeManager::generateTimecode()
     // Calculate timecodes according to mode
     switch (timecode_mode)
     {
-    case 0: // Basic mode
-        timecode.pts = getCurrentTimestamp();
+    case 0: // Basic mode: exact capture time
+        timecode.pts = mediaTimestamp(captureMicros);
         timecode.dts = timecode.pts;
         timecode.clock_reference = clock_reference;
         timecode.wall_clock = getWallClockMs();
         break;
 
-    case 1: // Advanced mode
-        timecode.pts = calculatePTS(frame_counter);
-        timecode.dts = calculateDTS(frame_counter);
+    case 1: // Advanced mode: capture time on the nearest frame boundary
+        timecode.pts = (uint32_t)((mediaTicks(captureMicros) + frame_duration_rtp / 2) /
+                                  frame_duration_rtp * frame_duration_rtp);
+        timecode.dts = timecode.pts;
         timecode.clock_reference = clock_reference;
         timecode.wall_clock = getWallClockMs();
         break;
 
     case 2: // Expert mode
-        timecode.pts = calculatePTS(frame_counter);
-        timecode.dts = calculateDTS(frame_counter);
+        timecode.pts = (uint32_t)((mediaTicks(captureMicros) + frame_duration_rtp / 2) /
+                                  frame_duration_rtp * frame_duration_rtp);
+        timecode.dts = timecode.pts;
         timecode.clock_reference = clock_reference;
         timecode.wall_clock = getWallClockMs();
 
         // Add synchronization metadata
-        if (ntp_synced)
+        if (last_sync_ms.load())
         {
             timecode.clock_reference |= 0x80000000; // Synchronization bit
         }
         break;
 
     default:
-        timecode.pts = getCurrentTimestamp();
+        timecode.pts = mediaTimestamp(captureMicros);
         timecode.dts = timecode.pts;
         timecode.clock_reference = clock_reference;
         timecode.wall_clock = getWallClockMs();
@@ -166,28 +188,28 @@ RTSPTimecode_t TimecodeManager::generateTimecode()
     // Ensure timecodes are never 0
     if (timecode.pts == 0)
     {
-        timecode.pts = RTSP_CLOCK_RATE / RTSP_FPS; // 1 frame in RTP timestamps
+        timecode.pts = frame_duration_rtp; // 1 frame in RTP timestamps
     }
     if (timecode.dts == 0)
     {
         timecode.dts = timecode.pts;
     }
 
-    // Force increasing timecodes if enabled
-    if (RTSP_FORCE_INCREASING_TIMECODES)
+    // Force increasing timecodes if enabled (a 90 kHz clock wraps every 13 hours)
+    if (RTSP_FORCE_INCREASING_TIMECODES && frame_counter > 1)
     {
-        if (timecode.pts <= last_frame_timestamp)
+        if ((int32_t)(timecode.pts - last_frame_timestamp) <= 0)
         {
-            timecode.pts = last_frame_timestamp + (RTSP_CLOCK_RATE / RTSP_FPS);
+            timecode.pts = last_frame_timestamp + frame_duration_rtp;
         }
-        if (timecode.dts <= last_frame_timestamp)
+        if ((int32_t)(timecode.dts - last_frame_timestamp) <= 0)
         {
             timecode.dts = timecode.pts;
         }
     }
 
     // Final timestamp consistency check
-    if (timecode.dts > timecode.pts)
+    if ((int32_t)(timecode.dts - timecode.pts) > 0)
     {
         // DTS should never be greater than PTS for MJPEG
         timecode.dts = timecode.pts;
@@ -201,6 +223,19 @@ RTSPTimecode_t TimecodeManager::generateTimecode()
     return timecode;
 }
 
+uint64_t TimecodeManager::mediaTicks(int64_t timerMicros) const
+{
+    // 64-bit all the way: the 32-bit result wraps cleanly instead of
+    // overflowing in the multiplication
+    const int64_t elapsed = timerMicros - start_time_us;
+    return elapsed > 0 ? (uint64_t)elapsed * RTSP_CLOCK_RATE / 1000000ULL : 0;
+}
+
+uint32_t TimecodeManager::mediaTimestamp(int64_t timerMicros) const
+{
+    return (uint32_t)mediaTicks(timerMicros);
+}
+
 uint32_t TimecodeManager::getCurrentTimestamp()
 {
     uint32_t wall_clock = getWallClockMs();
@@ -305,13 +340,23 @@ uint32_t TimecodeManager::rtpTimestampToMs(uint32_t rtp_ts)
     return (rtp_ts * 1000) / RTSP_CLOCK_RATE;
 }
 
+uint64_t TimecodeManager::getNTPTime(uint32_t ageMicros)
+{
+    // Seconds between the NTP (1900) and Unix (1970) epochs
+    static const uint64_t NTP_UNIX_OFFSET = 2208988800ULL;
+
+    struct timeval now;
+    gettimeofday(&now, nullptr);
+    uint64_t micros = (uint64_t)now.tv_sec * 1000000ULL + now.tv_usec - ageMicros;
+
+    uint64_t seconds = micros / 1000000ULL + NTP_UNIX_OFFSET;
+    uint64_t fraction = ((micros % 1000000ULL) << 32) / 1000000ULL;
+    return (seconds << 32) | fraction;
+}
+
 uint32_t TimecodeManager::getNTPTimestamp()
 {
-    if (ntp_synced)
-    {
-        return ntp_timestamp;
-    }
-    return 0;
+    return last_sync_ms.load() ? ntp_timestamp.load() : 0;
 }
 
 void TimecodeManager::updateFrameCounter()
@@ -13,11 +13,22 @@
 
 #include <WiFi.h>
 #include <time.h>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 #include "../../src/config.h"
 
 /**
  * @class TimecodeManager
  * @brief Manages PTS/DTS timecodes and temporal metadata for optimal FFmpeg compatibility
+ *
+ * One process-wide media clock (media()): the capture task stamps every
+ * frame with it once, so all viewers of a frame see the same PTS and a
+ * session only adds its own random RTP timestamp offset. The PTS comes
+ * from the capture time, not a frame count, so dropped or gated frames
+ * leave their real gap in the timeline. NTP runs in the
+ * background and slews the system clock, which only feeds the wall-clock
+ * side (RTCP sender reports, SDP); nothing waits for it.
  */
 class TimecodeManager
 {
@@ -25,16 +36,41 @@ public:
     TimecodeManager();
     ~TimecodeManager();
 
+    /**
+     * @brief The shared media clock
+     */
+    static TimecodeManager &media();
+
     // Initialization and configuration
-    void begin();
-    void syncWithNTP();
+    void begin(); // Also starts the background NTP task, once
     void updateClockReference();
 
     // Timecode generation
-    RTSPTimecode_t generateTimecode();
+    RTSPTimecode_t generateTimecode(int64_t captureMicros); // esp_timer_get_time() at capture
+
+    /**
+     * @brief Media time of an esp_timer_get_time() instant, in RTP clock units
+     *
+     * The clock behind every PTS (before mode 1/2 snap it to the frame
+     * grid). RTCP sender reports read it too, so their RTP side follows
+     * the same clock as the frames they describe.
+     */
+    uint32_t mediaTimestamp(int64_t timerMicros) const;
     uint32_t getCurrentTimestamp();
     uint32_t getWallClockMs();
 
+    /**
+     * @brief Current time as a 64-bit NTP timestamp (32.32 fixed point, since 1900)
+     *
+     * Read from the system clock that the background NTP task disciplines;
+     * before the first sync it counts from the 1970 epoch at boot, which
+     * still gives receivers a consistent NTP/RTP mapping. Used for RTCP
+     * sender reports.
+     *
+     * @param ageMicros Move the result this many microseconds into the past
+     */
+    static uint64_t getNTPTime(uint32_t ageMicros = 0);
+
     // Metadata for FFmpeg
     RTSPClockMetadata_t getClockMetadata();
     RTSPMJPEGMetadata_t getMJPEGMetadata(uint16_t width, uint16_t height);
@@ -55,24 +91,29 @@ private:
     // Reference clock
     uint32_t clock_reference;
     uint32_t start_time_ms;
-    uint32_t last_sync_time;
+    int64_t start_time_us; // esp_timer_get_time() at media time 0
 
     // Synchronization status
-    uint8_t sync_status;
     uint8_t timecode_mode;
 
     // Frame counters
     uint32_t frame_counter;
     uint32_t last_frame_timestamp;
 
-    // NTP metadata
-    uint32_t ntp_timestamp;
-    bool ntp_synced;
+    // NTP state, written by the SNTP callback (lwIP task), read anywhere
+    static std::atomic<uint8_t> sync_status;
+    static std::atomic<uint32_t> ntp_timestamp;   // Unix seconds at the last sync
+    static std::atomic<unsigned long> last_sync_ms; // millis() of the last sync (0 = never)
+    static TaskHandle_t ntp_task;
 
     // Private methods
     void initializeClock();
+    uint64_t mediaTicks(int64_t timerMicros) const;
     uint32_t getNTPTimestamp();
     void updateFrameCounter();
+
+    static void ntpTaskEntry(void *arg);
+    static void onTimeSync(struct timeval *tv);
 };
 
 #endif // TIMECODE_MANAGER_H
\ No newline at end of file
@@ -14,11 +14,89 @@
 #include "../../src/config.h"
 #include "../Utils/Logger.h"
 #include "../Utils/Helpers.h"
+#include <Preferences.h>
 
 // Static variables for monitoring
 unsigned long WiFiManager::lastConnectionCheck = 0;
 bool WiFiManager::connectionStable = false;
 bool WiFiManager::lastConnectionState = false;
+bool WiFiManager::modemSleep = false;
+bool WiFiManager::fastAttempt = false;
+const char *WiFiManager::pendingSsid = nullptr;
+const char *WiFiManager::pendingPassword = nullptr;
+#ifdef WIFI_USE_BSSID
+uint8_t WiFiManager::pendingChannel = 0;
+const uint8_t *WiFiManager::pendingBssid = nullptr;
+#endif
+
+// Last successful association, for a reconnect without scan or DHCP
+#define WIFI_ASSOCIATION_MAGIC 0x57494131 // "WIA1"
+
+struct WiFiAssociation
+{
+    uint32_t magic;
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint8_t reserved; // Keeps the layout free of padding for the checksum
+    uint32_t ip;
+    uint32_t gateway;
+    uint32_t subnet;
+    uint32_t dns;
+    uint32_t checksum;
+};
+
+// Survives software, watchdog and brownout resets; NVS covers power-on
+static RTC_NOINIT_ATTR WiFiAssociation rtcAssociation;
+
+static uint32_t associationChecksum(const WiFiAssociation &entry)
+{
+    // FNV-1a over everything but the checksum itself
+    const uint8_t *bytes = (const uint8_t *)&entry;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < offsetof(WiFiAssociation, checksum); i++)
+    {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static bool isValidAssociation(const WiFiAssociation &entry)
+{
+    return entry.magic == WIFI_ASSOCIATION_MAGIC && entry.channel != 0 && entry.checksum == associationChecksum(entry);
+}
+
+static bool loadAssociation(WiFiAssociation &entry)
+{
+    if (isValidAssociation(rtcAssociation))
+    {
+        entry = rtcAssociation;
+        return true;
+    }
+
+    Preferences prefs;
+    if (!prefs.begin(WIFI_FAST_CONNECT_NVS_NAMESPACE, true))
+    {
+        return false;
+    }
+    bool found = prefs.getBytes("assoc", &entry, sizeof(entry)) == sizeof(entry) && isValidAssociation(entry);
+    prefs.end();
+    if (found)
+    {
+        rtcAssociation = entry;
+    }
+    return found;
+}
+
+static void forgetAssociation()
+{
+    rtcAssociation.magic = 0;
+    Preferences prefs;
+    if (prefs.begin(WIFI_FAST_CONNECT_NVS_NAMESPACE, false))
+    {
+        prefs.remove("assoc");
+        prefs.end();
+    }
+}
 
 void WiFiManager::begin(const char *ssid, const char *password
 #ifdef WIFI_USE_BSSID
@@ -34,7 +112,7 @@ void WiFiManager::begin(const char *ssid, const char *password
     WiFi.mode(WIFI_STA);
 
     // Advanced WiFi configuration to avoid AUTH_EXPIRE
-    WiFi.setSleep(false);        // Disable WiFi sleep mode
+    WiFi.setSleep(modemSleep);   // WiFi sleep mode disabled until the capture scheduler idles
     WiFi.setAutoReconnect(true); // Enable automatic reconnection
 
     // WiFi power configuration to avoid disconnections
@@ -178,6 +256,132 @@ void WiFiManager::begin(const char *ssid, const char *password
     }
 }
 
+#ifndef WIFI_USE_BSSID
+void WiFiManager::beginAsync(const char *ssid, const char *password)
+#else
+void WiFiManager::beginAsync(const char *ssid, const char *password, const uint8_t channel, const uint8_t bssid[6])
+#endif
+{
+    pendingSsid = ssid;
+    pendingPassword = password;
+#ifdef WIFI_USE_BSSID
+    pendingChannel = channel;
+    pendingBssid = bssid;
+#endif
+
+    WiFi.persistent(false); // Our own cache below, no flash write per association
+    WiFi.mode(WIFI_STA);
+    WiFi.setSleep(modemSleep);
+    WiFi.setAutoReconnect(true);
+    WiFi.setTxPower(WIFI_POWER_19_5dBm);
+
+    configureStaticIP();
+
+    WiFiAssociation cached;
+    fastAttempt = WIFI_FAST_CONNECT_ENABLED && loadAssociation(cached);
+    if (!fastAttempt)
+    {
+        // Nothing cached yet: plain association, still overlapping camera init
+        LOG_INFO("No cached WiFi association, scanning");
+#ifndef WIFI_USE_BSSID
+        WiFi.begin(ssid, password);
+#else
+        WiFi.begin(ssid, password, channel, bssid);
+#endif
+        return;
+    }
+
+#ifndef WIFI_USE_STATIC_IP
+    if (WIFI_FAST_CONNECT_REUSE_IP && cached.ip != 0)
+    {
+        // Previous lease reused as-is: no DHCP round trip
+        WiFi.config(IPAddress(cached.ip), IPAddress(cached.gateway), IPAddress(cached.subnet), IPAddress(cached.dns));
+    }
+#endif
+
+    LOG_INFOF("Fast WiFi connect: channel %d, BSSID %02X:%02X:%02X:%02X:%02X:%02X", cached.channel,
+              cached.bssid[0], cached.bssid[1], cached.bssid[2], cached.bssid[3], cached.bssid[4], cached.bssid[5]);
+    WiFi.begin(ssid, password, cached.channel, cached.bssid);
+}
+
+bool WiFiManager::waitForConnection()
+{
+    // A cached association either works at once or not at all
+    const unsigned long timeout = fastAttempt ? WIFI_FAST_CONNECT_TIMEOUT_MS : WIFI_ASYNC_CONNECT_TIMEOUT_MS;
+    unsigned long start = millis();
+    while (WiFi.status() != WL_CONNECTED && millis() - start < timeout)
+    {
+        delay(10);
+    }
+
+    if (WiFi.status() == WL_CONNECTED)
+    {
+        connectionStable = true;
+        lastConnectionCheck = millis();
+        LOG_INFOF("WiFi connected%s, %lu ms after camera init", fastAttempt ? " from cache" : "", millis() - start);
+        logConnectionStatus();
+        fastAttempt = false;
+        saveAssociation();
+        return true;
+    }
+
+    if (fastAttempt)
+    {
+        // AP moved, channel changed or lease gone: start from scratch
+        LOG_WARN("Cached WiFi association failed, full connection");
+        forgetAssociation();
+        fastAttempt = false;
+#ifndef WIFI_USE_STATIC_IP
+        WiFi.config(IPAddress(), IPAddress(), IPAddress()); // Back to DHCP
+#endif
+    }
+
+#ifndef WIFI_USE_BSSID
+    begin(pendingSsid, pendingPassword);
+#else
+    begin(pendingSsid, pendingPassword, pendingChannel, pendingBssid);
+#endif
+    if (WiFi.status() == WL_CONNECTED)
+    {
+        saveAssociation();
+        return true;
+    }
+    return false;
+}
+
+void WiFiManager::saveAssociation()
+{
+    WiFiAssociation entry = {};
+    entry.magic = WIFI_ASSOCIATION_MAGIC;
+    const uint8_t *bssid = WiFi.BSSID();
+    if (bssid)
+    {
+        memcpy(entry.bssid, bssid, sizeof(entry.bssid));
+    }
+    entry.channel = WiFi.channel();
+    entry.ip = (uint32_t)WiFi.localIP();
+    entry.gateway = (uint32_t)WiFi.gatewayIP();
+    entry.subnet = (uint32_t)WiFi.subnetMask();
+    entry.dns = (uint32_t)WiFi.dnsIP();
+    entry.checksum = associationChecksum(entry);
+
+    bool changed = !isValidAssociation(rtcAssociation) || memcmp(&rtcAssociation, &entry, sizeof(entry)) != 0;
+    rtcAssociation = entry;
+    if (!changed)
+    {
+        return;
+    }
+
+    // Flash is only written when the association actually changes
+    Preferences prefs;
+    if (prefs.begin(WIFI_FAST_CONNECT_NVS_NAMESPACE, false))
+    {
+        prefs.putBytes("assoc", &entry, sizeof(entry));
+        prefs.end();
+        LOG_DEBUG("WiFi association cached");
+    }
+}
+
 bool WiFiManager::isConnected()
 {
     bool connected = (WiFi.status() == WL_CONNECTED);
@@ -267,7 +471,7 @@ bool WiFiManager::reconnect()
     delay(500);
 
     // Optimized configuration for reconnection
-    WiFi.setSleep(false);
+    WiFi.setSleep(modemSleep);
     WiFi.setAutoReconnect(true);
 
     // Configure static IP if enabled
@@ -361,7 +565,7 @@ bool WiFiManager::handleAuthError()
     delay(1000);
 
     // Reset WiFi parameters with optimized configuration
-    WiFi.setSleep(false);
+    WiFi.setSleep(modemSleep);
     WiFi.setAutoReconnect(true);
     WiFi.setTxPower(WIFI_POWER_19_5dBm);
 
@@ -448,3 +652,14 @@ void WiFiManager::updateConnectionState(bool connected)
         lastConnectionCheck = millis();
     }
 }
+
+void WiFiManager::setModemSleep(bool enable)
+{
+    if (enable == modemSleep)
+    {
+        return;
+    }
+    modemSleep = enable;
+    WiFi.setSleep(enable);
+    LOG_DEBUGF("WiFi modem sleep %s", enable ? "allowed" : "disabled");
+}
@@ -59,6 +59,35 @@ public:
     static void begin(const char *ssid, const char *password, const uint8_t channel, const uint8_t bssid[6]);
 #endif
 
+    /**
+     * @brief Starts associating without waiting for the result
+     *
+     * Lets the camera initialize while the WiFi task associates. With
+     * WIFI_FAST_CONNECT_ENABLED, the last successful BSSID and channel
+     * (and DHCP lease with WIFI_FAST_CONNECT_REUSE_IP), kept in RTC memory
+     * and NVS, are used to skip the scan and DHCP. Finish with
+     * waitForConnection().
+     *
+     * @param ssid WiFi network SSID
+     * @param password WiFi network password
+     */
+#ifndef WIFI_USE_BSSID
+    static void beginAsync(const char *ssid, const char *password);
+#else
+    static void beginAsync(const char *ssid, const char *password, const uint8_t channel, const uint8_t bssid[6]);
+#endif
+
+    /**
+     * @brief Waits for the association started by beginAsync()
+     *
+     * If the cached association does not connect within
+     * WIFI_FAST_CONNECT_TIMEOUT_MS, it is forgotten and the full begin()
+     * (scan, DHCP, retries) runs instead.
+     *
+     * @return true if connected
+     */
+    static bool waitForConnection();
+
     /**
      * @brief Checks if WiFi is connected
      *
@@ -125,8 +154,28 @@ public:
      */
     static bool handleAuthError();
 
+    /**
+     * @brief Allow or forbid Wi-Fi modem sleep
+     *
+     * Modem sleep is off while streaming (every DTIM wake-up would add
+     * latency) and may be allowed while the capture scheduler is idle.
+     * The setting survives reconnect() and handleAuthError().
+     *
+     * @param enable true to let the modem sleep between beacons
+     */
+    static void setModemSleep(bool enable);
+
 private:
     static unsigned long lastConnectionCheck;
+    static bool modemSleep;
+    static bool fastAttempt;
+    static const char *pendingSsid;
+    static const char *pendingPassword;
+#ifdef WIFI_USE_BSSID
+    static uint8_t pendingChannel;
+    static const uint8_t *pendingBssid;
+#endif
+    static void saveAssociation();
     static bool connectionStable;
     static bool lastConnectionState;
     static void logConnectionStatus();
@@ -121,8 +121,13 @@ const IPAddress primaryDNS(8, 8, 8, 8); // Optional
 #ifdef RTSP_NTP_SERVER
 // NTP synchronization interval (seconds)
 #define RTSP_NTP_SYNC_INTERVAL 3600 // 1 hour
-// NTP connection timeout (milliseconds)
+// First answer expected within (milliseconds): a warning is logged
+// after it, nothing ever waits for NTP
 #define RTSP_NTP_TIMEOUT 3000 // 3 seconds
+// Background task starting SNTP (smooth mode: the clock is slewed)
+#define RTSP_NTP_TASK_CORE 0
+#define RTSP_NTP_TASK_PRIORITY 1
+#define RTSP_NTP_TASK_STACK_SIZE 3072 // Bytes
 #endif
 
 // ===== CAMERA CONFIGURATION =====
@@ -235,11 +240,56 @@ const IPAddress primaryDNS(8, 8, 8, 8); // Optional
 #define RTSP_PORT 8554 // Current port: 8554
 // RTSP stream path (must start with /)
 #define RTSP_PATH "/stream=0"
+// Low-resolution substream for thumbnails and NVR grids (0 = disabled, 1 = enabled)
+#define RTSP_SUBSTREAM_ENABLED 1
+#define RTSP_SUBSTREAM_PATH "/stream=1"
+#define RTSP_SUBSTREAM_FRAME_SIZE FRAMESIZE_QVGA // Fixed profile, not driven by ABR
+#define RTSP_SUBSTREAM_JPEG_QUALITY 20
+// Substream frame rate, at most RTSP_FPS: with both streams watched the
+// main stream gives up one capture tick per substream frame
+#define RTSP_SUBSTREAM_FPS 2
+// Admission control: a viewer that would not fit is answered
+// "453 Not Enough Bandwidth" at SETUP or PLAY instead of slowing down
+// everyone already watching. Each unicast viewer costs the average frame
+// size of its stream times its fps; viewers joining an active multicast
+// group cost nothing. The budget is the Wi-Fi TX throughput measured
+// while sessions keep up (RTSP_ADMISSION_LINK_KBPS until then).
+#define RTSP_MAX_CLIENTS 5                  // RTSP connections at once, playing or not (one session slot each, reserved at boot)
+#define RTSP_ADMISSION_ENABLED 1            // 0 = only RTSP_MAX_CLIENTS applies
+#define RTSP_ADMISSION_LINK_KBPS 8000       // Link capacity assumed before anything was measured
+#define RTSP_ADMISSION_HEADROOM_PERCENT 80  // Share of the capacity viewers may commit
+#define RTSP_ADMISSION_WINDOW_MS 2000       // Throughput measurement window
+#define RTSP_ADMISSION_MIN_FREE_HEAP 40000  // Internal heap left free once a session is set up (bytes)
+#define RTSP_ADMISSION_MIN_FREE_PSRAM 65536 // PSRAM left free, when PSRAM is fitted (bytes)
+// Session timeout announced in SETUP (Session: id;timeout=N). Any RTSP
+// request (GET_PARAMETER / OPTIONS keepalives) or RTCP packet from the
+// viewer refreshes it; an expired session is torn down and its slot,
+// bandwidth and frames are freed at once. TCP interleaved viewers that
+// are playing are kept alive by the TCP stream itself. 0 = never expire.
+#define RTSP_SESSION_TIMEOUT_S 60
 
 // HTTP MJPEG server port
 #define HTTP_SERVER_PORT 80 // Current port: 80
 // HTTP MJPEG stream path (must start with /)
 #define HTTP_MJPEG_PATH "/mjpeg"
+// Maximum number of simultaneous MJPEG viewers (served without blocking the loop)
+#define HTTP_MJPEG_MAX_CLIENTS 4
+// Single JPEG from the last-good cache (shares the MJPEG viewer slots)
+#define HTTP_SNAPSHOT_PATH "/snapshot"
+// Give up on a snapshot if no fresh frame arrives in this time (ms)
+#define HTTP_SNAPSHOT_TIMEOUT_MS 1500
+
+// ===== METRICS =====
+// Hot-path latency histograms and streaming counters (0 = compiled out)
+#define METRICS_ENABLED 1
+// Prometheus scrape path on the HTTP server
+#define HTTP_METRICS_PATH "/metrics"
+// Rendered exposition buffer (bytes)
+#define METRICS_BUFFER_SIZE 12288
+// RTSP session counters published every N ms
+#define METRICS_PUBLISH_MS 1000
+// Session slots in the exposition (RTSP accept limit + the multicast stream)
+#define METRICS_MAX_SESSIONS 6
 
 // ===== OTA (Over-The-Air) CONFIGURATION =====
 // OTA server port (separate from main HTTP server)
@@ -256,6 +306,23 @@ const IPAddress primaryDNS(8, 8, 8, 8); // Optional
 // OTA progress update interval (ms)
 #define OTA_PROGRESS_INTERVAL 1000 // 1 second
 
+// Streaming update: the camera keeps serving while the image is written.
+// Upload data fills PSRAM blocks of whole flash sectors; a background
+// task writes them while the next ones fill.
+#define OTA_BLOCK_SIZE 32768        // Bytes per receive block (multiple of the 4096 byte flash sector)
+#define OTA_BLOCK_COUNT 4           // Blocks in flight (PSRAM, only while uploading)
+#define OTA_FLASH_TIMEOUT_MS 10000  // Receiver waits this long for a block before aborting
+#define OTA_COMPRESSED_ENABLED 1    // Accept gzip images (gzip -9 firmware.bin), inflated by the ROM inflater
+#define OTA_STREAM_ABR_LEVEL 2      // ABR level floor during an upload: congestion may still go coarser (0 = none)
+#define OTA_STREAM_FPS 5            // Main stream frame rate cap during an upload (0 = RTSP_FPS)
+#define OTA_TASK_CORE 1             // Upload server (replaces the loop's handleClient())
+#define OTA_TASK_PRIORITY 1
+#define OTA_TASK_STACK_SIZE 6144    // Bytes
+#define OTA_TASK_POLL_MS 10         // Server poll period when idle
+#define OTA_FLASH_TASK_CORE 0
+#define OTA_FLASH_TASK_PRIORITY 2   // Below capture and the RTSP sender
+#define OTA_FLASH_TASK_STACK_SIZE 4096 // Bytes
+
 // RTSP server name in headers
 #define RTSP_SERVER_NAME "ESP32CAM-RTSP-Multi/1.1" // TODO redundancy in version/label is BAD!
 
@@ -337,6 +404,12 @@ const IPAddress primaryDNS(8, 8, 8, 8); // Optional
 // 40-60 = Low quality, smaller files
 #define RTSP_MJPEG_COMPATIBILITY_QUALITY 25
 
+// RTP/JPEG payload format
+// 0 = Legacy: whole JPEG file as payload, Q = RTSP_MJPEG_COMPATIBILITY_QUALITY, type 0
+// 1 = RFC 2435: entropy-coded data only, quantization tables in-band (Q = 255),
+//     type (4:2:2 / 4:2:0) taken from the SOF segment (recommended)
+#define RTSP_JPEG_RFC2435 1
+
 // MJPEG profile for maximum compatibility
 // 0 = Standard profile
 // 1 = Baseline profile (maximum compatibility)
@@ -374,22 +447,156 @@ const IPAddress primaryDNS(8, 8, 8, 8); // Optional
 #define RTSP_HLS_CLOSED_GOP 1
 
 // Advanced optimization: number of frame buffers and capture mode
-#define CAMERA_FB_COUNT 2                   // 2 buffers - STABILITY OPTIMIZED
+#define CAMERA_FB_COUNT 3                   // 3 buffers - one in capture while consumers hold the others
 #define CAMERA_GRAB_MODE CAMERA_GRAB_LATEST // Latest frame mode for better timing
 
+// JPEG APP1 timestamp injection
+// 0 = Disabled
+// 1 = Each frame gets a precomputed EXIF APP1 segment (DateTime) inserted
+//     after SOI on HTTP output - the frame buffer itself is never rebuilt
+#define CAMERA_JPEG_APP1_TIMESTAMP 0
+
+// ===== CAPTURE PIPELINE CONFIGURATION =====
+// A dedicated task owns esp_camera_fb_get() and publishes frames into a
+// lock-free ring shared by all consumers (RTSP, HTTP).
+// Core 0 = PRO CPU (WiFi/lwIP), Core 1 = APP CPU (Arduino loop)
+#define CAPTURE_TASK_CORE 0
+#define CAPTURE_TASK_PRIORITY 5      // Above the loop, below WiFi
+#define CAPTURE_TASK_STACK_SIZE 4096 // Bytes
+
+// Ring slots - must not exceed CAMERA_FB_COUNT so the driver always has a
+// free buffer when the capture task asks for one
+#define CAPTURE_RING_SIZE CAMERA_FB_COUNT
+
+// Maximum number of tasks notified when a new frame is published
+#define CAPTURE_MAX_CONSUMER_TASKS 4
+
+// Last-good frame cache: a parsed PSRAM copy of a recent frame serves new
+// RTSP viewers and HTTP snapshots at once, without touching the sensor.
+// Instant start needs it: without the cache, an idle main stream hands its
+// last frame back to the driver and the next viewer waits for a capture
+#define CAPTURE_CACHE_ENABLED 1
+#define CAPTURE_CACHE_SLOTS 2                 // Copies in flight + the one being refreshed
+#define CAPTURE_CACHE_MAX_FRAME_SIZE 98304    // PSRAM bytes per slot, larger frames are not cached
+#define CAPTURE_CACHE_REFRESH_MS 500          // Copy interval while streaming
+#define CAPTURE_CACHE_MAX_AGE_MS 2000         // Older frames are not served, a capture is requested instead
+
+// Demand-driven capture scheduler
+// - Streaming: a viewer is playing, full rate
+// - Warm: an RTSP session is connected, a snapshot was requested or a
+//   stream ended less than CAPTURE_WARM_HOLD_MS ago; the sensor stays
+//   awake and refreshes the last-good cache so the first frame is instant
+// - Idle: sensor powered down (PWDN), CPU clock dropped, capture task parked
+#define CAPTURE_WARM_HOLD_MS 30000      // Warm time after the last activity before going idle
+#define CAPTURE_WARM_INTERVAL_MS 1000   // Cache refresh interval while warm
+#define CAPTURE_IDLE_CPU_FREQ_MHZ 80    // CPU clock while idle (0 = unchanged, WiFi needs >= 80)
+#define CAPTURE_IDLE_WIFI_SLEEP 1       // Allow WiFi modem sleep while idle (0 = never)
+
+// RTSP sender task (RTSP parsing + RTP packetization)
+#define RTSP_TASK_CORE 1
+#define RTSP_TASK_PRIORITY 3
+#define RTSP_TASK_STACK_SIZE 8192 // Bytes
+#define RTSP_TASK_POLL_MS 10      // Max wait between RTSP control checks
+#define RTSP_TASK_IDLE_POLL_MS 50 // Same, while the capture scheduler is idle
+
+// ===== MOTION GATING =====
+// Change detector run by the capture task on every main-stream frame,
+// from the compressed size of each JPEG restart interval (a coarse
+// activity map of the picture; the whole frame size when the encoder
+// emits no restart markers). Nothing is decoded.
+// Once the scene has been static for MOTION_STATIC_HOLD_MS, only
+// MOTION_STATIC_FPS frames per second are published to viewers and the
+// recorder; the first changed frame is published at once and restores
+// the full rate. RTP timestamps follow the capture time, so the gap
+// between published frames shows on its own.
+#define MOTION_DETECTION_ENABLED 1
+#define MOTION_GATING_ENABLED 1         // 0 = detect and report only, never decimate
+#define MOTION_STATIC_FPS 2             // Published rate of a static scene
+#define MOTION_STATIC_HOLD_MS 3000      // Quiet time before decimating
+#define MOTION_GRID_CELLS 64            // Restart intervals are summed into this many cells
+#define MOTION_CELL_DELTA_PERCENT 15    // Size change that marks a cell as changed
+#define MOTION_MIN_CHANGED_CELLS 2      // Changed cells that make a frame "motion"
+#define MOTION_FRAME_DELTA_PERCENT 6    // Whole-frame size change, without restart markers
+
+// ===== FRAME SOURCE (LOAD TESTING) =====
+// Where CameraManager gets its frames from. The test sources sit behind
+// the same capture()/captureForced()/releaseFrame() calls, so the
+// pipeline, the servers and /metrics behave exactly as with the sensor.
+// 0 = Live sensor
+// 1 = Replay: the .jpg files in CAMERA_REPLAY_DIR, loaded into PSRAM, looped
+// 2 = Synthetic: decodable frames at CAMERA_FRAME_SIZE, sizes from the range below
+#define CAMERA_FRAME_SOURCE 0
+#define CAMERA_TEST_SOURCE_FPS RTSP_FPS    // Delivery rate, stands in for the sensor VSYNC
+#define CAMERA_TEST_SOURCE_MAX_FRAMES 16   // Frames kept in PSRAM (replay files or synthetic variants)
+#define CAMERA_REPLAY_STORAGE 0            // 0 = SPIFFS partition (flash), 1 = SD card (SD_MMC, 1-bit)
+#define CAMERA_REPLAY_DIR "/replay"
+#define CAMERA_REPLAY_MAX_FRAME_SIZE 131072 // Larger files are skipped
+#define CAMERA_SYNTHETIC_MIN_BYTES 10000
+#define CAMERA_SYNTHETIC_MAX_BYTES 60000
+// Size distribution of the synthetic frames
+// 0 = Uniform over [MIN, MAX]
+// 1 = Sweep: MIN to MAX and back, one step per frame
+// 2 = Spikes: MIN, and MAX every CAMERA_SYNTHETIC_SPIKE_INTERVAL frames
+#define CAMERA_SYNTHETIC_DISTRIBUTION 0
+#define CAMERA_SYNTHETIC_SPIKE_INTERVAL 10
+
+// ===== SD CARD RECORDER =====
+// MJPEG AVI segments on the microSD slot (SD_MMC, 1-bit mode, shared
+// with the replay source), fed by the same captured frames as the
+// streamers: recording costs no client slot and no airtime. Frames are
+// copied into a PSRAM pre-roll ring and released at once, a writer task
+// writes SD_RECORDER_CHUNK_BYTES blocks while the next one fills, so a
+// slow card only ever costs recorded frames, never capture or streaming.
+// 0 = Off
+// 1 = Continuous: back-to-back segments of SD_RECORDER_SEGMENT_S
+// 2 = Event: a clip per SDRecorder::trigger() or detected motion, starting
+//     SD_RECORDER_PREROLL_S before it and ending SD_RECORDER_POSTROLL_S
+//     after the last one (keeps the sensor streaming for the pre-roll)
+#define SD_RECORDER_MODE 0
+#define SD_RECORDER_DIR "/rec"
+#define SD_RECORDER_FPS 5                  // Recorded frame rate, at most RTSP_FPS
+#define SD_RECORDER_SEGMENT_S 60           // Longest segment / clip
+#define SD_RECORDER_PREROLL_S 5
+#define SD_RECORDER_POSTROLL_S 10
+#define SD_RECORDER_RING_BYTES 1048576     // PSRAM pre-roll ring (must hold PREROLL_S * FPS frames)
+#define SD_RECORDER_RING_FRAMES 64         // Frames the ring can index (more than PREROLL_S * FPS)
+#define SD_RECORDER_CHUNK_BYTES 16384      // Write block (multiple of 512), two are allocated
+#define SD_RECORDER_MAX_SEGMENTS 500       // Oldest segments are deleted beyond this count...
+#define SD_RECORDER_MIN_FREE_MB 64         // ...or when less space than this is left on the card
+#define SD_RECORDER_WRITE_TIMEOUT_MS 2000  // Card stuck this long: the segment is closed
+#define SD_RECORDER_RETRY_MS 10000         // After a card error, before the next segment is tried
+#define SD_RECORDER_TASK_CORE 0
+#define SD_RECORDER_TASK_PRIORITY 2        // Below capture and the RTSP sender
+#define SD_RECORDER_TASK_STACK_SIZE 6144   // Bytes, for each of the two tasks (FATFS is stack hungry)
+
 // ===== SYSTEM CONFIGURATION =====
 // Serial port speed for debug messages
 #define SERIAL_BAUD_RATE 115200 // Current speed: 115200 bauds
 
 // Logger configuration
 // Available levels: LOG_ERROR, LOG_WARN, LOG_INFO, LOG_DEBUG, LOG_VERBOSE
+// Build-time level: calls below it are compiled out (override with -DLOG_LEVEL=...)
+#ifndef LOG_LEVEL
 #define LOG_LEVEL LOG_INFO // DEBUG level pour voir tous les logs
+#endif
 
 // Production mode - reduce log verbosity
 // 0 = Debug mode (all logs)
 // 1 = Production mode (minimal logs)
 #define PRODUCTION_MODE 0
 
+// Asynchronous log output (lines are queued, a low-priority task prints them)
+#define LOG_QUEUE_DEPTH 32        // Queued lines (power of two); extra lines are dropped and counted
+#define LOG_QUEUE_LINE_SIZE 160   // Bytes per queued line, longer lines are truncated
+#define LOG_TASK_CORE 0
+#define LOG_TASK_PRIORITY 1       // Below capture and RTSP tasks
+#define LOG_TASK_STACK_SIZE 3072  // Bytes
+#define LOG_DRAIN_INTERVAL_MS 20  // Drain period while the ring is empty
+#define LOG_OUTPUT_SERIAL 1       // Print lines on Serial
+// Optional UDP syslog (RFC 5424) collector, uncomment to enable
+// #define LOG_SYSLOG_HOST "192.168.1.10"
+#define LOG_SYSLOG_PORT 514
+
 // ===== OPTIMIZED WIFI CONFIGURATION =====
 // WiFi quality threshold to consider connection as stable
 #define WIFI_QUALITY_THRESHOLD 20
@@ -419,6 +626,16 @@ const IPAddress primaryDNS(8, 8, 8, 8); // Optional
 // WiFi reconnection delay in milliseconds
 #define WIFI_RECONNECT_DELAY 1000 // Balanced for reliability
 
+// Fast boot: WiFi associates while the camera initializes, and the last
+// successful BSSID/channel (RTC memory + NVS) lets the next boot skip
+// the scan; DHCP still runs unless WIFI_FAST_CONNECT_REUSE_IP
+#define WIFI_FAST_CONNECT_ENABLED 1
+#define WIFI_FAST_CONNECT_REUSE_IP 0         // 1 = configure the last lease statically: no DHCP, never renewed
+                                             // (only for an address outside the DHCP pool)
+#define WIFI_FAST_CONNECT_TIMEOUT_MS 3000    // Cached association gives up after this, then full scan
+#define WIFI_ASYNC_CONNECT_TIMEOUT_MS 4000   // Uncached background association, then full retries
+#define WIFI_FAST_CONNECT_NVS_NAMESPACE "wifi"
+
 // ===== OPTIMIZED UDP CONFIGURATION =====
 // Maximum number of UDP send attempts before TCP fallback
 #define RTSP_UDP_MAX_RETRIES 2 // Reduced for better timing
@@ -446,9 +663,87 @@ const IPAddress primaryDNS(8, 8, 8, 8); // Optional
 // Minimum framerate in case of UDP problems
 #define RTSP_MIN_FRAMERATE 10 // Increased to 10 FPS minimum
 
+// Adaptive bitrate (ABR): steps JPEG quality, then frame size, down under
+// congestion and back up when the link is clear. The setting follows the
+// worst active viewer.
+// 0 = Disabled (fixed CAMERA_JPEG_QUALITY / CAMERA_FRAME_SIZE)
+// 1 = Enabled
+#define RTSP_ABR_ENABLED 1
+#define RTSP_ABR_WINDOW_MS 2000         // Evaluation window
+#define RTSP_ABR_QUALITY_STEP 8         // JPEG quality increment per level
+#define RTSP_ABR_MAX_JPEG_QUALITY 63    // Worst JPEG quality used before reducing frame size
+#define RTSP_ABR_MIN_FRAME_SIZE FRAMESIZE_QVGA // Smallest frame size used
+#define RTSP_ABR_LOAD_HIGH_PERCENT 80   // Link load (stream bitrate / measured throughput) that counts as congested
+#define RTSP_ABR_LOAD_LOW_PERCENT 40    // Link load that counts as clear
+#define RTSP_ABR_DROP_PERCENT 10        // Skipped/aborted frames that count as congested
+#define RTSP_ABR_DOWN_WINDOWS 1         // Congested windows before stepping down
+#define RTSP_ABR_UP_WINDOWS 5           // Clear windows before stepping up (hysteresis)
+#define RTSP_ABR_LOSS_HIGH_PERCENT 5    // Receiver-reported loss (RTCP) that counts as congestion
+#define RTSP_ABR_LOSS_LOW_PERCENT 1     // Reported loss at or below which the link may step up
+#define RTSP_ABR_JITTER_HIGH_MS 60      // Reported interarrival jitter that counts as congestion
+#define RTSP_ABR_JITTER_LOW_MS 25       // Reported jitter at or below which the link may step up
+
 // Maximum RTP fragment size (bytes) - optimized for UDP
 #define RTSP_MAX_FRAGMENT_SIZE 1024 // Smaller fragments for TCP stability
 
+// DSCP marks (IP TOS field) per socket. The WiFi driver queues each
+// packet in the WMM access category of its top three bits: 8 (CS1)
+// background, 0 best effort, 32 (CS4) / 34 (AF41) video, 46 (EF) voice.
+// Media rides the video queue ahead of control requests and bulk uploads.
+#define RTSP_RTP_DSCP 34         // AF41: RTP/RTCP over UDP, unicast and multicast
+#define RTSP_INTERLEAVED_DSCP 34 // RTSP connection while it carries interleaved RTP
+#define RTSP_CONTROL_DSCP 0      // RTSP connection otherwise (requests and responses only)
+#define HTTP_MJPEG_DSCP 34       // HTTP MJPEG streams and snapshots
+#define OTA_DSCP 8               // CS1: a firmware upload yields to the streams
+#define LOG_SYSLOG_DSCP 8        // Remote log datagrams
+
+// Maximum RTP packet size (bytes) for TCP interleaved transport:
+// lwIP TCP_MSS (1436) minus the 4-byte '$' header, one packet per segment
+#define RTSP_TCP_MAX_PACKET_SIZE 1432
+
+// TCP interleaved coalescing: whole '$' packets are gathered into one
+// sendmsg() of up to RTSP_TCP_COALESCE_BYTES (a multiple of the MSS)
+#define RTSP_TCP_BATCH_PACKETS 4       // Packets per write
+#define RTSP_TCP_COALESCE_BYTES 5744   // 4 x TCP_MSS
+
+// Non-blocking per-client send queues
+#define RTSP_TX_PACKETS_PER_PUMP 4 // Writes (UDP packet or TCP batch) per session before moving to the next one
+#define RTSP_TX_MAX_PASSES 16      // Round-robin passes per sender wake-up
+
+// UDP packet pacing: a token bucket per stream spreads the packets of a
+// frame over part of the frame interval instead of bursting them into
+// the AP queue. The sender task sleeps on a hardware timer (esp_timer)
+// until the next packet is due. TCP interleaved is not paced.
+#define RTSP_PACING_ENABLED 1
+#define RTSP_PACING_SPREAD_PERCENT 70      // Share of the frame interval one frame is spread over
+#define RTSP_PACING_BURST_MS 4             // Bucket depth, in ms of the measured unthrottled throughput
+#define RTSP_PACING_MAX_BURST_BYTES 8192   // Bucket depth cap (at least one RTSP_MAX_FRAGMENT_SIZE)
+
+// RTP multicast: sessions that SETUP with "RTP/AVP;multicast" share one
+// stream sent to this group, so viewers no longer cost airtime or CPU.
+// When enabled the SDP advertises the group.
+#define RTSP_MULTICAST_ENABLED 0
+#define RTSP_MULTICAST_GROUP "239.255.42.42" // Administratively scoped
+#define RTSP_MULTICAST_PORT 5004             // RTP port (even), RTCP = port + 1
+#define RTSP_MULTICAST_TTL 1                 // Stay on the local subnet
+
+// RTCP (RFC 3550): sender reports out, receiver reports and generic NACKs
+// (RFC 4585) in, over the UDP RTCP port or the interleaved RTCP channel
+#define RTSP_RTCP_ENABLED 1
+#define RTSP_RTCP_INTERVAL_MS 1000 // Sender report period
+#define RTSP_RTCP_BUFFER_SIZE 512  // Largest RTCP packet read from the UDP port
+#define RTSP_RTCP_MAX_NACKS 16     // NACK entries kept per RTCP packet
+
+// Selective retransmission for UDP sessions (needs RTSP_RTCP_ENABLED):
+// the last packets sent are kept as descriptors into the frame buffers,
+// which stay referenced, and are sent again when the viewer NACKs them.
+// Advertised in the SDP with a=rtcp-fb. The previous frame keeps its
+// ring slot for up to RTSP_NACK_HOLD_MS after its last packet.
+#define RTSP_NACK_ENABLED 1
+#define RTSP_NACK_CACHE_PACKETS 96 // Window per session (about two SVGA frames)
+#define RTSP_NACK_HOLD_MS 150      // How long a finished frame stays retransmittable
+#define RTSP_NACK_MAX_BURST 32     // Retransmissions per received RTCP packet
+
 // UDP timeout to detect packet loss (ms)
 #define RTSP_UDP_TIMEOUT 100
 
@@ -464,7 +759,8 @@ const IPAddress primaryDNS(8, 8, 8, 8); // Optional
 // Main loop delay in milliseconds
 // Shorter delay = more responsive system
 // Longer delay = CPU saving
-#define MAIN_LOOP_DELAY 5 // 5ms - OPTIMIZED for 10 FPS timing control
+#define MAIN_LOOP_DELAY 5 // 5ms - loop only serves HTTP, frame timing lives in the capture task
+#define MAIN_LOOP_IDLE_DELAY 50 // Loop wake-up interval while the capture scheduler is idle
 
 // HTTP response codes
 #define HTTP_OK 200
@@ -475,6 +771,9 @@ const IPAddress primaryDNS(8, 8, 8, 8); // Optional
 #define DEBUG_INTERVAL_MS 10000
 #define MAC_STRING_SIZE 18
 #define HEADERS_BUFFER_SIZE 512
+#define RTSP_REQUEST_BUFFER_SIZE 1024  // Per-session RTSP request buffer (partial + pipelined requests)
+#define RTSP_RESPONSE_BUFFER_SIZE 1024 // Per-session RTSP response buffer (status + headers)
+#define RTSP_SDP_BUFFER_SIZE 2048      // Cached SDP body shared by all sessions
 #define LOG_BUFFER_SIZE 256
 
 // WiFi thresholds
@@ -548,9 +847,6 @@ typedef struct
 // Buffer size for RTSP sessions (bytes)
 #define RTSP_BUFFER_SIZE 8192 // Increased buffer for HLS stability
 
-// Maximum number of concurrent RTSP clients
-#define RTSP_MAX_CLIENTS 3 // Limited for stability
-
 // Health check interval (ms)
 #define HEALTH_CHECK_INTERVAL 5000 // 5 seconds
 
@@ -564,7 +860,6 @@ typedef struct
 
 // Memory optimization
 #define RTSP_MEMORY_POOL_SIZE 4096 // 4KB memory pool
-#define RTSP_SESSION_TIMEOUT 30000 // 30 seconds session timeout
 
 // Logging level (0=ERROR, 1=WARN, 2=INFO, 3=DEBUG)
 // #define LOG_LEVEL 2 // INFO level for production - COMMENTED to avoid conflict
@@ -25,11 +25,14 @@
 #include "config.h"
 #include "../lib/WiFiManager/WiFiManager.h"
 #include "../lib/CameraManager/CameraManager.h"
+#include "../lib/CameraManager/CapturePipeline.h"
 #include "../lib/Nano-RTSP/NanoRTSPServer.h"
 #include "../lib/Utils/Logger.h"
 #include "../lib/Utils/Helpers.h"
+#include "../lib/Utils/Metrics.h"
 #include "../lib/Utils/OTAManager.h"
 #include "../lib/HTTPMJPEGServer/HTTPMJPEGServer.h"
+#include "../lib/Recorder/SDRecorder.h"
 #include <WebServer.h>
 
 // === GLOBAL INSTANCES ===
@@ -54,9 +57,10 @@ unsigned long lastHealthCheck = 0;
  *
  * Initializes all modules in order:
  * 1. Logger and serial communication
- * 2. WiFi connection
- * 3. Camera initialization
- * 4. RTSP and HTTP server startup
+ * 2. WiFi association started in the background (cached BSSID/channel/lease)
+ * 3. Camera initialization and capture task, while WiFi associates
+ * 4. Wait for WiFi, then OTA, RTSP and HTTP server startup
+ * 5. Boot phase timings report
  *
  * @note This function only returns on critical error
  */
@@ -64,7 +68,8 @@ void setup()
 {
     // === BASIC INITIALIZATION ===
     Serial.begin(SERIAL_BAUD_RATE);
-    Logger::setLogLevel(LOG_LEVEL);
+    Logger::begin();
+    Logger::setLogLevel((LogLevel)LOG_LEVEL);
 
     startupTime = millis();
 
@@ -75,48 +80,16 @@ void setup()
     // Display system information
     Helpers::printSystemInfo();
 
-    // === WIFI CONNECTION ===
+    // === WIFI ASSOCIATION (background) ===
+    // The WiFi task associates while the camera initializes below
 #ifdef WIFI_USE_BSSID
     LOG_DEBUG("Using hardcoded BSSID and WiFi channel");
-    WiFiManager::begin(WIFI_SSID, WIFI_PASSWORD, WIFI_CHANNEL, WIFI_BSSID);
+    WiFiManager::beginAsync(WIFI_SSID, WIFI_PASSWORD, WIFI_CHANNEL, WIFI_BSSID);
 #else
     LOG_DEBUG("Trying to connect to any station");
-    WiFiManager::begin(WIFI_SSID, WIFI_PASSWORD);
-#endif
-
-    while (WiFi.status() != WL_CONNECTED)
-
-        if (!WiFiManager::isConnected())
-        {
-            LOG_ERROR("WiFi connection failed - Restarting in");
-            LOG_ERRORF("3...");
-            delay(1000);
-            LOG_ERRORF("2...");
-            delay(1000);
-            LOG_ERRORF("1...");
-            delay(1000);
-            ESP.restart();
-        }
-
-    // Display WiFi information (removed double initialization)
-    Helpers::printWiFiInfo();
-
-    // === OTA (Over-The-Air) ===
-#ifdef ENABLE_OTA
-    LOG_INFO("Starting OTA server...");
-                    if (otaManager.begin())
-    {
-        LOG_INFOF("OTA server started on port %d", OTA_SERVER_PORT);
-        String localIP = WiFiManager::getLocalIP().toString();
-        LOG_INFOF("OTA Update URL: http://%s:%d", localIP.c_str(), OTA_SERVER_PORT);
-    }
-    else
-    {
-        LOG_ERROR("Failed to start OTA server");
-    }
-#else
-    LOG_INFO("OTA functionality disabled");
+    WiFiManager::beginAsync(WIFI_SSID, WIFI_PASSWORD);
 #endif
+    unsigned long wifiStarted = millis();
 
     // === CAMERA INITIALIZATION ===
     LOG_INFO("Starting camera initialization process...");
@@ -139,6 +112,61 @@ void setup()
     LOG_INFO("Getting camera information...");
     LOG_INFO(CameraManager::getCameraInfo().c_str());
 
+    // === CAPTURE PIPELINE ===
+    // Dedicated capture task: the only owner of esp_camera_fb_get()
+    if (!CapturePipeline::begin())
+    {
+        LOG_ERROR("Capture pipeline start failed - Restarting");
+        delay(1000);
+        ESP.restart();
+    }
+    // loop() parks on frames and capture state changes (setup runs in the loop task)
+    CapturePipeline::registerConsumerTask(xTaskGetCurrentTaskHandle());
+    unsigned long cameraReady = millis();
+
+#if SD_RECORDER_MODE != 0
+    // === SD RECORDER ===
+    // Independent of WiFi: records even while the network is down
+    if (!SDRecorder::begin())
+    {
+        LOG_WARN("SD recorder not started, continuing without recording");
+    }
+#endif
+
+    // === WIFI CONNECTION ===
+    if (!WiFiManager::waitForConnection())
+    {
+        LOG_ERROR("WiFi connection failed - Restarting in");
+        LOG_ERRORF("3...");
+        delay(1000);
+        LOG_ERRORF("2...");
+        delay(1000);
+        LOG_ERRORF("1...");
+        delay(1000);
+        ESP.restart();
+    }
+    unsigned long wifiReady = millis();
+
+    // Display WiFi information (removed double initialization)
+    Helpers::printWiFiInfo();
+
+    // === OTA (Over-The-Air) ===
+#ifdef ENABLE_OTA
+    LOG_INFO("Starting OTA server...");
+    if (otaManager.begin())
+    {
+        LOG_INFOF("OTA server started on port %d", OTA_SERVER_PORT);
+        String localIP = WiFiManager::getLocalIP().toString();
+        LOG_INFOF("OTA Update URL: http://%s:%d", localIP.c_str(), OTA_SERVER_PORT);
+    }
+    else
+    {
+        LOG_ERROR("Failed to start OTA server");
+    }
+#else
+    LOG_INFO("OTA functionality disabled");
+#endif
+
     // === SERVER STARTUP ===
 
     // RTSP Server
@@ -167,12 +195,29 @@ void setup()
     // Display access URLs
     String localIP = WiFiManager::getLocalIP().toString();
     LOG_INFOF("RTSP Stream: rtsp://%s:%d%s", localIP.c_str(), RTSP_PORT, RTSP_PATH);
+#if RTSP_SUBSTREAM_ENABLED
+    LOG_INFOF("RTSP Substream: rtsp://%s:%d%s", localIP.c_str(), RTSP_PORT, RTSP_SUBSTREAM_PATH);
+#endif
     LOG_INFOF("HTTP Stream: http://%s%s", localIP.c_str(), HTTP_MJPEG_PATH);
+    LOG_INFOF("Snapshot: http://%s%s", localIP.c_str(), HTTP_SNAPSHOT_PATH);
+#if METRICS_ENABLED
+    LOG_INFOF("Metrics: http://%s%s", localIP.c_str(), HTTP_METRICS_PATH);
+#endif
 #ifdef ENABLE_OTA
     LOG_INFOF("OTA Update: http://%s:%d", localIP.c_str(), OTA_SERVER_PORT);
 #endif
     LOG_INFO("Compatible clients: VLC, FFmpeg, web browsers");
-    LOG_INFO("Limit: 5 simultaneous RTSP clients"); // TODO this should be dynamic..
+#if RTSP_ADMISSION_ENABLED
+    LOG_INFOF("Limit: %d simultaneous RTSP clients, viewers admitted on measured bandwidth and memory", RTSP_MAX_CLIENTS);
+#else
+    LOG_INFOF("Limit: %d simultaneous RTSP clients", RTSP_MAX_CLIENTS);
+#endif
+
+    // Boot phase timings, from reset (camera and WiFi overlap)
+    unsigned long ready = millis();
+    LOG_INFOF("Boot timings: setup at %lu ms, camera %lu ms, WiFi %lu ms (%lu ms after camera), servers %lu ms, ready at %lu ms",
+              startupTime, cameraReady - wifiStarted, wifiReady - wifiStarted,
+              wifiReady > cameraReady ? wifiReady - cameraReady : 0, ready - wifiReady, ready);
 
     // Final system information
     Helpers::printMemoryInfo();
@@ -207,7 +252,7 @@ void performHealthCheck()
  * @brief Main system loop
  *
  * Continuously manages:
- * - RTSP and HTTP clients
+ * - HTTP clients (RTSP and OTA run in their own tasks)
  * - System health monitoring
  * - Periodic debug logs
  * - WiFi stability verification
@@ -216,26 +261,14 @@ void performHealthCheck()
  */
 void loop()
 {
-    // === CLIENT MANAGEMENT ===
+    METRIC_TIMER_START(loopStart);
 
-    // RTSP client management
-    if (rtspServer)
-    {
-        rtspServer->handleClients();
-    }
-    else
-    {
-        LOG_ERROR("RTSP server is null!");
-    }
+    // === CLIENT MANAGEMENT ===
+    // RTSP clients are served by the RTSP sender task, frames by the capture task
 
-    // HTTP MJPEG client management
+    // HTTP MJPEG client management (new requests + non-blocking push to viewers)
     httpMJPEGServer.handleClient();
 
-    // OTA client management
-#ifdef ENABLE_OTA
-    otaManager.handleClient();
-#endif
-
     // === PERIODIC MONITORING ===
 
     // System health check
@@ -262,15 +295,19 @@ void loop()
         lastWiFiCheck = millis();
     }
 
-    // Adaptive delay for main loop - optimized for precise timing
-    delay(MAIN_LOOP_DELAY);
-
-    // Allow other tasks to execute and maintain timing precision
-    yield();
-
-    // Additional micro-delay for better timing precision
-    if (rtspServer && rtspServer->hasActiveClients())
+    // Follow the capture scheduler: modem sleep only while nobody watches
+    static CapturePowerState lastPowerState = CAPTURE_STATE_WARM;
+    CapturePowerState powerState = CapturePipeline::getPowerState();
+    if (powerState != lastPowerState)
     {
-        delayMicroseconds(500); // 0.5ms micro-delay for active RTSP clients
+        WiFiManager::setModemSleep(CAPTURE_IDLE_WIFI_SLEEP && powerState == CAPTURE_STATE_IDLE);
+        lastPowerState = powerState;
     }
+
+    METRIC_TIMER_STOP(METRIC_LOOP, loopStart);
+
+    // Frame timing is owned by the capture task, the loop only serves
+    // HTTP/monitoring: park until the next frame or state change,
+    // polling new HTTP requests at a slower pace while idle
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(powerState == CAPTURE_STATE_IDLE ? MAIN_LOOP_IDLE_DELAY : MAIN_LOOP_DELAY));
 }